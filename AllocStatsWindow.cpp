@@ -0,0 +1,78 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#include "AllocStatsWindow.h"
+// std
+#include <algorithm>
+// ours
+#include "AllocTracker.h"
+
+namespace windows {
+
+AllocStatsWindow::AllocStatsWindow(const char *name) : Window(name, true) {}
+
+static void countsColumns(const explorer::AllocCounts &counts)
+{
+  ImGui::TableNextColumn();
+  ImGui::Text("%llu", (unsigned long long)counts.count);
+  ImGui::TableNextColumn();
+  ImGui::Text("%llu", (unsigned long long)counts.bytes);
+}
+
+void AllocStatsWindow::buildUI()
+{
+  // the window itself allocates as little as possible, but whatever
+  // it does is counted as UI build like everything else
+  explorer::AllocScope scope(explorer::AllocPhase::UIBuild);
+
+  auto last = explorer::allocLastFrame();
+  auto highWater = explorer::allocHighWater();
+
+  ImGui::Text("Live heap: %.2f MB (peak %.2f MB)",
+      explorer::allocLiveBytes() / double(1 << 20),
+      explorer::allocPeakLiveBytes() / double(1 << 20));
+
+  static float history[explorer::allocHistorySize];
+  size_t frames = explorer::allocHistory(history);
+  if (frames > 0) {
+    float maxCount = std::max(1.f, *std::max_element(history, history + frames));
+    ImGui::PlotLines("Allocs/frame",
+        history,
+        int(frames),
+        0,
+        nullptr,
+        0.f,
+        maxCount,
+        ImVec2(0, 60));
+  }
+
+  if (ImGui::BeginTable("phases", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+    ImGui::TableSetupColumn("Phase");
+    ImGui::TableSetupColumn("Allocs");
+    ImGui::TableSetupColumn("Bytes");
+    ImGui::TableSetupColumn("Max allocs");
+    ImGui::TableSetupColumn("Max bytes");
+    ImGui::TableHeadersRow();
+
+    for (size_t i = 0; i < size_t(explorer::AllocPhase::Count); ++i) {
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(explorer::allocPhaseName(explorer::AllocPhase(i)));
+      countsColumns(last.phases[i]);
+      countsColumns(highWater.phases[i]);
+    }
+
+    ImGui::TableNextRow();
+    ImGui::TableNextColumn();
+    ImGui::TextUnformatted("Frame");
+    countsColumns(last.total);
+    countsColumns(highWater.total);
+
+    ImGui::EndTable();
+  }
+
+  if (ImGui::Button("Reset high-water marks"))
+    explorer::allocResetHighWater();
+}
+
+} // namespace windows
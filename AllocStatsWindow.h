@@ -0,0 +1,21 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// anari
+#include "anari_viewer/windows/Window.h"
+
+namespace windows {
+
+// Heap allocations per frame and phase (see AllocTracker.h); only
+// available in EXPLORER_TRACK_ALLOCATIONS builds
+class AllocStatsWindow : public anari_viewer::windows::Window
+{
+ public:
+  AllocStatsWindow(const char *name = "Allocations");
+
+  void buildUI() override;
+};
+
+} // namespace windows
@@ -0,0 +1,316 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#include "AllocTracker.h"
+// std
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+
+namespace explorer {
+
+const char *allocPhaseName(AllocPhase phase)
+{
+  switch (phase) {
+  case AllocPhase::Other:
+    return "Other";
+  case AllocPhase::UIBuild:
+    return "UI build";
+  case AllocPhase::LobeEval:
+    return "Lobe eval";
+  case AllocPhase::MeshGen:
+    return "Mesh gen";
+  case AllocPhase::ANARIUpdate:
+    return "ANARI update";
+  default:
+    return "?";
+  }
+}
+
+#ifdef EXPLORER_TRACK_ALLOCATIONS
+
+// Nothing in here may allocate: it all runs inside operator new.
+// Counters are plain atomics, the frame bookkeeping uses fixed-size
+// arrays guarded by a mutex that's only taken by the UI thread.
+
+constexpr size_t NumPhases = size_t(AllocPhase::Count);
+
+struct AtomicCounts
+{
+  std::atomic<uint64_t> count{0};
+  std::atomic<uint64_t> bytes{0};
+};
+
+static AtomicCounts g_current[NumPhases];
+static std::atomic<uint64_t> g_liveBytes{0};
+static std::atomic<uint64_t> g_peakLiveBytes{0};
+
+static thread_local AllocPhase g_phase = AllocPhase::Other;
+
+static std::mutex g_frameMutex;
+static AllocFrameStats g_lastFrame;
+static AllocFrameStats g_highWater;
+static float g_history[allocHistorySize];
+static size_t g_historyFrames{0}; // total frames closed
+
+AllocScope::AllocScope(AllocPhase phase) : m_previous(g_phase)
+{
+  g_phase = phase;
+}
+
+AllocScope::~AllocScope()
+{
+  g_phase = m_previous;
+}
+
+void allocBeginFrame()
+{
+  std::lock_guard<std::mutex> lock(g_frameMutex);
+
+  AllocFrameStats frame;
+  for (size_t i = 0; i < NumPhases; ++i) {
+    frame.phases[i].count = g_current[i].count.exchange(0, std::memory_order_relaxed);
+    frame.phases[i].bytes = g_current[i].bytes.exchange(0, std::memory_order_relaxed);
+    frame.total.count += frame.phases[i].count;
+    frame.total.bytes += frame.phases[i].bytes;
+
+    auto &hw = g_highWater.phases[i];
+    hw.count = std::max(hw.count, frame.phases[i].count);
+    hw.bytes = std::max(hw.bytes, frame.phases[i].bytes);
+  }
+  g_highWater.total.count = std::max(g_highWater.total.count, frame.total.count);
+  g_highWater.total.bytes = std::max(g_highWater.total.bytes, frame.total.bytes);
+
+  g_lastFrame = frame;
+  g_history[g_historyFrames++ % allocHistorySize] = float(frame.total.count);
+}
+
+AllocFrameStats allocLastFrame()
+{
+  std::lock_guard<std::mutex> lock(g_frameMutex);
+  return g_lastFrame;
+}
+
+AllocFrameStats allocHighWater()
+{
+  std::lock_guard<std::mutex> lock(g_frameMutex);
+  return g_highWater;
+}
+
+void allocResetHighWater()
+{
+  std::lock_guard<std::mutex> lock(g_frameMutex);
+  g_highWater = AllocFrameStats{};
+  g_peakLiveBytes = g_liveBytes.load();
+}
+
+size_t allocHistory(float *counts)
+{
+  std::lock_guard<std::mutex> lock(g_frameMutex);
+  size_t n = std::min(g_historyFrames, allocHistorySize);
+  size_t first = g_historyFrames - n;
+  for (size_t i = 0; i < n; ++i)
+    counts[i] = g_history[(first + i) % allocHistorySize];
+  return n;
+}
+
+uint64_t allocLiveBytes()
+{
+  return g_liveBytes.load(std::memory_order_relaxed);
+}
+
+uint64_t allocPeakLiveBytes()
+{
+  return g_peakLiveBytes.load(std::memory_order_relaxed);
+}
+
+// Every block carries a header in front of the user pointer with the
+// requested size (for live bytes) and the offset back to what malloc()
+// returned (for over-aligned blocks)
+struct AllocHeader
+{
+  uint64_t size;
+  uint64_t offset;
+};
+
+static_assert(sizeof(AllocHeader) == 16, "header keeps 16 byte alignment");
+
+static void *trackedAlloc(size_t size, size_t alignment)
+{
+  alignment = std::max(alignment, sizeof(AllocHeader));
+
+  auto *raw = (char *)std::malloc(size + sizeof(AllocHeader) + alignment - 1);
+  if (!raw)
+    return nullptr;
+
+  auto user = (uintptr_t(raw) + sizeof(AllocHeader) + alignment - 1)
+      & ~uintptr_t(alignment - 1);
+  auto *header = (AllocHeader *)(user - sizeof(AllocHeader));
+  header->size = size;
+  header->offset = user - uintptr_t(raw);
+
+  auto &counts = g_current[size_t(g_phase)];
+  counts.count.fetch_add(1, std::memory_order_relaxed);
+  counts.bytes.fetch_add(size, std::memory_order_relaxed);
+
+  uint64_t live = g_liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+  uint64_t peak = g_peakLiveBytes.load(std::memory_order_relaxed);
+  while (live > peak
+      && !g_peakLiveBytes.compare_exchange_weak(
+          peak, live, std::memory_order_relaxed)) {
+  }
+
+  return (void *)user;
+}
+
+static void trackedFree(void *ptr)
+{
+  if (!ptr)
+    return;
+
+  auto *header = (AllocHeader *)((char *)ptr - sizeof(AllocHeader));
+  g_liveBytes.fetch_sub(header->size, std::memory_order_relaxed);
+  std::free((char *)ptr - header->offset);
+}
+
+static void *trackedNew(size_t size, size_t alignment)
+{
+  if (size == 0)
+    size = 1;
+
+  for (;;) {
+    if (void *ptr = trackedAlloc(size, alignment))
+      return ptr;
+
+    auto handler = std::get_new_handler();
+    if (!handler)
+      throw std::bad_alloc();
+    handler();
+  }
+}
+
+static void *trackedNew(size_t size, size_t alignment, const std::nothrow_t &) noexcept
+{
+  try {
+    return trackedNew(size, alignment);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+#endif
+
+} // namespace explorer
+
+#ifdef EXPLORER_TRACK_ALLOCATIONS
+
+using explorer::trackedFree;
+using explorer::trackedNew;
+
+constexpr size_t DefaultAlignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+void *operator new(size_t size)
+{
+  return trackedNew(size, DefaultAlignment);
+}
+
+void *operator new[](size_t size)
+{
+  return trackedNew(size, DefaultAlignment);
+}
+
+void *operator new(size_t size, const std::nothrow_t &tag) noexcept
+{
+  return trackedNew(size, DefaultAlignment, tag);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept
+{
+  return trackedNew(size, DefaultAlignment, tag);
+}
+
+void *operator new(size_t size, std::align_val_t alignment)
+{
+  return trackedNew(size, size_t(alignment));
+}
+
+void *operator new[](size_t size, std::align_val_t alignment)
+{
+  return trackedNew(size, size_t(alignment));
+}
+
+void *operator new(
+    size_t size, std::align_val_t alignment, const std::nothrow_t &tag) noexcept
+{
+  return trackedNew(size, size_t(alignment), tag);
+}
+
+void *operator new[](
+    size_t size, std::align_val_t alignment, const std::nothrow_t &tag) noexcept
+{
+  return trackedNew(size, size_t(alignment), tag);
+}
+
+void operator delete(void *ptr) noexcept
+{
+  trackedFree(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+  trackedFree(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+  trackedFree(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+  trackedFree(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+  trackedFree(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+  trackedFree(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+  trackedFree(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept
+{
+  trackedFree(ptr);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept
+{
+  trackedFree(ptr);
+}
+
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept
+{
+  trackedFree(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept
+{
+  trackedFree(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept
+{
+  trackedFree(ptr);
+}
+
+#endif
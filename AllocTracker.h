@@ -0,0 +1,90 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <cstddef>
+#include <cstdint>
+
+namespace explorer {
+
+// Heap allocation accounting for the explorer's UI loop. Only active in
+// builds configured with -DEXPLORER_TRACK_ALLOCATIONS=ON, which replace
+// the global operator new/delete; otherwise AllocScope compiles to
+// nothing.
+//
+// Allocations are attributed to the innermost AllocScope on the
+// allocating thread; everything outside a scope (including background
+// threads) counts as Other.
+enum class AllocPhase : uint8_t
+{
+  Other,
+  UIBuild,
+  LobeEval,
+  MeshGen,
+  ANARIUpdate,
+  Count
+};
+
+struct AllocCounts
+{
+  uint64_t count{0};
+  uint64_t bytes{0};
+};
+
+struct AllocFrameStats
+{
+  AllocCounts phases[size_t(AllocPhase::Count)];
+  AllocCounts total;
+};
+
+const char *allocPhaseName(AllocPhase phase);
+
+#ifdef EXPLORER_TRACK_ALLOCATIONS
+
+class AllocScope
+{
+ public:
+  AllocScope(AllocPhase phase);
+  ~AllocScope();
+
+  AllocScope(const AllocScope &) = delete;
+  AllocScope &operator=(const AllocScope &) = delete;
+
+ private:
+  AllocPhase m_previous;
+};
+
+constexpr bool allocTrackingEnabled = true;
+
+// Closes the current frame: its counts become lastFrame() and update
+// the high-water marks
+void allocBeginFrame();
+
+AllocFrameStats allocLastFrame();
+AllocFrameStats allocHighWater(); // per phase, max. over frames
+void allocResetHighWater();
+
+// Allocations per frame of the last allocHistorySize frames, oldest first
+constexpr size_t allocHistorySize = 240;
+size_t allocHistory(float *counts);
+
+uint64_t allocLiveBytes();
+uint64_t allocPeakLiveBytes();
+
+#else
+
+class AllocScope
+{
+ public:
+  AllocScope(AllocPhase) {}
+};
+
+constexpr bool allocTrackingEnabled = false;
+
+inline void allocBeginFrame() {}
+
+#endif
+
+} // namespace explorer
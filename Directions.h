@@ -0,0 +1,90 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <cmath>
+#include <cstdint>
+#include <vector>
+// anari
+#include <anari/anari_cpp/ext/linalg.h>
+
+namespace explorer {
+
+inline float radians(float degrees)
+{
+  return degrees * float(M_PI) / 180.f;
+}
+
+// Unit vector for polar angle theta (measured from the +y surface normal)
+// and azimuth phi, same convention as the lobe's sphere parameterization
+inline anari::math::float3 sphericalDirection(float theta, float phi)
+{
+  return anari::math::float3(
+      sinf(theta) * cosf(phi),
+      cosf(theta),
+      sinf(theta) * sinf(phi));
+}
+
+// Hemisphere quadrature for albedos: midpoint rule in cos(theta) and phi,
+// i.e., equal solid angle cells; weights include the cosine
+inline void hemisphereQuadrature(uint32_t thetaSamples,
+                                 uint32_t phiSamples,
+                                 std::vector<anari::math::float3> &dirs,
+                                 std::vector<float> &weights)
+{
+  const float dOmega = 2.f * float(M_PI) / float(thetaSamples * phiSamples);
+  for (uint32_t t = 0; t < thetaSamples; ++t) {
+    float cosTheta = (t + 0.5f) / thetaSamples;
+    for (uint32_t p = 0; p < phiSamples; ++p) {
+      float phi = 2.f * float(M_PI) * (p + 0.5f) / phiSamples;
+      dirs.push_back(sphericalDirection(acosf(cosTheta), phi));
+      weights.push_back(cosTheta * dOmega);
+    }
+  }
+}
+
+// Tangent frame with n as "up" (y); the identity for n = +y, so results
+// match the sweeps' directions
+inline void makeFrame(anari::math::float3 n,
+                      anari::math::float3 &t,
+                      anari::math::float3 &b)
+{
+  using anari::math::float3;
+  float3 a = fabsf(n.z) > 0.9f ? float3(1.f, 0.f, 0.f) : float3(0.f, 0.f, 1.f);
+  t = normalize(cross(n, a));
+  b = cross(t, n);
+}
+
+inline uint64_t splitMix64(uint64_t x)
+{
+  x += 0x9e3779b97f4a7c15ull;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+// Cosine distributed direction around n (with frame t, b). The random
+// numbers only depend on seed and index, so results don't depend on how
+// a batch is split up. pdf is w.r.t. solid angle.
+inline anari::math::float3 cosineSampleDirection(uint64_t seed,
+                                                 uint64_t index,
+                                                 anari::math::float3 n,
+                                                 anari::math::float3 t,
+                                                 anari::math::float3 b,
+                                                 float &pdf)
+{
+  uint64_t bits1 = splitMix64(seed ^ splitMix64(index));
+  uint64_t bits2 = splitMix64(bits1);
+  float u1 = float(bits1 >> 40) * (1.f / float(1ull << 24));
+  float u2 = float(bits2 >> 40) * (1.f / float(1ull << 24));
+
+  float cosTheta = sqrtf(u1);
+  float sinTheta = sqrtf(fmaxf(0.f, 1.f - u1));
+  float phi = 2.f * float(M_PI) * u2;
+  pdf = cosTheta / float(M_PI);
+  return t * (sinTheta * cosf(phi)) + n * cosTheta + b * (sinTheta * sinf(phi));
+}
+
+} // namespace explorer
@@ -0,0 +1,256 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#include "EnvironmentMap.h"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+namespace explorer {
+
+using namespace anari::math;
+
+namespace {
+
+using File = std::unique_ptr<FILE, int (*)(FILE *)>;
+
+static std::vector<uint8_t> readFile(const std::string &fileName)
+{
+  File file(fopen(fileName.c_str(), "rb"), &fclose);
+  if (!file)
+    throw std::runtime_error("cannot open " + fileName);
+
+  std::vector<uint8_t> result;
+  uint8_t buffer[1 << 16];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file.get())) > 0)
+    result.insert(result.end(), buffer, buffer + n);
+  return result;
+}
+
+static float3 decodeRGBE(const uint8_t *rgbe)
+{
+  if (rgbe[3] == 0)
+    return float3(0.f);
+  float f = ldexpf(1.f, int(rgbe[3]) - (128 + 8));
+  return float3(rgbe[0] * f, rgbe[1] * f, rgbe[2] * f);
+}
+
+static void encodeRGBE(float3 value, uint8_t *rgbe)
+{
+  float v = std::max(value.x, std::max(value.y, value.z));
+  if (!(v > 1e-32f)) {
+    rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+    return;
+  }
+
+  int e;
+  float scale = frexpf(v, &e) * 256.f / v;
+  rgbe[0] = uint8_t(std::max(0.f, value.x) * scale);
+  rgbe[1] = uint8_t(std::max(0.f, value.y) * scale);
+  rgbe[2] = uint8_t(std::max(0.f, value.z) * scale);
+  rgbe[3] = uint8_t(e + 128);
+}
+
+// One scanline of RGBE pixels at pos, flat or "new" run-length encoded
+// (each component in its own runs)
+static void readScanline(const std::vector<uint8_t> &data,
+                         size_t &pos,
+                         uint32_t width,
+                         uint8_t *rgbe,
+                         const std::string &fileName)
+{
+  auto need = [&](size_t n) {
+    if (pos + n > data.size())
+      throw std::runtime_error(fileName + " is truncated");
+  };
+
+  need(4);
+  const bool rle = width >= 8 && width < 32768 && data[pos] == 2
+      && data[pos + 1] == 2 && (data[pos + 2] & 0x80) == 0;
+  if (!rle) {
+    need(size_t(width) * 4);
+    std::memcpy(rgbe, &data[pos], size_t(width) * 4);
+    pos += size_t(width) * 4;
+    return;
+  }
+
+  if (((uint32_t(data[pos + 2]) << 8) | data[pos + 3]) != width)
+    throw std::runtime_error(fileName + " has an invalid scanline");
+  pos += 4;
+
+  for (int c = 0; c < 4; ++c) {
+    uint32_t x = 0;
+    while (x < width) {
+      need(1);
+      uint32_t count = data[pos++];
+      if (count > 128) {
+        count -= 128;
+        need(1);
+        if (x + count > width)
+          throw std::runtime_error(fileName + " has an invalid scanline");
+        uint8_t value = data[pos++];
+        for (uint32_t i = 0; i < count; ++i)
+          rgbe[(x++) * 4 + c] = value;
+      } else {
+        if (count == 0 || x + count > width)
+          throw std::runtime_error(fileName + " has an invalid scanline");
+        need(count);
+        for (uint32_t i = 0; i < count; ++i)
+          rgbe[(x++) * 4 + c] = data[pos++];
+      }
+    }
+  }
+}
+
+static float3 bilinear(const EnvironmentMap &map, float u, float v)
+{
+  // u, v in [0,1]: texel centers at (i + 0.5) / size
+  float x = u * map.width - 0.5f;
+  float y = std::clamp(v * map.height - 0.5f, 0.f, float(map.height - 1));
+
+  float fx = floorf(x), fy = floorf(y);
+  float wx = x - fx, wy = y - fy;
+
+  int x0 = int(fx) % int(map.width);
+  if (x0 < 0)
+    x0 += map.width;
+  uint32_t x1 = (uint32_t(x0) + 1) % map.width;
+  uint32_t y0 = uint32_t(fy);
+  uint32_t y1 = std::min(y0 + 1, map.height - 1);
+
+  return (1.f - wy) * ((1.f - wx) * map.at(x0, y0) + wx * map.at(x1, y0))
+      + wy * ((1.f - wx) * map.at(x0, y1) + wx * map.at(x1, y1));
+}
+
+} // namespace
+
+float3 environmentDirection(uint32_t width, uint32_t height, float x, float y)
+{
+  float phi = 2.f * float(M_PI) * x / width;
+  float theta = float(M_PI) * y / height;
+  return float3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+}
+
+EnvironmentMap loadEnvironmentMap(const std::string &fileName)
+{
+  auto data = readFile(fileName);
+
+  // header lines up to an empty line, then the resolution line
+  size_t pos = 0;
+  auto nextLine = [&]() {
+    size_t end = pos;
+    while (end < data.size() && data[end] != '\n')
+      ++end;
+    if (end >= data.size())
+      throw std::runtime_error(fileName + " is truncated");
+    std::string line(data.begin() + pos, data.begin() + end);
+    pos = end + 1;
+    return line;
+  };
+
+  std::string line = nextLine();
+  if (line.rfind("#?", 0) != 0)
+    throw std::runtime_error(fileName + " is not a Radiance .hdr file");
+
+  while (!(line = nextLine()).empty()) {
+    if (line.rfind("FORMAT=", 0) == 0 && line != "FORMAT=32-bit_rle_rgbe")
+      throw std::runtime_error(fileName + ": unsupported format " + line.substr(7));
+  }
+
+  int width = 0, height = 0;
+  line = nextLine();
+  if (sscanf(line.c_str(), "-Y %d +X %d", &height, &width) != 2 || width <= 0
+      || height <= 0)
+    throw std::runtime_error(fileName + ": unsupported orientation " + line);
+
+  EnvironmentMap result{uint32_t(width), uint32_t(height)};
+  std::vector<uint8_t> rgbe(size_t(width) * 4);
+  for (uint32_t y = 0; y < result.height; ++y) {
+    readScanline(data, pos, result.width, rgbe.data(), fileName);
+    for (uint32_t x = 0; x < result.width; ++x)
+      result.at(x, y) = decodeRGBE(&rgbe[x * 4]);
+  }
+
+  return result;
+}
+
+void saveEnvironmentMap(const std::string &fileName, const EnvironmentMap &map)
+{
+  File file(fopen(fileName.c_str(), "wb"), &fclose);
+  if (!file)
+    throw std::runtime_error("cannot open " + fileName + " for writing");
+
+  // flat scanlines, every reader handles those
+  std::vector<uint8_t> rgbe(map.pixels.size() * 4);
+  for (size_t i = 0; i < map.pixels.size(); ++i)
+    encodeRGBE(map.pixels[i], &rgbe[i * 4]);
+
+  if (fprintf(file.get(),
+          "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %u +X %u\n",
+          map.height,
+          map.width)
+          < 0
+      || (!rgbe.empty() && fwrite(rgbe.data(), rgbe.size(), 1, file.get()) != 1)
+      || fflush(file.get()) != 0)
+    throw std::runtime_error("write to " + fileName + " failed");
+}
+
+EnvironmentPyramid::EnvironmentPyramid(const EnvironmentMap &map)
+{
+  if (map.width == 0 || map.height == 0)
+    throw std::runtime_error("empty environment map");
+
+  m_levels.push_back(map);
+  while (m_levels.back().width > 1 && m_levels.back().height > 1) {
+    const auto &src = m_levels.back();
+    EnvironmentMap dst(std::max(1u, src.width / 2), std::max(1u, src.height / 2));
+    for (uint32_t y = 0; y < dst.height; ++y) {
+      uint32_t y0 = std::min(2 * y, src.height - 1);
+      uint32_t y1 = std::min(2 * y + 1, src.height - 1);
+      for (uint32_t x = 0; x < dst.width; ++x) {
+        uint32_t x0 = std::min(2 * x, src.width - 1);
+        uint32_t x1 = std::min(2 * x + 1, src.width - 1);
+        dst.at(x, y) = 0.25f
+            * (src.at(x0, y0) + src.at(x1, y0) + src.at(x0, y1) + src.at(x1, y1));
+      }
+    }
+    m_levels.push_back(std::move(dst));
+  }
+}
+
+float3 EnvironmentPyramid::lookup(float3 dir, float lod) const
+{
+  float phi = atan2f(dir.z, dir.x);
+  if (phi < 0.f)
+    phi += 2.f * float(M_PI);
+  float u = phi / (2.f * float(M_PI));
+  float v = acosf(std::clamp(dir.y, -1.f, 1.f)) / float(M_PI);
+
+  lod = std::clamp(lod, 0.f, float(m_levels.size() - 1));
+  size_t l0 = size_t(lod);
+  size_t l1 = std::min(l0 + 1, m_levels.size() - 1);
+  float w = lod - l0;
+
+  float3 result = bilinear(m_levels[l0], u, v);
+  if (w > 0.f && l1 != l0)
+    result = (1.f - w) * result + w * bilinear(m_levels[l1], u, v);
+  return result;
+}
+
+size_t EnvironmentPyramid::numLevels() const
+{
+  return m_levels.size();
+}
+
+float EnvironmentPyramid::texelSolidAngle() const
+{
+  return 4.f * float(M_PI) / float(m_levels[0].width * m_levels[0].height);
+}
+
+} // namespace explorer
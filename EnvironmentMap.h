@@ -0,0 +1,69 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <cstdint>
+#include <string>
+#include <vector>
+// anari
+#include <anari/anari_cpp/ext/linalg.h>
+
+namespace explorer {
+
+// Equirectangular map of linear RGB radiance in the explorer's frame
+// (y up): columns cover phi = atan2(z, x) in [0,2pi), rows theta =
+// acos(y) in [0,pi], top row first
+struct EnvironmentMap
+{
+  uint32_t width{0};
+  uint32_t height{0};
+  std::vector<anari::math::float3> pixels;
+
+  EnvironmentMap() = default;
+  EnvironmentMap(uint32_t w, uint32_t h)
+    : width(w), height(h), pixels(size_t(w) * h, anari::math::float3(0.f))
+  {}
+
+  anari::math::float3 &at(uint32_t x, uint32_t y)
+  {
+    return pixels[size_t(y) * width + x];
+  }
+
+  const anari::math::float3 &at(uint32_t x, uint32_t y) const
+  {
+    return pixels[size_t(y) * width + x];
+  }
+};
+
+// Direction through continuous pixel coordinates (x, y), e.g. (x + 0.5,
+// y + 0.5) for the center of pixel (x, y)
+anari::math::float3 environmentDirection(
+    uint32_t width, uint32_t height, float x, float y);
+
+// Radiance .hdr files (RGBE, flat or run-length encoded scanlines, -Y +X
+// orientation). Throw std::runtime_error on I/O errors or unsupported files.
+EnvironmentMap loadEnvironmentMap(const std::string &fileName);
+void saveEnvironmentMap(const std::string &fileName, const EnvironmentMap &map);
+
+// Box-filtered mip pyramid of a map for filtered lookups (e.g., with the
+// footprint of an importance sample)
+class EnvironmentPyramid
+{
+ public:
+  explicit EnvironmentPyramid(const EnvironmentMap &map);
+
+  // Bilinear in each level (wrapping in phi), linear between levels
+  anari::math::float3 lookup(anari::math::float3 dir, float lod) const;
+
+  size_t numLevels() const;
+
+  // Average solid angle of a level 0 texel
+  float texelSolidAngle() const;
+
+ private:
+  std::vector<EnvironmentMap> m_levels;
+};
+
+} // namespace explorer
@@ -0,0 +1,529 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#include "EvalServer.h"
+
+// std
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+// posix
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+// ours
+#include "Directions.h"
+#include "material.h"
+#include "Parallel.h"
+
+namespace explorer {
+
+using namespace anari::math;
+
+namespace {
+
+// Work items are chunks of this many evaluations, so one large request
+// is spread over all workers and small ones don't wait behind it
+constexpr size_t ChunkSize = 4096;
+
+constexpr uint32_t MaxParams = 256;
+constexpr uint32_t MaxCount = 1u << 26;
+
+std::atomic<bool> g_stop{false};
+
+void onSignal(int)
+{
+  g_stop = true;
+}
+
+bool readAll(int fd, void *data, size_t size)
+{
+  char *ptr = (char *)data;
+  while (size > 0) {
+    ssize_t n = read(fd, ptr, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    ptr += n;
+    size -= size_t(n);
+  }
+  return true;
+}
+
+bool writeAll(int fd, const void *data, size_t size)
+{
+  const char *ptr = (const char *)data;
+  while (size > 0) {
+    ssize_t n = write(fd, ptr, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    ptr += n;
+    size -= size_t(n);
+  }
+  return true;
+}
+
+MaterialParam decodeParam(const EvalParam &ep)
+{
+  MaterialParam param;
+  param.name = std::string(ep.name, strnlen(ep.name, EvalNameSize));
+  param.type = DataType(ep.type);
+  if (param.type == DataType::Float)
+    param.value = ep.value[0];
+  else if (param.type == DataType::Float2)
+    param.value = float2(ep.value[0], ep.value[1]);
+  else if (param.type == DataType::Float3)
+    param.value = float3(ep.value[0], ep.value[1], ep.value[2]);
+  else if (param.type == DataType::Float4)
+    param.value = float4(ep.value[0], ep.value[1], ep.value[2], ep.value[3]);
+  else
+    throw std::runtime_error("invalid type for param " + param.name);
+  return param;
+}
+
+struct Connection
+{
+  Connection(int fd) : fd(fd) {}
+  ~Connection()
+  {
+    close(fd);
+  }
+
+  int fd;
+  std::mutex writeMutex;
+};
+
+struct Request
+{
+  std::shared_ptr<Connection> conn;
+  EvalRequestHeader header;
+  std::string subtype;
+  std::vector<EvalParam> rawParams; // to detect param changes cheaply
+  std::vector<MaterialParam> params;
+  std::vector<float3> input; // view dirs (Eval) or light dirs (Albedo)
+  std::vector<float3> values;
+  std::vector<EvalSample> samples;
+
+  std::atomic<size_t> chunksLeft{0};
+  std::mutex errorMutex;
+  std::string error;
+};
+
+struct Job
+{
+  std::shared_ptr<Request> request;
+  size_t first;
+  size_t count;
+};
+
+class JobQueue
+{
+ public:
+  void push(std::vector<Job> &jobs)
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for (auto &job : jobs)
+        m_jobs.push_back(std::move(job));
+    }
+    m_cv.notify_all();
+  }
+
+  // false once the queue was closed and is empty
+  bool pop(Job &job)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [&]() { return m_closed || !m_jobs.empty(); });
+    if (m_jobs.empty())
+      return false;
+    job = std::move(m_jobs.front());
+    m_jobs.pop_front();
+    return true;
+  }
+
+  void close()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_closed = true;
+    }
+    m_cv.notify_all();
+  }
+
+ private:
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  std::deque<Job> m_jobs;
+  bool m_closed{false};
+};
+
+void sendResponse(Request &req)
+{
+  EvalResponseHeader header{};
+  header.magic = EvalResponseMagic;
+  header.id = req.header.id;
+
+  const void *payload = nullptr;
+  size_t payloadSize = 0;
+
+  if (!req.error.empty()) {
+    header.status = 1;
+    header.errorLength = uint32_t(req.error.size());
+    payload = req.error.data();
+    payloadSize = req.error.size();
+  } else if (EvalRequestType(req.header.type) == EvalRequestType::Sample) {
+    header.count = uint32_t(req.samples.size());
+    payload = req.samples.data();
+    payloadSize = req.samples.size() * sizeof(EvalSample);
+  } else {
+    header.count = uint32_t(req.values.size());
+    payload = req.values.data();
+    payloadSize = req.values.size() * sizeof(float3);
+  }
+
+  // a client that went away just doesn't get its responses
+  std::lock_guard<std::mutex> lock(req.conn->writeMutex);
+  if (writeAll(req.conn->fd, &header, sizeof(header)))
+    writeAll(req.conn->fd, payload, payloadSize);
+}
+
+// Per worker thread state, reused across requests
+class Worker
+{
+ public:
+  void run(JobQueue &queue)
+  {
+    Job job;
+    while (queue.pop(job)) {
+      Request &req = *job.request;
+      try {
+        execute(job);
+      } catch (const std::exception &e) {
+        std::lock_guard<std::mutex> lock(req.errorMutex);
+        req.error = e.what();
+      }
+
+      if (--req.chunksLeft == 0)
+        sendResponse(req);
+      job.request.reset();
+    }
+  }
+
+ private:
+  struct CachedMaterial
+  {
+    std::unique_ptr<Material> mat;
+    std::vector<MaterialParam> defaults;
+    std::vector<EvalParam> rawParams; // last applied
+  };
+
+  Material &material(const Request &req)
+  {
+    auto &cached = m_materials[req.subtype];
+    if (!cached.mat) {
+      cached.mat.reset(Material::createInstance(req.subtype));
+      if (!cached.mat)
+        throw std::runtime_error("cannot create material " + req.subtype);
+      cached.defaults = Material::querySupportedParams(req.subtype);
+      cached.rawParams.clear();
+      for (auto &param : cached.defaults)
+        cached.mat->setParameter(param);
+    }
+
+    const bool changed = cached.rawParams.size() != req.rawParams.size()
+        || memcmp(cached.rawParams.data(),
+               req.rawParams.data(),
+               req.rawParams.size() * sizeof(EvalParam))
+            != 0;
+
+    if (changed) {
+      if (!cached.rawParams.empty()) {
+        for (auto &param : cached.defaults)
+          cached.mat->setParameter(param);
+      }
+      for (auto &param : req.params)
+        cached.mat->setParameter(param);
+      cached.rawParams = req.rawParams;
+    }
+
+    return *cached.mat;
+  }
+
+  void execute(const Job &job)
+  {
+    Request &req = *job.request;
+    const EvalRequestHeader &h = req.header;
+    Material &mat = material(req);
+
+    float3 t, b;
+    makeFrame(h.Ns, t, b);
+
+    switch (EvalRequestType(h.type)) {
+    case EvalRequestType::Eval: {
+      mat.evalBatch(h.Ng,
+          h.Ns,
+          req.input.data() + job.first,
+          job.count,
+          h.lightDir,
+          h.lightIntensity,
+          req.values.data() + job.first);
+      break;
+    }
+    case EvalRequestType::Albedo: {
+      auto key = std::make_pair(h.quadrature[0], h.quadrature[1]);
+      if (key != m_quadratureKey) {
+        m_quadratureDirs.clear();
+        m_quadratureWeights.clear();
+        hemisphereQuadrature(
+            key.first, key.second, m_quadratureDirs, m_quadratureWeights);
+        m_quadratureKey = key;
+      }
+
+      m_dirs.resize(m_quadratureDirs.size());
+      m_scratch.resize(m_quadratureDirs.size());
+      for (size_t i = 0; i < m_dirs.size(); ++i) {
+        float3 d = m_quadratureDirs[i];
+        m_dirs[i] = t * d.x + h.Ns * d.y + b * d.z;
+      }
+
+      for (size_t i = job.first; i < job.first + job.count; ++i) {
+        const float3 lightDir = req.input[i];
+        mat.evalBatch(h.Ng,
+            h.Ns,
+            m_dirs.data(),
+            m_dirs.size(),
+            lightDir,
+            h.lightIntensity,
+            m_scratch.data());
+
+        // eval() includes the cosine at the light, divide it out again
+        float3 albedo{0.f};
+        for (size_t j = 0; j < m_scratch.size(); ++j)
+          albedo += m_scratch[j] * m_quadratureWeights[j];
+        req.values[i] = albedo / std::max(1e-4f, dot(h.Ns, lightDir));
+      }
+      break;
+    }
+    case EvalRequestType::Sample: {
+      m_dirs.resize(job.count);
+      m_scratch.resize(job.count);
+      auto &samples = req.samples;
+      for (size_t i = 0; i < job.count; ++i) {
+        m_dirs[i] = cosineSampleDirection(
+            h.seed, job.first + i, h.Ns, t, b, samples[job.first + i].pdf);
+      }
+
+      mat.evalBatch(h.Ng,
+          h.Ns,
+          m_dirs.data(),
+          job.count,
+          h.lightDir,
+          h.lightIntensity,
+          m_scratch.data());
+
+      for (size_t i = 0; i < job.count; ++i) {
+        samples[job.first + i].dir = m_dirs[i];
+        samples[job.first + i].value = m_scratch[i];
+      }
+      break;
+    }
+    }
+  }
+
+  std::map<std::string, CachedMaterial> m_materials;
+
+  std::pair<uint32_t, uint32_t> m_quadratureKey{0, 0};
+  std::vector<float3> m_quadratureDirs;
+  std::vector<float> m_quadratureWeights;
+
+  std::vector<float3> m_dirs;
+  std::vector<float3> m_scratch;
+};
+
+// Reads requests from one client and queues them; returns when the
+// client disconnects or sends something that can't be parsed
+void serveConnection(std::shared_ptr<Connection> conn, JobQueue &queue)
+{
+  for (;;) {
+    auto req = std::make_shared<Request>();
+    req->conn = conn;
+    EvalRequestHeader &h = req->header;
+
+    if (!readAll(conn->fd, &h, sizeof(h)))
+      return;
+
+    const auto type = EvalRequestType(h.type);
+    if (h.magic != EvalRequestMagic || h.numParams > MaxParams
+        || h.count > MaxCount
+        || (type != EvalRequestType::Eval && type != EvalRequestType::Albedo
+            && type != EvalRequestType::Sample)) {
+      // the stream can't be resynchronized, drop the client
+      req->error = "invalid request";
+      sendResponse(*req);
+      return;
+    }
+
+    req->subtype = std::string(h.subtype, strnlen(h.subtype, EvalNameSize));
+
+    req->rawParams.resize(h.numParams);
+    if (!readAll(conn->fd, req->rawParams.data(), h.numParams * sizeof(EvalParam)))
+      return;
+
+    if (type != EvalRequestType::Sample) {
+      req->input.resize(h.count);
+      if (!readAll(conn->fd, req->input.data(), h.count * sizeof(float3)))
+        return;
+    }
+
+    try {
+      for (auto &ep : req->rawParams)
+        req->params.push_back(decodeParam(ep));
+      if (type == EvalRequestType::Albedo
+          && (h.quadrature[0] == 0 || h.quadrature[1] == 0))
+        throw std::runtime_error("albedo request without quadrature size");
+    } catch (const std::exception &e) {
+      req->error = e.what();
+    }
+
+    if (!req->error.empty() || h.count == 0) {
+      sendResponse(*req);
+      continue;
+    }
+
+    if (type == EvalRequestType::Sample)
+      req->samples.resize(h.count);
+    else
+      req->values.resize(h.count);
+
+    // albedos cost a whole quadrature each
+    size_t chunkSize = ChunkSize;
+    if (type == EvalRequestType::Albedo) {
+      chunkSize = std::max<size_t>(
+          1, ChunkSize / (size_t(h.quadrature[0]) * h.quadrature[1]));
+    }
+
+    std::vector<Job> jobs;
+    for (size_t first = 0; first < h.count; first += chunkSize)
+      jobs.push_back({req, first, std::min<size_t>(chunkSize, h.count - first)});
+    req->chunksLeft = jobs.size();
+    queue.push(jobs);
+  }
+}
+
+} // namespace
+
+void runEvalServer(const EvalServerOptions &options)
+{
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (options.socketPath.empty()
+      || options.socketPath.size() >= sizeof(addr.sun_path))
+    throw std::runtime_error("invalid socket path " + options.socketPath);
+  memcpy(addr.sun_path, options.socketPath.c_str(), options.socketPath.size());
+
+  // remove a stale socket left behind by a killed server
+  struct stat st;
+  if (stat(options.socketPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+    unlink(options.socketPath.c_str());
+
+  int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listenFd < 0)
+    throw std::runtime_error("cannot create socket");
+
+  if (bind(listenFd, (sockaddr *)&addr, sizeof(addr)) != 0
+      || listen(listenFd, 64) != 0) {
+    close(listenFd);
+    throw std::runtime_error("cannot listen on " + options.socketPath);
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  const unsigned numThreads =
+      options.numThreads > 0 ? options.numThreads : hardwareThreads();
+
+  JobQueue queue;
+  std::vector<std::thread> workers;
+  for (unsigned i = 0; i < numThreads; ++i)
+    workers.emplace_back([&]() { Worker().run(queue); });
+
+  if (options.verbose) {
+    fprintf(stderr, "[serve] listening on %s with %u workers\n",
+        options.socketPath.c_str(), numThreads);
+  }
+
+  struct Reader
+  {
+    std::thread thread;
+    std::shared_ptr<std::atomic<bool>> done;
+    std::weak_ptr<Connection> conn;
+  };
+  std::vector<Reader> readers;
+
+  while (!g_stop) {
+    // join the readers of clients that disconnected
+    for (auto it = readers.begin(); it != readers.end();) {
+      if (*it->done) {
+        it->thread.join();
+        it = readers.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    pollfd pfd{listenFd, POLLIN, 0};
+    if (poll(&pfd, 1, 200) <= 0)
+      continue;
+
+    int fd = accept(listenFd, nullptr, nullptr);
+    if (fd < 0)
+      continue;
+
+    auto conn = std::make_shared<Connection>(fd);
+    auto done = std::make_shared<std::atomic<bool>>(false);
+    std::thread thread([conn, done, &queue]() {
+      serveConnection(conn, queue);
+      *done = true;
+    });
+    readers.push_back({std::move(thread), done, conn});
+
+    if (options.verbose)
+      fprintf(stderr, "[serve] client connected\n");
+  }
+
+  if (options.verbose)
+    fprintf(stderr, "[serve] shutting down\n");
+
+  close(listenFd);
+  unlink(options.socketPath.c_str());
+
+  // wake up readers blocked on their clients
+  for (auto &r : readers) {
+    if (auto conn = r.conn.lock())
+      shutdown(conn->fd, SHUT_RDWR);
+  }
+  for (auto &r : readers)
+    r.thread.join();
+
+  queue.close();
+  for (auto &w : workers)
+    w.join();
+}
+
+} // namespace explorer
@@ -0,0 +1,99 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <cstdint>
+#include <string>
+// anari
+#include <anari/anari_cpp/ext/linalg.h>
+
+namespace explorer {
+
+// Wire protocol of the eval server. All values are in host byte order
+// (clients run on the same machine), float3 is three packed floats.
+//
+// A request is an EvalRequestHeader, numParams EvalParams and a payload:
+//   Eval:   count view directions (float3), evaluated under lightDir
+//   Albedo: count light directions (float3); the directional albedo
+//           of each, integrated with quadrature[0] x quadrature[1]
+//           samples (cos(theta) x phi)
+//   Sample: none; count view directions sampled for lightDir
+// Params not given in a request have the subtype's default values.
+//
+// Each request is answered by an EvalResponseHeader and a payload:
+//   Eval/Albedo: count float3 values
+//   Sample:      count EvalSamples
+//   on error (status != 0): errorLength bytes of message, no values
+//
+// Requests can be pipelined, i.e., sent without waiting for responses.
+// Responses carry the request's id and may arrive out of order.
+
+constexpr uint32_t EvalRequestMagic = 0x31515242; // "BRQ1"
+constexpr uint32_t EvalResponseMagic = 0x31535242; // "BRS1"
+constexpr size_t EvalNameSize = 64;
+
+enum class EvalRequestType : uint32_t
+{
+  Eval = 1,
+  Albedo = 2,
+  Sample = 3,
+};
+
+struct EvalRequestHeader
+{
+  uint32_t magic;
+  uint32_t type; // EvalRequestType
+  uint64_t id; // chosen by the client, echoed in the response
+  char subtype[EvalNameSize];
+  uint32_t numParams;
+  uint32_t count;
+  anari::math::float3 Ng;
+  anari::math::float3 Ns;
+  anari::math::float3 lightDir;
+  anari::math::float3 lightIntensity;
+  uint32_t quadrature[2]; // Albedo only
+  uint64_t seed; // Sample only
+};
+
+struct EvalParam
+{
+  char name[EvalNameSize];
+  uint32_t type; // DataType
+  float value[4];
+};
+
+struct EvalResponseHeader
+{
+  uint32_t magic;
+  int32_t status; // 0: ok
+  uint64_t id;
+  uint32_t count;
+  uint32_t errorLength;
+};
+
+// The plugin interface has no sampling routine, samples are cosine
+// distributed; value is eval() of the direction, pdf is w.r.t. solid angle
+struct EvalSample
+{
+  anari::math::float3 dir;
+  anari::math::float3 value;
+  float pdf;
+};
+
+struct EvalServerOptions
+{
+  std::string socketPath;
+  unsigned numThreads{0}; // 0: use all cores
+  bool verbose{false};
+};
+
+// Serves requests on a Unix domain socket until interrupted (SIGINT or
+// SIGTERM). A pool of worker threads, each with its own Material per
+// subtype that is reused across requests, evaluates requests in chunks,
+// so large requests are spread over the pool, too. The plugin must
+// already be loaded. Throws std::runtime_error on setup errors.
+void runEvalServer(const EvalServerOptions &options);
+
+} // namespace explorer
@@ -0,0 +1,533 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#include "FactorizedBRDF.h"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+#include <stdexcept>
+// ours
+#include "Directions.h"
+#include "Parallel.h"
+
+namespace explorer {
+
+using namespace anari::math;
+
+namespace {
+
+constexpr uint32_t Oversampling = 4; // extra SVD basis vectors
+constexpr size_t ColumnsPerItem = 256;
+constexpr float NMFEpsilon = 1e-12f;
+constexpr float MinCosine = 0.035f; // ~88 degrees, dividing out cos(theta_l)
+
+// Row-major matrix, only as much as the factorizations need
+struct Matrix
+{
+  size_t rows{0}, cols{0};
+  std::vector<float> data;
+
+  Matrix() = default;
+  Matrix(size_t r, size_t c) : rows(r), cols(c), data(r * c, 0.f) {}
+
+  float *row(size_t i)
+  {
+    return data.data() + i * cols;
+  }
+
+  const float *row(size_t i) const
+  {
+    return data.data() + i * cols;
+  }
+};
+
+// Y = A * Z (A: L x V, Z: V x p), parallel over the rows of A
+static void multiply(const Matrix &A, const Matrix &Z, Matrix &Y, unsigned numThreads)
+{
+  Y = Matrix(A.rows, Z.cols);
+  parallelFor(numThreads, A.rows, [&](unsigned, size_t l) {
+    const float *a = A.row(l);
+    std::vector<double> acc(Z.cols, 0.0);
+    for (size_t v = 0; v < A.cols; ++v) {
+      const float *z = Z.row(v);
+      for (size_t j = 0; j < Z.cols; ++j)
+        acc[j] += double(a[v]) * z[j];
+    }
+    float *y = Y.row(l);
+    for (size_t j = 0; j < Z.cols; ++j)
+      y[j] = float(acc[j]);
+  });
+}
+
+// Z = A^T * Q (A: L x V, Q: L x p), parallel over blocks of columns of A
+static void multiplyTransposed(
+    const Matrix &A, const Matrix &Q, Matrix &Z, unsigned numThreads)
+{
+  Z = Matrix(A.cols, Q.cols);
+  size_t numItems = (A.cols + ColumnsPerItem - 1) / ColumnsPerItem;
+  parallelFor(numThreads, numItems, [&](unsigned, size_t item) {
+    size_t first = item * ColumnsPerItem;
+    size_t last = std::min(A.cols, first + ColumnsPerItem);
+    for (size_t l = 0; l < A.rows; ++l) {
+      const float *a = A.row(l);
+      const float *q = Q.row(l);
+      for (size_t v = first; v < last; ++v) {
+        float *z = Z.row(v);
+        for (size_t j = 0; j < Q.cols; ++j)
+          z[j] += a[v] * q[j];
+      }
+    }
+  });
+}
+
+// M^T * M of a tall matrix, in double
+static std::vector<double> gram(const Matrix &M)
+{
+  const size_t p = M.cols;
+  std::vector<double> G(p * p, 0.0);
+  for (size_t i = 0; i < M.rows; ++i) {
+    const float *m = M.row(i);
+    for (size_t j = 0; j < p; ++j) {
+      for (size_t k = j; k < p; ++k)
+        G[j * p + k] += double(m[j]) * m[k];
+    }
+  }
+  for (size_t j = 0; j < p; ++j) {
+    for (size_t k = 0; k < j; ++k)
+      G[j * p + k] = G[k * p + j];
+  }
+  return G;
+}
+
+// Orthonormalizes the columns of M (modified Gram-Schmidt, applied
+// twice for stability); columns that turn out linearly dependent are
+// zeroed
+static void orthonormalize(Matrix &M)
+{
+  for (int pass = 0; pass < 2; ++pass) {
+    for (size_t j = 0; j < M.cols; ++j) {
+      for (size_t k = 0; k < j; ++k) {
+        double d = 0.0;
+        for (size_t i = 0; i < M.rows; ++i)
+          d += double(M.row(i)[j]) * M.row(i)[k];
+        for (size_t i = 0; i < M.rows; ++i)
+          M.row(i)[j] -= float(d) * M.row(i)[k];
+      }
+
+      double norm = 0.0;
+      for (size_t i = 0; i < M.rows; ++i)
+        norm += double(M.row(i)[j]) * M.row(i)[j];
+      norm = std::sqrt(norm);
+
+      float scale = norm > 1e-20 ? float(1.0 / norm) : 0.f;
+      for (size_t i = 0; i < M.rows; ++i)
+        M.row(i)[j] *= scale;
+    }
+  }
+}
+
+// Eigen decomposition of a small symmetric matrix (cyclic Jacobi).
+// Returns the eigenvalues in descending order; the columns of vectors
+// are the corresponding eigenvectors.
+static std::vector<double> symmetricEigen(
+    std::vector<double> S, size_t n, std::vector<double> &vectors)
+{
+  vectors.assign(n * n, 0.0);
+  for (size_t i = 0; i < n; ++i)
+    vectors[i * n + i] = 1.0;
+
+  for (int sweep = 0; sweep < 64; ++sweep) {
+    double offDiagonal = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t j = i + 1; j < n; ++j)
+        offDiagonal += S[i * n + j] * S[i * n + j];
+    }
+    if (offDiagonal < 1e-30)
+      break;
+
+    for (size_t p = 0; p < n; ++p) {
+      for (size_t q = p + 1; q < n; ++q) {
+        double spq = S[p * n + q];
+        if (std::abs(spq) < 1e-300)
+          continue;
+
+        double theta = (S[q * n + q] - S[p * n + p]) / (2.0 * spq);
+        double t = (theta >= 0.0 ? 1.0 : -1.0)
+            / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+        double c = 1.0 / std::sqrt(t * t + 1.0);
+        double s = t * c;
+
+        for (size_t k = 0; k < n; ++k) {
+          double skp = S[k * n + p], skq = S[k * n + q];
+          S[k * n + p] = c * skp - s * skq;
+          S[k * n + q] = s * skp + c * skq;
+        }
+        for (size_t k = 0; k < n; ++k) {
+          double spk = S[p * n + k], sqk = S[q * n + k];
+          S[p * n + k] = c * spk - s * sqk;
+          S[q * n + k] = s * spk + c * sqk;
+        }
+        for (size_t k = 0; k < n; ++k) {
+          double vkp = vectors[k * n + p], vkq = vectors[k * n + q];
+          vectors[k * n + p] = c * vkp - s * vkq;
+          vectors[k * n + q] = s * vkp + c * vkq;
+        }
+      }
+    }
+  }
+
+  std::vector<size_t> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return S[a * n + a] > S[b * n + b];
+  });
+
+  std::vector<double> values(n), sorted(n * n);
+  for (size_t j = 0; j < n; ++j) {
+    values[j] = S[order[j] * n + order[j]];
+    for (size_t i = 0; i < n; ++i)
+      sorted[i * n + j] = vectors[i * n + order[j]];
+  }
+  vectors = std::move(sorted);
+  return values;
+}
+
+// Truncated SVD by randomized subspace iteration (Halko et al. 2011):
+// A ~ W * H^T with W: L x rank, H: V x rank (singular values in H)
+static void truncatedSVD(const Matrix &A,
+                         uint32_t rank,
+                         int iterations,
+                         uint64_t seed,
+                         unsigned numThreads,
+                         Matrix &W,
+                         Matrix &H)
+{
+  const size_t p = std::min<size_t>(rank + Oversampling, std::min(A.rows, A.cols));
+
+  Matrix omega(A.cols, p);
+  for (size_t i = 0; i < omega.data.size(); ++i) {
+    uint64_t bits = splitMix64(seed ^ splitMix64(i));
+    omega.data[i] = float(bits >> 40) * (2.f / float(1ull << 24)) - 1.f;
+  }
+
+  Matrix Q, Z;
+  multiply(A, omega, Q, numThreads);
+  orthonormalize(Q);
+  for (int it = 0; it < iterations; ++it) {
+    multiplyTransposed(A, Q, Z, numThreads);
+    orthonormalize(Z);
+    multiply(A, Z, Q, numThreads);
+    orthonormalize(Q);
+  }
+
+  // A ~ Q * Q^T * A = Q * Z^T with Z = A^T * Q; the SVD of the small
+  // factor Z^T follows from the eigen decomposition of Z^T * Z
+  multiplyTransposed(A, Q, Z, numThreads);
+  std::vector<double> E;
+  auto lambda = symmetricEigen(gram(Z), p, E);
+
+  W = Matrix(A.rows, rank);
+  H = Matrix(A.cols, rank);
+  for (size_t k = 0; k < rank; ++k) {
+    if (k >= p || lambda[k] <= 0.0)
+      continue;
+
+    for (size_t l = 0; l < A.rows; ++l) {
+      double u = 0.0;
+      for (size_t j = 0; j < p; ++j)
+        u += Q.row(l)[j] * E[j * p + k];
+      W.row(l)[k] = float(u);
+    }
+
+    double sum = 0.0;
+    for (size_t v = 0; v < A.cols; ++v) {
+      double h = 0.0;
+      for (size_t j = 0; j < p; ++j)
+        h += Z.row(v)[j] * E[j * p + k];
+      H.row(v)[k] = float(h);
+      sum += h;
+    }
+
+    // the sign of each component is arbitrary, make view factors mostly
+    // positive
+    if (sum < 0.0) {
+      for (size_t l = 0; l < A.rows; ++l)
+        W.row(l)[k] = -W.row(l)[k];
+      for (size_t v = 0; v < A.cols; ++v)
+        H.row(v)[k] = -H.row(v)[k];
+    }
+  }
+}
+
+// NMF with Lee-Seung multiplicative updates, minimizing ||A - W H^T||;
+// W and H are the initial guess and must be non-negative
+static void nonNegativeFactorization(
+    const Matrix &A, int iterations, unsigned numThreads, Matrix &W, Matrix &H)
+{
+  const size_t rank = W.cols;
+  Matrix numerator;
+
+  auto update = [&](Matrix &X, const Matrix &Y, const Matrix &N) {
+    // X *= N / (X * (Y^T Y))
+    auto YtY = gram(Y);
+    parallelFor(numThreads, X.rows, [&](unsigned, size_t i) {
+      float *x = X.row(i);
+      const float *n = N.row(i);
+      std::vector<double> d(rank, 0.0);
+      for (size_t j = 0; j < rank; ++j) {
+        for (size_t k = 0; k < rank; ++k)
+          d[k] += double(x[j]) * YtY[j * rank + k];
+      }
+      for (size_t k = 0; k < rank; ++k)
+        x[k] *= float(std::max(0.f, n[k]) / (d[k] + NMFEpsilon));
+    });
+  };
+
+  for (int it = 0; it < iterations; ++it) {
+    multiplyTransposed(A, W, numerator, numThreads);
+    update(H, W, numerator);
+    multiply(A, H, numerator, numThreads);
+    update(W, H, numerator);
+  }
+}
+
+// Trilinear lookup in an isotropic table (one light phi) at the light
+// elevation thetaI and the view direction (thetaO, phiO relative to the
+// light's azimuth), all in degrees
+static float3 sampleIsotropicTable(
+    const MappedSweepFile &table, float thetaI, float thetaO, float phiO)
+{
+  const SweepSpec &spec = table.info().spec;
+  AxisLerp lt = axisLerp(spec.lightTheta, thetaI, false);
+  AxisLerp vt = axisLerp(spec.viewTheta, thetaO, false);
+  AxisLerp vp = axisLerp(
+      spec.viewPhi, spec.lightPhi.minValue + phiO, isPeriodicAxis(spec.viewPhi));
+
+  float3 result(0.f, 0.f, 0.f);
+  for (int i = 0; i < 2; ++i) {
+    const float3 *row = table.row(i ? lt.i1 : lt.i0);
+    for (int j = 0; j < 2; ++j) {
+      for (int k = 0; k < 2; ++k) {
+        float w = (i ? lt.w : 1.f - lt.w) * (j ? vt.w : 1.f - vt.w)
+            * (k ? vp.w : 1.f - vp.w);
+        if (w > 0.f)
+          result += w * row[(j ? vt.i1 : vt.i0) * spec.viewPhi.count + (k ? vp.i1 : vp.i0)];
+      }
+    }
+  }
+  return result;
+}
+
+// The matrices to factorize, one per channel
+static void buildMatrices(const MappedSweepFile &table,
+                          const FactorizedBRDF &brdf,
+                          unsigned numThreads,
+                          Matrix A[3])
+{
+  constexpr float DegToRad = 0.0174532925f;
+  constexpr float RadToDeg = 57.2957795f;
+
+  const size_t numRows = brdf.numRows();
+  const size_t numColumns = brdf.numColumns();
+  for (int c = 0; c < 3; ++c)
+    A[c] = Matrix(numRows, numColumns);
+
+  if (brdf.parameterization == FactorParameterization::LightView) {
+    parallelFor(numThreads, numRows, [&](unsigned, size_t r) {
+      const float3 *row = table.row(r);
+      for (size_t s = 0; s < numColumns; ++s) {
+        for (int c = 0; c < 3; ++c)
+          A[c].row(r)[s] = (&row[s].x)[c];
+      }
+    });
+    return;
+  }
+
+  // Resample at the half/difference grid points, without cos(theta_l)
+  parallelFor(numThreads, numRows, [&](unsigned, size_t r) {
+    float u = brdf.rowTheta.value(uint32_t(r));
+    float thetaH = 90.f * u * u * DegToRad;
+    float ch = cosf(thetaH), sh = sinf(thetaH);
+    float3 h(sh, 0.f, ch);
+
+    for (uint32_t t = 0; t < brdf.columnTheta.count; ++t) {
+      float thetaD = brdf.columnTheta.value(t) * DegToRad;
+      for (uint32_t p = 0; p < brdf.columnPhi.count; ++p) {
+        float phiD = brdf.columnPhi.value(p) * DegToRad;
+        float3 d(sinf(thetaD) * cosf(phiD), sinf(thetaD) * sinf(phiD), cosf(thetaD));
+
+        // rotate d by thetaH around y, the half vector has phi = 0
+        float3 wi(ch * d.x + sh * d.z, d.y, -sh * d.x + ch * d.z);
+        float3 wo = 2.f * dot(wi, h) * h - wi;
+
+        // Grid points below the horizon are never evaluated, but zeros
+        // there would break the low-rank structure; the table is extended
+        // (constant in theta) instead
+        float cosI = std::clamp(wi.z, MinCosine, 1.f);
+        float thetaI = acosf(cosI) * RadToDeg;
+        float thetaO = acosf(std::clamp(wo.z, 0.f, 1.f)) * RadToDeg;
+        float phiO = (atan2f(wo.y, wo.x) - atan2f(wi.y, wi.x)) * RadToDeg;
+        float3 value = sampleIsotropicTable(table, thetaI, thetaO, phiO) / cosI;
+
+        size_t s = size_t(t) * brdf.columnPhi.count + p;
+        for (int c = 0; c < 3; ++c)
+          A[c].row(r)[s] = (&value.x)[c];
+      }
+    }
+  });
+}
+
+} // namespace
+
+FactorizedBRDF factorizeBRDF(const MappedSweepFile &table, const FactorizeOptions &options)
+{
+  const SweepSpec &spec = table.info().spec;
+  if (spec.kind != SweepKind::Eval || !spec.params.empty()
+      || table.info().firstRow != 0 || table.info().numRows != spec.rowCount())
+    throw std::runtime_error("factorize needs a complete bake/sweep without param axes");
+
+  if (options.rank == 0)
+    throw std::runtime_error("factorization rank must be at least 1");
+
+  const unsigned numThreads =
+      options.numThreads > 0 ? options.numThreads : hardwareThreads();
+
+  FactorizedBRDF result;
+  result.subtype = spec.subtype;
+  result.method = options.method;
+  result.tableBytes = spec.rowCount() * spec.rowSize() * sizeof(float3);
+
+  if (options.halfDifference && spec.lightPhi.count == 1) {
+    const uint32_t n = std::max(2u, options.resolution);
+    result.parameterization = FactorParameterization::HalfDifference;
+    result.rowTheta = {"sqrtThetaHalf", 0.f, 1.f, n};
+    result.rowPhi = {"phiHalf", 0.f, 0.f, 1};
+    result.columnTheta = {"thetaDiff", 0.f, 90.f, n};
+    result.columnPhi = {"phiDiff", 0.f, 180.f, n};
+  } else {
+    result.parameterization = FactorParameterization::LightView;
+    result.rowTheta = spec.lightTheta;
+    result.rowPhi = spec.lightPhi;
+    result.columnTheta = spec.viewTheta;
+    result.columnPhi = spec.viewPhi;
+  }
+
+  const size_t numRows = result.numRows();
+  const size_t numColumns = result.numColumns();
+  const uint32_t rank = uint32_t(std::min<size_t>(options.rank, std::min(numRows, numColumns)));
+  result.rank = rank;
+  result.rowFactors.assign(numRows * 3 * rank, 0.f);
+  result.columnFactors.assign(numColumns * 3 * rank, 0.f);
+
+  const int iterations = options.iterations > 0
+      ? options.iterations
+      : (options.method == FactorizeMethod::SVD ? 8 : 200);
+
+  Matrix A[3];
+  buildMatrices(table, result, numThreads, A);
+
+  for (int c = 0; c < 3; ++c) {
+    if (options.method == FactorizeMethod::NMF) {
+      for (auto &a : A[c].data)
+        a = std::max(0.f, a);
+    }
+
+    Matrix W, H;
+    truncatedSVD(A[c],
+        rank,
+        options.method == FactorizeMethod::SVD ? iterations : 8,
+        uint64_t(c),
+        numThreads,
+        W,
+        H);
+
+    if (options.method == FactorizeMethod::NMF) {
+      // start from the magnitudes of the SVD factors, balanced so both
+      // sides carry the square root of the singular value
+      for (size_t k = 0; k < rank; ++k) {
+        double sigma = 0.0;
+        for (size_t s = 0; s < numColumns; ++s)
+          sigma += double(H.row(s)[k]) * H.row(s)[k];
+        sigma = std::sqrt(sigma);
+        float scale = sigma > 0.0 ? float(std::sqrt(sigma)) : 1.f;
+        for (size_t r = 0; r < numRows; ++r)
+          W.row(r)[k] = std::abs(W.row(r)[k]) * scale + 1e-6f;
+        for (size_t s = 0; s < numColumns; ++s)
+          H.row(s)[k] = std::abs(H.row(s)[k]) / scale + 1e-6f;
+      }
+      nonNegativeFactorization(A[c], iterations, numThreads, W, H);
+    }
+
+    for (size_t r = 0; r < numRows; ++r) {
+      std::copy(W.row(r), W.row(r) + rank,
+          result.rowFactors.data() + (r * 3 + c) * rank);
+    }
+    for (size_t s = 0; s < numColumns; ++s) {
+      std::copy(H.row(s), H.row(s) + rank,
+          result.columnFactors.data() + (s * 3 + c) * rank);
+    }
+
+    if (options.verbose)
+      fprintf(stderr, "[factorize] channel %d done\n", c);
+  }
+
+  // Error of what the plugin evaluates, at the table's samples
+  std::vector<float3> viewDirs;
+  for (uint32_t t = 0; t < spec.viewTheta.count; ++t) {
+    for (uint32_t p = 0; p < spec.viewPhi.count; ++p) {
+      float3 d = sphericalDirection(
+          radians(spec.viewTheta.value(t)), radians(spec.viewPhi.value(p)));
+      viewDirs.push_back(float3(d.x, d.z, d.y)); // z up
+    }
+  }
+
+  struct ErrorSums
+  {
+    double squaredError{0.0};
+    double squaredNorm{0.0};
+    double maxError{0.0};
+  };
+  std::vector<ErrorSums> sums(numThreads);
+  parallelFor(numThreads, spec.rowCount(), [&](unsigned threadID, size_t row) {
+    float3 d = sphericalDirection(
+        radians(spec.lightTheta.value(uint32_t(row / spec.lightPhi.count))),
+        radians(spec.lightPhi.value(uint32_t(row % spec.lightPhi.count))));
+
+    std::vector<float3> values(viewDirs.size());
+    evalFactorizedBRDF(
+        result, float3(d.x, d.z, d.y), viewDirs.data(), viewDirs.size(), values.data());
+
+    const float3 *target = table.row(row);
+    auto &s = sums[threadID];
+    for (size_t v = 0; v < viewDirs.size(); ++v) {
+      for (int c = 0; c < 3; ++c) {
+        double t = (&target[v].x)[c];
+        double error = (&values[v].x)[c] - t;
+        s.squaredError += error * error;
+        s.squaredNorm += t * t;
+        s.maxError = std::max(s.maxError, std::abs(error));
+      }
+    }
+  });
+
+  ErrorSums total;
+  for (auto &s : sums) {
+    total.squaredError += s.squaredError;
+    total.squaredNorm += s.squaredNorm;
+    total.maxError = std::max(total.maxError, s.maxError);
+  }
+
+  const double numValues = 3.0 * spec.rowCount() * spec.rowSize();
+  result.rmsError = float(std::sqrt(total.squaredError / numValues));
+  result.maxError = float(total.maxError);
+  result.relativeError = total.squaredNorm > 0.0
+      ? float(std::sqrt(total.squaredError / total.squaredNorm))
+      : 0.f;
+
+  return result;
+}
+
+} // namespace explorer
@@ -0,0 +1,330 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#include "FactorizedBRDF.h"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+namespace explorer {
+
+using namespace anari::math;
+
+namespace {
+
+// On-disk layout: header, the four axes, then the row factors and the
+// column factors as float arrays
+
+constexpr char FactorizedFileMagic[8] = "BRDFLRF";
+constexpr uint32_t FactorizedFileVersion = 1;
+
+struct FileHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t parameterization;
+  uint32_t method;
+  uint32_t rank;
+  uint32_t numRows;
+  uint32_t numColumns;
+  float rmsError;
+  float maxError;
+  float relativeError;
+  uint64_t tableBytes;
+  char subtype[64];
+};
+
+struct FileAxis
+{
+  char name[48];
+  float minValue;
+  float maxValue;
+  uint32_t count;
+  uint32_t pad;
+};
+
+using File = std::unique_ptr<FILE, int (*)(FILE *)>;
+
+static FileAxis encodeAxis(const SweepAxis &axis)
+{
+  FileAxis result{};
+  std::strncpy(result.name, axis.name.c_str(), sizeof(result.name) - 1);
+  result.minValue = axis.minValue;
+  result.maxValue = axis.maxValue;
+  result.count = axis.count;
+  return result;
+}
+
+static SweepAxis decodeAxis(const FileAxis &fa)
+{
+  SweepAxis result;
+  result.name = std::string(fa.name, strnlen(fa.name, sizeof(fa.name)));
+  result.minValue = fa.minValue;
+  result.maxValue = fa.maxValue;
+  result.count = fa.count;
+  return result;
+}
+
+static void writeAll(FILE *file, const void *data, size_t size, const std::string &fileName)
+{
+  if (size > 0 && fwrite(data, size, 1, file) != 1)
+    throw std::runtime_error("write to " + fileName + " failed");
+}
+
+static void readAll(FILE *file, void *data, size_t size, const std::string &fileName)
+{
+  if (size > 0 && fread(data, size, 1, file) != 1)
+    throw std::runtime_error(fileName + " is truncated");
+}
+
+constexpr float RadToDeg = 57.2957795f;
+
+// Views exactly at the horizon (e.g., the tables' theta = 90 samples) may
+// end up slightly below it numerically
+constexpr float HorizonEpsilon = 1e-4f;
+
+// Bilinear blend of the factors at the grid points around (a, b)
+static void blendFactors(const float *factors,
+                         const SweepAxis &phiAxis,
+                         AxisLerp a,
+                         AxisLerp b,
+                         uint32_t stride,
+                         float *out)
+{
+  std::fill(out, out + stride, 0.f);
+  for (int i = 0; i < 2; ++i) {
+    for (int j = 0; j < 2; ++j) {
+      float w = (i ? a.w : 1.f - a.w) * (j ? b.w : 1.f - b.w);
+      if (w <= 0.f)
+        continue;
+      uint32_t index = (i ? a.i1 : a.i0) * phiAxis.count + (j ? b.i1 : b.i0);
+      const float *f = factors + size_t(index) * stride;
+      for (uint32_t k = 0; k < stride; ++k)
+        out[k] += w * f[k];
+    }
+  }
+}
+
+static float3 combineFactors(const float *row, const float *column, uint32_t rank, float scale)
+{
+  float3 result;
+  for (int c = 0; c < 3; ++c) {
+    float sum = 0.f;
+    for (uint32_t k = 0; k < rank; ++k)
+      sum += row[c * rank + k] * column[c * rank + k];
+    (&result.x)[c] = std::max(0.f, sum * scale);
+  }
+  return result;
+}
+
+// Half/difference angles in degrees; phiD is folded into [0,180)
+// (isotropic BRDFs are symmetric under phiD + 180)
+static void halfDifferenceAngles(
+    float3 wi, float3 wo, float &thetaH, float &thetaD, float &phiD)
+{
+  float3 h = wi + wo;
+  float len = length(h);
+  if (len <= 0.f) {
+    thetaH = thetaD = 90.f;
+    phiD = 0.f;
+    return;
+  }
+  h = h / len;
+
+  float ch = std::clamp(h.z, -1.f, 1.f);
+  float sh = sqrtf(std::max(0.f, 1.f - ch * ch));
+  float phiH = atan2f(h.y, h.x);
+  float cp = cosf(phiH), sp = sinf(phiH);
+
+  // rotate wi by -phiH around z, then by -thetaH around y
+  float x = cp * wi.x + sp * wi.y;
+  float y = -sp * wi.x + cp * wi.y;
+  float dx = ch * x - sh * wi.z;
+  float dz = sh * x + ch * wi.z;
+
+  thetaH = acosf(ch) * RadToDeg;
+  thetaD = acosf(std::clamp(dz, -1.f, 1.f)) * RadToDeg;
+  phiD = atan2f(y, dx) * RadToDeg;
+  if (phiD < 0.f)
+    phiD += 180.f;
+}
+
+} // namespace
+
+void evalFactorizedBRDF(const FactorizedBRDF &brdf,
+                        float3 wi,
+                        const float3 *wo,
+                        size_t count,
+                        float3 *values)
+{
+  std::fill(values, values + count, float3(0.f, 0.f, 0.f));
+  if (wi.z <= 0.f)
+    return;
+
+  const uint32_t rank = brdf.rank;
+  const uint32_t stride = 3 * rank;
+  std::vector<float> row(stride), column(stride);
+
+  if (brdf.parameterization == FactorParameterization::HalfDifference) {
+    for (size_t i = 0; i < count; ++i) {
+      if (wo[i].z < -HorizonEpsilon)
+        continue;
+
+      float thetaH, thetaD, phiD;
+      halfDifferenceAngles(wi, wo[i], thetaH, thetaD, phiD);
+
+      blendFactors(brdf.rowFactors.data(),
+          brdf.rowPhi,
+          axisLerp(brdf.rowTheta, sqrtf(thetaH / 90.f), false),
+          AxisLerp{},
+          stride,
+          row.data());
+      blendFactors(brdf.columnFactors.data(),
+          brdf.columnPhi,
+          axisLerp(brdf.columnTheta, thetaD, false),
+          axisLerp(brdf.columnPhi, phiD, false),
+          stride,
+          column.data());
+      values[i] = combineFactors(row.data(), column.data(), rank, wi.z);
+    }
+    return;
+  }
+
+  // Light/view: the row factors only depend on the light. Isotropic
+  // tables (one light phi) are looked up relative to the light's azimuth.
+  float thetaI = acosf(std::min(wi.z, 1.f)) * RadToDeg;
+  float phiI = atan2f(wi.y, wi.x) * RadToDeg;
+
+  AxisLerp lp;
+  float phiOffset = 0.f;
+  if (brdf.rowPhi.count == 1)
+    phiOffset = brdf.rowPhi.minValue - phiI;
+  else
+    lp = axisLerp(brdf.rowPhi, phiI, isPeriodicAxis(brdf.rowPhi));
+
+  blendFactors(brdf.rowFactors.data(),
+      brdf.rowPhi,
+      axisLerp(brdf.rowTheta, thetaI, false),
+      lp,
+      stride,
+      row.data());
+
+  const bool periodic = isPeriodicAxis(brdf.columnPhi);
+  for (size_t i = 0; i < count; ++i) {
+    if (wo[i].z < -HorizonEpsilon)
+      continue;
+
+    float thetaO = acosf(std::min(wo[i].z, 1.f)) * RadToDeg;
+    float phiO = atan2f(wo[i].y, wo[i].x) * RadToDeg + phiOffset;
+
+    blendFactors(brdf.columnFactors.data(),
+        brdf.columnPhi,
+        axisLerp(brdf.columnTheta, thetaO, false),
+        axisLerp(brdf.columnPhi, phiO, periodic),
+        stride,
+        column.data());
+    values[i] = combineFactors(row.data(), column.data(), rank, 1.f);
+  }
+}
+
+void saveFactorizedBRDF(const std::string &fileName, const FactorizedBRDF &brdf)
+{
+  const size_t numComponents = 3 * size_t(brdf.rank);
+  if (brdf.rowFactors.size() != brdf.numRows() * numComponents
+      || brdf.columnFactors.size() != brdf.numColumns() * numComponents)
+    throw std::runtime_error("inconsistent factorization");
+
+  File file(fopen(fileName.c_str(), "wb"), &fclose);
+  if (!file)
+    throw std::runtime_error("cannot open " + fileName + " for writing");
+
+  FileHeader header{};
+  std::memcpy(header.magic, FactorizedFileMagic, sizeof(header.magic));
+  header.version = FactorizedFileVersion;
+  header.parameterization = uint32_t(brdf.parameterization);
+  header.method = uint32_t(brdf.method);
+  header.rank = brdf.rank;
+  header.numRows = brdf.numRows();
+  header.numColumns = brdf.numColumns();
+  header.rmsError = brdf.rmsError;
+  header.maxError = brdf.maxError;
+  header.relativeError = brdf.relativeError;
+  header.tableBytes = brdf.tableBytes;
+  std::strncpy(header.subtype, brdf.subtype.c_str(), sizeof(header.subtype) - 1);
+  writeAll(file.get(), &header, sizeof(header), fileName);
+
+  for (auto *axis : {&brdf.rowTheta, &brdf.rowPhi, &brdf.columnTheta, &brdf.columnPhi}) {
+    FileAxis fa = encodeAxis(*axis);
+    writeAll(file.get(), &fa, sizeof(fa), fileName);
+  }
+
+  writeAll(file.get(),
+      brdf.rowFactors.data(),
+      brdf.rowFactors.size() * sizeof(float),
+      fileName);
+  writeAll(file.get(),
+      brdf.columnFactors.data(),
+      brdf.columnFactors.size() * sizeof(float),
+      fileName);
+
+  if (fflush(file.get()) != 0)
+    throw std::runtime_error("write to " + fileName + " failed");
+}
+
+FactorizedBRDF loadFactorizedBRDF(const std::string &fileName)
+{
+  File file(fopen(fileName.c_str(), "rb"), &fclose);
+  if (!file)
+    throw std::runtime_error("cannot open " + fileName);
+
+  FileHeader header;
+  readAll(file.get(), &header, sizeof(header), fileName);
+  if (std::memcmp(header.magic, FactorizedFileMagic, sizeof(header.magic)) != 0
+      || header.version != FactorizedFileVersion
+      || header.parameterization > uint32_t(FactorParameterization::HalfDifference)
+      || header.method > uint32_t(FactorizeMethod::NMF) || header.rank == 0)
+    throw std::runtime_error(fileName + " is not a valid factorized BRDF");
+
+  FileAxis axes[4];
+  readAll(file.get(), axes, sizeof(axes), fileName);
+
+  FactorizedBRDF result;
+  result.subtype =
+      std::string(header.subtype, strnlen(header.subtype, sizeof(header.subtype)));
+  result.parameterization = FactorParameterization(header.parameterization);
+  result.rowTheta = decodeAxis(axes[0]);
+  result.rowPhi = decodeAxis(axes[1]);
+  result.columnTheta = decodeAxis(axes[2]);
+  result.columnPhi = decodeAxis(axes[3]);
+  result.method = FactorizeMethod(header.method);
+  result.rank = header.rank;
+  result.rmsError = header.rmsError;
+  result.maxError = header.maxError;
+  result.relativeError = header.relativeError;
+  result.tableBytes = header.tableBytes;
+
+  if (result.numRows() != header.numRows || result.numColumns() != header.numColumns
+      || header.numRows == 0 || header.numColumns == 0)
+    throw std::runtime_error(fileName + " has inconsistent axes");
+
+  const size_t numComponents = 3 * size_t(result.rank);
+  result.rowFactors.resize(result.numRows() * numComponents);
+  result.columnFactors.resize(result.numColumns() * numComponents);
+  readAll(file.get(),
+      result.rowFactors.data(),
+      result.rowFactors.size() * sizeof(float),
+      fileName);
+  readAll(file.get(),
+      result.columnFactors.data(),
+      result.columnFactors.size() * sizeof(float),
+      fileName);
+
+  return result;
+}
+
+} // namespace explorer
@@ -0,0 +1,155 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+// ours
+#include "Sweep.h"
+
+namespace explorer {
+
+enum class FactorizeMethod
+{
+  SVD, // truncated SVD, best L2 approximation of the given rank
+  NMF, // non-negative factors, the approximation never goes negative
+};
+
+enum class FactorParameterization
+{
+  // rows: the table's lights (lightTheta, lightPhi), columns: its views
+  // (viewTheta, viewPhi), values as in the table (including cos(theta_l))
+  LightView,
+  // Isotropic BRDFs in Rusinkiewicz' half/difference angles. Rows:
+  // u = sqrt(theta_h / 90) (more samples near the highlight), columns:
+  // (theta_d, phi_d in [0,180]). Values are the BRDF without
+  // cos(theta_l). Highlights are separable in these coordinates, in
+  // light/view coordinates they are not.
+  HalfDifference,
+};
+
+// Separable approximation of a tabulated BRDF (a bake, or a sweep
+// without param axes): for every color channel c,
+//
+//   value(row r, column s) ~ sum_k rowFactors[r][c][k] * columnFactors[s][c][k]
+//
+// Rows and columns are grids (row-major over their two axes, angles in
+// degrees) whose meaning depends on the parameterization. Singular
+// values are folded into the column factors, so evaluating is one dot
+// product of length rank per channel.
+struct FactorizedBRDF
+{
+  std::string subtype; // of the source table
+  FactorParameterization parameterization{FactorParameterization::LightView};
+  SweepAxis rowTheta, rowPhi, columnTheta, columnPhi;
+  FactorizeMethod method{FactorizeMethod::SVD};
+  uint32_t rank{0};
+
+  std::vector<float> rowFactors; // [numRows()][3][rank]
+  std::vector<float> columnFactors; // [numColumns()][3][rank]
+
+  // Error of the evaluated approximation at the source table's samples
+  float rmsError{0.f};
+  float maxError{0.f};
+  float relativeError{0.f}; // Frobenius norm of the error / of the table
+  uint64_t tableBytes{0}; // size of the source table's values
+
+  uint32_t numRows() const
+  {
+    return rowTheta.count * rowPhi.count;
+  }
+
+  uint32_t numColumns() const
+  {
+    return columnTheta.count * columnPhi.count;
+  }
+
+  uint64_t factorBytes() const
+  {
+    return (rowFactors.size() + columnFactors.size()) * sizeof(float);
+  }
+};
+
+// Evaluates the approximation for a light direction wi and view
+// directions wo, all in the local frame (z up, phi measured from x
+// towards y). Like Material::eval() the values include cos(theta_l), for
+// unit light intensity.
+void evalFactorizedBRDF(const FactorizedBRDF &brdf,
+                        anari::math::float3 wi,
+                        const anari::math::float3 *wo,
+                        size_t count,
+                        anari::math::float3 *values);
+
+// Throws std::runtime_error on I/O errors or invalid files
+void saveFactorizedBRDF(const std::string &fileName, const FactorizedBRDF &brdf);
+FactorizedBRDF loadFactorizedBRDF(const std::string &fileName);
+
+struct FactorizeOptions
+{
+  FactorizeMethod method{FactorizeMethod::SVD};
+  uint32_t rank{4};
+  bool halfDifference{true}; // if the table is isotropic
+  uint32_t resolution{90}; // of the half/difference grids
+  int iterations{0}; // 0: method default (SVD: 8 power iterations, NMF: 200)
+  unsigned numThreads{0}; // 0: use all cores
+  bool verbose{false};
+};
+
+// Factorizes a complete Eval table without param axes (as written by
+// bake). All products with the table are computed in parallel over its
+// rows or columns. Throws std::runtime_error if the table isn't
+// suitable.
+FactorizedBRDF factorizeBRDF(const MappedSweepFile &table, const FactorizeOptions &options);
+
+// Grid lookups (resampling and evaluation) ///////////////////////////////////
+
+// Linear interpolation between two samples of an axis
+struct AxisLerp
+{
+  uint32_t i0{0}, i1{0};
+  float w{0.f}; // weight of i1
+};
+
+// Phi axes that cover the full circle (e.g., 0:358:180) wrap around
+// between their last and first sample
+inline bool isPeriodicAxis(const SweepAxis &axis)
+{
+  if (axis.count <= 1)
+    return false;
+  float step = (axis.maxValue - axis.minValue) / (axis.count - 1);
+  return axis.maxValue - axis.minValue + 1.5f * step >= 360.f;
+}
+
+inline AxisLerp axisLerp(const SweepAxis &axis, float value, bool periodic)
+{
+  if (axis.count <= 1)
+    return {};
+
+  const uint32_t last = axis.count - 1;
+  const float step = (axis.maxValue - axis.minValue) / last;
+  float x = (value - axis.minValue) / step;
+
+  if (periodic) {
+    float period = 360.f / step; // in samples
+    x = fmodf(x, period);
+    if (x < 0.f)
+      x += period;
+    if (x >= last) {
+      float gap = period - last;
+      return {last, 0, gap > 1e-3f ? std::min(1.f, (x - last) / gap) : 0.f};
+    }
+  } else {
+    x = std::clamp(x, 0.f, float(last));
+  }
+
+  uint32_t i0 = std::min(uint32_t(x), last - 1);
+  return {i0, i0 + 1, x - i0};
+}
+
+} // namespace explorer
@@ -0,0 +1,416 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#include "Fit.h"
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+// ours
+#include "Directions.h"
+#include "Parallel.h"
+
+namespace explorer {
+
+using namespace anari::math;
+
+namespace {
+
+// Directions per work item; small enough to give all threads work even
+// for low-resolution targets, large enough to amortize evalBatch()
+constexpr uint32_t ViewsPerItem = 1024;
+
+struct WorkItem
+{
+  uint64_t row;
+  uint32_t firstView;
+  uint32_t numViews;
+};
+
+// Normal equations, accumulated per thread and reduced after each pass
+struct Normals
+{
+  double cost{0.0};
+  std::vector<double> JtJ;
+  std::vector<double> Jtr;
+
+  void reset(size_t n)
+  {
+    cost = 0.0;
+    JtJ.assign(n * n, 0.0);
+    Jtr.assign(n, 0.0);
+  }
+};
+
+// Per worker state
+struct Worker
+{
+  std::unique_ptr<Material> mat;
+  std::vector<float3> base;
+  std::vector<float3> perturbed;
+  std::vector<double> residuals;
+  std::vector<double> jacobian; // n columns of residuals.size()
+  Normals normals;
+};
+
+static int numComponents(DataType type)
+{
+  switch (type) {
+  case DataType::Float:
+    return 1;
+  case DataType::Float2:
+    return 2;
+  case DataType::Float3:
+    return 3;
+  case DataType::Float4:
+    return 4;
+  }
+  return 0;
+}
+
+static void applyParams(const std::vector<FitParam> &params,
+                        const std::vector<double> &x,
+                        Material &mat)
+{
+  size_t k = 0;
+  for (auto &p : params) {
+    MaterialParam param{p.name, {}, p.type};
+    if (p.type == DataType::Float)
+      param.value = float(x[k]);
+    else if (p.type == DataType::Float2)
+      param.value = float2(x[k], x[k + 1]);
+    else if (p.type == DataType::Float3)
+      param.value = float3(x[k], x[k + 1], x[k + 2]);
+    else if (p.type == DataType::Float4)
+      param.value = float4(x[k], x[k + 1], x[k + 2], x[k + 3]);
+    mat.setParameter(param);
+    k += numComponents(p.type);
+  }
+}
+
+static void readParams(const std::vector<FitParam> &params,
+                       const Material &mat,
+                       std::vector<double> &x)
+{
+  for (auto &p : params) {
+    auto param = mat.getParameter(p.name);
+    if (param.type != p.type || !param.value.has_value())
+      throw std::runtime_error("cannot fit parameter " + p.name);
+
+    float v[4] = {};
+    if (p.type == DataType::Float) {
+      v[0] = std::any_cast<float>(param.value);
+    } else if (p.type == DataType::Float2) {
+      auto f = std::any_cast<float2>(param.value);
+      v[0] = f.x, v[1] = f.y;
+    } else if (p.type == DataType::Float3) {
+      auto f = std::any_cast<float3>(param.value);
+      v[0] = f.x, v[1] = f.y, v[2] = f.z;
+    } else if (p.type == DataType::Float4) {
+      auto f = std::any_cast<float4>(param.value);
+      v[0] = f.x, v[1] = f.y, v[2] = f.z, v[3] = f.w;
+    }
+
+    for (int c = 0; c < numComponents(p.type); ++c)
+      x.push_back(std::clamp<double>(v[c], p.minValue, p.maxValue));
+  }
+}
+
+static double metricValue(FitMetric metric, float value, float cosView)
+{
+  switch (metric) {
+  case FitMetric::L2:
+    return value;
+  case FitMetric::Cosine:
+    return double(value) * cosView;
+  case FitMetric::Log:
+    return std::log1p(std::max(0.0, double(value) * cosView));
+  }
+  return value;
+}
+
+// Solves (A + lambda * diag(A)) x = b with Cholesky, false if the
+// damped system isn't positive definite
+static bool solveDamped(const std::vector<double> &A,
+                        const std::vector<double> &b,
+                        double lambda,
+                        std::vector<double> &x)
+{
+  const size_t n = b.size();
+  std::vector<double> L(n * n, 0.0);
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t j = 0; j <= i; ++j) {
+      double sum = A[i * n + j];
+      if (i == j)
+        sum += lambda * A[i * n + i] + 1e-12;
+      for (size_t k = 0; k < j; ++k)
+        sum -= L[i * n + k] * L[j * n + k];
+      if (i == j) {
+        if (sum <= 0.0)
+          return false;
+        L[i * n + i] = std::sqrt(sum);
+      } else {
+        L[i * n + j] = sum / L[j * n + j];
+      }
+    }
+  }
+
+  x.assign(n, 0.0);
+  for (size_t i = 0; i < n; ++i) {
+    double sum = b[i];
+    for (size_t k = 0; k < i; ++k)
+      sum -= L[i * n + k] * x[k];
+    x[i] = sum / L[i * n + i];
+  }
+  for (size_t i = n; i-- > 0;) {
+    double sum = x[i];
+    for (size_t k = i + 1; k < n; ++k)
+      sum -= L[k * n + i] * x[k];
+    x[i] = sum / L[i * n + i];
+  }
+  return true;
+}
+
+} // namespace
+
+FitResult fitMaterial(const MappedSweepFile &target,
+                      const Preset &initial,
+                      const std::vector<FitParam> &params,
+                      const FitOptions &options)
+{
+  const SweepSpec &spec = target.info().spec;
+  if (spec.kind != SweepKind::Eval || !spec.params.empty()
+      || target.info().firstRow != 0
+      || target.info().numRows != spec.rowCount())
+    throw std::runtime_error("fit target must be a complete bake/sweep without param axes");
+
+  if (params.empty())
+    throw std::runtime_error("no parameters to fit");
+
+  const unsigned numThreads =
+      options.numThreads > 0 ? options.numThreads : hardwareThreads();
+
+  std::vector<Worker> workers(numThreads);
+  for (auto &w : workers) {
+    w.mat.reset(Material::createInstance(initial.subtype));
+    if (!w.mat)
+      throw std::runtime_error("cannot create material " + initial.subtype);
+    applyPreset(initial, *w.mat);
+  }
+
+  std::vector<double> x;
+  readParams(params, *workers[0].mat, x);
+
+  const size_t n = x.size();
+  std::vector<double> lo, hi;
+  for (auto &p : params) {
+    for (int c = 0; c < numComponents(p.type); ++c) {
+      lo.push_back(p.minValue);
+      hi.push_back(p.maxValue);
+    }
+  }
+
+  // Direction tables of the target
+  std::vector<float3> viewDirs;
+  std::vector<float> cosView;
+  for (uint32_t t = 0; t < spec.viewTheta.count; ++t) {
+    for (uint32_t p = 0; p < spec.viewPhi.count; ++p) {
+      float theta = radians(spec.viewTheta.value(t));
+      viewDirs.push_back(sphericalDirection(theta, radians(spec.viewPhi.value(p))));
+      cosView.push_back(std::max(0.f, cosf(theta)));
+    }
+  }
+
+  std::vector<float3> lightDirs;
+  for (uint32_t t = 0; t < spec.lightTheta.count; ++t) {
+    for (uint32_t p = 0; p < spec.lightPhi.count; ++p) {
+      lightDirs.push_back(sphericalDirection(
+          radians(spec.lightTheta.value(t)), radians(spec.lightPhi.value(p))));
+    }
+  }
+
+  std::vector<WorkItem> items;
+  const uint32_t rowSize = uint32_t(spec.rowSize());
+  for (uint64_t row = 0; row < spec.rowCount(); ++row) {
+    for (uint32_t v = 0; v < rowSize; v += ViewsPerItem)
+      items.push_back({row, v, std::min(ViewsPerItem, rowSize - v)});
+  }
+
+  const double numResiduals = double(spec.rowCount()) * rowSize * 3;
+  const float3 Ng{0.f, 1.f, 0.f}, Ns{0.f, 1.f, 0.f};
+  const float3 lightIntensity{1.f};
+
+  // One pass over the target: the cost at x and, if requested, the normal
+  // equations of the linearized problem, with the Jacobian from forward
+  // differences. Each item evaluates the base and all n perturbed
+  // parameter sets back to back on the same directions.
+  Normals total;
+  auto evaluate = [&](const std::vector<double> &x, bool withJacobian) {
+    std::vector<double> h(n);
+    for (size_t j = 0; j < n; ++j) {
+      h[j] = 1e-3 * (hi[j] - lo[j]);
+      if (x[j] + h[j] > hi[j])
+        h[j] = -h[j];
+    }
+
+    for (auto &w : workers)
+      w.normals.reset(n);
+
+    parallelFor(numThreads, items.size(), [&](unsigned threadID, size_t i) {
+      Worker &w = workers[threadID];
+      const WorkItem &item = items[i];
+      const float3 *targetValues = target.row(item.row) + item.firstView;
+      const size_t numValues = size_t(item.numViews) * 3;
+
+      w.base.resize(item.numViews);
+      w.perturbed.resize(item.numViews);
+      w.residuals.resize(numValues);
+
+      applyParams(params, x, *w.mat);
+      w.mat->evalBatch(Ng,
+          Ns,
+          viewDirs.data() + item.firstView,
+          item.numViews,
+          lightDirs[item.row],
+          lightIntensity,
+          w.base.data());
+
+      for (uint32_t v = 0; v < item.numViews; ++v) {
+        const float c = cosView[item.firstView + v];
+        for (int k = 0; k < 3; ++k) {
+          double r = metricValue(options.metric, w.base[v][k], c)
+              - metricValue(options.metric, targetValues[v][k], c);
+          w.residuals[v * 3 + k] = r;
+          w.normals.cost += r * r;
+        }
+      }
+
+      if (!withJacobian)
+        return;
+
+      w.jacobian.resize(n * numValues);
+      std::vector<double> xj = x;
+      for (size_t j = 0; j < n; ++j) {
+        xj[j] = x[j] + h[j];
+        applyParams(params, xj, *w.mat);
+        xj[j] = x[j];
+
+        w.mat->evalBatch(Ng,
+            Ns,
+            viewDirs.data() + item.firstView,
+            item.numViews,
+            lightDirs[item.row],
+            lightIntensity,
+            w.perturbed.data());
+
+        double *column = w.jacobian.data() + j * numValues;
+        for (uint32_t v = 0; v < item.numViews; ++v) {
+          const float c = cosView[item.firstView + v];
+          for (int k = 0; k < 3; ++k) {
+            column[v * 3 + k] = (metricValue(options.metric, w.perturbed[v][k], c)
+                                    - metricValue(options.metric, w.base[v][k], c))
+                / h[j];
+          }
+        }
+      }
+
+      for (size_t a = 0; a < n; ++a) {
+        const double *ca = w.jacobian.data() + a * numValues;
+        for (size_t b = 0; b <= a; ++b) {
+          const double *cb = w.jacobian.data() + b * numValues;
+          double sum = 0.0;
+          for (size_t r = 0; r < numValues; ++r)
+            sum += ca[r] * cb[r];
+          w.normals.JtJ[a * n + b] += sum;
+        }
+        double sum = 0.0;
+        for (size_t r = 0; r < numValues; ++r)
+          sum += ca[r] * w.residuals[r];
+        w.normals.Jtr[a] += sum;
+      }
+    });
+
+    total.reset(n);
+    for (auto &w : workers) {
+      total.cost += w.normals.cost;
+      for (size_t j = 0; j < n * n; ++j)
+        total.JtJ[j] += w.normals.JtJ[j];
+      for (size_t j = 0; j < n; ++j)
+        total.Jtr[j] += w.normals.Jtr[j];
+    }
+
+    for (size_t a = 0; a < n; ++a) {
+      for (size_t b = a + 1; b < n; ++b)
+        total.JtJ[a * n + b] = total.JtJ[b * n + a];
+    }
+
+    return total.cost;
+  };
+
+  FitResult result;
+
+  double cost = evaluate(x, true);
+  result.initialError = std::sqrt(cost / numResiduals);
+
+  double lambda = 1e-3;
+  std::vector<double> delta, xNew(n), negJtr(n);
+  Normals normals = total;
+
+  int iteration = 0;
+  for (; iteration < options.maxIterations; ++iteration) {
+    for (size_t j = 0; j < n; ++j)
+      negJtr[j] = -normals.Jtr[j];
+
+    bool improved = false;
+    double newCost = cost;
+    while (lambda < 1e10) {
+      if (solveDamped(normals.JtJ, negJtr, lambda, delta)) {
+        for (size_t j = 0; j < n; ++j)
+          xNew[j] = std::clamp(x[j] + delta[j], lo[j], hi[j]);
+
+        // a step that only pushes against the bounds changes nothing, no
+        // need to evaluate it; larger lambdas turn it towards the gradient
+        if (xNew != x) {
+          newCost = evaluate(xNew, false);
+          if (newCost < cost) {
+            improved = true;
+            break;
+          }
+        }
+      }
+      lambda *= 4.0;
+    }
+
+    if (!improved)
+      break;
+
+    const double relativeChange = (cost - newCost) / std::max(cost, 1e-30);
+
+    x = xNew;
+    cost = evaluate(x, true);
+    normals = total;
+    lambda = std::max(1e-9, lambda / 3.0);
+
+    if (options.verbose) {
+      fprintf(stderr, "[fit] iteration %d: rms %g (lambda %g)\n",
+          iteration, std::sqrt(cost / numResiduals), lambda);
+    }
+
+    if (relativeChange < 1e-7) {
+      ++iteration; // this one counts
+      break;
+    }
+  }
+
+  applyParams(params, x, *workers[0].mat);
+
+  result.preset = makePreset(initial.subtype, *workers[0].mat);
+  result.finalError = std::sqrt(cost / numResiduals);
+  result.iterations = iteration;
+  return result;
+}
+
+} // namespace explorer
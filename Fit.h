@@ -0,0 +1,58 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <string>
+#include <vector>
+// ours
+#include "material.h"
+#include "Preset.h"
+#include "Sweep.h"
+
+namespace explorer {
+
+enum class FitMetric
+{
+  L2, // plain differences of the eval() values
+  Cosine, // values weighted by cos(theta_view)
+  Log, // log(1 + cosine weighted value), de-emphasizes highlights
+};
+
+// A parameter to optimize; Float2/3/4 params are fit per component
+struct FitParam
+{
+  std::string name;
+  DataType type{DataType::Float};
+  float minValue{0.f};
+  float maxValue{1.f};
+};
+
+struct FitOptions
+{
+  FitMetric metric{FitMetric::Cosine};
+  int maxIterations{100};
+  unsigned numThreads{0}; // 0: use all cores
+  bool verbose{false};
+};
+
+struct FitResult
+{
+  Preset preset;
+  double initialError{0.0}; // RMS of the residuals
+  double finalError{0.0};
+  int iterations{0};
+};
+
+// Fits params of initial.subtype to a tabulated target (an Eval sweep
+// or bake without param axes) with Levenberg-Marquardt. Residuals and
+// the finite-difference Jacobian are evaluated in parallel batches of
+// directions; params not in params keep their values from initial.
+// Throws std::runtime_error if the target isn't suitable.
+FitResult fitMaterial(const MappedSweepFile &target,
+                      const Preset &initial,
+                      const std::vector<FitParam> &params,
+                      const FitOptions &options);
+
+} // namespace explorer
@@ -0,0 +1,561 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#include "Lobe.h"
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <typeinfo>
+// ours
+#include "Directions.h"
+#include "Parallel.h"
+
+namespace explorer {
+
+using namespace anari::math;
+
+// Directions per evalBatch() call, keeps the temporaries in cache
+constexpr size_t LobeBlockSize = 256;
+
+// For time-sliced evaluation: small enough that a slow plugin doesn't
+// overrun the budget by much
+constexpr size_t IncrementalBlockSize = 32;
+
+using Clock = std::chrono::steady_clock;
+
+static Clock::time_point deadlineIn(double budgetMs)
+{
+  return Clock::now()
+      + std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double, std::milli>(budgetMs));
+}
+
+static const float3 g_Ng{0.f, 1.f, 0.f};
+static const float3 g_Ns{0.f, 1.f, 0.f};
+static const float3 g_lightIntensity{1.f};
+
+// a - b for one block of directions, accumulating the error stats
+static void evalDifferenceBlock(const Material &a,
+                                const Material &b,
+                                const float3 *dirs,
+                                size_t n,
+                                float3 lightDir,
+                                float3 *diff,
+                                double &sumSquares,
+                                float &maxError)
+{
+  float3 valuesB[LobeBlockSize];
+
+  a.evalBatch(g_Ng, g_Ns, dirs, n, lightDir, g_lightIntensity, diff);
+  b.evalBatch(g_Ng, g_Ns, dirs, n, lightDir, g_lightIntensity, valuesB);
+
+  for (size_t i = 0; i < n; ++i) {
+    diff[i] -= valuesB[i];
+    for (int c = 0; c < 3; ++c) {
+      sumSquares += double(diff[i][c]) * diff[i][c];
+      maxError = std::max(maxError, fabsf(diff[i][c]));
+    }
+  }
+}
+
+SphereGrid makeSphereGrid(int segments)
+{
+  SphereGrid grid;
+  grid.segments = segments;
+  grid.directions.reserve((segments - 1) * segments);
+  grid.indices.reserve((segments - 2) * segments * 2);
+
+  for (int i = 0; i < segments-1; ++i) {
+    for (int j = 0; j < segments; ++j) {
+      float phi = M_PI * (i+1) / float(segments);
+      float theta = 2.f * M_PI * j / float(segments);
+      grid.directions.push_back(sphericalDirection(phi, theta));
+    }
+  }
+
+  for (int j = 0; j < segments-2; ++j) {
+    for (int i = 0; i < segments; ++i) {
+      int j0 = j * segments;
+      int j1 = (j+1) * segments;
+      unsigned idx0 = j0 + i;
+      unsigned idx1 = j0 + (i+1) % segments;
+      unsigned idx2 = j1 + (i+1) % segments;
+      unsigned idx3 = j1 + i;
+      grid.indices.push_back(uint3(idx0,idx1,idx2));
+      grid.indices.push_back(uint3(idx0,idx2,idx3));
+    }
+  }
+
+  return grid;
+}
+
+// Shared by the one- and three-channel versions: channels[c] is the value
+// component lobe c is scaled by
+static void lobeVerticesImpl(const SphereGrid &grid,
+                             const float3 *values,
+                             const int *channels,
+                             int numChannels,
+                             float3 *const *positions,
+                             float3 *const *normals)
+{
+  const int segments = grid.segments;
+  const int rings = segments - 1;
+
+  auto position = [&](int c, int ring, int column) {
+    size_t i = size_t(ring) * segments + (column + segments) % segments;
+    float scale = values ? fabsf(values[i][channels[c]]) : 1.f;
+    return grid.directions[i] * scale;
+  };
+
+  for (int ring = 0; ring < rings; ++ring) {
+    // one-sided differences at the rings next to the poles
+    const int ring0 = std::max(ring - 1, 0);
+    const int ring1 = std::min(ring + 1, rings - 1);
+
+    for (int column = 0; column < segments; ++column) {
+      size_t i = size_t(ring) * segments + column;
+
+      for (int c = 0; c < numChannels; ++c) {
+        positions[c][i] = position(c, ring, column);
+
+        float3 tangentRing =
+            position(c, ring1, column) - position(c, ring0, column);
+        float3 tangentColumn =
+            position(c, ring, column + 1) - position(c, ring, column - 1);
+
+        // same orientation as the grid's triangles (outward on the sphere)
+        float3 n = cross(tangentColumn, tangentRing);
+        float len = length(n);
+        normals[c][i] = len > 1e-20f ? n / len : grid.directions[i];
+      }
+    }
+  }
+}
+
+void lobeVertices(const SphereGrid &grid,
+                  const float3 *values,
+                  int channel,
+                  float3 *positions,
+                  float3 *normals)
+{
+  lobeVerticesImpl(grid, values, &channel, 1, &positions, &normals);
+}
+
+void lobeVerticesRGB(const SphereGrid &grid,
+                     const float3 *values,
+                     float3 *const positions[3],
+                     float3 *const normals[3])
+{
+  const int channels[3] = {0, 1, 2};
+  lobeVerticesImpl(grid, values, channels, 3, positions, normals);
+}
+
+void evalLobe(const Material &mat,
+              const SphereGrid &grid,
+              float3 lightDir,
+              float3 *values)
+{
+  mat.evalBatch(g_Ng,
+      g_Ns,
+      grid.directions.data(),
+      grid.directions.size(),
+      lightDir,
+      g_lightIntensity,
+      values);
+}
+
+LobeDifferenceStats evalLobeDifference(const Material &a,
+                                       const Material &b,
+                                       const SphereGrid &grid,
+                                       float3 lightDir,
+                                       float3 *difference)
+{
+  LobeDifferenceStats stats;
+  double sumSquares = 0.0;
+
+  const size_t count = grid.directions.size();
+  for (size_t first = 0; first < count; first += LobeBlockSize) {
+    const size_t n = std::min(LobeBlockSize, count - first);
+    evalDifferenceBlock(a,
+        b,
+        grid.directions.data() + first,
+        n,
+        lightDir,
+        difference + first,
+        sumSquares,
+        stats.maxError);
+  }
+
+  if (count > 0)
+    stats.l2Error = float(std::sqrt(sumSquares / (count * 3)));
+
+  return stats;
+}
+
+LobeDifferenceStats evalLobeParallel(
+    const std::vector<const Material *> &materials,
+    const std::vector<const Material *> &references,
+    const SphereGrid &grid,
+    float3 lightDir,
+    float3 *values)
+{
+  LobeDifferenceStats stats;
+  if (materials.empty())
+    return stats;
+
+  const bool difference = !references.empty();
+  const unsigned numThreads =
+      difference ? unsigned(std::min(materials.size(), references.size()))
+                 : unsigned(materials.size());
+
+  const size_t count = grid.directions.size();
+  const size_t numBlocks = (count + LobeBlockSize - 1) / LobeBlockSize;
+
+  std::vector<double> sumSquares(numThreads, 0.0);
+  std::vector<float> maxError(numThreads, 0.f);
+
+  parallelFor(numThreads, numBlocks, [&](unsigned threadID, size_t block) {
+    const size_t first = block * LobeBlockSize;
+    const size_t n = std::min(LobeBlockSize, count - first);
+    const float3 *dirs = grid.directions.data() + first;
+
+    if (difference) {
+      evalDifferenceBlock(*materials[threadID],
+          *references[threadID],
+          dirs,
+          n,
+          lightDir,
+          values + first,
+          sumSquares[threadID],
+          maxError[threadID]);
+    } else {
+      materials[threadID]->evalBatch(
+          g_Ng, g_Ns, dirs, n, lightDir, g_lightIntensity, values + first);
+    }
+  });
+
+  if (difference && count > 0) {
+    double sum = 0.0;
+    for (unsigned t = 0; t < numThreads; ++t) {
+      sum += sumSquares[t];
+      stats.maxError = std::max(stats.maxError, maxError[t]);
+    }
+    stats.l2Error = float(std::sqrt(sum / (count * 3)));
+  }
+
+  return stats;
+}
+
+// LobeSensitivityEvaluator //
+
+LobeSensitivity LobeSensitivityEvaluator::evaluate(std::string_view subtype,
+                                                   const Material &mat,
+                                                   const SphereGrid &grid,
+                                                   float3 lightDir,
+                                                   float3 *values,
+                                                   float epsilon,
+                                                   unsigned numThreads)
+{
+  const size_t count = grid.directions.size();
+  const size_t numBlocks = (count + LobeBlockSize - 1) / LobeBlockSize;
+  if (numThreads == 0)
+    numThreads = hardwareThreads();
+  numThreads = unsigned(std::max<size_t>(1, std::min<size_t>(numThreads, numBlocks)));
+
+  prepare(subtype, mat, epsilon, numThreads);
+
+  LobeSensitivity result;
+  result.params = m_params;
+  result.derivatives.resize(m_params.size() * count);
+
+  parallelFor(numThreads, numBlocks, [&](unsigned threadID, size_t block) {
+    const size_t first = block * LobeBlockSize;
+    evalBlock(threadID,
+        grid,
+        first,
+        std::min(LobeBlockSize, count - first),
+        lightDir,
+        values,
+        result);
+  });
+
+  return result;
+}
+
+void LobeSensitivityEvaluator::start(std::string_view subtype,
+                                     const Material &mat,
+                                     const SphereGrid &grid,
+                                     float3 lightDir,
+                                     float epsilon)
+{
+  prepare(subtype, mat, epsilon, 1);
+
+  m_count = grid.directions.size();
+  m_next = 0;
+  m_lightDir = lightDir;
+  m_result.params = m_params;
+  // like the values, derivatives that weren't reached yet stay as they were
+  m_result.derivatives.resize(m_params.size() * m_count);
+}
+
+void LobeSensitivityEvaluator::step(const SphereGrid &grid,
+                                    float3 *values,
+                                    double budgetMs)
+{
+  const auto deadline = deadlineIn(budgetMs);
+
+  const size_t count = std::min(m_count, grid.directions.size());
+  while (m_next < count) {
+    const size_t n = std::min(IncrementalBlockSize, count - m_next);
+    evalBlock(0, grid, m_next, n, m_lightDir, values, m_result);
+    m_next += n;
+    if (Clock::now() >= deadline)
+      break;
+  }
+}
+
+void LobeSensitivityEvaluator::cancel()
+{
+  m_next = m_count;
+}
+
+bool LobeSensitivityEvaluator::done() const
+{
+  return m_next >= m_count;
+}
+
+float LobeSensitivityEvaluator::progress() const
+{
+  return m_count > 0 ? float(m_next) / m_count : 1.f;
+}
+
+const LobeSensitivity &LobeSensitivityEvaluator::result() const
+{
+  return m_result;
+}
+
+void LobeSensitivityEvaluator::clear()
+{
+  m_copies.clear();
+  m_params.clear();
+  m_subtype.clear();
+  m_numThreads = 0;
+  m_result = {};
+  m_count = m_next = 0;
+}
+
+void LobeSensitivityEvaluator::prepare(std::string_view subtype,
+                                       const Material &mat,
+                                       float epsilon,
+                                       unsigned numThreads)
+{
+  const auto supported = Material::querySupportedParams(subtype);
+
+  std::vector<std::string> params;
+  for (auto &param : supported) {
+    if (param.type == DataType::Float
+        && mat.getParameter(param.name).value.type() == typeid(float))
+      params.push_back(param.name);
+  }
+
+  const size_t perThread = 2 * params.size() + 1;
+
+  if (subtype != m_subtype || params != m_params || numThreads != m_numThreads
+      || m_copies.size() != numThreads * perThread) {
+    clear();
+    m_copies.resize(numThreads * perThread);
+    for (auto &copy : m_copies) {
+      copy.reset(Material::cloneInstance(subtype, mat));
+      if (!copy) {
+        clear();
+        throw std::runtime_error("cannot copy material " + std::string(subtype));
+      }
+    }
+    m_subtype = std::string(subtype);
+    m_params = std::move(params);
+    m_numThreads = numThreads;
+  } else {
+    // same instances, only the values change
+    for (auto &param : supported) {
+      auto actual = mat.getParameter(param.name);
+      if (!actual.value.has_value())
+        continue;
+      for (auto &copy : m_copies)
+        copy->setParameter(actual);
+    }
+  }
+
+  m_epsilon = epsilon;
+  for (unsigned t = 0; t < numThreads; ++t) {
+    for (size_t p = 0; p < m_params.size(); ++p) {
+      float v = std::any_cast<float>(mat.getParameter(m_params[p]).value);
+      m_copies[t * perThread + 1 + 2 * p]->setParameter(
+          {m_params[p], std::any(v - epsilon), DataType::Float});
+      m_copies[t * perThread + 2 + 2 * p]->setParameter(
+          {m_params[p], std::any(v + epsilon), DataType::Float});
+    }
+  }
+}
+
+void LobeSensitivityEvaluator::evalBlock(unsigned threadID,
+                                         const SphereGrid &grid,
+                                         size_t first,
+                                         size_t n,
+                                         float3 lightDir,
+                                         float3 *values,
+                                         LobeSensitivity &result) const
+{
+  const size_t count = grid.directions.size();
+  const size_t numParams = m_params.size();
+  const size_t perThread = 2 * numParams + 1;
+  const float3 *dirs = grid.directions.data() + first;
+
+  const auto *copies = &m_copies[threadID * perThread];
+  copies[0]->evalBatch(g_Ng, g_Ns, dirs, n, lightDir, g_lightIntensity, values + first);
+
+  float3 minus[LobeBlockSize], plus[LobeBlockSize];
+  for (size_t p = 0; p < numParams; ++p) {
+    copies[1 + 2 * p]->evalBatch(
+        g_Ng, g_Ns, dirs, n, lightDir, g_lightIntensity, minus);
+    copies[2 + 2 * p]->evalBatch(
+        g_Ng, g_Ns, dirs, n, lightDir, g_lightIntensity, plus);
+
+    float *d = &result.derivatives[p * count + first];
+    for (size_t i = 0; i < n; ++i) {
+      float v = (plus[i].y - minus[i].y) / (2.f * m_epsilon);
+      d[i] = std::isfinite(v) ? v : 0.f;
+    }
+  }
+}
+
+void polarSlice(const SphereGrid &grid,
+                const float3 *values,
+                float3 lightDir,
+                std::vector<float> &slice)
+{
+  const int segments = grid.segments;
+  const int rings = segments - 1;
+
+  auto sample = [&](float phi, int ring) {
+    float u = phi / (2.f * float(M_PI)) * segments;
+    u -= floorf(u / segments) * segments;
+    int j0 = std::min(int(u), segments - 1);
+    int j1 = (j0 + 1) % segments;
+    float f = u - j0;
+    const float3 *row = values + ring * segments;
+    return (1.f - f) * row[j0].y + f * row[j1].y;
+  };
+
+  const float phiLight = atan2f(lightDir.z, lightDir.x);
+
+  slice.resize(2 * rings);
+  for (int r = 0; r < rings; ++r) {
+    slice[rings - 1 - r] = sample(phiLight + float(M_PI), r);
+    slice[rings + r] = sample(phiLight, r);
+  }
+}
+
+void resampleLobe(const SphereGrid &from,
+                  const float3 *values,
+                  const SphereGrid &to,
+                  float3 *result)
+{
+  const int segments = from.segments;
+  const int rings = segments - 1;
+
+  // ring r is at polar angle pi * (r+1) / segments, column j at azimuth
+  // 2 pi * j / segments, so both map linearly between the grids
+  for (int r = 0; r < to.segments - 1; ++r) {
+    float v = float(r + 1) * segments / to.segments - 1.f;
+    v = std::clamp(v, 0.f, float(rings - 1));
+    int r0 = std::min(int(v), rings - 1);
+    int r1 = std::min(r0 + 1, rings - 1);
+    float fr = v - r0;
+
+    for (int j = 0; j < to.segments; ++j) {
+      float u = float(j) * segments / to.segments;
+      int j0 = std::min(int(u), segments - 1);
+      int j1 = (j0 + 1) % segments;
+      float fj = u - j0;
+
+      const float3 *row0 = values + r0 * segments;
+      const float3 *row1 = values + r1 * segments;
+      float3 a = (1.f - fj) * row0[j0] + fj * row0[j1];
+      float3 b = (1.f - fj) * row1[j0] + fj * row1[j1];
+      result[size_t(r) * to.segments + j] = (1.f - fr) * a + fr * b;
+    }
+  }
+}
+
+// IncrementalLobe //
+
+void IncrementalLobe::start(size_t count, float3 lightDir)
+{
+  m_count = count;
+  m_next = 0;
+  m_lightDir = lightDir;
+  m_sumSquares = 0.0;
+  m_maxError = 0.f;
+}
+
+size_t IncrementalLobe::step(const Material &mat,
+                             const Material *reference,
+                             const SphereGrid &grid,
+                             float3 *values,
+                             double budgetMs)
+{
+  const auto deadline = deadlineIn(budgetMs);
+
+  const size_t first = m_next;
+  const size_t count = std::min(m_count, grid.directions.size());
+
+  while (m_next < count) {
+    const size_t n = std::min(IncrementalBlockSize, count - m_next);
+    const float3 *dirs = grid.directions.data() + m_next;
+
+    if (reference) {
+      evalDifferenceBlock(mat,
+          *reference,
+          dirs,
+          n,
+          m_lightDir,
+          values + m_next,
+          m_sumSquares,
+          m_maxError);
+    } else {
+      mat.evalBatch(
+          g_Ng, g_Ns, dirs, n, m_lightDir, g_lightIntensity, values + m_next);
+    }
+
+    m_next += n;
+    if (Clock::now() >= deadline)
+      break;
+  }
+
+  return m_next - first;
+}
+
+bool IncrementalLobe::done() const
+{
+  return m_next >= m_count;
+}
+
+float IncrementalLobe::progress() const
+{
+  return m_count > 0 ? float(m_next) / m_count : 1.f;
+}
+
+LobeDifferenceStats IncrementalLobe::differenceStats() const
+{
+  LobeDifferenceStats stats;
+  stats.maxError = m_maxError;
+  if (m_next > 0)
+    stats.l2Error = float(std::sqrt(m_sumSquares / (m_next * 3)));
+  return stats;
+}
+
+} // namespace explorer
@@ -0,0 +1,210 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+// anari
+#include <anari/anari_cpp/ext/linalg.h>
+// ours
+#include "material.h"
+
+namespace explorer {
+
+// Directions and triangles of the sphere the lobe is built from: segments-1
+// rings (poles excluded) of segments vertices each. Only depends on the
+// resolution, so it can be shared by everything that draws lobes.
+struct SphereGrid
+{
+  int segments{0};
+  std::vector<anari::math::float3> directions;
+  std::vector<anari::math::uint3> indices;
+};
+
+SphereGrid makeSphereGrid(int segments);
+
+// Lobe surface vertices: positions are the directions scaled by
+// |values[i][channel]| (the unit sphere if values is null). Normals are
+// computed in the same pass from the neighbouring radii (central
+// differences along the rings and azimuths), so the surface shades
+// smoothly without a finer grid.
+void lobeVertices(const SphereGrid &grid,
+                  const anari::math::float3 *values,
+                  int channel,
+                  anari::math::float3 *positions,
+                  anari::math::float3 *normals);
+
+// lobeVertices() for all three channels in one traversal of the grid
+// (one lobe each, for the RGB view)
+void lobeVerticesRGB(const SphereGrid &grid,
+                     const anari::math::float3 *values,
+                     anari::math::float3 *const positions[3],
+                     anari::math::float3 *const normals[3]);
+
+// BRDF values for all grid directions (as view dirs) under lightDir
+void evalLobe(const Material &mat,
+              const SphereGrid &grid,
+              anari::math::float3 lightDir,
+              anari::math::float3 *values);
+
+struct LobeDifferenceStats
+{
+  float l2Error{0.f}; // RMS over all directions and channels
+  float maxError{0.f};
+};
+
+// Evaluates a and b on the same directions in a single traversal and
+// writes a-b; both materials see each direction block back to back
+LobeDifferenceStats evalLobeDifference(const Material &a,
+                                       const Material &b,
+                                       const SphereGrid &grid,
+                                       anari::math::float3 lightDir,
+                                       anari::math::float3 *difference);
+
+// evalLobe() (references empty) or evalLobeDifference() on one thread
+// per material; all materials must have the same params (e.g., be
+// clones), as do all references. Blocks of directions are handed out
+// dynamically, so results don't depend on the number of threads.
+LobeDifferenceStats evalLobeParallel(
+    const std::vector<const Material *> &materials,
+    const std::vector<const Material *> &references,
+    const SphereGrid &grid,
+    anari::math::float3 lightDir,
+    anari::math::float3 *values);
+
+// Finite differences of value.y w.r.t. the Float params of a subtype
+struct LobeSensitivity
+{
+  std::vector<std::string> params;
+  std::vector<float> derivatives; // [param][direction], d value.y / d param
+};
+
+// Evaluates mat (into values) and, for every Float param, two copies
+// with the param moved by -/+ epsilon (central differences; params have
+// no documented range, so the values aren't clamped). All of them are
+// evaluated in a single parallel pass: every thread has its own copies
+// and evaluates them back to back on each block of directions, so the
+// cost is that of 2 * params + 1 lobes, with no extra traversals.
+//
+// The copies are kept between calls and only get mat's current param
+// values; they're created again when the subtype, its Float params or the
+// number of threads change. Like all materials, they must be destroyed
+// (clear()) before the plugin is unloaded.
+class LobeSensitivityEvaluator
+{
+ public:
+  LobeSensitivityEvaluator() = default;
+  LobeSensitivityEvaluator(const LobeSensitivityEvaluator &) = delete;
+  LobeSensitivityEvaluator &operator=(const LobeSensitivityEvaluator &) = delete;
+
+  // Throws std::runtime_error if mat can't be copied
+  LobeSensitivity evaluate(std::string_view subtype,
+                           const Material &mat,
+                           const SphereGrid &grid,
+                           anari::math::float3 lightDir,
+                           anari::math::float3 *values,
+                           float epsilon = 0.01f,
+                           unsigned numThreads = 0);
+
+  // evaluate() in time slices on the calling thread, for plugins that
+  // must not be used from other threads: start() prepares the copies
+  // (throws like evaluate()), every step() evaluates blocks of directions
+  // until budgetMs have passed (at least one block). values and result()
+  // are complete once done(); grid must stay the same in between.
+  void start(std::string_view subtype,
+             const Material &mat,
+             const SphereGrid &grid,
+             anari::math::float3 lightDir,
+             float epsilon = 0.01f);
+  void step(const SphereGrid &grid,
+            anari::math::float3 *values,
+            double budgetMs);
+  void cancel(); // stops stepping, keeps the copies
+  bool done() const;
+  float progress() const; // in [0,1]
+  const LobeSensitivity &result() const;
+
+  void clear();
+
+ private:
+  void prepare(std::string_view subtype,
+               const Material &mat,
+               float epsilon,
+               unsigned numThreads);
+
+  void evalBlock(unsigned threadID,
+                 const SphereGrid &grid,
+                 size_t first,
+                 size_t n,
+                 anari::math::float3 lightDir,
+                 anari::math::float3 *values,
+                 LobeSensitivity &result) const;
+
+  std::string m_subtype;
+  std::vector<std::string> m_params; // the Float params
+  float m_epsilon{0.f};
+  unsigned m_numThreads{0};
+  // per thread: the material, then the -/+ copies of each param
+  std::vector<std::unique_ptr<Material>> m_copies;
+
+  // time-sliced evaluation
+  size_t m_count{0};
+  size_t m_next{0};
+  anari::math::float3 m_lightDir{0.f, 1.f, 0.f};
+  LobeSensitivity m_result;
+};
+
+// value.y along the great circle through the normal and lightDir, over
+// the signed polar angle in (-pi,pi) with positive angles on the light's
+// side; linearly interpolated between the grid's two nearest azimuths
+void polarSlice(const SphereGrid &grid,
+                const anari::math::float3 *values,
+                anari::math::float3 lightDir,
+                std::vector<float> &slice);
+
+// Bilinear resampling of values (one per direction of from) onto the
+// directions of to, e.g. to keep showing a lobe while it's evaluated
+// again at another resolution
+void resampleLobe(const SphereGrid &from,
+                  const anari::math::float3 *values,
+                  const SphereGrid &to,
+                  anari::math::float3 *result);
+
+// Evaluates a lobe (or a difference lobe) in time slices on the calling
+// thread, for plugins and devices that must not be used from other
+// threads: every step() evaluates blocks of directions, ring by ring, until
+// its budget is used up, so the lobe fills in over several frames. Values
+// of directions that weren't reached yet are left as they were.
+class IncrementalLobe
+{
+ public:
+  // Starts over on count directions (the grid's)
+  void start(size_t count, anari::math::float3 lightDir);
+
+  // Evaluates at least one block, then continues until budgetMs have
+  // passed; returns the number of directions evaluated
+  size_t step(const Material &mat,
+              const Material *reference,
+              const SphereGrid &grid,
+              anari::math::float3 *values,
+              double budgetMs);
+
+  bool done() const;
+  float progress() const; // in [0,1]
+
+  // Of the directions evaluated so far, when a reference was given
+  LobeDifferenceStats differenceStats() const;
+
+ private:
+  size_t m_count{0};
+  size_t m_next{0};
+  anari::math::float3 m_lightDir{0.f, 1.f, 0.f};
+  double m_sumSquares{0.0};
+  float m_maxError{0.f};
+};
+
+} // namespace explorer
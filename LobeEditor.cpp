@@ -0,0 +1,216 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#include "LobeEditor.h"
+// std
+#include <cfloat>
+// ours
+#include "AllocTracker.h"
+#include "material.h"
+
+namespace windows {
+
+LobeEditor::LobeEditor(
+    LobeSettings &settings, std::string &selectedMaterial, const char *name)
+  : Window(name, true)
+  , m_settings(settings)
+  , m_selectedMaterial(selectedMaterial)
+{
+}
+
+LobeEditor::~LobeEditor() {}
+
+void LobeEditor::setUpdateCallback(LobeUpdateCallback cb)
+{
+  m_updateCallback = cb;
+}
+
+void LobeEditor::setViewCallback(LobeUpdateCallback cb)
+{
+  m_viewCallback = cb;
+}
+
+void LobeEditor::setReferenceCallback(LobeUpdateCallback cb)
+{
+  m_referenceCallback = cb;
+}
+
+void LobeEditor::buildUI()
+{
+  explorer::AllocScope scope(explorer::AllocPhase::UIBuild);
+
+  bool updated = false;
+  bool viewUpdated = false;
+
+  viewUpdated |= ImGui::Checkbox("Lobe", &m_settings.showLobe);
+  ImGui::SameLine();
+  viewUpdated |= ImGui::Checkbox("RGB", &m_settings.rgbLobes);
+  ImGui::SameLine();
+  viewUpdated |= ImGui::Checkbox("Heat sphere", &m_settings.showHeatSphere);
+  ImGui::SameLine();
+  ImGui::Checkbox("Polar slice", &m_settings.showPolarSlice);
+
+  if (m_settings.showPolarSlice && !m_settings.polarSlice.empty()) {
+    ImGui::PlotLines("##polarSlice",
+        m_settings.polarSlice.data(),
+        int(m_settings.polarSlice.size()),
+        0,
+        "value.y, plane of incidence (-180..180 deg)",
+        FLT_MAX,
+        FLT_MAX,
+        ImVec2(0.f, 150.f));
+  }
+
+  ImGui::Separator();
+
+  ImGui::Checkbox("Auto quality", &m_settings.autoQuality);
+  if (m_settings.autoQuality) {
+    // picked up by the next update
+    ImGui::SliderFloat("Target latency (ms)",
+        &m_settings.targetLatencyMs, 5.f, 200.f, "%.0f");
+    ImGui::Text("%i segments, %i thread(s)",
+        m_settings.segments, m_settings.lobeThreads);
+    if (m_settings.lastLatencyMs > 0.f) {
+      ImGui::TextDisabled("last update %.1f ms (eval %.0f ns/sample, "
+                          "update %.0f ns/vertex)",
+          m_settings.lastLatencyMs,
+          m_settings.evalNsPerSample,
+          m_settings.updateNsPerVertex);
+    }
+  } else {
+    updated |= ImGui::SliderInt("Segments", &m_settings.segments, 16, 400);
+  }
+
+  ImGui::Separator();
+
+  if (ImGui::Button("Set reference")) {
+    m_referenceCallback();
+    updated |= m_settings.compare;
+  }
+
+  if (!m_settings.referenceSubtype.empty()) {
+    ImGui::SameLine();
+    ImGui::Text("(%s)", m_settings.referenceSubtype.c_str());
+
+    updated |= ImGui::Checkbox("Compare with reference", &m_settings.compare);
+
+    if (m_settings.compare) {
+      viewUpdated |=
+          ImGui::Checkbox("Signed difference", &m_settings.signedDifference);
+      if (m_settings.signedDifference)
+        ImGui::TextDisabled("red: current > reference, blue: current < reference");
+      ImGui::Text("L2 error:  %g", m_settings.l2Error);
+      ImGui::Text("max error: %g", m_settings.maxError);
+    }
+  } else {
+    ImGui::TextDisabled("no reference material");
+  }
+
+  ImGui::Separator();
+
+  updated |= ImGui::Checkbox("Sensitivity", &m_settings.showSensitivity);
+
+  if (m_settings.showSensitivity) {
+    const char *current = m_settings.sensitivityParam.empty()
+        ? "all params"
+        : m_settings.sensitivityParam.c_str();
+    if (ImGui::BeginCombo("Param", current)) {
+      if (ImGui::Selectable("all params", m_settings.sensitivityParam.empty())) {
+        m_settings.sensitivityParam.clear();
+        viewUpdated = true;
+      }
+      for (const auto &name : m_settings.sensitivityParams) {
+        if (ImGui::Selectable(name.c_str(), name == m_settings.sensitivityParam)) {
+          m_settings.sensitivityParam = name;
+          viewUpdated = true;
+        }
+      }
+      ImGui::EndCombo();
+    }
+
+    if (m_settings.sensitivityParam.empty()) {
+      for (size_t i = 0; i < m_settings.sensitivityParams.size(); ++i) {
+        auto c = sensitivityColor(i);
+        ImGui::TextColored(ImVec4(c.x, c.y, c.z, 1.f),
+            "%s",
+            m_settings.sensitivityParams[i].c_str());
+      }
+    } else {
+      ImGui::TextDisabled("black: insensitive, white: most sensitive");
+    }
+  }
+
+  ImGui::Separator();
+
+  updated |= ImGui::Checkbox("Grid", &m_settings.showGrid);
+
+  if (m_settings.showGrid) {
+    updated |= buildGridAxisUI("Columns", m_settings.gridColumns);
+    updated |= buildGridAxisUI("Rows", m_settings.gridRows);
+    updated |= ImGui::SliderInt(
+        "Grid segments", &m_settings.gridSegments, 16, 200);
+
+    const int numCells = m_settings.gridColumns.count * m_settings.gridRows.count;
+    if (m_settings.gridCellsDone < numCells)
+      ImGui::Text("%i/%i cells", m_settings.gridCellsDone, numCells);
+  }
+
+  ImGui::Separator();
+
+  updated |= ImGui::Checkbox("Incremental (UI thread)", &m_settings.incremental);
+
+  if (m_settings.incremental) {
+    // only affects the following frames, no need to start over
+    ImGui::SliderFloat(
+        "Frame budget (ms)", &m_settings.frameBudgetMs, 0.5f, 33.f, "%.1f");
+    if (m_settings.lobeProgress < 1.f)
+      ImGui::ProgressBar(m_settings.lobeProgress);
+  }
+
+  if (updated)
+    m_updateCallback();
+  else if (viewUpdated)
+    m_viewCallback();
+}
+
+bool LobeEditor::buildGridAxisUI(const char *label, explorer::LobeGridAxis &axis)
+{
+  bool updated = false;
+
+  ImGui::PushID(label);
+
+  if (ImGui::BeginCombo(label, axis.name.c_str())) {
+    std::vector<std::string> names{"lightTheta"};
+    for (const auto &p : explorer::Material::querySupportedParams(m_selectedMaterial)) {
+      if (p.type == explorer::DataType::Float)
+        names.push_back(p.name);
+    }
+
+    for (const auto &name : names) {
+      if (ImGui::Selectable(name.c_str(), name == axis.name)
+          && name != axis.name) {
+        axis.name = name;
+        // degrees for the light, the param editor's range otherwise
+        axis.minValue = 0.f;
+        axis.maxValue = name == "lightTheta" ? 80.f : 1.f;
+        updated = true;
+      }
+    }
+    ImGui::EndCombo();
+  }
+
+  float range[] = {axis.minValue, axis.maxValue};
+  if (ImGui::DragFloat2("min/max", range, 0.01f)) {
+    axis.minValue = range[0];
+    axis.maxValue = range[1];
+    updated = true;
+  }
+
+  updated |= ImGui::SliderInt("count", &axis.count, 1, 8);
+
+  ImGui::PopID();
+
+  return updated;
+}
+
+} // namespace windows
@@ -0,0 +1,111 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// anari
+#include "anari_viewer/windows/Window.h"
+// std
+#include <functional>
+#include <string>
+#include <vector>
+// ours
+#include "LobeGrid.h"
+
+namespace windows {
+
+// How the lobe is visualized; owned by the application, edited here
+struct LobeSettings
+{
+  // Views, all derived from the same evaluation
+  bool showLobe{true};
+  bool rgbLobes{false}; // one lobe per channel instead of value.y only
+  bool showHeatSphere{false};
+  bool showPolarSlice{true};
+
+  // Lobe resolution; with autoQuality, it and the number of threads that
+  // evaluate the lobe are chosen to keep updates near targetLatencyMs
+  int segments{100};
+  bool autoQuality{true};
+  float targetLatencyMs{33.f};
+
+  // Difference lobe: current material minus a snapshot ("reference")
+  bool compare{false};
+  bool signedDifference{true};
+  std::string referenceSubtype; // empty until a reference was taken
+
+  // Sensitivity: the lobe colored by d value.y / d param of one Float
+  // param (heat colors), or of all of them (each direction in the color of
+  // the param it's most sensitive to)
+  bool showSensitivity{false};
+  std::string sensitivityParam; // empty: all params
+  std::vector<std::string> sensitivityParams; // evaluated ones
+
+  // Small multiples: a grid of lobes over one or two swept parameters
+  bool showGrid{false};
+  explorer::LobeGridAxis gridColumns{"roughness", 0.f, 1.f, 4};
+  explorer::LobeGridAxis gridRows{"lightTheta", 0.f, 80.f, 4};
+  int gridSegments{100};
+
+  // Evaluate on the UI thread, spending at most frameBudgetMs per frame
+  // (for plugins that must not be called from other threads)
+  bool incremental{false};
+  float frameBudgetMs{4.f};
+
+  // Output of the last lobe update, for display only
+  float l2Error{0.f};
+  float maxError{0.f};
+  std::vector<float> polarSlice;
+  int gridCellsDone{0};
+  float lobeProgress{1.f}; // of the incremental evaluation
+  int lobeThreads{1};
+  float evalNsPerSample{0.f};
+  float updateNsPerVertex{0.f};
+  float lastLatencyMs{0.f};
+};
+
+// Colors of the params in the sensitivity view (all params)
+inline anari::math::float3 sensitivityColor(size_t param)
+{
+  const anari::math::float3 palette[] = {{0.9f, 0.3f, 0.2f},
+      {0.3f, 0.75f, 0.3f},
+      {0.25f, 0.45f, 0.95f},
+      {0.95f, 0.8f, 0.2f},
+      {0.75f, 0.35f, 0.85f},
+      {0.2f, 0.8f, 0.85f},
+      {0.95f, 0.55f, 0.15f},
+      {0.6f, 0.6f, 0.6f}};
+  return palette[param % (sizeof(palette) / sizeof(palette[0]))];
+}
+
+using LobeUpdateCallback = std::function<void()>;
+
+class LobeEditor : public anari_viewer::windows::Window
+{
+ public:
+  LobeEditor(LobeSettings &settings,
+             std::string &selectedMaterial,
+             const char *name = "Lobe Editor");
+  ~LobeEditor();
+
+  // Called when settings changed and the lobe needs to be re-evaluated
+  void setUpdateCallback(LobeUpdateCallback cb);
+  // Called when only the views changed (no re-evaluation needed)
+  void setViewCallback(LobeUpdateCallback cb);
+  // Called to snapshot the current material as the comparison reference
+  void setReferenceCallback(LobeUpdateCallback cb);
+
+  void buildUI() override;
+
+ private:
+  bool buildGridAxisUI(const char *label, explorer::LobeGridAxis &axis);
+
+  LobeUpdateCallback m_updateCallback;
+  LobeUpdateCallback m_viewCallback;
+  LobeUpdateCallback m_referenceCallback;
+
+  LobeSettings &m_settings;
+  std::string &m_selectedMaterial;
+};
+
+} // namespace windows
@@ -0,0 +1,196 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#include "LobeGrid.h"
+
+// std
+#include <chrono>
+// ours
+#include "Directions.h"
+#include "Parallel.h"
+
+namespace explorer {
+
+using namespace anari::math;
+
+LobeGridBuilder::~LobeGridBuilder()
+{
+  cancel();
+}
+
+void LobeGridBuilder::start(std::string_view subtype,
+                            const Material &mat,
+                            float3 lightDir,
+                            int segments,
+                            const LobeGridAxis &columns,
+                            const LobeGridAxis &rows,
+                            unsigned numThreads)
+{
+  cancel();
+  prepare(lightDir, segments, columns, rows);
+
+  const size_t numCells = m_cellValues.size();
+  if (numThreads == 0)
+    numThreads = hardwareThreads();
+  numThreads = unsigned(std::min<size_t>(numThreads, numCells));
+
+  m_materials.resize(numThreads);
+  for (auto &m : m_materials)
+    m.reset(Material::cloneInstance(subtype, mat));
+
+  for (unsigned i = 0; i < numThreads; ++i)
+    m_threads.emplace_back(&LobeGridBuilder::worker, this, i);
+}
+
+void LobeGridBuilder::startOnCallingThread(std::string_view subtype,
+                                           const Material &mat,
+                                           float3 lightDir,
+                                           int segments,
+                                           const LobeGridAxis &columns,
+                                           const LobeGridAxis &rows)
+{
+  cancel();
+  prepare(lightDir, segments, columns, rows);
+
+  m_materials.resize(1);
+  m_materials[0].reset(Material::cloneInstance(subtype, mat));
+  m_onCallingThread = true;
+}
+
+void LobeGridBuilder::step(double budgetMs)
+{
+  if (!m_onCallingThread || m_materials.empty() || !m_materials[0])
+    return;
+
+  using Clock = std::chrono::steady_clock;
+  const auto start = Clock::now();
+  auto remainingMs = [&]() {
+    return budgetMs
+        - std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  };
+
+  Material &mat = *m_materials[0];
+  const size_t numCells = m_cellValues.size();
+  while (m_nextCell < numCells && remainingMs() > 0.0) {
+    const size_t cell = m_nextCell;
+    if (!m_cellStarted) {
+      m_cellLobe.start(m_grid.directions.size(), setupCell(mat, cell));
+      m_cellStarted = true;
+    }
+
+    m_cellLobe.step(
+        mat, nullptr, m_grid, m_cellValues[cell].data(), remainingMs());
+
+    if (m_cellLobe.done()) {
+      m_cellStarted = false;
+      m_nextCell++;
+      cellDone(cell);
+    }
+  }
+}
+
+void LobeGridBuilder::cancel()
+{
+  m_cancel = true;
+  for (auto &t : m_threads)
+    t.join();
+  m_threads.clear();
+  m_materials.clear();
+  m_onCallingThread = false;
+  m_cellStarted = false;
+}
+
+std::vector<size_t> LobeGridBuilder::takeFinished()
+{
+  std::vector<size_t> result;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::swap(result, m_finished);
+  return result;
+}
+
+bool LobeGridBuilder::busy() const
+{
+  return (!m_threads.empty() || m_onCallingThread)
+      && m_numDone < m_cellValues.size();
+}
+
+size_t LobeGridBuilder::numCells() const
+{
+  return m_cellValues.size();
+}
+
+const SphereGrid &LobeGridBuilder::sphereGrid() const
+{
+  return m_grid;
+}
+
+const std::vector<float3> &LobeGridBuilder::cellValues(size_t cell) const
+{
+  return m_cellValues[cell];
+}
+
+void LobeGridBuilder::prepare(float3 lightDir,
+                              int segments,
+                              const LobeGridAxis &columns,
+                              const LobeGridAxis &rows)
+{
+  if (m_grid.segments != segments)
+    m_grid = makeSphereGrid(segments);
+
+  m_columns = columns;
+  m_rows = rows;
+  m_lightDir = lightDir;
+
+  const size_t numCells = size_t(columns.count) * rows.count;
+  m_cellValues.resize(numCells);
+  for (auto &values : m_cellValues)
+    values.resize(m_grid.directions.size());
+
+  m_finished.clear();
+  m_nextCell = 0;
+  m_numDone = 0;
+  m_cancel = false;
+}
+
+float3 LobeGridBuilder::setupCell(Material &mat, size_t cell) const
+{
+  const int column = int(cell % m_columns.count);
+  const int row = int(cell / m_columns.count);
+
+  float3 lightDir = m_lightDir;
+  for (auto axis : {std::make_pair(&m_columns, column),
+                    std::make_pair(&m_rows, row)}) {
+    const float value = axis.first->value(axis.second);
+    if (axis.first->name == "lightTheta") {
+      float phi = atan2f(m_lightDir.z, m_lightDir.x);
+      lightDir = sphericalDirection(radians(value), phi);
+    } else {
+      mat.setParameter({axis.first->name, std::any(value), DataType::Float});
+    }
+  }
+
+  return lightDir;
+}
+
+void LobeGridBuilder::cellDone(size_t cell)
+{
+  m_numDone++;
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_finished.push_back(cell);
+}
+
+void LobeGridBuilder::worker(unsigned threadID)
+{
+  Material *mat = m_materials[threadID].get();
+  if (!mat)
+    return;
+
+  const size_t numCells = m_cellValues.size();
+  for (size_t cell = m_nextCell++; cell < numCells && !m_cancel;
+       cell = m_nextCell++) {
+    evalLobe(*mat, m_grid, setupCell(*mat, cell), m_cellValues[cell].data());
+    cellDone(cell);
+  }
+}
+
+} // namespace explorer
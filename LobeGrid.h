@@ -0,0 +1,113 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+// ours
+#include "Lobe.h"
+#include "material.h"
+
+namespace explorer {
+
+// What one axis of a lobe grid varies: a Float parameter of the material,
+// or "lightTheta", the light's polar angle in degrees
+struct LobeGridAxis
+{
+  std::string name;
+  float minValue{0.f};
+  float maxValue{1.f};
+  int count{4};
+
+  float value(int i) const
+  {
+    if (count <= 1)
+      return minValue;
+    return minValue + (maxValue - minValue) * i / float(count - 1);
+  }
+};
+
+// Evaluates a columns x rows grid of lobes on worker threads, all on the
+// same SphereGrid. The UI thread polls for finished cells, so the grid
+// fills in progressively. Cells are numbered row-major.
+//
+// For plugins that must not be used from other threads, the cells can
+// instead be evaluated on the calling thread in time slices (step()).
+class LobeGridBuilder
+{
+ public:
+  LobeGridBuilder() = default;
+  ~LobeGridBuilder();
+
+  // Cancels a running build and starts over; mat is cloned (on the
+  // calling thread), so it can be modified right after this returns
+  void start(std::string_view subtype,
+             const Material &mat,
+             anari::math::float3 lightDir,
+             int segments,
+             const LobeGridAxis &columns,
+             const LobeGridAxis &rows,
+             unsigned numThreads = 0);
+
+  // Like start(), but without workers: every step() evaluates the cells
+  // one after the other (each as an IncrementalLobe) until budgetMs have
+  // passed
+  void startOnCallingThread(std::string_view subtype,
+                            const Material &mat,
+                            anari::math::float3 lightDir,
+                            int segments,
+                            const LobeGridAxis &columns,
+                            const LobeGridAxis &rows);
+  void step(double budgetMs);
+
+  // Stops the workers and destroys the material clones
+  void cancel();
+
+  // Cells finished since the last call; their values stay valid until
+  // the next start()
+  std::vector<size_t> takeFinished();
+
+  bool busy() const;
+
+  size_t numCells() const;
+  const SphereGrid &sphereGrid() const;
+  const std::vector<anari::math::float3> &cellValues(size_t cell) const;
+
+ private:
+  void prepare(anari::math::float3 lightDir,
+               int segments,
+               const LobeGridAxis &columns,
+               const LobeGridAxis &rows);
+  // Sets the cell's params on mat, returns its light direction
+  anari::math::float3 setupCell(Material &mat, size_t cell) const;
+  void cellDone(size_t cell);
+  void worker(unsigned threadID);
+
+  SphereGrid m_grid;
+  LobeGridAxis m_columns;
+  LobeGridAxis m_rows;
+  anari::math::float3 m_lightDir;
+
+  std::vector<std::unique_ptr<Material>> m_materials; // one per thread
+  std::vector<std::vector<anari::math::float3>> m_cellValues;
+
+  std::vector<std::thread> m_threads;
+  std::atomic<size_t> m_nextCell{0};
+  std::atomic<size_t> m_numDone{0};
+  std::atomic<bool> m_cancel{false};
+
+  bool m_onCallingThread{false};
+  IncrementalLobe m_cellLobe; // of cell m_nextCell
+  bool m_cellStarted{false};
+
+  std::mutex m_mutex;
+  std::vector<size_t> m_finished;
+};
+
+} // namespace explorer
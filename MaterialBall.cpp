@@ -0,0 +1,224 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#include "MaterialBall.h"
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+// ours
+#include "Parallel.h"
+
+namespace explorer {
+
+using namespace anari::math;
+
+constexpr int TileSize = 16; // a multiple of the coarsest stride
+constexpr int PassStrides[] = {8, 4, 2, 1};
+constexpr size_t NumPasses = sizeof(PassStrides) / sizeof(PassStrides[0]);
+constexpr float BallRadius = 0.95f; // of the image's half size
+constexpr uint8_t NotRendered = 0xff;
+
+static uint32_t packColor(float3 value)
+{
+  auto toByte = [](float v) {
+    v = powf(std::clamp(v, 0.f, 1.f), 1.f / 2.2f);
+    return uint32_t(v * 255.f + 0.5f);
+  };
+  return toByte(value.x) | (toByte(value.y) << 8) | (toByte(value.z) << 16)
+      | (0xffu << 24);
+}
+
+MaterialBallRenderer::~MaterialBallRenderer()
+{
+  cancel();
+}
+
+void MaterialBallRenderer::start(std::string_view subtype,
+                                 const Material &mat,
+                                 float3 lightDir,
+                                 int size,
+                                 unsigned numThreads)
+{
+  cancel();
+  prepare(lightDir, size);
+
+  // leave a core to the UI thread and the ANARI device
+  if (numThreads == 0)
+    numThreads = std::max(1u, hardwareThreads() - 1);
+  numThreads = unsigned(std::min<size_t>(numThreads, m_numTiles));
+
+  m_materials.resize(numThreads);
+  for (auto &m : m_materials)
+    m.reset(Material::cloneInstance(subtype, mat));
+
+  for (unsigned i = 0; i < numThreads; ++i)
+    m_threads.emplace_back(&MaterialBallRenderer::worker, this, i);
+}
+
+void MaterialBallRenderer::startOnCallingThread(std::string_view subtype,
+                                                const Material &mat,
+                                                float3 lightDir,
+                                                int size)
+{
+  cancel();
+  prepare(lightDir, size);
+
+  m_materials.resize(1);
+  m_materials[0].reset(Material::cloneInstance(subtype, mat));
+  m_onCallingThread = true;
+}
+
+void MaterialBallRenderer::step(double budgetMs)
+{
+  if (!m_onCallingThread || budgetMs <= 0.0 || m_materials.empty()
+      || !m_materials[0])
+    return;
+
+  using Clock = std::chrono::steady_clock;
+  const auto deadline = Clock::now()
+      + std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double, std::milli>(budgetMs));
+
+  const size_t numItems = NumPasses * m_numTiles;
+  while (m_nextItem < numItems) {
+    const size_t item = m_nextItem++;
+    renderTile(*m_materials[0], item % m_numTiles, PassStrides[item / m_numTiles]);
+    m_numDone++;
+    if (Clock::now() >= deadline)
+      break;
+  }
+}
+
+void MaterialBallRenderer::cancel()
+{
+  m_cancel = true;
+  for (auto &t : m_threads)
+    t.join();
+  m_threads.clear();
+  m_materials.clear();
+  m_onCallingThread = false;
+}
+
+bool MaterialBallRenderer::takeImage(std::vector<uint32_t> &pixels)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_changed)
+    return false;
+
+  pixels = m_pixels;
+  m_changed = false;
+  return true;
+}
+
+bool MaterialBallRenderer::busy() const
+{
+  return (!m_threads.empty() || m_onCallingThread)
+      && m_numDone < NumPasses * m_numTiles;
+}
+
+int MaterialBallRenderer::size() const
+{
+  return m_size;
+}
+
+void MaterialBallRenderer::prepare(float3 lightDir, int size)
+{
+  m_size = std::max(1, size);
+  m_tilesPerRow = (m_size + TileSize - 1) / TileSize;
+  m_numTiles = size_t(m_tilesPerRow) * m_tilesPerRow;
+  m_lightDir = normalize(lightDir);
+
+  {
+    // the previous image stays until the new passes overwrite it, so
+    // dragging a slider doesn't flicker
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const size_t numPixels = size_t(m_size) * m_size;
+    if (m_pixels.size() != numPixels)
+      m_pixels.assign(numPixels, 0);
+    m_pixelStride.assign(numPixels, NotRendered);
+  }
+
+  m_nextItem = 0;
+  m_numDone = 0;
+  m_cancel = false;
+}
+
+void MaterialBallRenderer::worker(unsigned threadID)
+{
+  Material *mat = m_materials[threadID].get();
+  if (!mat)
+    return;
+
+  // pass-major, so the whole ball is coarse before any tile gets finer
+  const size_t numItems = NumPasses * m_numTiles;
+  for (size_t item = m_nextItem++; item < numItems && !m_cancel;
+       item = m_nextItem++) {
+    renderTile(*mat, item % m_numTiles, PassStrides[item / m_numTiles]);
+    m_numDone++;
+  }
+}
+
+void MaterialBallRenderer::renderTile(const Material &mat, size_t tile, int stride)
+{
+  const int x0 = int(tile % m_tilesPerRow) * TileSize;
+  const int y0 = int(tile / m_tilesPerRow) * TileSize;
+  const int x1 = std::min(x0 + TileSize, m_size);
+  const int y1 = std::min(y0 + TileSize, m_size);
+
+  uint32_t colors[TileSize * TileSize];
+  uint8_t strides[TileSize * TileSize];
+  std::fill(strides, strides + TileSize * TileSize, NotRendered);
+
+  const float3 viewDir(0.f, 0.f, 1.f);
+  const float3 white(1.f, 1.f, 1.f);
+  const bool firstPass = stride == PassStrides[0];
+
+  for (int y = y0; y < y1; y += stride) {
+    for (int x = x0; x < x1; x += stride) {
+      // computed by the previous pass already
+      if (!firstPass && x % (2 * stride) == 0 && y % (2 * stride) == 0)
+        continue;
+
+      float px = ((x + 0.5f) / m_size * 2.f - 1.f) / BallRadius;
+      float py = (1.f - (y + 0.5f) / m_size * 2.f) / BallRadius;
+      float r2 = px * px + py * py;
+
+      uint32_t color = 0; // transparent background
+      if (r2 < 1.f) {
+        float3 n(px, py, sqrtf(1.f - r2));
+        color = packColor(mat.eval(n, n, viewDir, m_lightDir, white));
+      }
+
+      // coarse passes fill their whole block
+      for (int by = y; by < std::min(y + stride, y1); ++by) {
+        for (int bx = x; bx < std::min(x + stride, x1); ++bx) {
+          size_t i = size_t(by - y0) * TileSize + (bx - x0);
+          colors[i] = color;
+          strides[i] = uint8_t(stride);
+        }
+      }
+
+      if (m_cancel)
+        return;
+    }
+  }
+
+  // Tiles of different passes may finish out of order; a pixel is only
+  // replaced by results of the same or a finer pass
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (int y = y0; y < y1; ++y) {
+    for (int x = x0; x < x1; ++x) {
+      size_t i = size_t(y - y0) * TileSize + (x - x0);
+      size_t p = size_t(y) * m_size + x;
+      if (strides[i] != NotRendered && strides[i] <= m_pixelStride[p]) {
+        m_pixels[p] = colors[i];
+        m_pixelStride[p] = strides[i];
+      }
+    }
+  }
+  m_changed = true;
+}
+
+} // namespace explorer
@@ -0,0 +1,87 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+// ours
+#include "material.h"
+
+namespace explorer {
+
+// Renders a "material ball" on the CPU, independent of the ANARI device:
+// a unit sphere seen from +z (orthographic), lit by a directional light
+// in the explorer's frame (y up), shaded with the material's eval().
+//
+// The image is split into tiles that worker threads pick up in refinement
+// passes (every 8th pixel first, drawn as blocks, then 4, 2 and 1), so a
+// coarse ball shows up right away and sharpens while params stay put.
+// Finished tiles are copied into the shared image under a lock; the UI
+// thread polls for changes and uploads them. For plugins that must not be
+// used from other threads, the tiles can instead be rendered on the
+// calling thread in time slices (step()).
+class MaterialBallRenderer
+{
+ public:
+  MaterialBallRenderer() = default;
+  ~MaterialBallRenderer();
+
+  // Cancels a running render and starts over; mat is cloned (on the
+  // calling thread), so it can be modified right after this returns
+  void start(std::string_view subtype,
+             const Material &mat,
+             anari::math::float3 lightDir,
+             int size,
+             unsigned numThreads = 0);
+
+  // Like start(), but without workers: every step() renders tiles until
+  // budgetMs have passed (at least one if budgetMs > 0)
+  void startOnCallingThread(std::string_view subtype,
+                            const Material &mat,
+                            anari::math::float3 lightDir,
+                            int size);
+  void step(double budgetMs);
+
+  // Stops the workers and destroys the material clones, the image keeps
+  // what was rendered so far
+  void cancel();
+
+  // Copies the image (size x size RGBA8, top row first) if it changed
+  // since the last call
+  bool takeImage(std::vector<uint32_t> &pixels);
+
+  bool busy() const;
+  int size() const;
+
+ private:
+  void prepare(anari::math::float3 lightDir, int size);
+  void worker(unsigned threadID);
+  void renderTile(const Material &mat, size_t tile, int stride);
+
+  int m_size{0};
+  int m_tilesPerRow{0};
+  size_t m_numTiles{0};
+  anari::math::float3 m_lightDir;
+
+  std::vector<std::unique_ptr<Material>> m_materials; // one per thread
+
+  std::vector<std::thread> m_threads;
+  std::atomic<size_t> m_nextItem{0}; // pass * m_numTiles + tile
+  std::atomic<size_t> m_numDone{0};
+  std::atomic<bool> m_cancel{false};
+  bool m_onCallingThread{false};
+
+  std::mutex m_mutex;
+  std::vector<uint32_t> m_pixels;
+  std::vector<uint8_t> m_pixelStride; // of the pass that wrote the pixel
+  bool m_changed{false};
+};
+
+} // namespace explorer
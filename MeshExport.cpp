@@ -0,0 +1,215 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#include "MeshExport.h"
+
+// std
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace explorer {
+
+using namespace anari::math;
+
+// Writes go straight into a large buffer that is flushed with a single
+// fwrite() (stdio buffering is disabled); writes larger than the buffer
+// bypass it. Records are formatted in place via claim()/commit().
+class MeshFile
+{
+ public:
+  MeshFile(const std::string &fileName) : m_fileName(fileName)
+  {
+    m_file = fopen(fileName.c_str(), "wb");
+    if (!m_file)
+      throw std::runtime_error("cannot open " + fileName);
+    setvbuf(m_file, nullptr, _IONBF, 0);
+    m_buffer.resize(BufferSize);
+  }
+
+  ~MeshFile()
+  {
+    if (m_file)
+      fclose(m_file);
+  }
+
+  void write(const void *data, size_t size)
+  {
+    if (size >= m_buffer.size()) {
+      flush();
+      writeAll(data, size);
+      return;
+    }
+    memcpy(claim(size), data, size);
+    commit(size);
+  }
+
+  // Space for up to maxSize bytes at the end of the buffer
+  char *claim(size_t maxSize)
+  {
+    if (m_used + maxSize > m_buffer.size())
+      flush();
+    return m_buffer.data() + m_used;
+  }
+
+  void commit(size_t size)
+  {
+    m_used += size;
+  }
+
+  void close()
+  {
+    flush();
+    if (fclose(m_file) != 0) {
+      m_file = nullptr;
+      throw std::runtime_error("cannot write " + m_fileName);
+    }
+    m_file = nullptr;
+  }
+
+ private:
+  static constexpr size_t BufferSize = 4 << 20;
+
+  void flush()
+  {
+    writeAll(m_buffer.data(), m_used);
+    m_used = 0;
+  }
+
+  void writeAll(const void *data, size_t size)
+  {
+    if (size > 0 && fwrite(data, 1, size, m_file) != size)
+      throw std::runtime_error("cannot write " + m_fileName);
+  }
+
+  std::string m_fileName;
+  FILE *m_file{nullptr};
+  std::vector<char> m_buffer;
+  size_t m_used{0};
+};
+
+static bool littleEndian()
+{
+  const uint16_t one = 1;
+  uint8_t firstByte;
+  memcpy(&firstByte, &one, 1);
+  return firstByte == 1;
+}
+
+static void writePLY(MeshFile &file, const MeshView &mesh)
+{
+  char header[512];
+  int len = snprintf(header,
+      sizeof(header),
+      "ply\n"
+      "format %s 1.0\n"
+      "element vertex %zu\n"
+      "property float x\n"
+      "property float y\n"
+      "property float z\n"
+      "%s"
+      "element face %zu\n"
+      "property list uchar uint vertex_indices\n"
+      "end_header\n",
+      littleEndian() ? "binary_little_endian" : "binary_big_endian",
+      mesh.vertexCount,
+      mesh.normals ? "property float nx\n"
+                     "property float ny\n"
+                     "property float nz\n"
+                   : "",
+      mesh.indices ? mesh.triangleCount : size_t(0));
+  file.write(header, size_t(len));
+
+  if (!mesh.normals) {
+    file.write(mesh.positions, mesh.vertexCount * sizeof(float3));
+  } else {
+    for (size_t i = 0; i < mesh.vertexCount; ++i) {
+      char *dst = file.claim(2 * sizeof(float3));
+      memcpy(dst, &mesh.positions[i], sizeof(float3));
+      memcpy(dst + sizeof(float3), &mesh.normals[i], sizeof(float3));
+      file.commit(2 * sizeof(float3));
+    }
+  }
+
+  if (!mesh.indices)
+    return;
+
+  for (size_t i = 0; i < mesh.triangleCount; ++i) {
+    char *dst = file.claim(1 + sizeof(uint3));
+    dst[0] = 3;
+    memcpy(dst + 1, &mesh.indices[i], sizeof(uint3));
+    file.commit(1 + sizeof(uint3));
+  }
+}
+
+static void writeOBJ(MeshFile &file, const MeshView &mesh)
+{
+  constexpr size_t MaxLine = 128;
+
+  for (size_t i = 0; i < mesh.vertexCount; ++i) {
+    const float3 p = mesh.positions[i];
+    file.commit(snprintf(
+        file.claim(MaxLine), MaxLine, "v %.7g %.7g %.7g\n", p.x, p.y, p.z));
+  }
+
+  if (mesh.normals) {
+    for (size_t i = 0; i < mesh.vertexCount; ++i) {
+      const float3 n = mesh.normals[i];
+      file.commit(snprintf(
+          file.claim(MaxLine), MaxLine, "vn %.7g %.7g %.7g\n", n.x, n.y, n.z));
+    }
+  }
+
+  if (!mesh.indices)
+    return;
+
+  // OBJ indices are 1-based
+  for (size_t i = 0; i < mesh.triangleCount; ++i) {
+    const uint3 t = mesh.indices[i] + 1u;
+    if (mesh.normals) {
+      file.commit(snprintf(file.claim(MaxLine),
+          MaxLine,
+          "f %u//%u %u//%u %u//%u\n",
+          t.x, t.x, t.y, t.y, t.z, t.z));
+    } else {
+      file.commit(snprintf(
+          file.claim(MaxLine), MaxLine, "f %u %u %u\n", t.x, t.y, t.z));
+    }
+  }
+}
+
+MeshFormat meshFormatFromFileName(const std::string &fileName)
+{
+  std::string ext = fileName.substr(std::min(fileName.size(), fileName.rfind('.')));
+  std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) {
+    return char(std::tolower(c));
+  });
+
+  if (ext == ".ply")
+    return MeshFormat::PLY;
+  else if (ext == ".obj")
+    return MeshFormat::OBJ;
+
+  throw std::runtime_error("unknown mesh format: " + fileName
+      + " (expected .ply or .obj)");
+}
+
+void writeMesh(const std::string &fileName,
+               const MeshView &mesh,
+               MeshFormat format)
+{
+  MeshFile file(fileName);
+
+  if (format == MeshFormat::PLY)
+    writePLY(file, mesh);
+  else
+    writeOBJ(file, mesh);
+
+  file.close();
+}
+
+} // namespace explorer
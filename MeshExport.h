@@ -0,0 +1,46 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <cstddef>
+#include <string>
+// anari
+#include <anari/anari_cpp/ext/linalg.h>
+
+namespace explorer {
+
+// Non-owning view of a mesh, e.g. mapped ANARI arrays or the lobe
+// generator's buffers; nothing is copied when writing it. Without
+// indices the vertices are written as a point cloud.
+struct MeshView
+{
+  const anari::math::float3 *positions{nullptr};
+  const anari::math::float3 *normals{nullptr}; // optional
+  size_t vertexCount{0};
+  const anari::math::uint3 *indices{nullptr}; // optional
+  size_t triangleCount{0};
+};
+
+enum class MeshFormat
+{
+  PLY, // binary, native byte order
+  OBJ,
+};
+
+// From the file extension (.ply/.obj, case insensitive); throws if unknown
+MeshFormat meshFormatFromFileName(const std::string &fileName);
+
+// Streams the mesh to fileName through a large write buffer. Throws
+// std::runtime_error on I/O errors.
+void writeMesh(const std::string &fileName,
+               const MeshView &mesh,
+               MeshFormat format);
+
+inline void writeMesh(const std::string &fileName, const MeshView &mesh)
+{
+  writeMesh(fileName, mesh, meshFormatFromFileName(fileName));
+}
+
+} // namespace explorer
@@ -0,0 +1,103 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ObjectStatsWindow.h"
+// std
+#include <algorithm>
+#include <vector>
+// ours
+#include "AllocTracker.h"
+#include "ObjectTracker.h"
+
+namespace windows {
+
+ObjectStatsWindow::ObjectStatsWindow(const char *name) : Window(name, true) {}
+
+static void bytesText(const char *label, uint64_t bytes)
+{
+  if (bytes >= (1ull << 20))
+    ImGui::Text("%s: %.2f MB", label, bytes / double(1ull << 20));
+  else if (bytes >= (1ull << 10))
+    ImGui::Text("%s: %.2f KB", label, bytes / double(1ull << 10));
+  else
+    ImGui::Text("%s: %llu B", label, (unsigned long long)bytes);
+}
+
+void ObjectStatsWindow::buildUI()
+{
+  explorer::AllocScope scope(explorer::AllocPhase::UIBuild);
+
+  auto &tracker = explorer::objectTracker();
+
+  auto types = tracker.typeStats();
+  uint64_t live = 0;
+  for (auto &[type, stats] : types)
+    live += stats.live;
+
+  ImGui::Text("frame %llu, %llu live objects",
+      (unsigned long long)tracker.frame(),
+      (unsigned long long)live);
+  bytesText("Live array data", tracker.liveArrayBytes());
+  bytesText("Array data uploaded (total)", tracker.totalArrayBytes());
+
+  // Churn: objects created per frame; a flat line at zero is the goal
+  // while nothing changes
+  auto history = tracker.history();
+  std::vector<float> created(history.size());
+  float maxCreated = 1.f;
+  for (size_t i = 0; i < history.size(); ++i) {
+    created[i] = float(history[i].created);
+    maxCreated = std::max(maxCreated, created[i]);
+  }
+  if (!created.empty()) {
+    ImGui::PlotLines("Created/frame",
+        created.data(),
+        int(created.size()),
+        0,
+        nullptr,
+        0.f,
+        maxCreated,
+        ImVec2(0, 60));
+  }
+
+  if (ImGui::BeginTable("types", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+    ImGui::TableSetupColumn("Type");
+    ImGui::TableSetupColumn("Live");
+    ImGui::TableSetupColumn("Created");
+    ImGui::TableSetupColumn("Released");
+    ImGui::TableHeadersRow();
+    for (auto &[type, stats] : types) {
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(explorer::ObjectTracker::typeName(type));
+      ImGui::TableNextColumn();
+      ImGui::Text("%llu", (unsigned long long)stats.live);
+      ImGui::TableNextColumn();
+      ImGui::Text("%llu (+%llu)",
+          (unsigned long long)stats.created,
+          (unsigned long long)stats.createdThisFrame);
+      ImGui::TableNextColumn();
+      ImGui::Text("%llu (+%llu)",
+          (unsigned long long)stats.released,
+          (unsigned long long)stats.releasedThisFrame);
+    }
+    ImGui::EndTable();
+  }
+
+  if (ImGui::CollapsingHeader("Live objects")) {
+    for (auto &obj : tracker.liveObjects()) {
+      auto name = explorer::ObjectTracker::objectName(obj);
+      if (obj.arrayBytes > 0) {
+        ImGui::Text("%s (frame %llu, %llu bytes)",
+            name.c_str(),
+            (unsigned long long)obj.frame,
+            (unsigned long long)obj.arrayBytes);
+      } else {
+        ImGui::Text(
+            "%s (frame %llu)", name.c_str(), (unsigned long long)obj.frame);
+      }
+    }
+  }
+}
+
+} // namespace windows
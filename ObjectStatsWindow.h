@@ -0,0 +1,21 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// anari
+#include "anari_viewer/windows/Window.h"
+
+namespace windows {
+
+// Debug panel for the ObjectTracker: live ANARI objects by type, churn
+// per frame and array bytes handed to the device
+class ObjectStatsWindow : public anari_viewer::windows::Window
+{
+ public:
+  ObjectStatsWindow(const char *name = "ANARI Objects");
+
+  void buildUI() override;
+};
+
+} // namespace windows
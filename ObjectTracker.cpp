@@ -0,0 +1,219 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#include "ObjectTracker.h"
+
+// std
+#include <algorithm>
+#include <cctype>
+
+namespace explorer {
+
+constexpr size_t HistoryFrames = 240;
+
+void ObjectTracker::setNameObjects(bool enable)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_nameObjects = enable;
+}
+
+void ObjectTracker::beginFrame()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  m_history.push_back(m_current);
+  if (m_history.size() > HistoryFrames)
+    m_history.pop_front();
+
+  m_current = FrameStats{};
+  m_current.frame = ++m_frame;
+  for (auto &[type, stats] : m_types) {
+    stats.createdThisFrame = 0;
+    stats.releasedThisFrame = 0;
+  }
+}
+
+void ObjectTracker::created(
+    anari::Device d, anari::Object obj, ANARIDataType type, uint64_t arrayBytes)
+{
+  if (!obj)
+    return;
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  LiveObject record;
+  record.type = type;
+  record.serial = m_nextSerial++;
+  record.frame = m_frame;
+  record.arrayBytes = arrayBytes;
+  record.refs = 1;
+
+  if (m_nameObjects)
+    anari::setParameter(d, obj, "name", objectName(record));
+
+  m_live[obj] = record;
+
+  auto &stats = m_types[type];
+  stats.live++;
+  stats.created++;
+  stats.createdThisFrame++;
+
+  m_current.created++;
+  m_current.arrayBytes += arrayBytes;
+  m_liveArrayBytes += arrayBytes;
+  m_totalArrayBytes += arrayBytes;
+}
+
+void ObjectTracker::retained(anari::Object obj)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_live.find(obj);
+  if (it != m_live.end())
+    it->second.refs++;
+}
+
+void ObjectTracker::released(anari::Object obj)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_live.find(obj);
+  if (it == m_live.end() || --it->second.refs > 0)
+    return;
+
+  auto &stats = m_types[it->second.type];
+  stats.live--;
+  stats.released++;
+  stats.releasedThisFrame++;
+
+  m_current.released++;
+  m_liveArrayBytes -= it->second.arrayBytes;
+  m_live.erase(it);
+}
+
+uint64_t ObjectTracker::frame() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_frame;
+}
+
+std::map<ANARIDataType, ObjectTracker::TypeStats> ObjectTracker::typeStats() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_types;
+}
+
+std::vector<ObjectTracker::FrameStats> ObjectTracker::history() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return std::vector<FrameStats>(m_history.begin(), m_history.end());
+}
+
+uint64_t ObjectTracker::liveArrayBytes() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_liveArrayBytes;
+}
+
+uint64_t ObjectTracker::totalArrayBytes() const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_totalArrayBytes;
+}
+
+std::vector<ObjectTracker::LiveObject> ObjectTracker::liveObjects() const
+{
+  std::vector<LiveObject> result;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto &[obj, record] : m_live)
+      result.push_back(record);
+  }
+
+  std::sort(result.begin(), result.end(),
+      [](const LiveObject &a, const LiveObject &b) { return a.serial < b.serial; });
+  return result;
+}
+
+bool ObjectTracker::printLeakReport(std::ostream &out) const
+{
+  auto live = liveObjects();
+  if (live.empty())
+    return true;
+
+  std::stable_sort(live.begin(), live.end(),
+      [](const LiveObject &a, const LiveObject &b) { return a.type < b.type; });
+
+  out << "[LEAK ] " << live.size() << " ANARI object(s) still referenced:\n";
+  for (size_t i = 0; i < live.size();) {
+    size_t end = i;
+    while (end < live.size() && live[end].type == live[i].type)
+      end++;
+
+    out << "[LEAK ]   " << typeName(live[i].type) << ": " << end - i << '\n';
+    for (; i < end; ++i) {
+      out << "[LEAK ]     " << objectName(live[i]) << " (frame " << live[i].frame;
+      if (live[i].refs > 1)
+        out << ", " << live[i].refs << " refs";
+      if (live[i].arrayBytes > 0)
+        out << ", " << live[i].arrayBytes << " bytes";
+      out << ")\n";
+    }
+  }
+
+  return false;
+}
+
+const char *ObjectTracker::typeName(ANARIDataType type)
+{
+  switch (type) {
+  case ANARI_ARRAY1D:
+    return "Array1D";
+  case ANARI_ARRAY2D:
+    return "Array2D";
+  case ANARI_ARRAY3D:
+    return "Array3D";
+  case ANARI_CAMERA:
+    return "Camera";
+  case ANARI_FRAME:
+    return "Frame";
+  case ANARI_GEOMETRY:
+    return "Geometry";
+  case ANARI_GROUP:
+    return "Group";
+  case ANARI_INSTANCE:
+    return "Instance";
+  case ANARI_LIGHT:
+    return "Light";
+  case ANARI_MATERIAL:
+    return "Material";
+  case ANARI_RENDERER:
+    return "Renderer";
+  case ANARI_SAMPLER:
+    return "Sampler";
+  case ANARI_SPATIAL_FIELD:
+    return "SpatialField";
+  case ANARI_SURFACE:
+    return "Surface";
+  case ANARI_VOLUME:
+    return "Volume";
+  case ANARI_WORLD:
+    return "World";
+  default:
+    return "Object";
+  }
+}
+
+std::string ObjectTracker::objectName(const LiveObject &obj)
+{
+  std::string name = typeName(obj.type);
+  std::transform(name.begin(), name.end(), name.begin(),
+      [](unsigned char c) { return char(std::tolower(c)); });
+  return name + "#" + std::to_string(obj.serial);
+}
+
+ObjectTracker &objectTracker()
+{
+  static ObjectTracker tracker;
+  return tracker;
+}
+
+} // namespace explorer
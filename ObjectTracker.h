@@ -0,0 +1,168 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+// anari
+#include <anari/anari_cpp.hpp>
+#include <anari/frontend/type_utility.h>
+
+namespace explorer {
+
+// Accounting of the ANARI objects the explorer creates: live objects by
+// type, creations and releases per frame and bytes of array data handed
+// to the device. "Live" counts the explorer's own references, so objects
+// that are only kept alive by their parents (e.g., after
+// setAndReleaseParameter()) are not live; whatever is still live at
+// teardown was leaked.
+class ObjectTracker
+{
+ public:
+  struct TypeStats
+  {
+    uint64_t live{0};
+    uint64_t created{0};
+    uint64_t released{0};
+    uint64_t createdThisFrame{0};
+    uint64_t releasedThisFrame{0};
+  };
+
+  struct FrameStats
+  {
+    uint64_t frame{0};
+    uint32_t created{0};
+    uint32_t released{0};
+    uint64_t arrayBytes{0};
+  };
+
+  struct LiveObject
+  {
+    ANARIDataType type;
+    uint64_t serial{0}; // in order of creation
+    uint64_t frame{0}; // created in
+    uint64_t arrayBytes{0};
+    int refs{0};
+  };
+
+  // Names every new object ("geometry#12", matching the leak report),
+  // so debug device messages and traces can be attributed
+  void setNameObjects(bool enable);
+
+  // Closes the current frame's counts
+  void beginFrame();
+
+  void created(anari::Device d, anari::Object obj, ANARIDataType type, uint64_t arrayBytes = 0);
+  void retained(anari::Object obj);
+  void released(anari::Object obj);
+
+  uint64_t frame() const;
+  std::map<ANARIDataType, TypeStats> typeStats() const;
+  std::vector<FrameStats> history() const; // oldest first
+  uint64_t liveArrayBytes() const;
+  uint64_t totalArrayBytes() const;
+  std::vector<LiveObject> liveObjects() const; // oldest first
+
+  // Prints all live objects (grouped by type); returns false if there
+  // were any
+  bool printLeakReport(std::ostream &out) const;
+
+  static const char *typeName(ANARIDataType type);
+  static std::string objectName(const LiveObject &obj);
+
+ private:
+  mutable std::mutex m_mutex;
+  bool m_nameObjects{false};
+  uint64_t m_frame{0};
+  uint64_t m_nextSerial{0};
+  std::unordered_map<anari::Object, LiveObject> m_live;
+  std::map<ANARIDataType, TypeStats> m_types;
+  FrameStats m_current;
+  std::deque<FrameStats> m_history;
+  uint64_t m_liveArrayBytes{0};
+  uint64_t m_totalArrayBytes{0};
+};
+
+ObjectTracker &objectTracker();
+
+// Drop-in replacements for the anari:: calls that create and release
+// objects, reporting to objectTracker(). Handles that weren't created
+// through these (e.g., the device) are passed through untracked.
+namespace tracked {
+
+template <typename T>
+inline T newObject(anari::Device d, const char *subtype)
+{
+  T obj = anari::newObject<T>(d, subtype);
+  objectTracker().created(d, obj, anari::ANARITypeFor<T>::value);
+  return obj;
+}
+
+template <typename T>
+inline T newObject(anari::Device d)
+{
+  T obj = anari::newObject<T>(d);
+  objectTracker().created(d, obj, anari::ANARITypeFor<T>::value);
+  return obj;
+}
+
+inline anari::Array1D newArray1D(anari::Device d, ANARIDataType type, uint64_t numItems)
+{
+  auto array = anari::newArray1D(d, type, numItems);
+  objectTracker().created(d, array, ANARI_ARRAY1D, anari::sizeOf(type) * numItems);
+  return array;
+}
+
+template <typename T>
+inline anari::Array1D newArray1D(anari::Device d, const T *appMemory, uint64_t numItems = 1)
+{
+  auto array = anari::newArray1D(d, appMemory, numItems);
+  objectTracker().created(d, array, ANARI_ARRAY1D, sizeof(T) * numItems);
+  return array;
+}
+
+inline anari::Array2D newArray2D(anari::Device d,
+                                 const void *appMemory,
+                                 ANARIMemoryDeleter deleter,
+                                 const void *userData,
+                                 ANARIDataType type,
+                                 uint64_t numItems1,
+                                 uint64_t numItems2)
+{
+  auto array = anariNewArray2D(d, appMemory, deleter, userData, type, numItems1, numItems2);
+  objectTracker().created(
+      d, array, ANARI_ARRAY2D, anari::sizeOf(type) * numItems1 * numItems2);
+  return array;
+}
+
+template <typename T>
+inline void retain(anari::Device d, T obj)
+{
+  anari::retain(d, obj);
+  objectTracker().retained(obj);
+}
+
+template <typename T>
+inline void release(anari::Device d, T obj)
+{
+  objectTracker().released(obj);
+  anari::release(d, obj);
+}
+
+template <typename T>
+inline void setAndReleaseParameter(anari::Device d, anari::Object obj, const char *name, T value)
+{
+  anari::setParameter(d, obj, name, value);
+  release(d, value);
+}
+
+} // namespace tracked
+} // namespace explorer
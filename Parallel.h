@@ -0,0 +1,63 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace explorer {
+
+inline unsigned hardwareThreads()
+{
+  unsigned n = std::thread::hardware_concurrency();
+  return n > 0 ? n : 1;
+}
+
+// Calls func(threadID, i) for all i in [0,count) on numThreads workers.
+// Indices are handed out dynamically, so workers that hit cheap items
+// just grab more. threadID is stable per worker and in [0,numThreads),
+// use it to index per-thread state (e.g., one Material per worker).
+// The first exception thrown by func stops the loop and is rethrown.
+template <typename Func>
+inline void parallelFor(unsigned numThreads, size_t count, Func &&func)
+{
+  if (numThreads == 0)
+    numThreads = hardwareThreads();
+
+  std::atomic<size_t> next{0};
+  std::exception_ptr error;
+  std::mutex errorMutex;
+
+  auto worker = [&](unsigned threadID) {
+    for (size_t i = next++; i < count; i = next++) {
+      try {
+        func(threadID, i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if (!error)
+          error = std::current_exception();
+        next = count;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < numThreads && t < count; ++t)
+    threads.emplace_back(worker, t);
+
+  worker(0);
+
+  for (auto &t : threads)
+    t.join();
+
+  if (error)
+    std::rethrow_exception(error);
+}
+
+} // namespace explorer
@@ -2,21 +2,32 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "ParamEditor.h"
+// std
+#include <iostream>
+#include <stdexcept>
+// ours
+#include "AllocTracker.h"
+#include "Preset.h"
 
 namespace windows {
 
+constexpr int BallSize = 192;
+
 ParamEditor::ParamEditor(explorer::Material &mat,
                          anari::math::float3 &lightDir,
                          std::string &selectedMaterial,
                          const char *name)
   : Window(name, true)
-  , m_material(mat)
+  , m_material(&mat)
   , m_lightDir(lightDir)
   , m_selectedMaterial(selectedMaterial)
 {
 }
 
-ParamEditor::~ParamEditor() {}
+ParamEditor::~ParamEditor()
+{
+  m_ball.cancel();
+}
 
 void ParamEditor::setMaterialUpdateCallback(ParamUpdateCallback cb)
 {
@@ -28,8 +39,45 @@ void ParamEditor::setLightUpdateCallback(ParamUpdateCallback cb)
   m_lightUpdateCallback = cb;
 }
 
+void ParamEditor::setMaterial(explorer::Material &mat)
+{
+  m_material = &mat;
+  m_ballOutdated = true;
+}
+
+void ParamEditor::cancelPreview()
+{
+  m_ball.cancel();
+  m_ballOutdated = true;
+}
+
+void ParamEditor::releasePreview()
+{
+  cancelPreview();
+  if (m_ballTexture) {
+    glDeleteTextures(1, &m_ballTexture);
+    m_ballTexture = 0;
+  }
+}
+
+void ParamEditor::setPreviewOnUIThread(bool enabled)
+{
+  if (enabled == m_ballOnUIThread)
+    return;
+
+  m_ball.cancel();
+  m_ballOnUIThread = enabled;
+  m_ballOutdated = true;
+}
+
+void ParamEditor::stepPreview(double budgetMs)
+{
+  m_ball.step(budgetMs);
+}
+
 void ParamEditor::buildUI()
 {
+  explorer::AllocScope scope(explorer::AllocPhase::UIBuild);
   drawEditor();
 }
 
@@ -48,7 +96,7 @@ void ParamEditor::drawEditor()
     }
     if (std::string(selected) != m_selectedMaterial) {
       m_selectedMaterial = selected;
-      m_material.setSubtype(selected);
+      m_material->setSubtype(selected);
       materialUpdated = true;
     }
     ImGui::EndCombo();
@@ -57,19 +105,42 @@ void ParamEditor::drawEditor()
   auto params = explorer::Material::querySupportedParams(selected);
 
   for (auto &param : params) {
-    auto actualParam = m_material.getParameter(param.name);
+    auto actualParam = m_material->getParameter(param.name);
     if (actualParam.type == explorer::DataType::Float) {
       float value = std::any_cast<float>(actualParam.value);
       bool updated = ImGui::DragFloat(actualParam.name.c_str(), &value, value, 0.f, 1.f);
       if (updated) {
         auto newParam = actualParam;
         newParam.value = value;
-        m_material.setParameter(newParam);
+        m_material->setParameter(newParam);
       }
       materialUpdated |= updated;
     }
   }
 
+  ImGui::InputText("Preset", m_presetFileName.data(), m_presetFileName.size());
+
+  if (ImGui::Button("Load preset")) {
+    try {
+      auto preset = explorer::loadPreset(m_presetFileName.data());
+      m_selectedMaterial = preset.subtype;
+      explorer::applyPreset(preset, *m_material);
+      materialUpdated = true;
+    } catch (const std::exception &e) {
+      std::cerr << e.what() << '\n';
+    }
+  }
+
+  ImGui::SameLine();
+  if (ImGui::Button("Save preset")) {
+    try {
+      explorer::savePreset(m_presetFileName.data(),
+          explorer::makePreset(m_selectedMaterial, *m_material));
+    } catch (const std::exception &e) {
+      std::cerr << e.what() << '\n';
+    }
+  }
+
   if (ImGui::DragFloat3("Light dir", (float *)&m_lightDir[0])) {
     lightUpdated = true;
   }
@@ -82,6 +153,56 @@ void ParamEditor::drawEditor()
   if (materialUpdated && !lightUpdated) {
     m_materialUpdateCallback();
   }
+
+  if (materialUpdated || lightUpdated)
+    m_ballOutdated = true;
+
+  drawPreview();
+}
+
+void ParamEditor::drawPreview()
+{
+  if (!ImGui::CollapsingHeader("Material Ball", ImGuiTreeNodeFlags_DefaultOpen))
+    return;
+
+  // the light can also be changed from elsewhere
+  if (m_lightDir != m_ballLightDir)
+    m_ballOutdated = true;
+
+  if (m_ballOutdated && anari::math::length(m_lightDir) > 0.f) {
+    if (m_ballOnUIThread) {
+      m_ball.startOnCallingThread(
+          m_selectedMaterial, *m_material, m_lightDir, BallSize);
+    } else {
+      m_ball.start(m_selectedMaterial, *m_material, m_lightDir, BallSize);
+    }
+    m_ballLightDir = m_lightDir;
+    m_ballOutdated = false;
+  }
+
+  if (m_ball.takeImage(m_ballPixels)) {
+    if (!m_ballTexture) {
+      glGenTextures(1, &m_ballTexture);
+      glBindTexture(GL_TEXTURE_2D, m_ballTexture);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    glBindTexture(GL_TEXTURE_2D, m_ballTexture);
+    glTexImage2D(GL_TEXTURE_2D,
+        0,
+        GL_RGBA8,
+        m_ball.size(),
+        m_ball.size(),
+        0,
+        GL_RGBA,
+        GL_UNSIGNED_BYTE,
+        m_ballPixels.data());
+  }
+
+  if (m_ballTexture) {
+    ImGui::Image((ImTextureID)(intptr_t)m_ballTexture,
+        ImVec2(float(m_ball.size()), float(m_ball.size())));
+  }
 }
 
 } // namespace windows
@@ -14,6 +14,7 @@
 #include <vector>
 // ours
 #include "material.h"
+#include "MaterialBall.h"
 
 namespace windows {
 
@@ -31,19 +32,44 @@ class ParamEditor : public anari_viewer::windows::Window
   void setLightUpdateCallback(ParamUpdateCallback cb);
   void setMaterialUpdateCallback(ParamUpdateCallback cb);
 
+  // The edited material was replaced (e.g., after a plugin reload)
+  void setMaterial(explorer::Material &mat);
+
+  // Stops the material ball's workers, their material clones must be
+  // gone before the plugin is replaced
+  void cancelPreview();
+
+  // Also frees the preview texture, needs the GL context
+  void releasePreview();
+
+  // Renders the ball on the UI thread (in stepPreview()) instead of on
+  // worker threads, for plugins that must only be used from one thread
+  void setPreviewOnUIThread(bool enabled);
+  void stepPreview(double budgetMs);
+
   void buildUI() override;
 
  private:
   void drawEditor();
+  void drawPreview();
 
   ParamUpdateCallback m_lightUpdateCallback;
   ParamUpdateCallback m_materialUpdateCallback;
 
-  explorer::Material &m_material;
+  explorer::Material *m_material{nullptr};
 
   anari::math::float3 &m_lightDir;
 
   std::string &m_selectedMaterial;
+
+  std::array<char, 512> m_presetFileName{};
+
+  explorer::MaterialBallRenderer m_ball;
+  std::vector<uint32_t> m_ballPixels;
+  GLuint m_ballTexture{0};
+  anari::math::float3 m_ballLightDir{0.f, 0.f, 0.f};
+  bool m_ballOutdated{true};
+  bool m_ballOnUIThread{false};
 };
 
 } // namespace windows
@@ -0,0 +1,692 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#include "PluginHost.h"
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+// posix
+#include <fcntl.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+// ours
+#include "Parallel.h"
+
+extern char **environ;
+
+namespace explorer {
+
+using namespace anari::math;
+
+// Shared memory layout ///////////////////////////////////////////////////////
+
+constexpr uint32_t HostMagic = 0x4f485242; // "BRHO"
+constexpr size_t HostBatchSize = 4096;
+constexpr uint32_t HostMaxParams = 32;
+constexpr size_t HostNameSize = 64;
+
+// Host restarts per batch before giving up on a plugin that keeps crashing
+constexpr int HostMaxAttempts = 3;
+
+struct HostParam
+{
+  char name[HostNameSize];
+  uint32_t type;
+  float value[4];
+};
+
+// One in-flight batch. Slot i is only ever served by host worker i, so
+// no lock is shared between the processes (a crashing host can't leave
+// one held); the two semaphores hand the slot back and forth.
+struct HostSlot
+{
+  sem_t request;
+  sem_t response;
+
+  // written by the client
+  uint64_t materialID;
+  uint64_t materialVersion;
+  char subtype[HostNameSize];
+  uint32_t numParams;
+  HostParam params[HostMaxParams];
+  float3 Ng, Ns, lightDir, lightIntensity;
+  uint32_t count;
+  float3 viewDirs[HostBatchSize];
+
+  // written by the host
+  int32_t status; // != 0: the plugin threw, see error
+  char error[256];
+  float3 values[HostBatchSize];
+};
+
+struct HostHeader
+{
+  uint32_t magic;
+  uint32_t numSlots;
+  std::atomic<uint32_t> shutdown;
+  sem_t ready;
+};
+
+static size_t alignUp(size_t size)
+{
+  return (size + 63) & ~size_t(63);
+}
+
+static size_t slotOffset(uint32_t i)
+{
+  return alignUp(sizeof(HostHeader)) + i * alignUp(sizeof(HostSlot));
+}
+
+static HostSlot &slotAt(void *mapping, uint32_t i)
+{
+  return *reinterpret_cast<HostSlot *>((char *)mapping + slotOffset(i));
+}
+
+static void copyName(char *dst, const std::string &src)
+{
+  if (src.size() >= HostNameSize)
+    throw std::runtime_error("name too long for the plugin host: " + src);
+  memcpy(dst, src.c_str(), src.size() + 1);
+}
+
+static void encodeParam(const MaterialParam &param, HostParam &hp)
+{
+  copyName(hp.name, param.name);
+  hp.type = uint32_t(param.type);
+  memset(hp.value, 0, sizeof(hp.value));
+  if (param.type == DataType::Float) {
+    hp.value[0] = std::any_cast<float>(param.value);
+  } else if (param.type == DataType::Float2) {
+    auto v = std::any_cast<float2>(param.value);
+    memcpy(hp.value, &v, sizeof(v));
+  } else if (param.type == DataType::Float3) {
+    auto v = std::any_cast<float3>(param.value);
+    memcpy(hp.value, &v, sizeof(v));
+  } else {
+    auto v = std::any_cast<float4>(param.value);
+    memcpy(hp.value, &v, sizeof(v));
+  }
+}
+
+static MaterialParam decodeParam(const HostParam &hp)
+{
+  MaterialParam param;
+  param.name = hp.name;
+  param.type = DataType(hp.type);
+  if (param.type == DataType::Float)
+    param.value = hp.value[0];
+  else if (param.type == DataType::Float2)
+    param.value = float2(hp.value[0], hp.value[1]);
+  else if (param.type == DataType::Float3)
+    param.value = float3(hp.value[0], hp.value[1], hp.value[2]);
+  else
+    param.value = float4(hp.value[0], hp.value[1], hp.value[2], hp.value[3]);
+  return param;
+}
+
+// sem_wait() with a timeout in milliseconds; false on timeout
+static bool waitFor(sem_t *sem, long ms)
+{
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += ms / 1000;
+  ts.tv_nsec += (ms % 1000) * 1000000L;
+  if (ts.tv_nsec >= 1000000000L) {
+    ts.tv_sec += 1;
+    ts.tv_nsec -= 1000000000L;
+  }
+
+  while (sem_timedwait(sem, &ts) != 0) {
+    if (errno != EINTR)
+      return false;
+  }
+  return true;
+}
+
+// The host is a mode of the batch tool, which is installed next to us
+static std::string hostExecutable()
+{
+  char path[4096];
+  ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+  if (len <= 0)
+    return "anariBRDFTool";
+
+  std::string dir(path, size_t(len));
+  dir.resize(dir.rfind('/') + 1);
+  return dir + "anariBRDFTool";
+}
+
+// Client side ////////////////////////////////////////////////////////////////
+
+// One running host process and its mapping
+struct HostConnection
+{
+  ~HostConnection();
+
+  // Reaps the host if it has exited
+  bool alive();
+
+  // Wakes up everyone waiting for a slot of a host that died
+  void abandon();
+
+  // Waits for a free slot; false if the host died in the meantime
+  bool acquireSlot(uint32_t &i);
+  bool tryAcquireSlot(uint32_t &i);
+  void releaseSlot(uint32_t i);
+
+  HostHeader *header{nullptr};
+  void *mapping{nullptr};
+  size_t size{0};
+  pid_t pid{-1};
+
+  std::mutex mutex;
+  std::condition_variable slotFreed;
+  std::vector<uint32_t> freeSlots;
+  bool exited{false};
+};
+
+HostConnection::~HostConnection()
+{
+  if (pid > 0 && alive()) {
+    header->shutdown = 1;
+    for (uint32_t i = 0; i < header->numSlots; ++i)
+      sem_post(&slotAt(mapping, i).request);
+
+    // give workers stuck in a slow eval a moment, then kill the host
+    for (int i = 0; i < 20 && alive(); ++i)
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    if (alive()) {
+      kill(pid, SIGKILL);
+      waitpid(pid, nullptr, 0);
+    }
+  }
+
+  if (mapping)
+    munmap(mapping, size);
+}
+
+bool HostConnection::alive()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!exited) {
+    pid_t r = waitpid(pid, nullptr, WNOHANG);
+    exited = r == pid || (r < 0 && errno == ECHILD);
+  }
+  return !exited;
+}
+
+void HostConnection::abandon()
+{
+  alive(); // reaps it
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    exited = true;
+  }
+  slotFreed.notify_all();
+}
+
+bool HostConnection::acquireSlot(uint32_t &i)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  slotFreed.wait(lock, [&]() { return !freeSlots.empty() || exited; });
+  if (freeSlots.empty())
+    return false;
+  i = freeSlots.back();
+  freeSlots.pop_back();
+  return true;
+}
+
+bool HostConnection::tryAcquireSlot(uint32_t &i)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  if (freeSlots.empty())
+    return false;
+  i = freeSlots.back();
+  freeSlots.pop_back();
+  return true;
+}
+
+void HostConnection::releaseSlot(uint32_t i)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    freeSlots.push_back(i);
+  }
+  slotFreed.notify_one();
+}
+
+static std::shared_ptr<HostConnection> startHost(
+    const std::string &pluginName, unsigned numWorkers)
+{
+  static std::atomic<unsigned> counter{0};
+  const std::string shmName = "/anariBRDFHost." + std::to_string(getpid())
+      + "." + std::to_string(counter++);
+
+  auto conn = std::make_shared<HostConnection>();
+
+  int fd = shm_open(shmName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0)
+    throw std::runtime_error("cannot create shared memory " + shmName);
+
+  conn->size = slotOffset(numWorkers);
+  if (ftruncate(fd, off_t(conn->size)) != 0) {
+    close(fd);
+    shm_unlink(shmName.c_str());
+    throw std::runtime_error("cannot resize shared memory " + shmName);
+  }
+
+  void *mapping =
+      mmap(nullptr, conn->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    shm_unlink(shmName.c_str());
+    throw std::runtime_error("cannot map shared memory " + shmName);
+  }
+  conn->mapping = mapping;
+
+  conn->header = new (mapping) HostHeader;
+  conn->header->magic = HostMagic;
+  conn->header->numSlots = numWorkers;
+  conn->header->shutdown = 0;
+  sem_init(&conn->header->ready, 1, 0);
+  for (uint32_t i = 0; i < numWorkers; ++i) {
+    HostSlot &slot = slotAt(mapping, i);
+    sem_init(&slot.request, 1, 0);
+    sem_init(&slot.response, 1, 0);
+    conn->freeSlots.push_back(i);
+  }
+
+  std::string exe = hostExecutable();
+  std::vector<std::string> args = {
+      exe, "host", "-p", pluginName, shmName};
+  std::vector<char *> argv;
+  for (auto &arg : args)
+    argv.push_back(arg.data());
+  argv.push_back(nullptr);
+
+  int err = posix_spawnp(
+      &conn->pid, exe.c_str(), nullptr, nullptr, argv.data(), environ);
+  if (err != 0) {
+    conn->pid = -1;
+    shm_unlink(shmName.c_str());
+    throw std::runtime_error("cannot start plugin host " + exe);
+  }
+
+  // plugin load and worker startup
+  bool ready = false;
+  for (int i = 0; i < 100 && !ready && conn->alive(); ++i)
+    ready = waitFor(&conn->header->ready, 100);
+
+  // the host has it mapped now (or never will)
+  shm_unlink(shmName.c_str());
+
+  if (!ready)
+    throw std::runtime_error("plugin host " + exe + " failed to start");
+
+  return conn;
+}
+
+PluginHost::PluginHost(std::string pluginName, unsigned numWorkers)
+  : m_pluginName(pluginName)
+  , m_numWorkers(numWorkers > 0 ? numWorkers : hardwareThreads())
+{
+  m_connection = startHost(m_pluginName, m_numWorkers);
+}
+
+static PluginHost *g_installedHost = nullptr;
+
+static Material *createRemoteInstance(std::string_view subtype)
+{
+  return new RemoteMaterial(*g_installedHost, subtype);
+}
+
+PluginHost::~PluginHost()
+{
+  if (g_installedHost == this) {
+    Material::setInstanceFactory(nullptr);
+    g_installedHost = nullptr;
+  }
+}
+
+void PluginHost::install()
+{
+  g_installedHost = this;
+  Material::setInstanceFactory(createRemoteInstance);
+}
+
+void PluginHost::restart()
+{
+  auto conn = startHost(m_pluginName, m_numWorkers);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::swap(m_connection, conn);
+}
+
+std::shared_ptr<HostConnection> PluginHost::connection()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_connection;
+}
+
+void PluginHost::restartAfterCrash(const std::shared_ptr<HostConnection> &dead)
+{
+  // threads waiting for one of its slots move on to the new host
+  dead->abandon();
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_connection != dead)
+    return; // another thread got there first
+
+  std::cerr << "[WARN] plugin host exited unexpectedly, restarting\n";
+  m_connection = startHost(m_pluginName, m_numWorkers);
+}
+
+void PluginHost::evalBatch(const RemoteMaterial &mat,
+                           float3 Ng,
+                           float3 Ns,
+                           const float3 *viewDirs,
+                           size_t count,
+                           float3 lightDir,
+                           float3 lightIntensity,
+                           float3 *values)
+{
+  if (mat.m_params.size() > HostMaxParams)
+    throw std::runtime_error("too many params for the plugin host");
+
+  // Chunks of a batch go to as many host workers as there are free slots
+  // and are collected in submission order
+  const size_t numChunks = (count + HostBatchSize - 1) / HostBatchSize;
+  std::vector<size_t> todo;
+  for (size_t c = numChunks; c-- > 0;)
+    todo.push_back(c);
+
+  struct Pending
+  {
+    uint32_t slot;
+    size_t chunk;
+  };
+  std::deque<Pending> pending;
+
+  std::string error;
+  int restarts = 0;
+  auto conn = connection();
+
+  // after a crash: chunks of a batch that are still to do go to a new
+  // host; a plugin that crashes on every attempt gets zeros
+  auto restartHost = [&]() {
+    restartAfterCrash(conn);
+    conn = connection();
+
+    if (++restarts < HostMaxAttempts)
+      return true;
+
+    std::cerr << "[ERROR] plugin host keeps crashing, giving up on batch\n";
+    for (size_t chunk : todo) {
+      const size_t first = chunk * HostBatchSize;
+      std::fill(values + first,
+          values + std::min(count, first + HostBatchSize),
+          float3(0.f));
+    }
+    return false;
+  };
+
+  while (!todo.empty() || !pending.empty()) {
+    bool hostDied = false;
+    while (!todo.empty()) {
+      uint32_t i = 0;
+      if (pending.empty()) {
+        if (!conn->acquireSlot(i)) {
+          hostDied = true;
+          break;
+        }
+      } else if (!conn->tryAcquireSlot(i)) {
+        break;
+      }
+
+      const size_t chunk = todo.back();
+      todo.pop_back();
+      const size_t first = chunk * HostBatchSize;
+      const uint32_t n = uint32_t(std::min(HostBatchSize, count - first));
+
+      HostSlot &slot = slotAt(conn->mapping, i);
+      slot.materialID = mat.m_id;
+      slot.materialVersion = mat.m_version;
+      copyName(slot.subtype, mat.m_subtype);
+      slot.numParams = uint32_t(mat.m_params.size());
+      for (size_t p = 0; p < mat.m_params.size(); ++p)
+        encodeParam(mat.m_params[p], slot.params[p]);
+      slot.Ng = Ng;
+      slot.Ns = Ns;
+      slot.lightDir = lightDir;
+      slot.lightIntensity = lightIntensity;
+      slot.count = n;
+      memcpy(slot.viewDirs, viewDirs + first, n * sizeof(float3));
+
+      sem_post(&slot.request);
+      pending.push_back({i, chunk});
+    }
+
+    // another thread saw it die (nothing of ours is pending there)
+    if (hostDied) {
+      if (!restartHost())
+        break;
+      continue;
+    }
+
+    const Pending p = pending.front();
+    pending.pop_front();
+    HostSlot &slot = slotAt(conn->mapping, p.slot);
+
+    bool done = false;
+    while (!(done = waitFor(&slot.response, 100)) && conn->alive())
+      ;
+
+    if (done) {
+      const size_t first = p.chunk * HostBatchSize;
+      if (slot.status != 0)
+        error = slot.error;
+      else
+        memcpy(values + first, slot.values, slot.count * sizeof(float3));
+      conn->releaseSlot(p.slot);
+      continue;
+    }
+
+    // The host died and took all pending chunks with it
+    todo.push_back(p.chunk);
+    for (auto &q : pending)
+      todo.push_back(q.chunk);
+    pending.clear();
+
+    if (!restartHost())
+      break;
+  }
+
+  if (!error.empty())
+    throw std::runtime_error(error);
+}
+
+// RemoteMaterial /////////////////////////////////////////////////////////////
+
+static std::atomic<uint64_t> g_nextMaterialID{0};
+
+RemoteMaterial::RemoteMaterial(PluginHost &host, std::string_view subtype)
+  : m_host(host)
+  , m_id(g_nextMaterialID++)
+  , m_subtype(subtype)
+{
+}
+
+float3 RemoteMaterial::eval(float3 Ng,
+                            float3 Ns,
+                            float3 viewDir,
+                            float3 lightDir,
+                            float3 lightIntensity) const
+{
+  float3 value;
+  evalBatch(Ng, Ns, &viewDir, 1, lightDir, lightIntensity, &value);
+  return value;
+}
+
+void RemoteMaterial::evalBatch(float3 Ng,
+                               float3 Ns,
+                               const float3 *viewDirs,
+                               size_t count,
+                               float3 lightDir,
+                               float3 lightIntensity,
+                               float3 *values) const
+{
+  m_host.evalBatch(
+      *this, Ng, Ns, viewDirs, count, lightDir, lightIntensity, values);
+}
+
+void RemoteMaterial::setSubtype(std::string_view subtype)
+{
+  // plugins reset their params to the subtype's defaults
+  m_subtype = subtype;
+  m_params.clear();
+  m_version++;
+}
+
+void RemoteMaterial::setParameter(MaterialParam param)
+{
+  auto it = std::find_if(m_params.begin(), m_params.end(), [&](auto &p) {
+    return p.name == param.name;
+  });
+  if (it != m_params.end())
+    *it = param;
+  else
+    m_params.push_back(param);
+  m_version++;
+}
+
+MaterialParam RemoteMaterial::getParameter(std::string_view name) const
+{
+  for (auto &param : m_params) {
+    if (param.name == name)
+      return param;
+  }
+
+  for (auto &param : querySupportedParams(m_subtype)) {
+    if (param.name == name)
+      return param;
+  }
+
+  return {};
+}
+
+// Host side //////////////////////////////////////////////////////////////////
+
+static void hostWorker(HostHeader &header, HostSlot &slot, pid_t parent)
+{
+  std::unique_ptr<Material> mat;
+  std::string subtype;
+  std::vector<MaterialParam> defaults;
+  uint64_t id = ~uint64_t(0), version = 0;
+
+  for (;;) {
+    if (!waitFor(&slot.request, 1000)) {
+      // don't outlive the client
+      if (header.shutdown || getppid() != parent)
+        return;
+      continue;
+    }
+
+    if (header.shutdown)
+      return;
+
+    try {
+      if (!mat || subtype != slot.subtype) {
+        subtype = slot.subtype;
+        mat.reset(Material::createInstance(subtype));
+        id = ~uint64_t(0);
+        if (!mat)
+          throw std::runtime_error("cannot create material " + subtype);
+        defaults = Material::querySupportedParams(subtype);
+      }
+
+      // clients only send the params they set, the others must be back at
+      // their defaults when switching materials (or after setSubtype())
+      if (slot.materialID != id || slot.materialVersion != version) {
+        for (auto &param : defaults)
+          mat->setParameter(param);
+        for (uint32_t p = 0; p < slot.numParams; ++p)
+          mat->setParameter(decodeParam(slot.params[p]));
+        id = slot.materialID;
+        version = slot.materialVersion;
+      }
+
+      mat->evalBatch(slot.Ng,
+          slot.Ns,
+          slot.viewDirs,
+          slot.count,
+          slot.lightDir,
+          slot.lightIntensity,
+          slot.values);
+      slot.status = 0;
+    } catch (const std::exception &e) {
+      slot.status = 1;
+      snprintf(slot.error, sizeof(slot.error), "%s", e.what());
+      mat.reset();
+    }
+
+    sem_post(&slot.response);
+  }
+}
+
+int runPluginHost(const std::string &shmName)
+{
+  int fd = shm_open(shmName.c_str(), O_RDWR, 0600);
+  if (fd < 0)
+    throw std::runtime_error("cannot open shared memory " + shmName);
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(HostHeader)) {
+    close(fd);
+    throw std::runtime_error("invalid shared memory " + shmName);
+  }
+
+  size_t size = size_t(st.st_size);
+  void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    throw std::runtime_error("cannot map shared memory " + shmName);
+
+  auto &header = *reinterpret_cast<HostHeader *>(mapping);
+  if (header.magic != HostMagic || slotOffset(header.numSlots) != size) {
+    munmap(mapping, size);
+    throw std::runtime_error("invalid shared memory " + shmName);
+  }
+
+  const pid_t parent = getppid();
+
+  std::vector<std::thread> workers;
+  for (uint32_t i = 0; i < header.numSlots; ++i) {
+    workers.emplace_back(
+        hostWorker, std::ref(header), std::ref(slotAt(mapping, i)), parent);
+  }
+
+  sem_post(&header.ready);
+
+  for (auto &w : workers)
+    w.join();
+
+  munmap(mapping, size);
+  return 0;
+}
+
+} // namespace explorer
@@ -0,0 +1,104 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <memory>
+#include <mutex>
+#include <string>
+// ours
+#include "material.h"
+
+namespace explorer {
+
+struct HostConnection;
+class RemoteMaterial;
+
+// Runs the material plugin in a separate process (anariBRDFTool host),
+// so a crashing plugin can't take down the caller. Batches of view
+// directions and their values are exchanged through a shared memory
+// region that holds one slot per host worker thread; requests only
+// carry the material's params, arrays are written in place. If the host
+// dies, it is restarted and the batch is resubmitted.
+//
+// After install(), Material::createInstance() hands out instances that
+// evaluate in the host. The plugin stays loaded in the calling process
+// for querySupportedSubtypes()/querySupportedParams() (metadata only).
+class PluginHost
+{
+ public:
+  // numWorkers == 0: one per core
+  PluginHost(std::string pluginName, unsigned numWorkers = 0);
+  ~PluginHost();
+
+  PluginHost(const PluginHost &) = delete;
+  PluginHost &operator=(const PluginHost &) = delete;
+
+  void install();
+
+  // Starts a fresh host process, e.g. after the plugin was rebuilt
+  void restart();
+
+  // Evaluates count view directions; batches larger than a slot are
+  // split. Throws std::runtime_error if the plugin threw in the host.
+  void evalBatch(const RemoteMaterial &mat,
+                 anari::math::float3 Ng,
+                 anari::math::float3 Ns,
+                 const anari::math::float3 *viewDirs,
+                 size_t count,
+                 anari::math::float3 lightDir,
+                 anari::math::float3 lightIntensity,
+                 anari::math::float3 *values);
+
+ private:
+  std::shared_ptr<HostConnection> connection();
+  void restartAfterCrash(const std::shared_ptr<HostConnection> &dead);
+
+  std::string m_pluginName;
+  unsigned m_numWorkers{0};
+
+  std::mutex m_mutex;
+  std::shared_ptr<HostConnection> m_connection;
+};
+
+// Material proxy that keeps its params locally and evaluates in the host
+class RemoteMaterial : public Material
+{
+ public:
+  RemoteMaterial(PluginHost &host, std::string_view subtype);
+
+  anari::math::float3 eval(anari::math::float3 Ng,
+                           anari::math::float3 Ns,
+                           anari::math::float3 viewDir,
+                           anari::math::float3 lightDir,
+                           anari::math::float3 lightIntensity) const override;
+
+  void evalBatch(anari::math::float3 Ng,
+                 anari::math::float3 Ns,
+                 const anari::math::float3 *viewDirs,
+                 size_t count,
+                 anari::math::float3 lightDir,
+                 anari::math::float3 lightIntensity,
+                 anari::math::float3 *values) const override;
+
+  void setSubtype(std::string_view subtype) override;
+  void setParameter(MaterialParam param) override;
+  MaterialParam getParameter(std::string_view name) const override;
+
+ private:
+  friend class PluginHost;
+
+  PluginHost &m_host;
+  uint64_t m_id{0}; // unique, so host workers can cache applied params
+  uint64_t m_version{0}; // bumped on every change
+  std::string m_subtype;
+  std::vector<MaterialParam> m_params;
+};
+
+// Host side: serves the shared memory region created by a PluginHost
+// until that process exits or shuts the host down. The plugin must
+// already be loaded.
+int runPluginHost(const std::string &shmName);
+
+} // namespace explorer
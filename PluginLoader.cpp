@@ -143,6 +143,23 @@ void *loadPlugin(std::string libName)
   return lib;
 }
 
+void *loadPluginFile(std::string fileName)
+{
+#ifdef _WIN32
+  void *lib = LoadLibrary(fileName.c_str());
+  if (!lib)
+    throw std::runtime_error("could not open library " + fileName);
+#else
+  void *lib = dlopen(fileName.c_str(), RTLD_LAZY | RTLD_LOCAL);
+  if (!lib) {
+    throw std::runtime_error(
+        "could not open library " + fileName + ": " + dlerror());
+  }
+#endif
+
+  return lib;
+}
+
 void freePlugin(void *lib)
 {
   if (lib)
@@ -154,4 +171,21 @@ void *getSymbolAddress(void *lib, const std::string &symbol)
   return LOOKUP_SYM(lib, symbol);
 }
 
+std::string getLibraryFileName(void *lib, const std::string &symbol)
+{
+#ifdef _WIN32
+  (void)symbol;
+  char pathBuf[16384];
+  if (!GetModuleFileNameA((HMODULE)lib, pathBuf, sizeof(pathBuf)))
+    return std::string();
+  return std::string(pathBuf);
+#else
+  void *addr = getSymbolAddress(lib, symbol);
+  Dl_info di;
+  if (!addr || !dladdr(addr, &di) || !di.dli_fname)
+    return std::string();
+  return std::string(di.dli_fname);
+#endif
+}
+
 } // namespace explorer
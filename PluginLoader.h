@@ -9,8 +9,15 @@ typedef void *Plugin;
 
 Plugin loadPlugin(std::string libName);
 
+// Loads the library at exactly this path (no lib prefix/extension added)
+Plugin loadPluginFile(std::string fileName);
+
 void freePlugin(void *lib);
 
 void *getSymbolAddress(void *lib, const std::string &symbol);
 
+// Path of the file lib was loaded from, found through one of its symbols;
+// empty if that can't be determined
+std::string getLibraryFileName(void *lib, const std::string &symbol);
+
 } // namespace explorer
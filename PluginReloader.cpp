@@ -0,0 +1,106 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#include "PluginReloader.h"
+
+// std
+#include <stdexcept>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace explorer {
+
+constexpr std::chrono::milliseconds PollInterval{250};
+constexpr std::chrono::milliseconds SettleTime{250};
+
+PluginReloader::~PluginReloader()
+{
+  std::error_code ec;
+  for (auto &copy : m_shadowCopies)
+    fs::remove(copy, ec);
+}
+
+void PluginReloader::watch(std::string fileName)
+{
+  m_fileName = fileName;
+  m_pending = false;
+
+  std::error_code ec;
+  m_writeTime = fs::last_write_time(m_fileName, ec);
+  m_size = fs::file_size(m_fileName, ec);
+}
+
+bool PluginReloader::changed()
+{
+  if (m_fileName.empty())
+    return false;
+
+  auto now = Clock::now();
+  if (now - m_lastPoll < PollInterval)
+    return false;
+  m_lastPoll = now;
+
+  // The file may briefly not exist while the linker replaces it
+  std::error_code ec1, ec2;
+  auto writeTime = fs::last_write_time(m_fileName, ec1);
+  auto size = fs::file_size(m_fileName, ec2);
+  if (ec1 || ec2)
+    return false;
+
+  if (writeTime != m_writeTime || size != m_size) {
+    m_writeTime = writeTime;
+    m_size = size;
+    m_lastChange = now;
+    m_pending = true;
+    return false;
+  }
+
+  if (m_pending && now - m_lastChange >= SettleTime) {
+    m_pending = false;
+    return true;
+  }
+
+  return false;
+}
+
+Plugin PluginReloader::loadShadowCopy()
+{
+  fs::path original(m_fileName);
+  fs::path copy = original.parent_path()
+      / ("." + original.filename().string() + ".reload"
+          + std::to_string(++m_generation));
+
+#ifndef _WIN32
+  copy += "." + std::to_string(getpid());
+#endif
+
+  std::error_code ec;
+  fs::copy_file(original, copy, fs::copy_options::overwrite_existing, ec);
+  if (ec) {
+    throw std::runtime_error(
+        "cannot copy " + m_fileName + " to " + copy.string() + ": " + ec.message());
+  }
+
+  Plugin plugin = nullptr;
+  try {
+    plugin = loadPluginFile(copy.string());
+  } catch (...) {
+    fs::remove(copy, ec);
+    throw;
+  }
+
+#ifdef _WIN32
+  // loaded DLLs can't be deleted, clean up on exit
+  m_shadowCopies.push_back(copy.string());
+#else
+  // the mapping stays valid after unlinking
+  fs::remove(copy, ec);
+#endif
+
+  return plugin;
+}
+
+} // namespace explorer
@@ -0,0 +1,56 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+// ours
+#include "PluginLoader.h"
+
+namespace explorer {
+
+// Watches a plugin library for rebuilds and loads the new version from a
+// shadow copy. Loading the original path again would hand back the old
+// code (the dynamic loader caches libraries by path/inode), and the build
+// can overwrite the original while the copy is in use.
+class PluginReloader
+{
+ public:
+  PluginReloader() = default;
+  ~PluginReloader();
+
+  PluginReloader(const PluginReloader &) = delete;
+  PluginReloader &operator=(const PluginReloader &) = delete;
+
+  void watch(std::string fileName);
+
+  // Cheap enough to call every frame (stats the file at most every
+  // 250 ms). True once per change, after the file stopped changing, so
+  // half-written libraries aren't picked up.
+  bool changed();
+
+  // Copies the library next to the original (so $ORIGIN rpaths keep
+  // working) and loads the copy; throws std::runtime_error on failure
+  Plugin loadShadowCopy();
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  std::string m_fileName;
+  std::filesystem::file_time_type m_writeTime{};
+  uintmax_t m_size{0};
+
+  Clock::time_point m_lastPoll{};
+  Clock::time_point m_lastChange{};
+  bool m_pending{false};
+
+  unsigned m_generation{0};
+  std::vector<std::string> m_shadowCopies; // still to be removed
+};
+
+} // namespace explorer
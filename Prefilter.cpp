@@ -0,0 +1,192 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#include "Prefilter.h"
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+// ours
+#include "Directions.h"
+#include "Parallel.h"
+
+namespace explorer {
+
+using namespace anari::math;
+
+namespace {
+
+constexpr float Pi = 3.14159265358979f;
+
+// Importance samples of one level's lobe, in the local frame (y up)
+struct LobeSample
+{
+  float3 dir;
+  float3 weight; // eval() / pdf
+  float lod; // pyramid level matching the sample's solid angle
+};
+
+static float luminance(float3 v)
+{
+  return 0.2126f * v.x + 0.7152f * v.y + 0.0722f * v.z;
+}
+
+static float random01(uint64_t index, uint64_t dimension)
+{
+  uint64_t bits = splitMix64(splitMix64(index) ^ dimension);
+  return float(bits >> 40) * (1.f / float(1ull << 24));
+}
+
+// Tabulates the lobe (view = normal = +y) on a theta/phi grid with theta
+// = pi/2 * u^2 for uniform u, so narrow lobes still get many cells, and
+// draws stratified samples proportional to the cells' luminance
+static std::vector<LobeSample> sampleLobe(const Material &mat,
+                                          uint32_t resolution,
+                                          uint32_t numSamples,
+                                          float texelSolidAngle)
+{
+  const float3 up(0.f, 1.f, 0.f);
+  const float3 white(1.f, 1.f, 1.f);
+  const uint32_t numTheta = std::max(1u, resolution);
+  const uint32_t numPhi = 2 * numTheta;
+  const float dPhi = 2.f * Pi / numPhi;
+
+  auto thetaEdge = [&](uint32_t i) {
+    float u = float(i) / numTheta;
+    return 0.5f * Pi * u * u;
+  };
+
+  std::vector<float> cellSolidAngle(numTheta);
+  for (uint32_t i = 0; i < numTheta; ++i)
+    cellSolidAngle[i] = (cosf(thetaEdge(i)) - cosf(thetaEdge(i + 1))) * dPhi;
+
+  std::vector<double> cdf(size_t(numTheta) * numPhi + 1, 0.0);
+  for (uint32_t i = 0; i < numTheta; ++i) {
+    float u = (i + 0.5f) / numTheta;
+    float theta = 0.5f * Pi * u * u;
+    for (uint32_t j = 0; j < numPhi; ++j) {
+      float3 l = sphericalDirection(theta, (j + 0.5f) * dPhi);
+      float w = luminance(mat.eval(up, up, up, l, white)) * cellSolidAngle[i];
+      size_t cell = size_t(i) * numPhi + j;
+      cdf[cell + 1] = cdf[cell] + (std::isfinite(w) ? std::max(0.f, w) : 0.f);
+    }
+  }
+
+  const double total = cdf.back();
+  std::vector<LobeSample> result;
+  if (!(total > 0.0))
+    return result; // black lobe
+
+  for (uint32_t k = 0; k < numSamples; ++k) {
+    double xi = (k + random01(k, 0)) / numSamples * total;
+    size_t cell = std::upper_bound(cdf.begin() + 1, cdf.end(), xi) - cdf.begin() - 1;
+    cell = std::min(cell, cdf.size() - 2);
+
+    const uint32_t i = uint32_t(cell / numPhi);
+    const uint32_t j = uint32_t(cell % numPhi);
+    const double p = (cdf[cell + 1] - cdf[cell]) / total;
+    if (!(p > 0.0))
+      continue;
+
+    // uniform in solid angle within the cell
+    float cos0 = cosf(thetaEdge(i)), cos1 = cosf(thetaEdge(i + 1));
+    float cosTheta = cos0 + random01(k, 1) * (cos1 - cos0);
+    float phi = (j + random01(k, 2)) * dPhi;
+    float3 l = sphericalDirection(acosf(std::clamp(cosTheta, -1.f, 1.f)), phi);
+
+    float pdf = float(p) / cellSolidAngle[i];
+    float3 value = mat.eval(up, up, up, l, white);
+    if (!std::isfinite(value.x + value.y + value.z))
+      continue;
+
+    // mip level whose texels cover the sample's share of the sphere
+    // (filtered importance sampling, +1 to blur a little more)
+    float sampleSolidAngle = 1.f / (numSamples * pdf);
+    float lod = std::max(0.f, 0.5f * log2f(sampleSolidAngle / texelSolidAngle) + 1.f);
+
+    result.push_back({l, value / pdf, lod});
+  }
+
+  return result;
+}
+
+} // namespace
+
+std::vector<EnvironmentMap> prefilterEnvironment(
+    const EnvironmentMap &map, Material &mat, const PrefilterOptions &options)
+{
+  if (options.samples == 0)
+    throw std::runtime_error("prefiltering needs at least one sample");
+
+  const EnvironmentPyramid pyramid(map);
+  const uint32_t width0 = options.width > 0 ? options.width : map.width;
+  const unsigned numThreads =
+      options.numThreads > 0 ? options.numThreads : hardwareThreads();
+  const uint32_t numLevels = std::max(1u, options.levels.count);
+
+  std::vector<EnvironmentMap> result;
+  for (uint32_t level = 0; level < numLevels; ++level) {
+    auto start = std::chrono::steady_clock::now();
+
+    if (!options.levels.name.empty()) {
+      mat.setParameter({options.levels.name,
+          std::any(options.levels.value(level)),
+          DataType::Float});
+    }
+
+    auto samples = sampleLobe(
+        mat, options.lobeResolution, options.samples, pyramid.texelSolidAngle());
+
+    const uint32_t width = std::max(8u, width0 >> level);
+    EnvironmentMap out(width, std::max(4u, width / 2));
+
+    parallelFor(numThreads, out.height, [&](unsigned, size_t y) {
+      if (options.cancel && *options.cancel)
+        throw std::runtime_error("prefiltering cancelled");
+
+      for (uint32_t x = 0; x < out.width; ++x) {
+        float3 r = environmentDirection(out.width, out.height, x + 0.5f, y + 0.5f);
+        float3 t, b;
+        makeFrame(r, t, b);
+
+        float3 sum(0.f);
+        for (auto &s : samples) {
+          float3 l = t * s.dir.x + r * s.dir.y + b * s.dir.z;
+          sum += s.weight * pyramid.lookup(l, s.lod);
+        }
+        out.at(x, uint32_t(y)) = sum / float(options.samples);
+      }
+    });
+
+    if (options.verbose) {
+      std::chrono::duration<double, std::milli> elapsed =
+          std::chrono::steady_clock::now() - start;
+      std::cerr << "[prefilter] level " << level;
+      if (!options.levels.name.empty())
+        std::cerr << " (" << options.levels.name << " = " << options.levels.value(level) << ")";
+      std::cerr << ": " << out.width << 'x' << out.height << ", " << samples.size()
+                << " samples, " << elapsed.count() << " ms\n";
+    }
+
+    result.push_back(std::move(out));
+  }
+
+  return result;
+}
+
+void savePrefilteredLevels(
+    const std::string &prefix, const std::vector<EnvironmentMap> &levels)
+{
+  const int digits = int(std::to_string(levels.empty() ? 0 : levels.size() - 1).size());
+  for (size_t i = 0; i < levels.size(); ++i) {
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "_%0*zu.hdr", digits, i);
+    saveEnvironmentMap(prefix + suffix, levels[i]);
+  }
+}
+
+} // namespace explorer
@@ -0,0 +1,51 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <atomic>
+#include <string>
+#include <vector>
+// ours
+#include "EnvironmentMap.h"
+#include "material.h"
+#include "Sweep.h"
+
+namespace explorer {
+
+struct PrefilterOptions
+{
+  // Float param varied over the output levels (e.g., roughness 0:1:6);
+  // without a name there's a single level with the material's values
+  SweepAxis levels{"", 0.f, 0.f, 1};
+  uint32_t width{0}; // of level 0 (0: as the input), halved per level
+  uint32_t samples{512}; // per texel
+  uint32_t lobeResolution{128}; // theta cells of the tabulated lobe
+  unsigned numThreads{0}; // 0: use all cores
+  bool verbose{false};
+  const std::atomic<bool> *cancel{nullptr}; // polled per row
+};
+
+// Convolves an environment map with the material, one map per level:
+// texel r holds the radiance reflected towards r by a surface with normal
+// r (view = normal, as for split-sum prefiltering), i.e., the integral of
+// L(l) * eval(r, r, r, l) over l.
+//
+// The lobe is the same in every texel's frame, so the plugin is only
+// evaluated once per level: on a grid over the hemisphere (denser near
+// the normal), which becomes the importance sampling distribution, and
+// at the samples drawn from it. All texels then share these samples;
+// each one is looked up in a mip pyramid of the input at the level
+// matching its solid angle, which keeps the result free of noise even for
+// rough lobes. Texels are integrated in parallel.
+//
+// Sets the level param on mat. Throws std::runtime_error when cancelled.
+std::vector<EnvironmentMap> prefilterEnvironment(
+    const EnvironmentMap &map, Material &mat, const PrefilterOptions &options);
+
+// Writes <prefix>_<level>.hdr for all levels
+void savePrefilteredLevels(
+    const std::string &prefix, const std::vector<EnvironmentMap> &levels);
+
+} // namespace explorer
@@ -0,0 +1,112 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#include "Preset.h"
+
+// std
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace explorer {
+
+using namespace anari::math;
+
+Preset loadPreset(std::string fileName)
+{
+  std::ifstream in(fileName);
+  if (!in)
+    throw std::runtime_error("cannot open preset " + fileName);
+
+  Preset result;
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream ls(line);
+    std::string name;
+    if (!(ls >> name) || name[0] == '#')
+      continue;
+
+    if (name == "subtype") {
+      ls >> result.subtype;
+      continue;
+    }
+
+    std::vector<float> v;
+    for (float f; ls >> f;)
+      v.push_back(f);
+
+    MaterialParam param;
+    param.name = name;
+    if (v.size() == 1) {
+      param.type = DataType::Float;
+      param.value = v[0];
+    } else if (v.size() == 2) {
+      param.type = DataType::Float2;
+      param.value = float2(v[0], v[1]);
+    } else if (v.size() == 3) {
+      param.type = DataType::Float3;
+      param.value = float3(v[0], v[1], v[2]);
+    } else if (v.size() == 4) {
+      param.type = DataType::Float4;
+      param.value = float4(v[0], v[1], v[2], v[3]);
+    } else {
+      throw std::runtime_error("invalid value for " + name + " in " + fileName);
+    }
+    result.params.push_back(param);
+  }
+
+  if (result.subtype.empty())
+    throw std::runtime_error(fileName + " doesn't specify a subtype");
+
+  return result;
+}
+
+void savePreset(std::string fileName, const Preset &preset)
+{
+  std::ofstream out(fileName);
+  if (!out)
+    throw std::runtime_error("cannot write preset " + fileName);
+
+  out.precision(9); // round-trips floats exactly
+  out << "subtype " << preset.subtype << '\n';
+  for (auto &param : preset.params) {
+    out << param.name;
+    if (param.type == DataType::Float) {
+      out << ' ' << std::any_cast<float>(param.value);
+    } else if (param.type == DataType::Float2) {
+      auto v = std::any_cast<float2>(param.value);
+      out << ' ' << v.x << ' ' << v.y;
+    } else if (param.type == DataType::Float3) {
+      auto v = std::any_cast<float3>(param.value);
+      out << ' ' << v.x << ' ' << v.y << ' ' << v.z;
+    } else if (param.type == DataType::Float4) {
+      auto v = std::any_cast<float4>(param.value);
+      out << ' ' << v.x << ' ' << v.y << ' ' << v.z << ' ' << v.w;
+    }
+    out << '\n';
+  }
+
+  if (!out)
+    throw std::runtime_error("cannot write preset " + fileName);
+}
+
+Preset makePreset(std::string_view subtype, const Material &mat)
+{
+  Preset result;
+  result.subtype = std::string(subtype);
+  for (auto &param : Material::querySupportedParams(subtype)) {
+    auto actualParam = mat.getParameter(param.name);
+    if (actualParam.value.has_value())
+      result.params.push_back(actualParam);
+  }
+  return result;
+}
+
+void applyPreset(const Preset &preset, Material &mat)
+{
+  mat.setSubtype(preset.subtype);
+  for (auto &param : preset.params)
+    mat.setParameter(param);
+}
+
+} // namespace explorer
@@ -0,0 +1,37 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <string>
+#include <vector>
+// ours
+#include "material.h"
+
+namespace explorer {
+
+// A named parameter set, stored as plain text:
+//
+//   subtype PBM
+//   roughness 0.25
+//   baseColor 0.8 0.5 0.3
+//
+// The number of values determines the DataType (1: Float, 3: Float3, ...)
+struct Preset
+{
+  std::string subtype;
+  std::vector<MaterialParam> params;
+};
+
+Preset loadPreset(std::string fileName);
+
+void savePreset(std::string fileName, const Preset &preset);
+
+// Current values of all params that subtype supports
+Preset makePreset(std::string_view subtype, const Material &mat);
+
+// Switches mat to the preset's subtype and applies its params
+void applyPreset(const Preset &preset, Material &mat);
+
+} // namespace explorer
@@ -0,0 +1,151 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#include "QualityController.h"
+
+// std
+#include <algorithm>
+#include <cmath>
+// ours
+#include "Parallel.h"
+
+namespace explorer {
+
+// Weight of a new measurement in the running estimates
+constexpr double Smoothing = 0.3;
+
+// Cost of an extra worker thread per update (start and join), so cheap
+// lobes stay on one thread
+constexpr double ThreadOverheadMs = 0.05;
+
+// The choice is kept while its predicted latency is within this band
+// around the target, and when the new one differs by less than this
+constexpr double LowerBand = 0.7;
+constexpr double UpperBand = 1.15;
+constexpr double MinSegmentChange = 0.15;
+
+static size_t gridVertices(int segments)
+{
+  return size_t(segments - 1) * size_t(segments);
+}
+
+QualityController::QualityController(
+    int minSegments, int maxSegments, unsigned maxThreads)
+  : m_minSegments(std::max(3, minSegments))
+  , m_maxSegments(std::max(m_minSegments, maxSegments))
+  , m_maxThreads(maxThreads > 0 ? maxThreads : hardwareThreads())
+{}
+
+void QualityController::setTarget(double latencyMs)
+{
+  m_targetMs = std::max(0.0, latencyMs);
+}
+
+double QualityController::target() const
+{
+  return m_targetMs;
+}
+
+void QualityController::reset()
+{
+  m_measured = false;
+  m_evalNsPerSample = 0.0;
+  m_updateNsPerVertex = 0.0;
+  m_lastLatencyMs = 0.0;
+}
+
+void QualityController::record(size_t numSamples,
+                               unsigned numThreads,
+                               double evalMs,
+                               size_t numVertices,
+                               double updateMs)
+{
+  if (numSamples == 0 || numVertices == 0)
+    return;
+
+  // as if on one thread; imperfect scaling shows up as a higher cost
+  const double overheadMs = ThreadOverheadMs * (std::max(1u, numThreads) - 1);
+  const double evalNs = std::max(0.0, evalMs - overheadMs) * 1e6
+      * std::max(1u, numThreads) / numSamples;
+  const double updateNs = updateMs * 1e6 / numVertices;
+
+  const double w = m_measured ? Smoothing : 1.0;
+  m_evalNsPerSample += w * (evalNs - m_evalNsPerSample);
+  m_updateNsPerVertex += w * (updateNs - m_updateNsPerVertex);
+  m_lastLatencyMs = evalMs + updateMs;
+  m_measured = true;
+}
+
+double QualityController::predictLatencyMs(const QualityChoice &choice) const
+{
+  const double n = double(gridVertices(choice.segments));
+  const unsigned threads = std::max(1u, choice.threads);
+  return (n * m_evalNsPerSample / threads + n * m_updateNsPerVertex) * 1e-6
+      + ThreadOverheadMs * (threads - 1);
+}
+
+unsigned QualityController::threadsFor(int segments) const
+{
+  // as few as meet the target, leaving cores to the other workers
+  unsigned best = 1;
+  double bestMs = predictLatencyMs({segments, 1});
+  for (unsigned t = 1; t <= m_maxThreads; ++t) {
+    double ms = predictLatencyMs({segments, t});
+    if (ms <= m_targetMs)
+      return t;
+    if (ms < bestMs) {
+      best = t;
+      bestMs = ms;
+    }
+  }
+  return best;
+}
+
+QualityChoice QualityController::choose(const QualityChoice &current) const
+{
+  if (!m_measured)
+    return current;
+
+  // the finest resolution that fits, the coarsest one if none does
+  QualityChoice ideal{m_minSegments, threadsFor(m_minSegments)};
+  for (int s = m_maxSegments; s > m_minSegments; --s) {
+    QualityChoice c{s, threadsFor(s)};
+    if (predictLatencyMs(c) <= m_targetMs) {
+      ideal = c;
+      break;
+    }
+  }
+
+  const double predicted = predictLatencyMs(current);
+  const bool inBand = predicted >= LowerBand * m_targetMs
+      && predicted <= UpperBand * m_targetMs;
+  const bool smallChange = std::abs(ideal.segments - current.segments)
+      < MinSegmentChange * current.segments;
+
+  // threads don't change what's shown, they can follow the costs freely
+  if (inBand && smallChange)
+    return {current.segments, threadsFor(current.segments)};
+  return ideal;
+}
+
+bool QualityController::measured() const
+{
+  return m_measured;
+}
+
+double QualityController::evalNsPerSample() const
+{
+  return m_evalNsPerSample;
+}
+
+double QualityController::updateNsPerVertex() const
+{
+  return m_updateNsPerVertex;
+}
+
+double QualityController::lastLatencyMs() const
+{
+  return m_lastLatencyMs;
+}
+
+} // namespace explorer
@@ -0,0 +1,72 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <cstddef>
+
+namespace explorer {
+
+struct QualityChoice
+{
+  int segments{100}; // of the lobe's SphereGrid
+  unsigned threads{1}; // evaluating the lobe
+};
+
+// Picks the lobe resolution (and the fewest threads evaluating it) so
+// that a lobe update, i.e., evaluation, meshing and handing the arrays to
+// the device, takes about a target latency. The costs are learned online
+// from the updates: eval time per sample and thread (which depends on the
+// plugin and subtype), and update time per vertex (which depends on the
+// device). The choice only changes when the predicted latency leaves a
+// band around the target, so it doesn't flip between neighbouring
+// resolutions from update to update.
+class QualityController
+{
+ public:
+  QualityController(int minSegments = 16,
+                    int maxSegments = 400,
+                    unsigned maxThreads = 0); // 0: all cores
+
+  void setTarget(double latencyMs);
+  double target() const;
+
+  // Forgets the learned costs (e.g., the subtype or the plugin changed),
+  // the next update is measured from scratch
+  void reset();
+
+  // One lobe update: numSamples eval() calls on numThreads took evalMs,
+  // meshing and updating numVertices vertices took updateMs
+  void record(size_t numSamples,
+              unsigned numThreads,
+              double evalMs,
+              size_t numVertices,
+              double updateMs);
+
+  // The choice for the next update; current if nothing was measured yet
+  // or its predicted latency is still close to the target
+  QualityChoice choose(const QualityChoice &current) const;
+
+  double predictLatencyMs(const QualityChoice &choice) const;
+
+  bool measured() const;
+  double evalNsPerSample() const; // single thread
+  double updateNsPerVertex() const;
+  double lastLatencyMs() const;
+
+ private:
+  unsigned threadsFor(int segments) const;
+
+  int m_minSegments;
+  int m_maxSegments;
+  unsigned m_maxThreads;
+  double m_targetMs{33.0};
+
+  bool m_measured{false};
+  double m_evalNsPerSample{0.0};
+  double m_updateNsPerVertex{0.0};
+  double m_lastLatencyMs{0.0};
+};
+
+} // namespace explorer
@@ -0,0 +1,521 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#include "SamplingTable.h"
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+// posix
+#include <unistd.h>
+// ours
+#include "Directions.h"
+#include "Parallel.h"
+
+namespace explorer {
+
+using namespace anari::math;
+
+namespace {
+
+constexpr float Pi = 3.14159265358979f;
+
+// On-disk layout: header, then the marginal and the conditional CDFs as
+// float arrays
+
+constexpr char SamplingFileMagic[8] = "BRDFSMP";
+constexpr uint32_t SamplingFileVersion = 1;
+
+struct FileHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t numLightTheta;
+  uint32_t numViewTheta;
+  uint32_t numViewPhi;
+  uint64_t key;
+  char subtype[64];
+};
+
+using File = std::unique_ptr<FILE, int (*)(FILE *)>;
+
+static void writeAll(FILE *file, const void *data, size_t size, const std::string &fileName)
+{
+  if (size > 0 && fwrite(data, size, 1, file) != 1)
+    throw std::runtime_error("write to " + fileName + " failed");
+}
+
+static void readAll(FILE *file, void *data, size_t size, const std::string &fileName)
+{
+  if (size > 0 && fread(data, size, 1, file) != 1)
+    throw std::runtime_error(fileName + " is truncated");
+}
+
+static float luminance(float3 v)
+{
+  return 0.2126f * v.x + 0.7152f * v.y + 0.0722f * v.z;
+}
+
+// FNV-1a
+struct Hasher
+{
+  uint64_t value{0xcbf29ce484222325ull};
+
+  void add(const void *data, size_t size)
+  {
+    auto *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; ++i) {
+      value ^= bytes[i];
+      value *= 0x100000001b3ull;
+    }
+  }
+
+  void addString(std::string_view str)
+  {
+    add(str.data(), str.size());
+    add(uint8_t(0)); // so "ab" + "c" != "a" + "bc"
+  }
+
+  template <typename T>
+  void add(const T &v)
+  {
+    add(&v, sizeof(v));
+  }
+};
+
+static float cellSolidAngle(const SamplingTable &table, uint32_t row)
+{
+  const float dTheta = 0.5f * Pi / table.numViewTheta;
+  const float dPhi = 2.f * Pi / table.numViewPhi;
+  return (cosf(row * dTheta) - cosf((row + 1) * dTheta)) * dPhi;
+}
+
+// The interval [cdf[i], cdf[i+1]) that contains u, skipping empty ones
+static uint32_t findInterval(const float *cdf, uint32_t n, float u)
+{
+  uint32_t i = uint32_t(std::upper_bound(cdf, cdf + n + 1, u) - cdf);
+  i = std::clamp(i, 1u, n) - 1;
+  while (i > 0 && !(cdf[i + 1] > cdf[i]))
+    --i;
+  return i;
+}
+
+// The slices around the light's elevation and the weight of the second
+struct SliceLerp
+{
+  uint32_t k0{0}, k1{0};
+  float w{0.f};
+};
+
+static SliceLerp lightSlices(const SamplingTable &table, float3 lightDir)
+{
+  const float theta = acosf(std::clamp(lightDir.y, 0.f, 1.f));
+  const uint32_t last = table.numLightTheta - 1;
+  float x = theta / (0.5f * Pi) * table.numLightTheta - 0.5f;
+  x = std::clamp(x, 0.f, float(last));
+
+  SliceLerp result;
+  result.k0 = std::min(uint32_t(x), last > 0 ? last - 1 : 0u);
+  result.k1 = std::min(result.k0 + 1, last);
+  result.w = result.k1 != result.k0 ? x - result.k0 : 0.f;
+  return result;
+}
+
+static float lightAzimuth(float3 lightDir)
+{
+  // lights at the normal have no azimuth, the tables are symmetric there
+  return (lightDir.x != 0.f || lightDir.z != 0.f) ? atan2f(lightDir.z, lightDir.x)
+                                                  : 0.f;
+}
+
+// Probability of cell (row, column) in slice k
+static float cellProbability(
+    const SamplingTable &table, uint32_t k, uint32_t row, uint32_t column)
+{
+  const float *marginal = &table.marginalCDF[size_t(k) * (table.numViewTheta + 1)];
+  const float *conditional = &table.conditionalCDF[
+      (size_t(k) * table.numViewTheta + row) * (table.numViewPhi + 1)];
+  return (marginal[row + 1] - marginal[row])
+      * (conditional[column + 1] - conditional[column]);
+}
+
+static std::string hexKey(uint64_t key)
+{
+  char buffer[17];
+  snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)key);
+  return buffer;
+}
+
+} // namespace
+
+// SamplingTable //
+
+float3 SamplingTable::sample(
+    float3 lightDir, float u1, float u2, float u3, float &pdf) const
+{
+  const auto slices = lightSlices(*this, lightDir);
+  const uint32_t k = u3 < slices.w ? slices.k1 : slices.k0;
+
+  const float *marginal = &marginalCDF[size_t(k) * (numViewTheta + 1)];
+  const uint32_t row = findInterval(marginal, numViewTheta, u1);
+  const float *conditional =
+      &conditionalCDF[(size_t(k) * numViewTheta + row) * (numViewPhi + 1)];
+  const uint32_t column = findInterval(conditional, numViewPhi, u2);
+
+  // the remainders position the direction within the cell, uniformly in
+  // solid angle (i.e., in cos(theta) and phi)
+  auto remainder = [](const float *cdf, uint32_t i, float u) {
+    float width = cdf[i + 1] - cdf[i];
+    return width > 0.f ? std::clamp((u - cdf[i]) / width, 0.f, 1.f) : 0.5f;
+  };
+
+  const float dTheta = 0.5f * Pi / numViewTheta;
+  const float dPhi = 2.f * Pi / numViewPhi;
+  const float cos0 = cosf(row * dTheta), cos1 = cosf((row + 1) * dTheta);
+  const float cosTheta = cos0 + remainder(marginal, row, u1) * (cos1 - cos0);
+  const float phi =
+      (column + remainder(conditional, column, u2)) * dPhi + lightAzimuth(lightDir);
+
+  pdf = ((1.f - slices.w) * cellProbability(*this, slices.k0, row, column)
+            + slices.w * cellProbability(*this, slices.k1, row, column))
+      / cellSolidAngle(*this, row);
+  return sphericalDirection(acosf(std::clamp(cosTheta, -1.f, 1.f)), phi);
+}
+
+float SamplingTable::pdf(float3 lightDir, float3 viewDir) const
+{
+  if (!(viewDir.y > 0.f))
+    return 0.f;
+
+  const float dTheta = 0.5f * Pi / numViewTheta;
+  const float dPhi = 2.f * Pi / numViewPhi;
+
+  const float theta = acosf(std::min(viewDir.y, 1.f));
+  const uint32_t row = std::min(uint32_t(theta / dTheta), numViewTheta - 1);
+
+  float phi = atan2f(viewDir.z, viewDir.x) - lightAzimuth(lightDir);
+  phi -= floorf(phi / (2.f * Pi)) * 2.f * Pi;
+  const uint32_t column = std::min(uint32_t(phi / dPhi), numViewPhi - 1);
+
+  const auto slices = lightSlices(*this, lightDir);
+  return ((1.f - slices.w) * cellProbability(*this, slices.k0, row, column)
+             + slices.w * cellProbability(*this, slices.k1, row, column))
+      / cellSolidAngle(*this, row);
+}
+
+// Building //
+
+SamplingTable buildSamplingTable(std::string_view subtype,
+                                 const Material &mat,
+                                 const SamplingTableOptions &options)
+{
+  if (options.lightTheta == 0 || options.viewTheta == 0 || options.viewPhi == 0
+      || options.supersampling == 0)
+    throw std::runtime_error("sampling table resolutions must be positive");
+  if (!(options.uniformFraction >= 0.f && options.uniformFraction <= 1.f))
+    throw std::runtime_error("uniform fraction must be in [0,1]");
+
+  auto start = std::chrono::steady_clock::now();
+
+  SamplingTable table;
+  table.subtype = std::string(subtype);
+  table.key = samplingTableKey(subtype, mat, options);
+  table.numLightTheta = options.lightTheta;
+  table.numViewTheta = options.viewTheta;
+  table.numViewPhi = options.viewPhi;
+
+  const uint32_t L = options.lightTheta;
+  const uint32_t T = options.viewTheta;
+  const uint32_t P = options.viewPhi;
+  const uint32_t S = options.supersampling;
+  const float dTheta = 0.5f * Pi / T;
+  const float dPhi = 2.f * Pi / P;
+
+  const unsigned numThreads = std::max(1u,
+      std::min(options.numThreads > 0 ? options.numThreads : hardwareThreads(),
+          L * T));
+
+  std::vector<std::unique_ptr<Material>> materials(numThreads);
+  for (auto &m : materials) {
+    m.reset(Material::cloneInstance(subtype, mat));
+    if (!m)
+      throw std::runtime_error("cannot copy material " + std::string(subtype));
+  }
+
+  // integral of luminance(eval) * cos(theta_v) over each cell, estimated
+  // from S x S stratified evaluations
+  std::vector<double> weights(size_t(L) * T * P, 0.0);
+
+  parallelFor(numThreads, size_t(L) * T, [&](unsigned threadID, size_t job) {
+    const uint32_t k = uint32_t(job / T);
+    const uint32_t row = uint32_t(job % T);
+    const float thetaL = 0.5f * Pi * (k + 0.5f) / L;
+    const float3 up(0.f, 1.f, 0.f);
+
+    std::vector<float3> dirs;
+    std::vector<float> cosines;
+    dirs.reserve(size_t(P) * S * S);
+    for (uint32_t column = 0; column < P; ++column) {
+      for (uint32_t a = 0; a < S; ++a) {
+        float theta = (row + (a + 0.5f) / S) * dTheta;
+        for (uint32_t b = 0; b < S; ++b) {
+          float phi = (column + (b + 0.5f) / S) * dPhi;
+          dirs.push_back(sphericalDirection(theta, phi));
+          cosines.push_back(cosf(theta));
+        }
+      }
+    }
+
+    std::vector<float3> values(dirs.size());
+    materials[threadID]->evalBatch(up,
+        up,
+        dirs.data(),
+        dirs.size(),
+        sphericalDirection(thetaL, 0.f),
+        float3(1.f),
+        values.data());
+
+    const double solidAngle = cellSolidAngle(table, row);
+    double *w = &weights[job * P];
+    for (size_t i = 0; i < values.size(); ++i) {
+      float v = luminance(values[i]) * cosines[i];
+      if (std::isfinite(v) && v > 0.f)
+        w[i / (S * S)] += double(v) * solidAngle / (S * S);
+    }
+  });
+
+  table.marginalCDF.resize(size_t(L) * (T + 1));
+  table.conditionalCDF.resize(size_t(L) * T * (P + 1));
+
+  for (uint32_t k = 0; k < L; ++k) {
+    const double *w = &weights[size_t(k) * T * P];
+    double total = 0.0;
+    for (size_t i = 0; i < size_t(T) * P; ++i)
+      total += w[i];
+
+    // black slices are sampled uniformly
+    const double uniform = total > 0.0 ? options.uniformFraction : 1.0;
+
+    float *marginal = &table.marginalCDF[size_t(k) * (T + 1)];
+    std::vector<double> rowProbability(T, 0.0);
+    for (uint32_t row = 0; row < T; ++row) {
+      const double cellUniform =
+          uniform * cellSolidAngle(table, row) / (2.0 * Pi);
+
+      float *conditional = &table.conditionalCDF[(size_t(k) * T + row) * (P + 1)];
+      std::vector<double> p(P);
+      for (uint32_t column = 0; column < P; ++column) {
+        double fromEval = total > 0.0 ? w[size_t(row) * P + column] / total : 0.0;
+        p[column] = (1.0 - uniform) * fromEval + cellUniform;
+        rowProbability[row] += p[column];
+      }
+
+      double sum = 0.0;
+      conditional[0] = 0.f;
+      for (uint32_t column = 0; column < P; ++column) {
+        sum += p[column];
+        conditional[column + 1] =
+            rowProbability[row] > 0.0 ? float(sum / rowProbability[row]) : 0.f;
+      }
+      conditional[P] = 1.f;
+    }
+
+    double sum = 0.0;
+    marginal[0] = 0.f;
+    for (uint32_t row = 0; row < T; ++row) {
+      sum += rowProbability[row];
+      marginal[row + 1] = float(sum);
+    }
+    marginal[T] = 1.f;
+  }
+
+  if (options.verbose) {
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cerr << "[sampling] " << subtype << ": " << L << " x " << T << " x "
+              << P << " cells, " << weights.size() * S * S << " evals, "
+              << elapsed.count() << " ms\n";
+  }
+
+  return table;
+}
+
+uint64_t samplingTableKey(std::string_view subtype,
+                          const Material &mat,
+                          const SamplingTableOptions &options)
+{
+  Hasher h;
+  h.add(uint32_t(SamplingFileVersion));
+
+  const std::string plugin = Material::pluginFileName();
+  h.addString(plugin);
+  std::error_code ec;
+  auto modified = std::filesystem::last_write_time(plugin, ec);
+  if (!ec)
+    h.add(int64_t(modified.time_since_epoch().count()));
+
+  h.addString(subtype);
+  for (auto &param : Material::querySupportedParams(subtype)) {
+    auto actual = mat.getParameter(param.name);
+    h.addString(param.name);
+    h.add(uint32_t(param.type));
+    if (auto *v = std::any_cast<float>(&actual.value))
+      h.add(*v);
+    else if (auto *v = std::any_cast<float2>(&actual.value))
+      h.add(*v);
+    else if (auto *v = std::any_cast<float3>(&actual.value))
+      h.add(*v);
+    else if (auto *v = std::any_cast<float4>(&actual.value))
+      h.add(*v);
+  }
+
+  h.add(options.lightTheta);
+  h.add(options.viewTheta);
+  h.add(options.viewPhi);
+  h.add(options.supersampling);
+  h.add(options.uniformFraction);
+  return h.value;
+}
+
+// I/O //
+
+void saveSamplingTable(const std::string &fileName, const SamplingTable &table)
+{
+  const size_t L = table.numLightTheta, T = table.numViewTheta, P = table.numViewPhi;
+  if (L == 0 || T == 0 || P == 0 || table.marginalCDF.size() != L * (T + 1)
+      || table.conditionalCDF.size() != L * T * (P + 1))
+    throw std::runtime_error("inconsistent sampling table");
+
+  File file(fopen(fileName.c_str(), "wb"), &fclose);
+  if (!file)
+    throw std::runtime_error("cannot open " + fileName + " for writing");
+
+  FileHeader header{};
+  std::memcpy(header.magic, SamplingFileMagic, sizeof(header.magic));
+  header.version = SamplingFileVersion;
+  header.numLightTheta = table.numLightTheta;
+  header.numViewTheta = table.numViewTheta;
+  header.numViewPhi = table.numViewPhi;
+  header.key = table.key;
+  std::strncpy(header.subtype, table.subtype.c_str(), sizeof(header.subtype) - 1);
+  writeAll(file.get(), &header, sizeof(header), fileName);
+
+  writeAll(file.get(),
+      table.marginalCDF.data(),
+      table.marginalCDF.size() * sizeof(float),
+      fileName);
+  writeAll(file.get(),
+      table.conditionalCDF.data(),
+      table.conditionalCDF.size() * sizeof(float),
+      fileName);
+
+  if (fflush(file.get()) != 0)
+    throw std::runtime_error("write to " + fileName + " failed");
+}
+
+SamplingTable loadSamplingTable(const std::string &fileName)
+{
+  File file(fopen(fileName.c_str(), "rb"), &fclose);
+  if (!file)
+    throw std::runtime_error("cannot open " + fileName);
+
+  FileHeader header;
+  readAll(file.get(), &header, sizeof(header), fileName);
+  if (std::memcmp(header.magic, SamplingFileMagic, sizeof(header.magic)) != 0
+      || header.version != SamplingFileVersion || header.numLightTheta == 0
+      || header.numViewTheta == 0 || header.numViewPhi == 0
+      || header.numViewTheta > (1u << 16) || header.numViewPhi > (1u << 16)
+      || header.numLightTheta > (1u << 16))
+    throw std::runtime_error(fileName + " is not a valid sampling table");
+
+  SamplingTable table;
+  table.subtype =
+      std::string(header.subtype, strnlen(header.subtype, sizeof(header.subtype)));
+  table.key = header.key;
+  table.numLightTheta = header.numLightTheta;
+  table.numViewTheta = header.numViewTheta;
+  table.numViewPhi = header.numViewPhi;
+
+  const size_t L = table.numLightTheta, T = table.numViewTheta, P = table.numViewPhi;
+  table.marginalCDF.resize(L * (T + 1));
+  table.conditionalCDF.resize(L * T * (P + 1));
+  readAll(file.get(),
+      table.marginalCDF.data(),
+      table.marginalCDF.size() * sizeof(float),
+      fileName);
+  readAll(file.get(),
+      table.conditionalCDF.data(),
+      table.conditionalCDF.size() * sizeof(float),
+      fileName);
+
+  return table;
+}
+
+SamplingTable cachedSamplingTable(const std::string &cacheDir,
+                                  std::string_view subtype,
+                                  const Material &mat,
+                                  const SamplingTableOptions &options,
+                                  bool *fromCache)
+{
+  const uint64_t key = samplingTableKey(subtype, mat, options);
+
+  std::string name(subtype);
+  for (auto &c : name) {
+    if (!isalnum((unsigned char)c) && c != '-' && c != '_')
+      c = '_';
+  }
+  const std::string fileName =
+      (std::filesystem::path(cacheDir) / (name + "-" + hexKey(key) + ".smp")).string();
+
+  if (fromCache)
+    *fromCache = false;
+
+  // anything wrong with the file (missing, truncated, hash collision
+  // between subtypes) just means building it again
+  try {
+    auto table = loadSamplingTable(fileName);
+    if (table.key == key && table.subtype == subtype
+        && table.numLightTheta == options.lightTheta
+        && table.numViewTheta == options.viewTheta
+        && table.numViewPhi == options.viewPhi) {
+      if (fromCache)
+        *fromCache = true;
+      return table;
+    }
+  } catch (const std::exception &) {
+  }
+
+  auto table = buildSamplingTable(subtype, mat, options);
+
+  // written under a temporary name first, so concurrent readers never
+  // see a partial file; the name is unique to this process and call, so
+  // concurrent builders of the same table don't write into one file (the
+  // last rename wins, all of them are complete)
+  static std::atomic<uint64_t> tmpCounter{0};
+  std::error_code ec;
+  std::filesystem::create_directories(cacheDir, ec);
+  const std::string tmpName = fileName + ".tmp" + std::to_string(getpid()) + "-"
+      + std::to_string(tmpCounter++);
+  try {
+    saveSamplingTable(tmpName, table);
+    std::filesystem::rename(tmpName, fileName);
+  } catch (const std::exception &e) {
+    std::filesystem::remove(tmpName, ec);
+    if (options.verbose)
+      std::cerr << "[sampling] not cached: " << e.what() << '\n';
+  }
+
+  return table;
+}
+
+} // namespace explorer
@@ -0,0 +1,93 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <cstdint>
+#include <string>
+#include <vector>
+// anari
+#include <anari/anari_cpp/ext/linalg.h>
+// ours
+#include "material.h"
+
+namespace explorer {
+
+// Tabulated importance sampling of view directions for plugins that only
+// implement eval(): for each of a set of light elevations, a piecewise
+// constant distribution over the hemisphere proportional to
+// luminance(eval(v, l)) * cos(theta_v), stored as a marginal CDF over
+// theta_v rows and one conditional CDF over phi_v per row. Sampling is
+// two binary searches; directions are uniform in solid angle within
+// their cell, so pdf() is exact. A small uniform part keeps the pdf
+// positive wherever eval() might be.
+//
+// The material is assumed to be isotropic: tables are built for lights at
+// phi = 0 and rotated to the light's azimuth. All directions are in the
+// local frame (y up, like the lobes).
+struct SamplingTable
+{
+  std::string subtype;
+  uint64_t key{0}; // see samplingTableKey()
+  uint32_t numLightTheta{0}; // slices at theta_l = 90 deg * (i + 0.5) / n
+  uint32_t numViewTheta{0}; // rows, uniform in theta_v over [0,90] deg
+  uint32_t numViewPhi{0}; // columns over [0,360) deg, relative to the light
+
+  std::vector<float> marginalCDF; // [light][row + 1]
+  std::vector<float> conditionalCDF; // [light][row][column + 1]
+
+  // u1, u2 pick the row and column (their remainders the position in the
+  // cell), u3 one of the two slices around the light's elevation;
+  // returns the view direction and its pdf w.r.t. solid angle
+  anari::math::float3 sample(anari::math::float3 lightDir,
+                             float u1,
+                             float u2,
+                             float u3,
+                             float &pdf) const;
+
+  float pdf(anari::math::float3 lightDir, anari::math::float3 viewDir) const;
+
+  uint64_t bytes() const
+  {
+    return (marginalCDF.size() + conditionalCDF.size()) * sizeof(float);
+  }
+};
+
+struct SamplingTableOptions
+{
+  uint32_t lightTheta{16};
+  uint32_t viewTheta{64};
+  uint32_t viewPhi{128};
+  uint32_t supersampling{2}; // n x n eval() calls per cell
+  float uniformFraction{0.02f}; // of the probability spread uniformly
+  unsigned numThreads{0}; // 0: use all cores
+  bool verbose{false};
+};
+
+// Builds the table from subtype's current params in mat; rows are
+// evaluated in parallel, on one copy of mat per thread. Throws
+// std::runtime_error if mat can't be copied.
+SamplingTable buildSamplingTable(std::string_view subtype,
+                                 const Material &mat,
+                                 const SamplingTableOptions &options);
+
+// Hash of everything the table depends on: the plugin library (path and
+// modification time), subtype, all param values and the resolution
+uint64_t samplingTableKey(std::string_view subtype,
+                          const Material &mat,
+                          const SamplingTableOptions &options);
+
+// Throw std::runtime_error on I/O errors or invalid files
+void saveSamplingTable(const std::string &fileName, const SamplingTable &table);
+SamplingTable loadSamplingTable(const std::string &fileName);
+
+// The table for mat's current params from cacheDir (one file per param
+// snapshot) if it's there and valid, else built and stored there
+SamplingTable cachedSamplingTable(const std::string &cacheDir,
+                                  std::string_view subtype,
+                                  const Material &mat,
+                                  const SamplingTableOptions &options,
+                                  bool *fromCache = nullptr);
+
+} // namespace explorer
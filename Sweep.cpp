@@ -0,0 +1,742 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#include "Sweep.h"
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+// posix
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+// ours
+#include "Directions.h"
+#include "Parallel.h"
+
+namespace explorer {
+
+using namespace anari::math;
+
+namespace {
+
+// On-disk layout //////////////////////////////////////////////////////////////
+
+constexpr char SweepFileMagic[8] = "BRDFSWP";
+constexpr char CheckpointMagic[8] = "BRDFCKP";
+constexpr uint32_t SweepFileVersion = 2;
+
+struct FileHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t dataOffset;
+  uint64_t rowCount;
+  uint64_t rowSize;
+  uint64_t firstRow;
+  uint64_t numRows;
+  uint32_t numAxes;
+  uint32_t numFixedParams;
+  uint32_t kind;
+  uint32_t complete;
+  char subtype[64];
+};
+
+struct FileAxis
+{
+  char name[48];
+  float minValue;
+  float maxValue;
+  uint32_t count;
+  uint32_t pad;
+};
+
+struct FileParam
+{
+  char name[48];
+  uint32_t type;
+  float value[4];
+};
+
+struct Checkpoint
+{
+  char magic[8];
+  uint64_t specHash;
+  uint64_t rowsDone;
+};
+
+static void copyName(char *dst, size_t size, const std::string &src)
+{
+  if (src.size() >= size)
+    throw std::runtime_error("name too long for sweep file: " + src);
+  std::memset(dst, 0, size);
+  std::memcpy(dst, src.data(), src.size());
+}
+
+static FileParam encodeParam(const MaterialParam &param)
+{
+  FileParam result{};
+  copyName(result.name, sizeof(result.name), param.name);
+  result.type = uint32_t(param.type);
+  if (param.type == DataType::Float)
+    result.value[0] = std::any_cast<float>(param.value);
+  else if (param.type == DataType::Float2)
+    std::memcpy(result.value, &std::any_cast<const float2 &>(param.value), sizeof(float2));
+  else if (param.type == DataType::Float3)
+    std::memcpy(result.value, &std::any_cast<const float3 &>(param.value), sizeof(float3));
+  else if (param.type == DataType::Float4)
+    std::memcpy(result.value, &std::any_cast<const float4 &>(param.value), sizeof(float4));
+  return result;
+}
+
+static MaterialParam decodeParam(const FileParam &fp)
+{
+  MaterialParam result;
+  result.name = std::string(fp.name, strnlen(fp.name, sizeof(fp.name)));
+  result.type = DataType(fp.type);
+  if (result.type == DataType::Float)
+    result.value = fp.value[0];
+  else if (result.type == DataType::Float2)
+    result.value = float2(fp.value[0], fp.value[1]);
+  else if (result.type == DataType::Float3)
+    result.value = float3(fp.value[0], fp.value[1], fp.value[2]);
+  else if (result.type == DataType::Float4)
+    result.value = float4(fp.value[0], fp.value[1], fp.value[2], fp.value[3]);
+  else
+    throw std::runtime_error("invalid parameter type in sweep file");
+  return result;
+}
+
+static std::vector<char> encodeHeader(const SweepSpec &spec,
+                                      uint64_t firstRow,
+                                      uint64_t numRows,
+                                      bool complete)
+{
+  std::vector<char> result(SweepFileDataOffset, 0);
+
+  auto axes = spec.axes();
+  if (sizeof(FileHeader) + axes.size() * sizeof(FileAxis)
+          + spec.fixedParams.size() * sizeof(FileParam)
+      > SweepFileDataOffset)
+    throw std::runtime_error("too many sweep axes/parameters");
+
+  FileHeader header{};
+  std::memcpy(header.magic, SweepFileMagic, sizeof(header.magic));
+  header.version = SweepFileVersion;
+  header.dataOffset = SweepFileDataOffset;
+  header.rowCount = spec.rowCount();
+  header.rowSize = spec.rowSize();
+  header.firstRow = firstRow;
+  header.numRows = numRows;
+  header.numAxes = uint32_t(axes.size());
+  header.numFixedParams = uint32_t(spec.fixedParams.size());
+  header.kind = uint32_t(spec.kind);
+  header.complete = complete ? 1 : 0;
+  copyName(header.subtype, sizeof(header.subtype), spec.subtype);
+
+  char *ptr = result.data();
+  std::memcpy(ptr, &header, sizeof(header));
+  ptr += sizeof(header);
+
+  for (auto &axis : axes) {
+    FileAxis fa{};
+    copyName(fa.name, sizeof(fa.name), axis.name);
+    fa.minValue = axis.minValue;
+    fa.maxValue = axis.maxValue;
+    fa.count = axis.count;
+    std::memcpy(ptr, &fa, sizeof(fa));
+    ptr += sizeof(fa);
+  }
+
+  for (auto &param : spec.fixedParams) {
+    FileParam fp = encodeParam(param);
+    std::memcpy(ptr, &fp, sizeof(fp));
+    ptr += sizeof(fp);
+  }
+
+  return result;
+}
+
+// FNV-1a over the header; with firstRow = numRows = 0, two files belong
+// to the same sweep iff their hashes match
+static uint64_t headerHash(
+    const SweepSpec &spec, uint64_t firstRow = 0, uint64_t numRows = 0)
+{
+  auto bytes = encodeHeader(spec, firstRow, numRows, false);
+  uint64_t hash = 14695981039346656037ull;
+  for (char c : bytes) {
+    hash ^= uint8_t(c);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+// POSIX I/O helpers ///////////////////////////////////////////////////////////
+
+static void pwriteAll(int fd, const void *data, size_t size, uint64_t offset)
+{
+  const char *ptr = (const char *)data;
+  while (size > 0) {
+    ssize_t n = pwrite(fd, ptr, size, off_t(offset));
+    if (n < 0)
+      throw std::runtime_error("write to sweep file failed");
+    ptr += n;
+    size -= size_t(n);
+    offset += uint64_t(n);
+  }
+}
+
+static void preadAll(int fd, void *data, size_t size, uint64_t offset)
+{
+  char *ptr = (char *)data;
+  while (size > 0) {
+    ssize_t n = pread(fd, ptr, size, off_t(offset));
+    if (n <= 0)
+      throw std::runtime_error("read from sweep file failed");
+    ptr += n;
+    size -= size_t(n);
+    offset += uint64_t(n);
+  }
+}
+
+static std::string checkpointFileName(const std::string &outputFile)
+{
+  return outputFile + ".ckpt";
+}
+
+static uint64_t readCheckpoint(const std::string &fileName, uint64_t hash)
+{
+  FILE *fp = fopen(fileName.c_str(), "rb");
+  if (!fp)
+    return 0;
+
+  Checkpoint ckpt{};
+  size_t n = fread(&ckpt, sizeof(ckpt), 1, fp);
+  fclose(fp);
+
+  if (n != 1 || std::memcmp(ckpt.magic, CheckpointMagic, sizeof(ckpt.magic)) != 0
+      || ckpt.specHash != hash)
+    return 0;
+
+  return ckpt.rowsDone;
+}
+
+static void writeCheckpoint(
+    const std::string &fileName, uint64_t hash, uint64_t rowsDone)
+{
+  Checkpoint ckpt{};
+  std::memcpy(ckpt.magic, CheckpointMagic, sizeof(ckpt.magic));
+  ckpt.specHash = hash;
+  ckpt.rowsDone = rowsDone;
+
+  // write + rename so a crash never leaves a torn checkpoint behind
+  std::string tmpName = fileName + ".tmp";
+  FILE *fp = fopen(tmpName.c_str(), "wb");
+  if (!fp)
+    throw std::runtime_error("cannot write checkpoint " + tmpName);
+  bool ok = fwrite(&ckpt, sizeof(ckpt), 1, fp) == 1;
+  ok &= fclose(fp) == 0;
+  if (!ok || std::rename(tmpName.c_str(), fileName.c_str()) != 0)
+    throw std::runtime_error("cannot write checkpoint " + fileName);
+}
+
+// Tracks finished chunks (which complete out of order) and periodically
+// persists the contiguous prefix of finished rows
+class ProgressTracker
+{
+ public:
+  ProgressTracker(int fd,
+                  std::string checkpointFile,
+                  uint64_t hash,
+                  uint64_t startRow,
+                  uint64_t endRow,
+                  uint64_t rowsPerChunk,
+                  bool verbose)
+    : m_fd(fd)
+    , m_checkpointFile(checkpointFile)
+    , m_hash(hash)
+    , m_startRow(startRow)
+    , m_endRow(endRow)
+    , m_rowsPerChunk(rowsPerChunk)
+    , m_verbose(verbose)
+    , m_done((endRow - startRow + rowsPerChunk - 1) / rowsPerChunk, false)
+    , m_lastCheckpoint(std::chrono::steady_clock::now())
+  {
+  }
+
+  void chunkDone(size_t chunk)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_done[chunk] = true;
+    while (m_lowWater < m_done.size() && m_done[m_lowWater])
+      m_lowWater++;
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - m_lastCheckpoint < std::chrono::seconds(2))
+      return;
+
+    m_lastCheckpoint = now;
+    fdatasync(m_fd);
+    writeCheckpoint(m_checkpointFile, m_hash, rowsDone());
+
+    if (m_verbose) {
+      fprintf(stderr, "[sweep] %llu/%llu rows\n",
+          (unsigned long long)rowsDone(), (unsigned long long)m_endRow);
+    }
+  }
+
+ private:
+  uint64_t rowsDone() const
+  {
+    return std::min(m_endRow, m_startRow + m_lowWater * m_rowsPerChunk);
+  }
+
+  std::mutex m_mutex;
+  int m_fd;
+  std::string m_checkpointFile;
+  uint64_t m_hash;
+  uint64_t m_startRow;
+  uint64_t m_endRow;
+  uint64_t m_rowsPerChunk;
+  bool m_verbose;
+  std::vector<bool> m_done;
+  size_t m_lowWater{0};
+  std::chrono::steady_clock::time_point m_lastCheckpoint;
+};
+
+} // namespace
+
+// SweepSpec definitions //////////////////////////////////////////////////////
+
+std::vector<SweepAxis> SweepSpec::axes() const
+{
+  std::vector<SweepAxis> result = params;
+  result.push_back(lightTheta);
+  result.push_back(lightPhi);
+  result.push_back(viewTheta);
+  result.push_back(viewPhi);
+  return result;
+}
+
+uint64_t SweepSpec::rowCount() const
+{
+  uint64_t result = uint64_t(lightTheta.count) * lightPhi.count;
+  for (auto &p : params)
+    result *= p.count;
+  return result;
+}
+
+uint64_t SweepSpec::rowSize() const
+{
+  if (kind == SweepKind::Albedo)
+    return 1;
+  return uint64_t(viewTheta.count) * viewPhi.count;
+}
+
+// Sweep file I/O /////////////////////////////////////////////////////////////
+
+SweepFileInfo readSweepFileInfo(std::string fileName)
+{
+  int fd = open(fileName.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("cannot open sweep file " + fileName);
+
+  std::vector<char> bytes(SweepFileDataOffset);
+  try {
+    preadAll(fd, bytes.data(), bytes.size(), 0);
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+  close(fd);
+
+  FileHeader header;
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  if (std::memcmp(header.magic, SweepFileMagic, sizeof(header.magic)) != 0
+      || header.version != SweepFileVersion
+      || header.dataOffset != SweepFileDataOffset || header.numAxes < 4
+      || header.kind > uint32_t(SweepKind::Albedo))
+    throw std::runtime_error(fileName + " is not a valid sweep file");
+
+  SweepFileInfo result;
+  result.firstRow = header.firstRow;
+  result.numRows = header.numRows;
+  result.complete = header.complete != 0;
+  result.spec.kind = SweepKind(header.kind);
+  result.spec.subtype =
+      std::string(header.subtype, strnlen(header.subtype, sizeof(header.subtype)));
+
+  // the axis and param tables must fit into the header block, as written
+  // by encodeHeader() (names are fixed-size fields, see strnlen() below)
+  const uint64_t tableBytes = uint64_t(header.numAxes) * sizeof(FileAxis)
+      + uint64_t(header.numFixedParams) * sizeof(FileParam);
+  if (tableBytes > SweepFileDataOffset - sizeof(header))
+    throw std::runtime_error(fileName + " has a corrupt header");
+
+  const char *ptr = bytes.data() + sizeof(header);
+  std::vector<SweepAxis> axes(header.numAxes);
+  for (auto &axis : axes) {
+    FileAxis fa;
+    std::memcpy(&fa, ptr, sizeof(fa));
+    ptr += sizeof(fa);
+    axis.name = std::string(fa.name, strnlen(fa.name, sizeof(fa.name)));
+    axis.minValue = fa.minValue;
+    axis.maxValue = fa.maxValue;
+    axis.count = fa.count;
+  }
+
+  for (uint32_t i = 0; i < header.numFixedParams; ++i) {
+    FileParam fp;
+    std::memcpy(&fp, ptr, sizeof(fp));
+    ptr += sizeof(fp);
+    result.spec.fixedParams.push_back(decodeParam(fp));
+  }
+
+  size_t numParams = axes.size() - 4;
+  result.spec.params.assign(axes.begin(), axes.begin() + numParams);
+  result.spec.lightTheta = axes[numParams + 0];
+  result.spec.lightPhi = axes[numParams + 1];
+  result.spec.viewTheta = axes[numParams + 2];
+  result.spec.viewPhi = axes[numParams + 3];
+
+  return result;
+}
+
+// MappedSweepFile definitions ////////////////////////////////////////////////
+
+MappedSweepFile::MappedSweepFile(std::string fileName)
+  : m_info(readSweepFileInfo(fileName))
+{
+  if (!m_info.complete)
+    throw std::runtime_error(fileName + " is incomplete");
+
+  m_size = SweepFileDataOffset
+      + m_info.numRows * m_info.spec.rowSize() * sizeof(float3);
+
+  int fd = open(fileName.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("cannot open " + fileName);
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || uint64_t(st.st_size) != m_size) {
+    close(fd);
+    throw std::runtime_error(fileName + " has the wrong size");
+  }
+
+  m_mapping = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (m_mapping == MAP_FAILED)
+    throw std::runtime_error("cannot map " + fileName);
+}
+
+MappedSweepFile::~MappedSweepFile()
+{
+  munmap(m_mapping, m_size);
+}
+
+const SweepFileInfo &MappedSweepFile::info() const
+{
+  return m_info;
+}
+
+const float3 *MappedSweepFile::row(uint64_t i) const
+{
+  const char *data = (const char *)m_mapping + SweepFileDataOffset;
+  return (const float3 *)data + i * m_info.spec.rowSize();
+}
+
+// Sweep engine ///////////////////////////////////////////////////////////////
+
+float3 setupSweepRow(const SweepSpec &spec, uint64_t row, Material &mat)
+{
+  // Decode the row index, last axis varies fastest:
+  uint64_t idx = row;
+  const uint32_t lp = idx % spec.lightPhi.count;
+  idx /= spec.lightPhi.count;
+  const uint32_t lt = idx % spec.lightTheta.count;
+  idx /= spec.lightTheta.count;
+  for (size_t i = spec.params.size(); i-- > 0;) {
+    const auto &axis = spec.params[i];
+    const uint32_t pi = idx % axis.count;
+    idx /= axis.count;
+    mat.setParameter({axis.name, std::any(axis.value(pi)), DataType::Float});
+  }
+
+  return sphericalDirection(
+      radians(spec.lightTheta.value(lt)), radians(spec.lightPhi.value(lp)));
+}
+
+void runSweep(const SweepSpec &spec, const SweepOptions &options)
+{
+  const uint64_t rowCount = spec.rowCount();
+  const uint64_t rowSize = spec.rowSize();
+  const uint64_t rowBytes = rowSize * sizeof(float3);
+
+  if (rowCount == 0 || rowSize == 0)
+    throw std::runtime_error("sweep is empty");
+
+  const uint64_t firstRow = options.firstRow;
+  const uint64_t endRow = options.numRows > 0
+      ? std::min(rowCount, firstRow + options.numRows)
+      : rowCount;
+  if (firstRow >= endRow)
+    throw std::runtime_error("row range is outside of the sweep");
+
+  const unsigned numThreads =
+      options.numThreads > 0 ? options.numThreads : hardwareThreads();
+  const uint64_t rowsPerChunk = options.rowsPerChunk > 0
+      ? options.rowsPerChunk
+      : std::max<uint64_t>(1, (1 << 20) / rowBytes);
+
+  const uint64_t hash = headerHash(spec, firstRow, endRow - firstRow);
+  const std::string checkpointFile = checkpointFileName(options.outputFile);
+
+  uint64_t startRow = firstRow;
+  if (options.resume) {
+    startRow = std::max(
+        firstRow, std::min(endRow, readCheckpoint(checkpointFile, hash)));
+  }
+
+  int flags = O_RDWR | O_CREAT | (startRow == firstRow ? O_TRUNC : 0);
+  int fd = open(options.outputFile.c_str(), flags, 0644);
+  if (fd < 0)
+    throw std::runtime_error("cannot open " + options.outputFile);
+
+  // a checkpoint is only useful with the partial file it belongs to
+  struct stat st;
+  const uint64_t fileSize =
+      SweepFileDataOffset + (endRow - firstRow) * rowBytes;
+  if (startRow > firstRow
+      && (fstat(fd, &st) != 0 || uint64_t(st.st_size) != fileSize))
+    startRow = firstRow;
+
+  if (options.verbose && startRow > firstRow) {
+    fprintf(stderr, "[sweep] resuming at row %llu/%llu\n",
+        (unsigned long long)startRow, (unsigned long long)endRow);
+  }
+
+  // Per-worker state: the material (plugins aren't required to be thread
+  // safe) and a chunk-sized result buffer; nothing else is ever resident
+  std::vector<std::unique_ptr<Material>> materials(numThreads);
+  std::vector<std::vector<float3>> buffers(numThreads);
+  std::vector<std::vector<float3>> scratch(numThreads);
+  for (auto &mat : materials) {
+    mat.reset(Material::createInstance(spec.subtype));
+    if (!mat) {
+      close(fd);
+      throw std::runtime_error("cannot create material " + spec.subtype);
+    }
+    for (auto &param : spec.fixedParams)
+      mat->setParameter(param);
+  }
+
+  // Direction table shared by all rows
+  std::vector<float3> viewDirs;
+  std::vector<float> weights;
+  if (spec.kind == SweepKind::Albedo) {
+    hemisphereQuadrature(
+        spec.viewTheta.count, spec.viewPhi.count, viewDirs, weights);
+  } else {
+    for (uint32_t t = 0; t < spec.viewTheta.count; ++t) {
+      for (uint32_t p = 0; p < spec.viewPhi.count; ++p) {
+        viewDirs.push_back(sphericalDirection(radians(spec.viewTheta.value(t)),
+                                              radians(spec.viewPhi.value(p))));
+      }
+    }
+  }
+
+  const float3 Ng{0.f, 1.f, 0.f}, Ns{0.f, 1.f, 0.f};
+  const float3 lightIntensity{1.f};
+
+  try {
+    if (ftruncate(fd, off_t(fileSize)) != 0)
+      throw std::runtime_error("cannot resize " + options.outputFile);
+
+    auto header = encodeHeader(spec, firstRow, endRow - firstRow, false);
+    pwriteAll(fd, header.data(), header.size(), 0);
+
+    ProgressTracker progress(fd,
+        checkpointFile,
+        hash,
+        startRow,
+        endRow,
+        rowsPerChunk,
+        options.verbose);
+
+    const uint64_t numChunks = (endRow - startRow + rowsPerChunk - 1) / rowsPerChunk;
+
+    parallelFor(numThreads, numChunks, [&](unsigned threadID, size_t chunk) {
+      Material &mat = *materials[threadID];
+      auto &buffer = buffers[threadID];
+
+      const uint64_t row0 = startRow + chunk * rowsPerChunk;
+      const uint64_t row1 = std::min(endRow, row0 + rowsPerChunk);
+      buffer.resize((row1 - row0) * rowSize);
+
+      for (uint64_t row = row0; row < row1; ++row) {
+        float3 lightDir = setupSweepRow(spec, row, mat);
+
+        float3 *values = buffer.data() + (row - row0) * rowSize;
+
+        if (spec.kind == SweepKind::Eval) {
+          mat.evalBatch(
+              Ng, Ns, viewDirs.data(), rowSize, lightDir, lightIntensity, values);
+        } else {
+          // eval() includes the cosine at the light, divide it out again
+          auto &tmp = scratch[threadID];
+          tmp.resize(viewDirs.size());
+          mat.evalBatch(Ng,
+              Ns,
+              viewDirs.data(),
+              viewDirs.size(),
+              lightDir,
+              lightIntensity,
+              tmp.data());
+          float3 albedo{0.f};
+          for (size_t i = 0; i < tmp.size(); ++i)
+            albedo += tmp[i] * weights[i];
+          *values = albedo / std::max(1e-4f, dot(Ns, lightDir));
+        }
+      }
+
+      pwriteAll(fd,
+          buffer.data(),
+          buffer.size() * sizeof(float3),
+          SweepFileDataOffset + (row0 - firstRow) * rowBytes);
+
+      progress.chunkDone(chunk);
+    });
+
+    if (fsync(fd) != 0)
+      throw std::runtime_error("cannot flush " + options.outputFile);
+
+    header = encodeHeader(spec, firstRow, endRow - firstRow, true);
+    pwriteAll(fd, header.data(), header.size(), 0);
+
+    if (fsync(fd) != 0)
+      throw std::runtime_error("cannot flush " + options.outputFile);
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+
+  close(fd);
+  std::remove(checkpointFile.c_str());
+}
+
+void shardRowRange(const SweepSpec &spec,
+                   unsigned i,
+                   unsigned n,
+                   uint64_t &firstRow,
+                   uint64_t &numRows)
+{
+  const uint64_t rowCount = spec.rowCount();
+  if (n > rowCount) {
+    throw std::runtime_error("cannot split " + std::to_string(rowCount)
+        + " rows into " + std::to_string(n) + " shards");
+  }
+  firstRow = rowCount * i / n;
+  numRows = rowCount * (i + 1) / n - firstRow;
+}
+
+// Shard merging //////////////////////////////////////////////////////////////
+
+void mergeSweepFiles(const std::vector<std::string> &inputFiles,
+                     const std::string &outputFile)
+{
+  if (inputFiles.empty())
+    throw std::runtime_error("nothing to merge");
+
+  std::vector<std::pair<SweepFileInfo, std::string>> shards;
+  for (auto &fileName : inputFiles)
+    shards.push_back({readSweepFileInfo(fileName), fileName});
+
+  std::sort(shards.begin(), shards.end(), [](const auto &a, const auto &b) {
+    return a.first.firstRow < b.first.firstRow;
+  });
+
+  const SweepSpec &spec = shards[0].first.spec;
+  const uint64_t hash = headerHash(spec);
+  const uint64_t rowBytes = spec.rowSize() * sizeof(float3);
+
+  uint64_t nextRow = 0;
+  for (auto &shard : shards) {
+    const auto &info = shard.first;
+    if (headerHash(info.spec) != hash)
+      throw std::runtime_error(shard.second + " belongs to a different sweep");
+    if (!info.complete)
+      throw std::runtime_error(shard.second + " is incomplete");
+    if (info.firstRow != nextRow) {
+      throw std::runtime_error(info.firstRow < nextRow
+              ? "overlapping shards at " + shard.second
+              : "missing rows before " + shard.second);
+    }
+
+    struct stat st;
+    if (stat(shard.second.c_str(), &st) != 0
+        || uint64_t(st.st_size) != SweepFileDataOffset + info.numRows * rowBytes)
+      throw std::runtime_error(shard.second + " has the wrong size");
+
+    nextRow += info.numRows;
+  }
+
+  if (nextRow != spec.rowCount())
+    throw std::runtime_error("shards don't cover all rows of the sweep");
+
+  int out = open(outputFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out < 0)
+    throw std::runtime_error("cannot open " + outputFile);
+
+  try {
+    // complete is only set after the data, as in runSweep()
+    auto header = encodeHeader(spec, 0, spec.rowCount(), false);
+    pwriteAll(out, header.data(), header.size(), 0);
+
+    std::vector<char> buffer(16 << 20);
+    uint64_t outOffset = SweepFileDataOffset;
+    for (auto &shard : shards) {
+      int in = open(shard.second.c_str(), O_RDONLY);
+      if (in < 0)
+        throw std::runtime_error("cannot open " + shard.second);
+      posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+      uint64_t remaining = shard.first.numRows * rowBytes;
+      uint64_t inOffset = SweepFileDataOffset;
+      try {
+        while (remaining > 0) {
+          size_t n = size_t(std::min<uint64_t>(remaining, buffer.size()));
+          preadAll(in, buffer.data(), n, inOffset);
+          pwriteAll(out, buffer.data(), n, outOffset);
+          inOffset += n;
+          outOffset += n;
+          remaining -= n;
+        }
+      } catch (...) {
+        close(in);
+        throw;
+      }
+      close(in);
+    }
+
+    if (fsync(out) != 0)
+      throw std::runtime_error("cannot flush " + outputFile);
+
+    header = encodeHeader(spec, 0, spec.rowCount(), true);
+    pwriteAll(out, header.data(), header.size(), 0);
+  } catch (...) {
+    close(out);
+    throw;
+  }
+
+  if (close(out) != 0)
+    throw std::runtime_error("cannot write " + outputFile);
+}
+
+} // namespace explorer
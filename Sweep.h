@@ -0,0 +1,137 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <cstdint>
+#include <string>
+#include <vector>
+// ours
+#include "material.h"
+
+namespace explorer {
+
+// Evenly spaced samples in [minValue,maxValue] (both inclusive)
+struct SweepAxis
+{
+  std::string name;
+  float minValue{0.f};
+  float maxValue{0.f};
+  uint32_t count{1};
+
+  float value(uint32_t i) const
+  {
+    if (count <= 1)
+      return minValue;
+    return minValue + (maxValue - minValue) * i / float(count - 1);
+  }
+};
+
+enum class SweepKind
+{
+  Eval, // one value per view direction
+  Albedo, // one value per row: the reflectance integrated over the views
+};
+
+// A sweep evaluates the BRDF over the Cartesian product of its axes:
+// [params..., lightTheta, lightPhi, viewTheta, viewPhi]. Angles are in
+// degrees. All evaluations that share the same params and light form a
+// "row", rows are the unit of work and of I/O. For Albedo sweeps the
+// view axes only define the hemisphere quadrature (viewTheta.count
+// strata in cos(theta), viewPhi.count in phi), their ranges are unused.
+struct SweepSpec
+{
+  SweepKind kind{SweepKind::Eval};
+  std::string subtype;
+  std::vector<MaterialParam> fixedParams;
+  std::vector<SweepAxis> params;
+  SweepAxis lightTheta{"lightTheta", 0.f, 0.f, 1};
+  SweepAxis lightPhi{"lightPhi", 0.f, 0.f, 1};
+  SweepAxis viewTheta{"viewTheta", 0.f, 90.f, 91};
+  SweepAxis viewPhi{"viewPhi", 0.f, 0.f, 1};
+
+  std::vector<SweepAxis> axes() const;
+
+  uint64_t rowCount() const;
+  uint64_t rowSize() const;
+};
+
+// Sets the swept params of row on mat and returns the row's light
+// direction (fixed params are left alone)
+anari::math::float3 setupSweepRow(const SweepSpec &spec,
+                                  uint64_t row,
+                                  Material &mat);
+
+// Output files are a fixed size header followed by rowCount() * rowSize()
+// float3 values, in row-major order of the spec's axes. The data starts
+// page aligned, so the whole file can be mmap'ed and indexed directly.
+constexpr uint32_t SweepFileDataOffset = 4096;
+
+// A file can hold a subrange of the rows (a shard), in that case
+// firstRow/numRows say which ones. complete is only set once all rows
+// were written and flushed.
+struct SweepFileInfo
+{
+  SweepSpec spec;
+  uint64_t firstRow{0};
+  uint64_t numRows{0};
+  bool complete{false};
+};
+
+SweepFileInfo readSweepFileInfo(std::string fileName);
+
+// Read-only memory mapping of a complete sweep file
+class MappedSweepFile
+{
+ public:
+  MappedSweepFile(std::string fileName);
+  ~MappedSweepFile();
+
+  MappedSweepFile(const MappedSweepFile &) = delete;
+  MappedSweepFile &operator=(const MappedSweepFile &) = delete;
+
+  const SweepFileInfo &info() const;
+
+  // Values of the i'th row stored in the file (i.e., row firstRow + i)
+  const anari::math::float3 *row(uint64_t i) const;
+
+ private:
+  SweepFileInfo m_info;
+  void *m_mapping{nullptr};
+  size_t m_size{0};
+};
+
+struct SweepOptions
+{
+  std::string outputFile;
+  unsigned numThreads{0}; // 0: use all cores
+  uint64_t rowsPerChunk{0}; // 0: pick so a chunk is about 1 MiB
+  uint64_t firstRow{0};
+  uint64_t numRows{0}; // 0: all rows from firstRow on
+  bool resume{false};
+  bool verbose{false};
+};
+
+// Evaluates the sweep with one Material per worker thread, streaming
+// finished chunks to options.outputFile. Progress is checkpointed to
+// <outputFile>.ckpt; with options.resume set, an interrupted sweep
+// continues from there. Throws std::runtime_error on failure.
+void runSweep(const SweepSpec &spec, const SweepOptions &options);
+
+// Rows of shard i when splitting the sweep into n shards; throws
+// std::runtime_error if n exceeds the row count (shards must not be empty)
+void shardRowRange(const SweepSpec &spec,
+                   unsigned i,
+                   unsigned n,
+                   uint64_t &firstRow,
+                   uint64_t &numRows);
+
+// Validates that the inputs are complete shards of the same sweep that
+// cover all of its rows exactly once, and concatenates them (in row
+// order) into outputFile. The result is byte-identical to the output of
+// a single runSweep() over all rows.
+void mergeSweepFiles(const std::vector<std::string> &inputFiles,
+                     const std::string &outputFile);
+
+} // namespace explorer
@@ -5,10 +5,36 @@
 // anari
 #define ANARI_EXTENSION_UTILITY_IMPL
 #include <anari/anari_cpp.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 // ours
+#include "AllocTracker.h"
+#ifdef EXPLORER_TRACK_ALLOCATIONS
+#include "AllocStatsWindow.h"
+#endif
+#include "Lobe.h"
+#include "LobeEditor.h"
+#include "LobeGrid.h"
 #include "material.h"
+#include "MeshExport.h"
+#include "ObjectStatsWindow.h"
+#include "ObjectTracker.h"
+#include "Parallel.h"
 #include "ParamEditor.h"
+#ifdef EXPLORER_PLUGIN_HOST
+#include "PluginHost.h"
+#endif
+#include "PluginReloader.h"
+#include "Prefilter.h"
+#include "Preset.h"
+#include "QualityController.h"
 
 using box3_t = std::array<anari::math::float3, 2>;
 namespace anari {
@@ -18,14 +44,21 @@ ANARI_TYPEFOR_DEFINITION(box3_t);
 
 using namespace anari::math;
 
+using MaterialCopies = std::vector<std::unique_ptr<explorer::Material>>;
+
 static const bool g_true = true;
 static bool g_verbose = false;
 static bool g_useDefaultLayout = true;
 static bool g_enableDebug = false;
+static bool g_showObjectStats = false;
+static bool g_isolatePlugin = false;
 static std::string g_libraryName = "environment";
+static std::string g_presetFileName;
+static std::string g_exportFileName;
 static anari::Library g_debug = nullptr;
 static anari::Device g_device = nullptr;
 static const char *g_traceDir = nullptr;
+static std::chrono::steady_clock::time_point g_startTime;
 
 static  float  g_groundPlaneOpacity = { 0.5f };
 static std::string g_selectedMaterial = "Matte";
@@ -38,6 +71,12 @@ static  float  g_ior = { 1.f };
 static  bool   g_showGroundPlane = { true };
 static  bool   g_showLightDir = { true };
 static  bool   g_showAxes = { true };
+static const int g_coarseLobeSegments = { 24 }; // first frame
+static windows::LobeSettings g_lobeSettings;
+static explorer::SphereGrid g_lobeGrid; // the grid of g_lobeValues
+static std::vector<float3> g_lobeValues;
+static explorer::LobeSensitivity g_lobeSensitivity; // of g_lobeValues
+static std::vector<anari::Instance> g_gridCells;
 static box3_t  g_bounds = { anari::math::float3{-3.f, 0.f, -3.f},
                             anari::math::float3{3.f, 1.f, 3.f} };
 
@@ -66,6 +105,12 @@ Size=549,813
 Collapsed=0
 DockId=0x00000002,0
 
+[Window][Lobe Editor]
+Pos=0,25
+Size=549,813
+Collapsed=0
+DockId=0x00000002,2
+
 [Window][Debug##Default]
 Pos=60,60
 Size=400,400
@@ -120,7 +165,7 @@ static anari::Array2D makeTextureData(anari::Device d, int dim)
     }
   }
 
-  return anariNewArray2D(
+  return explorer::tracked::newArray2D(
       d, data, &anari_free, nullptr, ANARI_UFIXED8_VEC3, dim, dim);
 }
 
@@ -139,34 +184,34 @@ static anari::Surface makePlane(anari::Device d, box3_t bounds)
       {1.f, 0.f},
   };
 
-  auto geom = anari::newObject<anari::Geometry>(d, "quad");
-  anari::setAndReleaseParameter(d,
+  auto geom = explorer::tracked::newObject<anari::Geometry>(d, "quad");
+  explorer::tracked::setAndReleaseParameter(d,
       geom,
       "vertex.position",
-      anari::newArray1D(d, vertices, 4));
-  anari::setAndReleaseParameter(d,
+      explorer::tracked::newArray1D(d, vertices, 4));
+  explorer::tracked::setAndReleaseParameter(d,
       geom,
       "vertex.attribute0",
-      anari::newArray1D(d, texcoords, 4));
+      explorer::tracked::newArray1D(d, texcoords, 4));
   anari::commitParameters(d, geom);
 
-  auto surface = anari::newObject<anari::Surface>(d);
-  anari::setAndReleaseParameter(d, surface, "geometry", geom);
+  auto surface = explorer::tracked::newObject<anari::Surface>(d);
+  explorer::tracked::setAndReleaseParameter(d, surface, "geometry", geom);
 
-  auto tex = anari::newObject<anari::Sampler>(d, "image2D");
-  anari::setAndReleaseParameter(d, tex, "image", makeTextureData(d, 8));
+  auto tex = explorer::tracked::newObject<anari::Sampler>(d, "image2D");
+  explorer::tracked::setAndReleaseParameter(d, tex, "image", makeTextureData(d, 8));
   anari::setParameter(d, tex, "inAttribute", "attribute0");
   anari::setParameter(d, tex, "wrapMode1", "clampToEdge");
   anari::setParameter(d, tex, "wrapMode2", "clampToEdge");
   anari::setParameter(d, tex, "filter", "nearest");
   anari::commitParameters(d, tex);
 
-  auto mat = anari::newObject<anari::Material>(d, "matte");
-  anari::setAndReleaseParameter(d, mat, "color", tex);
+  auto mat = explorer::tracked::newObject<anari::Material>(d, "matte");
+  explorer::tracked::setAndReleaseParameter(d, mat, "color", tex);
   anari::setParameter(d, mat, "alphaMode", "blend");
   anari::setParameter(d, mat, "opacity", g_groundPlaneOpacity);
   anari::commitParameters(d, mat);
-  anari::setAndReleaseParameter(d, surface, "material", mat);
+  explorer::tracked::setAndReleaseParameter(d, surface, "material", mat);
 
   anari::commitParameters(d, surface);
 
@@ -177,15 +222,15 @@ static anari::Instance makePlaneInstance(anari::Device d, const box3_t &bounds)
 {
   auto surface = makePlane(d, bounds);
 
-  auto group = anari::newObject<anari::Group>(d);
-  anari::setAndReleaseParameter(
-      d, group, "surface", anari::newArray1D(d, &surface));
+  auto group = explorer::tracked::newObject<anari::Group>(d);
+  explorer::tracked::setAndReleaseParameter(
+      d, group, "surface", explorer::tracked::newArray1D(d, &surface));
   anari::commitParameters(d, group);
 
-  anari::release(d, surface);
+  explorer::tracked::release(d, surface);
 
-  auto inst = anari::newObject<anari::Instance>(d, "transform");
-  anari::setAndReleaseParameter(d, inst, "group", group);
+  auto inst = explorer::tracked::newObject<anari::Instance>(d, "transform");
+  explorer::tracked::setAndReleaseParameter(d, inst, "group", group);
   anari::commitParameters(d, inst);
 
   return inst;
@@ -198,11 +243,11 @@ static anari::Instance makeArrowInstance(anari::Device d,
 {
   // Cylinder geometry:
   anari::math::float3 cylPositions[] = { v1, v2 };
-  auto cylGeom = anari::newObject<anari::Geometry>(d, "cylinder");
-  anari::setAndReleaseParameter(d,
+  auto cylGeom = explorer::tracked::newObject<anari::Geometry>(d, "cylinder");
+  explorer::tracked::setAndReleaseParameter(d,
       cylGeom,
       "vertex.position",
-      anari::newArray1D(d, cylPositions, 2));
+      explorer::tracked::newArray1D(d, cylPositions, 2));
   anari::setParameter(d, cylGeom, "radius", 0.02f);
   anari::commitParameters(d, cylGeom);
 
@@ -210,119 +255,380 @@ static anari::Instance makeArrowInstance(anari::Device d,
   anari::math::float3 dir = v1 + v2;
   anari::math::float3 conePositions[] = { v2, v2+normalize(dir)/6.f };
   float coneRadii[] = { 0.05f, 0.0f };
-  auto coneGeom = anari::newObject<anari::Geometry>(d, "cone");
-  anari::setAndReleaseParameter(d,
+  auto coneGeom = explorer::tracked::newObject<anari::Geometry>(d, "cone");
+  explorer::tracked::setAndReleaseParameter(d,
       coneGeom,
       "vertex.position",
-      anari::newArray1D(d, conePositions, 2));
-  anari::setAndReleaseParameter(d,
+      explorer::tracked::newArray1D(d, conePositions, 2));
+  explorer::tracked::setAndReleaseParameter(d,
       coneGeom,
       "vertex.radius",
-      anari::newArray1D(d, coneRadii, 2));
+      explorer::tracked::newArray1D(d, coneRadii, 2));
   anari::commitParameters(d, coneGeom);
 
   // Surfaces and material:
 
-  auto mat = anari::newObject<anari::Material>(d, "matte");
+  auto mat = explorer::tracked::newObject<anari::Material>(d, "matte");
   anari::setParameter(d, mat, "color", color);
   anari::commitParameters(d, mat);
 
-  auto cylSurface = anari::newObject<anari::Surface>(d);
-  anari::setAndReleaseParameter(d, cylSurface, "geometry", cylGeom);
+  auto cylSurface = explorer::tracked::newObject<anari::Surface>(d);
+  explorer::tracked::setAndReleaseParameter(d, cylSurface, "geometry", cylGeom);
   anari::setParameter(d, cylSurface, "material", mat);
   anari::commitParameters(d, cylSurface);
 
-  auto coneSurface = anari::newObject<anari::Surface>(d);
-  anari::setAndReleaseParameter(d, coneSurface, "geometry", coneGeom);
+  auto coneSurface = explorer::tracked::newObject<anari::Surface>(d);
+  explorer::tracked::setAndReleaseParameter(d, coneSurface, "geometry", coneGeom);
   anari::setParameter(d, coneSurface, "material", mat);
   anari::commitParameters(d, coneSurface);
 
-  anari::release(d, mat);
+  explorer::tracked::release(d, mat);
 
   anari::Surface surface[2];
   surface[0] = cylSurface;
   surface[1] = coneSurface;
 
-  auto group = anari::newObject<anari::Group>(d);
-  anari::setAndReleaseParameter(
-      d, group, "surface", anari::newArray1D(d, surface, 2));
+  auto group = explorer::tracked::newObject<anari::Group>(d);
+  explorer::tracked::setAndReleaseParameter(
+      d, group, "surface", explorer::tracked::newArray1D(d, surface, 2));
   anari::commitParameters(d, group);
 
-  anari::release(d, cylSurface);
-  anari::release(d, coneSurface);
+  explorer::tracked::release(d, cylSurface);
+  explorer::tracked::release(d, coneSurface);
 
-  auto inst = anari::newObject<anari::Instance>(d, "transform");
-  anari::setAndReleaseParameter(d, inst, "group", group);
+  auto inst = explorer::tracked::newObject<anari::Instance>(d, "transform");
+  explorer::tracked::setAndReleaseParameter(d, inst, "group", group);
   anari::commitParameters(d, inst);
 
   return inst;
 }
 
-static anari::Geometry generateSphereMesh(anari::Device device, const explorer::Material &mat)
+// Black -> red -> yellow -> white
+static float4 heatColor(float t)
 {
-  float3 viewDir{0.f,1.f,0.f};
+  t = std::clamp(t, 0.f, 1.f);
+  return float4(std::min(1.f, 3.f * t),
+                std::clamp(3.f * t - 1.f, 0.f, 1.f),
+                std::clamp(3.f * t - 2.f, 0.f, 1.f),
+                1.f);
+}
+
+// The directional field that all lobe views are derived from; only
+// material and light changes re-evaluate it, views just read it. Copies
+// of mat (and of reference, same number) are evaluated on threads of
+// their own.
+static void evalBRDF(const explorer::Material &mat,
+                     const explorer::Material *reference,
+                     const MaterialCopies &matCopies = {},
+                     const MaterialCopies &referenceCopies = {})
+{
+  explorer::AllocScope scope(explorer::AllocPhase::LobeEval);
+
+  if (g_lobeGrid.segments != g_lobeSettings.segments)
+    g_lobeGrid = explorer::makeSphereGrid(g_lobeSettings.segments);
+
+  const auto &grid = g_lobeGrid;
   float3 lightDir = normalize(g_lightDir);
-  float3 lightIntensity{1.f};
-  float3 Ng{0.f,1.f,0.f}, Ns{0.f,1.f,0.f};
 
-  int segments = 400;
-  int vertexCount = (segments - 1) * segments;
-  int indexCount = ((segments - 2) * segments) * 2;
+  g_lobeValues.resize(grid.directions.size());
+
+  if (!matCopies.empty()) {
+    std::vector<const explorer::Material *> materials{&mat};
+    std::vector<const explorer::Material *> references;
+    for (auto &copy : matCopies)
+      materials.push_back(copy.get());
+    if (reference) {
+      references.push_back(reference);
+      for (auto &copy : referenceCopies)
+        references.push_back(copy.get());
+    }
+
+    auto stats = explorer::evalLobeParallel(
+        materials, references, grid, lightDir, g_lobeValues.data());
+    if (reference) {
+      g_lobeSettings.l2Error = stats.l2Error;
+      g_lobeSettings.maxError = stats.maxError;
+    }
+  } else if (reference) {
+    auto stats = explorer::evalLobeDifference(
+        mat, *reference, grid, lightDir, g_lobeValues.data());
+    g_lobeSettings.l2Error = stats.l2Error;
+    g_lobeSettings.maxError = stats.maxError;
+  } else {
+    explorer::evalLobe(mat, grid, lightDir, g_lobeValues.data());
+  }
+
+  explorer::polarSlice(
+      grid, g_lobeValues.data(), lightDir, g_lobeSettings.polarSlice);
+}
+
+// The field and its sensitivity to the material's Float params
+static void evalSensitivity(explorer::LobeSensitivityEvaluator &evaluator,
+                            const explorer::Material &mat,
+                            unsigned numThreads)
+{
+  explorer::AllocScope scope(explorer::AllocPhase::LobeEval);
+
+  if (g_lobeGrid.segments != g_lobeSettings.segments)
+    g_lobeGrid = explorer::makeSphereGrid(g_lobeSettings.segments);
+
+  const auto &grid = g_lobeGrid;
+  float3 lightDir = normalize(g_lightDir);
+
+  g_lobeValues.resize(grid.directions.size());
+
+  try {
+    g_lobeSensitivity = evaluator.evaluate(g_selectedMaterial,
+        mat,
+        grid,
+        lightDir,
+        g_lobeValues.data(),
+        0.01f,
+        numThreads);
+  } catch (const std::exception &e) {
+    std::cerr << "[ERROR] " << e.what() << '\n';
+    g_lobeSensitivity = {};
+    explorer::evalLobe(mat, grid, lightDir, g_lobeValues.data());
+  }
+
+  g_lobeSettings.sensitivityParams = g_lobeSensitivity.params;
+
+  explorer::polarSlice(
+      grid, g_lobeValues.data(), lightDir, g_lobeSettings.polarSlice);
+}
+
+// Makes a field that was evaluated elsewhere (e.g., in the background)
+// the current one
+static void setLobeField(explorer::SphereGrid grid, std::vector<float3> values)
+{
+  explorer::AllocScope scope(explorer::AllocPhase::LobeEval);
+
+  g_lobeGrid = std::move(grid);
+  g_lobeValues = std::move(values);
+  explorer::polarSlice(g_lobeGrid,
+      g_lobeValues.data(),
+      normalize(g_lightDir),
+      g_lobeSettings.polarSlice);
+}
+
+// Writes the current lobe (value.y of the field) as PLY or OBJ
+static void exportLobe(const std::string &fileName)
+{
+  const auto &grid = g_lobeGrid;
+
+  std::vector<float3> positions(grid.directions.size());
+  std::vector<float3> normals(grid.directions.size());
+  explorer::lobeVertices(
+      grid, g_lobeValues.data(), 1, positions.data(), normals.data());
+
+  explorer::MeshView mesh;
+  mesh.positions = positions.data();
+  mesh.normals = normals.data();
+  mesh.vertexCount = positions.size();
+  mesh.indices = grid.indices.data();
+  mesh.triangleCount = grid.indices.size();
+  explorer::writeMesh(fileName, mesh);
+}
+
+// Grid positions, displaced by |value.y| if values are given (else the
+// unit sphere), with smooth normals and optionally with colors
+static anari::Geometry makeLobeGeometry(anari::Device device,
+                                        const explorer::SphereGrid &grid,
+                                        const float3 *values,
+                                        const float4 *colors = nullptr)
+{
+  explorer::AllocScope scope(explorer::AllocPhase::MeshGen);
+
+  size_t vertexCount = grid.directions.size();
+  size_t indexCount = grid.indices.size();
 
   auto positionArray =
-      anari::newArray1D(device, ANARI_FLOAT32_VEC3, vertexCount);
+      explorer::tracked::newArray1D(device, ANARI_FLOAT32_VEC3, vertexCount);
   auto *position = anari::map<anari::math::float3>(device, positionArray);
 
+  auto normalArray =
+      explorer::tracked::newArray1D(device, ANARI_FLOAT32_VEC3, vertexCount);
+  auto *normal = anari::map<anari::math::float3>(device, normalArray);
+
   auto indexArray =
-      anari::newArray1D(device, ANARI_UINT32_VEC3, indexCount);
+      explorer::tracked::newArray1D(device, ANARI_UINT32_VEC3, indexCount);
   auto *index = anari::map<anari::math::uint3>(device, indexArray);
 
-  int cnt = 0;
-  for (int i = 0; i < segments-1; ++i) {
-    for (int j = 0; j < segments; ++j) {
-      float phi = M_PI * (i+1) / float(segments);
-      float theta = 2.f * M_PI * j / float(segments);
-
-      anari::math::float3 v(
-        sinf(phi) * cosf(theta),
-        cosf(phi),
-        sinf(phi) * sinf(theta));
+  explorer::lobeVertices(grid, values, 1, position, normal);
 
-      viewDir = normalize(float3(v.x,v.y,v.z));
-      float3 value = mat.eval(Ng,Ns,normalize(viewDir),lightDir,lightIntensity);
-      float scale = fabsf(value.y);
-      position[cnt++] = v * scale;
-    }
-  }
-
-  cnt = 0;
-  for (int j = 0; j < segments-2; ++j) {
-    for (int i = 0; i < segments; ++i) {
-      int j0 = j * segments + 1;
-      int j1 = (j+1) * segments + 1;
-      unsigned idx0 = j0 + i;
-      unsigned idx1 = j0 + (i+1) % segments;
-      unsigned idx2 = j1 + (i+1) % segments;
-      unsigned idx3 = j1 + i;
-      index[cnt++] = anari::math::uint3(idx0,idx1,idx2);
-      index[cnt++] = anari::math::uint3(idx0,idx2,idx3);
-    }
-  }
+  std::copy(grid.indices.begin(), grid.indices.end(), index);
 
   anari::unmap(device, positionArray);
+  anari::unmap(device, normalArray);
   anari::unmap(device, indexArray);
 
-  //auto geometry = anari::newObject<anari::Geometry>(device, "quad");
-  auto geometry = anari::newObject<anari::Geometry>(device, "triangle");
-  anari::setAndReleaseParameter(
+  //auto geometry = explorer::tracked::newObject<anari::Geometry>(device, "quad");
+  auto geometry = explorer::tracked::newObject<anari::Geometry>(device, "triangle");
+  explorer::tracked::setAndReleaseParameter(
       device, geometry, "vertex.position", positionArray);
-  anari::setAndReleaseParameter(
+  explorer::tracked::setAndReleaseParameter(
+      device, geometry, "vertex.normal", normalArray);
+  explorer::tracked::setAndReleaseParameter(
       device, geometry, "primitive.index", indexArray);
+
+  if (colors) {
+    explorer::tracked::setAndReleaseParameter(device,
+        geometry,
+        "vertex.color",
+        explorer::tracked::newArray1D(device, colors, vertexCount));
+  }
+
   anari::commitParameters(device, geometry);
 
   return geometry;
 }
 
+static bool hasSensitivity()
+{
+  return g_lobeSettings.showSensitivity && !g_lobeSensitivity.params.empty()
+      && g_lobeSensitivity.derivatives.size()
+      == g_lobeSensitivity.params.size() * g_lobeValues.size();
+}
+
+// Heat colors of |d value.y / d param| for the selected param; for all
+// params, the color of the one with the largest |derivative|, darker
+// where the lobe is less sensitive. Params have no common range (nor
+// unit), so each param's derivatives are divided by their max over the
+// lobe: all params show where they matter most relative to themselves.
+static std::vector<float4> sensitivityColors()
+{
+  const auto &s = g_lobeSensitivity;
+  const size_t count = g_lobeValues.size();
+  std::vector<float4> colors(count);
+
+  auto selected =
+      std::find(s.params.begin(), s.params.end(), g_lobeSettings.sensitivityParam);
+  if (selected != s.params.end()) {
+    const float *d = &s.derivatives[(selected - s.params.begin()) * count];
+    float maxValue = 0.f;
+    for (size_t i = 0; i < count; ++i)
+      maxValue = std::max(maxValue, fabsf(d[i]));
+    float scale = maxValue > 0.f ? 1.f / maxValue : 0.f;
+    for (size_t i = 0; i < count; ++i)
+      colors[i] = heatColor(fabsf(d[i]) * scale);
+    return colors;
+  }
+
+  std::vector<float> scales(s.params.size(), 0.f);
+  for (size_t p = 0; p < s.params.size(); ++p) {
+    const float *d = &s.derivatives[p * count];
+    float maxValue = 0.f;
+    for (size_t i = 0; i < count; ++i)
+      maxValue = std::max(maxValue, fabsf(d[i]));
+    scales[p] = maxValue > 0.f ? 1.f / maxValue : 0.f;
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    size_t best = 0;
+    float bestValue = 0.f;
+    for (size_t p = 0; p < s.params.size(); ++p) {
+      float v = fabsf(s.derivatives[p * count + i]) * scales[p];
+      if (v > bestValue) {
+        best = p;
+        bestValue = v;
+      }
+    }
+    float3 c = windows::sensitivityColor(best) * (0.15f + 0.85f * bestValue);
+    colors[i] = float4(c.x, c.y, c.z, 1.f);
+  }
+  return colors;
+}
+
+static bool lobeHasColors()
+{
+  return hasSensitivity()
+      || (g_lobeSettings.compare && g_lobeSettings.signedDifference);
+}
+
+// The lobe; difference lobes are colored by sign if requested, the
+// sensitivity view takes precedence
+static anari::Geometry generateSphereMesh(anari::Device device)
+{
+  const auto &grid = g_lobeGrid;
+
+  if (hasSensitivity()) {
+    auto colors = sensitivityColors();
+    return makeLobeGeometry(device, grid, g_lobeValues.data(), colors.data());
+  }
+
+  if (!g_lobeSettings.compare || !g_lobeSettings.signedDifference)
+    return makeLobeGeometry(device, grid, g_lobeValues.data());
+
+  std::vector<float4> colors(g_lobeValues.size());
+  for (size_t i = 0; i < g_lobeValues.size(); ++i) {
+    colors[i] = g_lobeValues[i].y >= 0.f ? float4(0.9f, 0.25f, 0.2f, 1.f)
+                                         : float4(0.2f, 0.4f, 0.9f, 1.f);
+  }
+
+  return makeLobeGeometry(device, grid, g_lobeValues.data(), colors.data());
+}
+
+// Unit sphere, colored by |value.y| relative to the field's maximum
+static anari::Geometry generateHeatSphereMesh(anari::Device device)
+{
+  const auto &grid = g_lobeGrid;
+
+  float maxValue = 0.f;
+  for (auto &v : g_lobeValues)
+    maxValue = std::max(maxValue, fabsf(v.y));
+
+  float scale = maxValue > 0.f ? 1.f / maxValue : 0.f;
+
+  std::vector<float4> colors(g_lobeValues.size());
+  for (size_t i = 0; i < g_lobeValues.size(); ++i)
+    colors[i] = heatColor(fabsf(g_lobeValues[i].y) * scale);
+
+  return makeLobeGeometry(device, grid, nullptr, colors.data());
+}
+
+// One lobe per color channel; the index array is shared between them
+static void generateRGBMeshes(anari::Device device, anari::Geometry geometries[3])
+{
+  const auto &grid = g_lobeGrid;
+  size_t vertexCount = grid.directions.size();
+  size_t indexCount = grid.indices.size();
+
+  auto indexArray =
+      explorer::tracked::newArray1D(device, ANARI_UINT32_VEC3, indexCount);
+  auto *index = anari::map<anari::math::uint3>(device, indexArray);
+  std::copy(grid.indices.begin(), grid.indices.end(), index);
+  anari::unmap(device, indexArray);
+
+  anari::Array1D positionArrays[3], normalArrays[3];
+  anari::math::float3 *positions[3], *normals[3];
+  for (int c = 0; c < 3; ++c) {
+    positionArrays[c] =
+        explorer::tracked::newArray1D(device, ANARI_FLOAT32_VEC3, vertexCount);
+    normalArrays[c] =
+        explorer::tracked::newArray1D(device, ANARI_FLOAT32_VEC3, vertexCount);
+    positions[c] = anari::map<anari::math::float3>(device, positionArrays[c]);
+    normals[c] = anari::map<anari::math::float3>(device, normalArrays[c]);
+  }
+
+  // one pass over the directions fills all three lobes
+  explorer::lobeVerticesRGB(grid, g_lobeValues.data(), positions, normals);
+
+  for (int c = 0; c < 3; ++c) {
+    anari::unmap(device, positionArrays[c]);
+    anari::unmap(device, normalArrays[c]);
+
+    geometries[c] = explorer::tracked::newObject<anari::Geometry>(device, "triangle");
+    explorer::tracked::setAndReleaseParameter(
+        device, geometries[c], "vertex.position", positionArrays[c]);
+    explorer::tracked::setAndReleaseParameter(
+        device, geometries[c], "vertex.normal", normalArrays[c]);
+    anari::setParameter(device, geometries[c], "primitive.index", indexArray);
+    anari::commitParameters(device, geometries[c]);
+  }
+
+  explorer::tracked::release(device, indexArray);
+}
+
 #if 0
 static anari::Geometry generateSampleMesh(anari::Device device, dco::Material mat)
 {
@@ -377,21 +683,69 @@ static anari::Geometry generateSampleMesh(anari::Device device, dco::Material ma
 }
 #endif
 
-static anari::Surface makeBRDFSurface(anari::Device device, const explorer::Material &mat)
+static anari::Surface makeBRDFSurface(anari::Device device)
 {
-  auto geometry = generateSphereMesh(device, mat);
+  auto geometry = generateSphereMesh(device);
   anari::commitParameters(device, geometry);
 
-  auto material = anari::newObject<anari::Material>(device, "matte");
+  auto material = explorer::tracked::newObject<anari::Material>(device, "matte");
+  if (lobeHasColors())
+    anari::setParameter(device, material, "color", "color");
   anari::commitParameters(device, material);
 
-  auto quadSurface = anari::newObject<anari::Surface>(device);
-  anari::setAndReleaseParameter(device, quadSurface, "geometry", geometry);
-  anari::setAndReleaseParameter(device, quadSurface, "material", material);
+  auto quadSurface = explorer::tracked::newObject<anari::Surface>(device);
+  explorer::tracked::setAndReleaseParameter(device, quadSurface, "geometry", geometry);
+  explorer::tracked::setAndReleaseParameter(device, quadSurface, "material", material);
   anari::commitParameters(device, quadSurface);
   return quadSurface;
 }
 
+// Translucent, so the nested channel lobes stay visible
+static void makeRGBSurfaces(anari::Device device,
+                            std::vector<anari::Surface> &surfaces)
+{
+  const float3 channelColors[3] = {
+      {1.f, 0.2f, 0.2f}, {0.2f, 1.f, 0.2f}, {0.2f, 0.2f, 1.f}};
+
+  anari::Geometry geometries[3];
+  generateRGBMeshes(device, geometries);
+
+  for (int c = 0; c < 3; ++c) {
+    auto material = explorer::tracked::newObject<anari::Material>(device, "matte");
+    anari::setParameter(device, material, "color", channelColors[c]);
+    anari::setParameter(device, material, "alphaMode", "blend");
+    anari::setParameter(device, material, "opacity", 0.5f);
+    anari::commitParameters(device, material);
+
+    auto surface = explorer::tracked::newObject<anari::Surface>(device);
+    explorer::tracked::setAndReleaseParameter(device, surface, "geometry", geometries[c]);
+    explorer::tracked::setAndReleaseParameter(device, surface, "material", material);
+    anari::commitParameters(device, surface);
+    surfaces.push_back(surface);
+  }
+}
+
+static anari::Surface makeHeatSphereSurface(anari::Device device)
+{
+  auto geometry = generateHeatSphereMesh(device);
+  anari::commitParameters(device, geometry);
+
+  // see-through when stacked with the lobe
+  auto material = explorer::tracked::newObject<anari::Material>(device, "matte");
+  anari::setParameter(device, material, "color", "color");
+  if (g_lobeSettings.showLobe) {
+    anari::setParameter(device, material, "alphaMode", "blend");
+    anari::setParameter(device, material, "opacity", 0.35f);
+  }
+  anari::commitParameters(device, material);
+
+  auto surface = explorer::tracked::newObject<anari::Surface>(device);
+  explorer::tracked::setAndReleaseParameter(device, surface, "geometry", geometry);
+  explorer::tracked::setAndReleaseParameter(device, surface, "material", material);
+  anari::commitParameters(device, surface);
+  return surface;
+}
+
 static anari::Surface makeBRDFSamples(anari::Device device, const explorer::Material &mat)
 {
 #if 0
@@ -412,6 +766,8 @@ static anari::Surface makeBRDFSamples(anari::Device device, const explorer::Mate
 
 static void addPlaneAndArrows(anari::Device device, anari::World world)
 {
+  explorer::AllocScope scope(explorer::AllocPhase::ANARIUpdate);
+
   std::vector<anari::Instance> instances;
 
   // ground plane
@@ -453,13 +809,21 @@ static void addPlaneAndArrows(anari::Device device, anari::World world)
     instances.push_back(zInst);
   }
 
+  // lobe grid cells (owned by g_gridCells):
+  for (auto &cell : g_gridCells) {
+    if (cell) {
+      explorer::tracked::retain(device, cell);
+      instances.push_back(cell);
+    }
+  }
+
   if (!instances.empty()) {
-    anari::setAndReleaseParameter(
+    explorer::tracked::setAndReleaseParameter(
         device, world, "instance",
-        anari::newArray1D(device, instances.data(), instances.size()));
+        explorer::tracked::newArray1D(device, instances.data(), instances.size()));
 
     for (auto &i : instances) {
-      anari::release(device, i);
+      explorer::tracked::release(device, i);
     }
   } else {
     anari::unsetParameter(device, world, "instance");
@@ -468,19 +832,127 @@ static void addPlaneAndArrows(anari::Device device, anari::World world)
   anari::commitParameters(device, world);
 }
 
-static void addBRDFGeom(anari::Device device, anari::World world, const explorer::Material &mat)
+// Instance transform of a grid cell: cells tile the ground plane, all
+// lobes share the same scale so they stay comparable
+static void setGridCellTransform(anari::Device device,
+                                 anari::Instance inst,
+                                 size_t cell,
+                                 float lobeScale)
 {
+  const int columns = g_lobeSettings.gridColumns.count;
+  const int rows = g_lobeSettings.gridRows.count;
+  const float cellSize =
+      (g_bounds[1].x - g_bounds[0].x) / float(std::max(columns, rows));
+
+  const float x = (float(cell % columns) - 0.5f * (columns - 1)) * cellSize;
+  const float z = (float(cell / columns) - 0.5f * (rows - 1)) * cellSize;
+  const float s = 0.45f * cellSize * lobeScale;
+
+  anari::math::mat4 xfm = {{s, 0.f, 0.f, 0.f},
+                           {0.f, s, 0.f, 0.f},
+                           {0.f, 0.f, s, 0.f},
+                           {x, 0.f, z, 1.f}};
+  anari::setParameter(device, inst, "transform", xfm);
+  anari::commitParameters(device, inst);
+}
+
+static anari::Instance makeGridCellInstance(anari::Device device,
+                                            const explorer::SphereGrid &grid,
+                                            anari::Array1D indexArray,
+                                            const std::vector<float3> &values)
+{
+  size_t vertexCount = grid.directions.size();
+
+  auto positionArray =
+      explorer::tracked::newArray1D(device, ANARI_FLOAT32_VEC3, vertexCount);
+  auto normalArray =
+      explorer::tracked::newArray1D(device, ANARI_FLOAT32_VEC3, vertexCount);
+
+  explorer::lobeVertices(grid,
+      values.data(),
+      1,
+      anari::map<anari::math::float3>(device, positionArray),
+      anari::map<anari::math::float3>(device, normalArray));
+
+  anari::unmap(device, positionArray);
+  anari::unmap(device, normalArray);
+
+  auto geometry = explorer::tracked::newObject<anari::Geometry>(device, "triangle");
+  explorer::tracked::setAndReleaseParameter(
+      device, geometry, "vertex.position", positionArray);
+  explorer::tracked::setAndReleaseParameter(
+      device, geometry, "vertex.normal", normalArray);
+  anari::setParameter(device, geometry, "primitive.index", indexArray);
+  anari::commitParameters(device, geometry);
+
+  auto material = explorer::tracked::newObject<anari::Material>(device, "matte");
+  anari::commitParameters(device, material);
+
+  auto surface = explorer::tracked::newObject<anari::Surface>(device);
+  explorer::tracked::setAndReleaseParameter(device, surface, "geometry", geometry);
+  explorer::tracked::setAndReleaseParameter(device, surface, "material", material);
+  anari::commitParameters(device, surface);
+
+  auto group = explorer::tracked::newObject<anari::Group>(device);
+  explorer::tracked::setAndReleaseParameter(
+      device, group, "surface", explorer::tracked::newArray1D(device, &surface));
+  anari::commitParameters(device, group);
+
+  explorer::tracked::release(device, surface);
+
+  auto inst = explorer::tracked::newObject<anari::Instance>(device, "transform");
+  explorer::tracked::setAndReleaseParameter(device, inst, "group", group);
+  anari::commitParameters(device, inst);
+
+  return inst;
+}
+
+static void releaseGridCells(anari::Device device)
+{
+  for (auto &cell : g_gridCells) {
+    if (cell)
+      explorer::tracked::release(device, cell);
+  }
+  g_gridCells.clear();
+}
+
+// Builds the enabled views from the current field (see evalBRDF())
+static void addBRDFGeom(anari::Device device, anari::World world)
+{
+  explorer::AllocScope scope(explorer::AllocPhase::ANARIUpdate);
+
   std::vector<anari::Surface> surfaces;
 
-  auto brdfSurf = makeBRDFSurface(device, mat);
-  surfaces.push_back(brdfSurf);
+  // the lobe grid replaces the single lobe views
+  if (g_lobeSettings.showGrid) {
+    anari::unsetParameter(device, world, "surface");
+    anari::commitParameters(device, world);
+    return;
+  }
+
+  if (g_lobeSettings.showLobe && g_lobeSettings.rgbLobes)
+    makeRGBSurfaces(device, surfaces);
+  else if (g_lobeSettings.showLobe)
+    surfaces.push_back(makeBRDFSurface(device));
+
+  if (g_lobeSettings.showHeatSphere)
+    surfaces.push_back(makeHeatSphereSurface(device));
 
   //auto brdfSamples = makeBRDFSamples(device, mat);
   //surfaces.push_back(brdfSamples);
 
-  anari::setAndReleaseParameter(
-      device, world, "surface",
-      anari::newArray1D(device, surfaces.data(), surfaces.size()));
+  if (!surfaces.empty()) {
+    explorer::tracked::setAndReleaseParameter(
+        device, world, "surface",
+        explorer::tracked::newArray1D(device, surfaces.data(), surfaces.size()));
+
+    for (auto &s : surfaces) {
+      explorer::tracked::release(device, s);
+    }
+  } else {
+    anari::unsetParameter(device, world, "surface");
+  }
+
   anari::commitParameters(device, world);
 }
 
@@ -645,8 +1117,28 @@ static void statusFunc(const void *userData,
     fprintf(stderr, "[DEBUG][%p] %s\n", source, message);
 }
 
+// Startup phases run on two threads, so each reports its own start;
+// printed with --verbose
+static void reportPhase(const char *name,
+                        std::chrono::steady_clock::time_point phaseStart)
+{
+  if (!g_verbose)
+    return;
+
+  auto now = std::chrono::steady_clock::now();
+  std::chrono::duration<double, std::milli> took = now - phaseStart;
+  std::chrono::duration<double, std::milli> total = now - g_startTime;
+
+  static std::mutex mutex;
+  std::lock_guard<std::mutex> lock(mutex);
+  std::cout << "[startup] " << name << ": " << took.count() << " ms (at "
+            << total.count() << " ms)\n";
+}
+
 static void initializeANARI()
 {
+  auto start = std::chrono::steady_clock::now();
+
   auto library =
       anariLoadLibrary(g_libraryName.c_str(), statusFunc, &g_verbose);
   if (!library)
@@ -655,6 +1147,9 @@ static void initializeANARI()
   if (g_enableDebug)
     g_debug = anariLoadLibrary("debug", statusFunc, &g_true);
 
+  reportPhase("ANARI library load", start);
+  start = std::chrono::steady_clock::now();
+
   anari::Device dev = anariNewDevice(library, "default");
 
   anari::unloadLibrary(library);
@@ -668,7 +1163,13 @@ static void initializeANARI()
   anari::setParameter(dev, dev, "glAPI", "OpenGL");
 #endif
 
+  reportPhase("ANARI device creation", start);
+  start = std::chrono::steady_clock::now();
+
   if (g_enableDebug) {
+    // names show up in the debug device's messages and traces
+    explorer::objectTracker().setNameObjects(true);
+
     anari::Device dbg = anariNewDevice(g_debug, "debug");
     anari::setParameter(dbg, dbg, "wrappedDevice", dev);
     if (g_traceDir) {
@@ -682,19 +1183,106 @@ static void initializeANARI()
 
   anari::commitParameters(dev, dev);
 
+  reportPhase(g_enableDebug ? "ANARI debug device" : "ANARI device commit", start);
+
   g_device = dev;
 }
 
+// Everything the first frame needs that doesn't depend on the device;
+// prepared by a task that runs while the window and device are created
+struct StartupMaterial
+{
+#ifdef EXPLORER_PLUGIN_HOST
+  std::unique_ptr<explorer::PluginHost> pluginHost;
+#endif
+  std::unique_ptr<explorer::Material> material; // null if no plugin
+  explorer::SphereGrid coarseGrid;
+  std::vector<float3> coarseValues;
+};
+
+static StartupMaterial loadStartupMaterial()
+{
+  StartupMaterial result;
+
+  auto start = std::chrono::steady_clock::now();
+  explorer::Material::loadPlugin("visionaray_material");
+  reportPhase("plugin load", start);
+  if (!explorer::Material::pluginLoaded())
+    return result;
+
+  start = std::chrono::steady_clock::now();
+
+#ifdef EXPLORER_PLUGIN_HOST
+  if (g_isolatePlugin) {
+    result.pluginHost =
+        std::make_unique<explorer::PluginHost>("visionaray_material");
+    result.pluginHost->install();
+  }
+#endif
+
+  result.material.reset(explorer::Material::createInstance(g_selectedMaterial));
+  if (!result.material)
+    throw std::runtime_error("cannot create material " + g_selectedMaterial);
+
+  if (!g_presetFileName.empty()) {
+    try {
+      auto preset = explorer::loadPreset(g_presetFileName);
+      std::unique_ptr<explorer::Material> mat(
+          explorer::Material::createInstance(preset.subtype));
+      if (!mat)
+        throw std::runtime_error("cannot create material " + preset.subtype);
+      explorer::applyPreset(preset, *mat);
+      g_selectedMaterial = preset.subtype;
+      result.material = std::move(mat);
+    } catch (const std::exception &e) {
+      // keep the default material
+      std::cerr << "[ERROR] cannot load preset " << g_presetFileName << ": "
+                << e.what() << '\n';
+    }
+  }
+
+  reportPhase("material", start);
+  start = std::chrono::steady_clock::now();
+
+  result.coarseGrid = explorer::makeSphereGrid(g_coarseLobeSegments);
+  result.coarseValues.resize(result.coarseGrid.directions.size());
+  explorer::evalLobe(*result.material,
+                     result.coarseGrid,
+                     normalize(g_lightDir),
+                     result.coarseValues.data());
+
+  reportPhase("coarse lobe", start);
+  return result;
+}
+
+// A field evaluated in the background
+struct LobeField
+{
+  explorer::SphereGrid grid;
+  std::vector<float3> values;
+};
+
 // Application definition /////////////////////////////////////////////////////
 
 class Application : public anari_viewer::Application
 {
  public:
-  Application() = default;
+  // The plugin is loaded (and a coarse lobe evaluated) while the base
+  // class creates the window and setupWindows() the device
+  Application()
+  {
+    // incremental: the plugin must only be used from the UI thread
+    m_startup = std::async(g_lobeSettings.incremental ? std::launch::deferred
+                                                      : std::launch::async,
+        loadStartupMaterial);
+  }
+
   ~Application() override = default;
 
   anari_viewer::WindowArray setupWindows() override
   {
+    reportPhase("window creation", g_startTime);
+
     anari_viewer::ui::init();
 
     // ANARI //
@@ -707,20 +1295,39 @@ class Application : public anari_viewer::Application
       std::exit(1);
 
     m_state.device = device;
-    m_state.world = anari::newObject<anari::World>(device);
+    m_state.world = explorer::tracked::newObject<anari::World>(device);
+
+    auto start = std::chrono::steady_clock::now();
+    StartupMaterial startup;
+    try {
+      startup = m_startup.get();
+    } catch (const std::exception &e) {
+      std::cerr << "[ERROR] " << e.what() << '\n';
+      exit(1);
+    }
+    reportPhase("wait for plugin", start);
 
-    explorer::Material::loadPlugin("visionaray_material");
     if (!explorer::Material::pluginLoaded()) {
       std::cerr << "Plugin not loaded, nothing much we can do here....\n";
       exit(0);
     }
 
-    m_material = explorer::Material::createInstance(g_selectedMaterial);
+    m_pluginReloader.watch(explorer::Material::pluginFileName());
 
-    addBRDFGeom(m_state.device, m_state.world, *m_material);
+#ifdef EXPLORER_PLUGIN_HOST
+    m_pluginHost = std::move(startup.pluginHost);
+#endif
+    m_material = std::move(startup.material);
+
+    // coarse lobe first, the full one follows from startFullLobe()
+    start = std::chrono::steady_clock::now();
+    setLobeField(std::move(startup.coarseGrid), std::move(startup.coarseValues));
+    addBRDFGeom(m_state.device, m_state.world);
     addPlaneAndArrows(m_state.device, m_state.world);
 
     anari::commitParameters(device, m_state.world);
+    reportPhase("scene", start);
+    start = std::chrono::steady_clock::now();
 
     // ImGui //
 
@@ -742,16 +1349,36 @@ class Application : public anari_viewer::Application
     auto *peditor = new windows::ParamEditor(*m_material,
                                              g_lightDir,
                                              g_selectedMaterial);
+    m_paramEditor = peditor;
 
     peditor->setLightUpdateCallback(
         [=]() {
           addPlaneAndArrows(m_state.device, m_state.world);
-          addBRDFGeom(m_state.device, m_state.world, *m_material);
+          updateBRDFGeom();
         });
 
     peditor->setMaterialUpdateCallback(
         [=]() {
-          addBRDFGeom(m_state.device, m_state.world, *m_material);
+          updateBRDFGeom();
+        });
+
+    auto *lobeEditor = new windows::LobeEditor(g_lobeSettings, g_selectedMaterial);
+
+    lobeEditor->setReferenceCallback(
+        [=]() {
+          m_reference.reset(explorer::Material::cloneInstance(
+              g_selectedMaterial, *m_material));
+          g_lobeSettings.referenceSubtype = g_selectedMaterial;
+        });
+
+    lobeEditor->setUpdateCallback(
+        [=]() {
+          updateBRDFGeom();
+        });
+
+    lobeEditor->setViewCallback(
+        [=]() {
+          addBRDFGeom(m_state.device, m_state.world);
         });
 
     // Setup scene //
@@ -760,14 +1387,26 @@ class Application : public anari_viewer::Application
     windows.emplace_back(viewport);
     windows.emplace_back(leditor);
     windows.emplace_back(peditor);
+    windows.emplace_back(lobeEditor);
+    if (g_showObjectStats)
+      windows.emplace_back(new windows::ObjectStatsWindow);
+#ifdef EXPLORER_TRACK_ALLOCATIONS
+    windows.emplace_back(new windows::AllocStatsWindow);
+#endif
     //  windows.emplace_back(isoeditor);
 
+    reportPhase("windows", start);
+
+    if (g_lobeSettings.incremental)
+      updateBRDFGeom();
+    else
+      startFullLobe();
+
     return windows;
   }
 
-  void buildMainMenuUI()
+  void buildMainMenuUI() override
   {
-  std::cout << "???\n";
     if (ImGui::BeginMainMenuBar()) {
       if (ImGui::BeginMenu("File")) {
         if (ImGui::MenuItem("print ImGui ini")) {
@@ -775,6 +1414,35 @@ class Application : public anari_viewer::Application
           printf("%s\n", info);
         }
 
+        ImGui::Separator();
+
+        ImGui::InputText("##exportFile",
+            m_exportFileName.data(),
+            m_exportFileName.size());
+        if (ImGui::MenuItem("Export lobe (.ply/.obj)")) {
+          try {
+            exportLobe(m_exportFileName.data());
+            std::cout << "Lobe written to " << m_exportFileName.data() << '\n';
+          } catch (const std::exception &e) {
+            std::cerr << "[ERROR] " << e.what() << '\n';
+          }
+        }
+
+        ImGui::Separator();
+
+        ImGui::InputText("##environmentFile",
+            m_environmentFileName.data(),
+            m_environmentFileName.size());
+        ImGui::InputText("##prefilterPrefix",
+            m_prefilterPrefix.data(),
+            m_prefilterPrefix.size());
+        if (ImGui::MenuItem("Prefilter environment (.hdr)",
+                nullptr,
+                false,
+                !m_prefilter.valid())) {
+          startPrefilter();
+        }
+
         ImGui::EndMenu();
       }
 
@@ -782,17 +1450,604 @@ class Application : public anari_viewer::Application
     }
   }
 
+  void uiFrameStart() override
+  {
+    explorer::objectTracker().beginFrame();
+    explorer::allocBeginFrame();
+
+    if (!m_firstFrameStarted) {
+      m_firstFrameStarted = true;
+      reportPhase("first frame", g_startTime);
+    }
+
+    if (m_pluginReloader.changed())
+      reloadPlugin();
+
+    pollFullLobe();
+
+    // in incremental mode, the lobe (or grid) comes first and the material
+    // ball gets what's left of the frame budget
+    auto stepStart = std::chrono::steady_clock::now();
+    stepIncrementalLobe();
+    stepIncrementalSensitivity();
+    m_gridBuilder.step(g_lobeSettings.frameBudgetMs);
+    pollBRDFGrid();
+
+    m_paramEditor->setPreviewOnUIThread(g_lobeSettings.incremental);
+    if (g_lobeSettings.incremental) {
+      std::chrono::duration<double, std::milli> spent =
+          std::chrono::steady_clock::now() - stepStart;
+      m_paramEditor->stepPreview(g_lobeSettings.frameBudgetMs - spent.count());
+    }
+
+    pollPrefilter();
+  }
+
   void teardown() override
   {
-    anari::release(m_state.device, m_state.world);
+    m_gridBuilder.cancel();
+    m_paramEditor->releasePreview();
+    cancelPrefilter();
+    releaseGridCells(m_state.device);
+    if (m_gridIndexArray)
+      explorer::tracked::release(m_state.device, m_gridIndexArray);
+    explorer::tracked::release(m_state.device, m_state.world);
+
+    m_fullLobe = {};
+    m_lobeCopies.clear();
+    m_referenceCopies.clear();
+    m_sensitivity.clear();
+    m_reference.reset();
+    m_material.reset();
+
+    // everything the explorer created should be gone by now
+    if (!explorer::objectTracker().printLeakReport(std::cerr) || g_verbose) {
+      auto types = explorer::objectTracker().typeStats();
+      for (auto &[type, stats] : types) {
+        std::cerr << "[STATS] " << explorer::ObjectTracker::typeName(type)
+                  << ": " << stats.created << " created, " << stats.released
+                  << " released\n";
+      }
+    }
+
     anari::release(m_state.device, m_state.device);
     anari_viewer::ui::shutdown();
+
+#ifdef EXPLORER_TRACK_ALLOCATIONS
+    auto highWater = explorer::allocHighWater();
+    for (size_t i = 0; i < size_t(explorer::AllocPhase::Count); ++i) {
+      std::cout << "[ALLOC] " << explorer::allocPhaseName(explorer::AllocPhase(i))
+                << ": max " << highWater.phases[i].count << " allocations ("
+                << highWater.phases[i].bytes << " bytes) per frame\n";
+    }
+    std::cout << "[ALLOC] peak heap: " << explorer::allocPeakLiveBytes() << " bytes\n";
+#endif
   }
 
  private:
+  // Called when the plugin library was rebuilt: the new version is
+  // loaded first, so a broken build leaves the old one in place. Then
+  // the materials are snapshotted and recreated from the new version,
+  // and only if that works, everything created from the old plugin is
+  // destroyed and the old plugin freed.
+  void reloadPlugin()
+  {
+    auto start = std::chrono::steady_clock::now();
+
+    explorer::Plugin plugin = nullptr;
+    try {
+      plugin = m_pluginReloader.loadShadowCopy();
+    } catch (const std::exception &e) {
+      std::cerr << "[ERROR] plugin reload failed, keeping the old version: "
+                << e.what() << '\n';
+      return;
+    }
+
+    if (!explorer::getSymbolAddress(plugin, "createMaterialInstance")) {
+      std::cerr << "[ERROR] reloaded plugin has no createMaterialInstance(), "
+                << "keeping the old version\n";
+      explorer::freePlugin(plugin);
+      return;
+    }
+
+    auto current = explorer::makePreset(g_selectedMaterial, *m_material);
+    std::unique_ptr<explorer::Preset> reference;
+    if (m_reference) {
+      reference = std::make_unique<explorer::Preset>(explorer::makePreset(
+          g_lobeSettings.referenceSubtype, *m_reference));
+    }
+
+    // the new materials are created while the old plugin is still loaded,
+    // so if the new version can't restore them, everything stays as it was
+    auto previous = explorer::Material::exchangePlugin(plugin);
+    std::unique_ptr<explorer::Material> material, referenceMaterial;
+    try {
+      material.reset(restoreMaterial(current));
+      if (reference)
+        referenceMaterial.reset(restoreMaterial(*reference));
+    } catch (const std::exception &e) {
+      std::cerr << "[ERROR] reloaded plugin cannot restore the materials, "
+                << "keeping the old version: " << e.what() << '\n';
+      material.reset();
+      referenceMaterial.reset();
+      explorer::Material::exchangePlugin(previous);
+      explorer::freePlugin(plugin);
+      return;
+    }
+
+    m_gridBuilder.cancel();
+    m_paramEditor->cancelPreview();
+    cancelPrefilter();
+    m_fullLobe = {}; // waits for it, it uses a material from the plugin
+    m_lobeCopies.clear();
+    m_referenceCopies.clear();
+    m_sensitivity.clear();
+    m_quality.reset(); // eval costs change with the code
+    m_reference = std::move(referenceMaterial);
+    m_material = std::move(material);
+
+    explorer::freePlugin(previous);
+
+#ifdef EXPLORER_PLUGIN_HOST
+    if (m_pluginHost) {
+      try {
+        m_pluginHost->restart();
+      } catch (const std::exception &e) {
+        std::cerr << "[ERROR] " << e.what() << '\n';
+      }
+    }
+#endif
+
+    g_selectedMaterial = current.subtype;
+    m_paramEditor->setMaterial(*m_material);
+    if (reference)
+      g_lobeSettings.referenceSubtype = reference->subtype;
+
+    updateBRDFGeom();
+
+    if (g_verbose) {
+      std::chrono::duration<double, std::milli> elapsed =
+          std::chrono::steady_clock::now() - start;
+      std::cout << "Plugin reloaded in " << elapsed.count() << " ms\n";
+    }
+  }
+
+  // Creates a material from a snapshot taken with the previous plugin;
+  // subtypes and params the new version no longer has are dropped
+  static explorer::Material *restoreMaterial(explorer::Preset &preset)
+  {
+    auto subtypes = explorer::Material::querySupportedSubtypes();
+    if (!subtypes.empty()
+        && std::find(subtypes.begin(), subtypes.end(), preset.subtype)
+            == subtypes.end())
+      preset.subtype = subtypes[0];
+
+    auto *mat = explorer::Material::createInstance(preset.subtype);
+    if (!mat)
+      throw std::runtime_error("cannot create material " + preset.subtype);
+
+    mat->setSubtype(preset.subtype);
+    for (auto &param : explorer::Material::querySupportedParams(preset.subtype)) {
+      for (auto &saved : preset.params) {
+        if (saved.name == param.name && saved.type == param.type)
+          mat->setParameter(saved);
+      }
+    }
+
+    return mat;
+  }
+
+  // Evaluates the startup field at full resolution in the background,
+  // on a copy of the material
+  void startFullLobe()
+  {
+    std::shared_ptr<explorer::Material> mat(
+        explorer::Material::cloneInstance(g_selectedMaterial, *m_material));
+    if (!mat)
+      return;
+
+    float3 lightDir = normalize(g_lightDir);
+    int segments = g_lobeSettings.segments;
+    m_fullLobe = std::async(std::launch::async, [mat, lightDir, segments]() {
+      auto start = std::chrono::steady_clock::now();
+      LobeField field;
+      field.grid = explorer::makeSphereGrid(segments);
+      field.values.resize(field.grid.directions.size());
+      explorer::evalLobe(*mat, field.grid, lightDir, field.values.data());
+      reportPhase("full lobe", start);
+      return field;
+    });
+  }
+
+  // Convolves the environment map with a copy of the current material in
+  // the background, over 6 levels of its (first) roughness param if it
+  // has one, and writes <prefix>_<level>.hdr
+  void startPrefilter()
+  {
+    std::shared_ptr<explorer::Material> mat(
+        explorer::Material::cloneInstance(g_selectedMaterial, *m_material));
+    if (!mat)
+      return;
+
+    explorer::PrefilterOptions options;
+    for (auto &param : explorer::Material::querySupportedParams(g_selectedMaterial)) {
+      if (param.type == explorer::DataType::Float
+          && param.name.find("oughness") != std::string::npos) {
+        options.levels = {param.name, 0.f, 1.f, 6};
+        break;
+      }
+    }
+    options.numThreads = std::max(1u, explorer::hardwareThreads() - 1);
+    options.verbose = g_verbose;
+    options.cancel = &m_cancelPrefilter;
+
+    std::string input = m_environmentFileName.data();
+    std::string prefix = m_prefilterPrefix.data();
+    m_prefilter = std::async(std::launch::async, [mat, options, input, prefix]() {
+      try {
+        auto map = explorer::loadEnvironmentMap(input);
+        auto levels = explorer::prefilterEnvironment(map, *mat, options);
+        explorer::savePrefilteredLevels(prefix, levels);
+        std::cout << "Prefiltered environment written to " << prefix << "_*.hdr\n";
+      } catch (const std::exception &e) {
+        std::cerr << "[ERROR] " << e.what() << '\n';
+      }
+    });
+  }
+
+  void pollPrefilter()
+  {
+    if (m_prefilter.valid()
+        && m_prefilter.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+      m_prefilter = {};
+  }
+
+  void cancelPrefilter()
+  {
+    m_cancelPrefilter = true;
+    m_prefilter = {}; // waits for it, it uses a material from the plugin
+    m_cancelPrefilter = false;
+  }
+
+  void pollFullLobe()
+  {
+    if (!m_fullLobe.valid()
+        || m_fullLobe.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+      return;
+
+    auto field = m_fullLobe.get();
+    setLobeField(std::move(field.grid), std::move(field.values));
+    addBRDFGeom(m_state.device, m_state.world);
+    reportPhase("full lobe shown", g_startTime);
+  }
+
+  void updateBRDFGeom()
+  {
+    // supersedes the startup field (waits for it if it's still running,
+    // which takes no longer than evaluating it here)
+    m_fullLobe = {};
+    m_incremental = {};
+    m_sensitivity.cancel();
+    g_lobeSettings.lobeProgress = 1.f;
+
+    if (g_lobeSettings.showGrid) {
+      startBRDFGrid();
+      addBRDFGeom(m_state.device, m_state.world);
+      return;
+    }
+
+    if (!g_gridCells.empty()) {
+      m_gridBuilder.cancel();
+      releaseGridCells(m_state.device);
+      addPlaneAndArrows(m_state.device, m_state.world);
+    }
+
+    // all params in one pass; in time slices on this thread in incremental
+    // mode (the plain lobe if the material can't be copied)
+    if (g_lobeSettings.showSensitivity) {
+      if (!g_lobeSettings.incremental) {
+        evalSensitivity(m_sensitivity, *m_material, 0);
+        addBRDFGeom(m_state.device, m_state.world);
+        return;
+      }
+      if (startIncrementalSensitivity())
+        return;
+    }
+    g_lobeSensitivity = {};
+    m_sensitivity.clear();
+
+    if (g_lobeSettings.incremental) {
+      startIncrementalLobe();
+      return;
+    }
+
+    const explorer::Material *reference =
+        g_lobeSettings.compare ? m_reference.get() : nullptr;
+
+    if (!g_lobeSettings.autoQuality) {
+      m_lobeCopies.clear();
+      m_referenceCopies.clear();
+      evalBRDF(*m_material, reference);
+      addBRDFGeom(m_state.device, m_state.world);
+      return;
+    }
+
+    // costs learned for another subtype say little about this one
+    if (g_selectedMaterial != m_qualitySubtype) {
+      m_quality.reset();
+      m_qualitySubtype = g_selectedMaterial;
+    }
+
+    const unsigned numThreads = std::max(1, g_lobeSettings.lobeThreads);
+    updateLobeCopies(numThreads - 1, reference);
+
+    auto start = std::chrono::steady_clock::now();
+    evalBRDF(*m_material, reference, m_lobeCopies, m_referenceCopies);
+    auto evaluated = std::chrono::steady_clock::now();
+    addBRDFGeom(m_state.device, m_state.world);
+    auto updated = std::chrono::steady_clock::now();
+
+    std::chrono::duration<double, std::milli> evalMs = evaluated - start;
+    std::chrono::duration<double, std::milli> updateMs = updated - evaluated;
+    const size_t numDirections = g_lobeGrid.directions.size();
+    m_quality.setTarget(g_lobeSettings.targetLatencyMs);
+    m_quality.record(numDirections * (reference ? 2 : 1),
+        numThreads,
+        evalMs.count(),
+        numDirections,
+        updateMs.count());
+
+    // takes effect with the next update
+    auto choice = m_quality.choose(
+        {g_lobeSettings.segments, unsigned(g_lobeSettings.lobeThreads)});
+    g_lobeSettings.segments = choice.segments;
+    g_lobeSettings.lobeThreads = int(choice.threads);
+    g_lobeSettings.evalNsPerSample = float(m_quality.evalNsPerSample());
+    g_lobeSettings.updateNsPerVertex = float(m_quality.updateNsPerVertex());
+    g_lobeSettings.lastLatencyMs = float(m_quality.lastLatencyMs());
+  }
+
+  // Fresh copies of the material (and reference) for the extra threads
+  // of evalBRDF(), they have to see the current params
+  void updateLobeCopies(unsigned count, const explorer::Material *reference)
+  {
+    m_lobeCopies.clear();
+    m_referenceCopies.clear();
+    for (unsigned i = 0; i < count; ++i) {
+      m_lobeCopies.emplace_back(
+          explorer::Material::cloneInstance(g_selectedMaterial, *m_material));
+      if (reference) {
+        m_referenceCopies.emplace_back(explorer::Material::cloneInstance(
+            g_lobeSettings.referenceSubtype, *reference));
+      }
+    }
+
+    // a failed copy (e.g., out of memory in the plugin) costs a thread
+    auto failed = [](auto &copy) { return !copy; };
+    if (std::any_of(m_lobeCopies.begin(), m_lobeCopies.end(), failed)
+        || std::any_of(m_referenceCopies.begin(), m_referenceCopies.end(), failed)) {
+      m_lobeCopies.clear();
+      m_referenceCopies.clear();
+    }
+  }
+
+  // Starts over on the current grid; the previous field stays visible
+  // (where it wasn't evaluated again yet) if the resolution didn't change
+  void startIncrementalLobe()
+  {
+    updateIncrementalGrid();
+    m_incremental.start(g_lobeGrid.directions.size(), normalize(g_lightDir));
+    g_lobeSettings.lobeProgress = 0.f;
+  }
+
+  // The same for the sensitivity view; false if the material can't be
+  // copied
+  bool startIncrementalSensitivity()
+  {
+    updateIncrementalGrid();
+    try {
+      m_sensitivity.start(
+          g_selectedMaterial, *m_material, g_lobeGrid, normalize(g_lightDir));
+    } catch (const std::exception &e) {
+      std::cerr << "[ERROR] " << e.what() << '\n';
+      return false;
+    }
+    g_lobeSettings.sensitivityParams = m_sensitivity.result().params;
+    g_lobeSettings.lobeProgress = 0.f;
+    return true;
+  }
+
+  // A new resolution starts from the previous field resampled onto the
+  // new grid, so the lobe keeps its shape while it's evaluated again
+  void updateIncrementalGrid()
+  {
+    if (g_lobeGrid.segments == g_lobeSettings.segments)
+      return;
+
+    auto grid = explorer::makeSphereGrid(g_lobeSettings.segments);
+    std::vector<float3> values(grid.directions.size(), float3(0.f));
+    if (g_lobeGrid.segments > 1
+        && g_lobeValues.size() == g_lobeGrid.directions.size()) {
+      explorer::resampleLobe(
+          g_lobeGrid, g_lobeValues.data(), grid, values.data());
+    }
+    g_lobeGrid = std::move(grid);
+    g_lobeValues = std::move(values);
+  }
+
+  // Evaluates as much of the field as the frame budget allows and shows
+  // the partial result
+  void stepIncrementalLobe()
+  {
+    if (m_incremental.done())
+      return;
+
+    {
+      explorer::AllocScope scope(explorer::AllocPhase::LobeEval);
+
+      const explorer::Material *reference =
+          g_lobeSettings.compare ? m_reference.get() : nullptr;
+      m_incremental.step(*m_material,
+          reference,
+          g_lobeGrid,
+          g_lobeValues.data(),
+          g_lobeSettings.frameBudgetMs);
+      g_lobeSettings.lobeProgress = m_incremental.progress();
+
+      if (m_incremental.done()) {
+        if (reference) {
+          auto stats = m_incremental.differenceStats();
+          g_lobeSettings.l2Error = stats.l2Error;
+          g_lobeSettings.maxError = stats.maxError;
+        }
+        explorer::polarSlice(g_lobeGrid,
+            g_lobeValues.data(),
+            normalize(g_lightDir),
+            g_lobeSettings.polarSlice);
+      }
+    }
+
+    addBRDFGeom(m_state.device, m_state.world);
+  }
+
+  void stepIncrementalSensitivity()
+  {
+    if (m_sensitivity.done())
+      return;
+
+    {
+      explorer::AllocScope scope(explorer::AllocPhase::LobeEval);
+
+      m_sensitivity.step(
+          g_lobeGrid, g_lobeValues.data(), g_lobeSettings.frameBudgetMs);
+      g_lobeSensitivity = m_sensitivity.result();
+      g_lobeSettings.lobeProgress = m_sensitivity.progress();
+
+      if (m_sensitivity.done()) {
+        explorer::polarSlice(g_lobeGrid,
+            g_lobeValues.data(),
+            normalize(g_lightDir),
+            g_lobeSettings.polarSlice);
+      }
+    }
+
+    addBRDFGeom(m_state.device, m_state.world);
+  }
+
+  void startBRDFGrid()
+  {
+    auto device = m_state.device;
+
+    // cells are evaluated from uiFrameStart() in incremental mode
+    if (g_lobeSettings.incremental) {
+      m_gridBuilder.startOnCallingThread(g_selectedMaterial,
+                                         *m_material,
+                                         normalize(g_lightDir),
+                                         g_lobeSettings.gridSegments,
+                                         g_lobeSettings.gridColumns,
+                                         g_lobeSettings.gridRows);
+    } else {
+      m_gridBuilder.start(g_selectedMaterial,
+                          *m_material,
+                          normalize(g_lightDir),
+                          g_lobeSettings.gridSegments,
+                          g_lobeSettings.gridColumns,
+                          g_lobeSettings.gridRows);
+    }
+
+    // all cells share one index array
+    const auto &grid = m_gridBuilder.sphereGrid();
+    if (grid.segments != m_gridIndexSegments) {
+      if (m_gridIndexArray)
+        explorer::tracked::release(device, m_gridIndexArray);
+      m_gridIndexArray = explorer::tracked::newArray1D(
+          device, ANARI_UINT32_VEC3, grid.indices.size());
+      auto *index = anari::map<anari::math::uint3>(device, m_gridIndexArray);
+      std::copy(grid.indices.begin(), grid.indices.end(), index);
+      anari::unmap(device, m_gridIndexArray);
+      m_gridIndexSegments = grid.segments;
+    }
+
+    releaseGridCells(device);
+    g_gridCells.resize(m_gridBuilder.numCells(), nullptr);
+    g_lobeSettings.gridCellsDone = 0;
+    m_gridLobeScale = 0.f;
+    m_gridMaxRadius = 0.f;
+
+    addPlaneAndArrows(device, m_state.world);
+  }
+
+  // Turns cells that finished since the last frame into instances
+  void pollBRDFGrid()
+  {
+    explorer::AllocScope scope(explorer::AllocPhase::ANARIUpdate);
+
+    auto finished = m_gridBuilder.takeFinished();
+    if (finished.empty())
+      return;
+
+    auto device = m_state.device;
+    const auto &grid = m_gridBuilder.sphereGrid();
+
+    for (size_t cell : finished) {
+      const auto &values = m_gridBuilder.cellValues(cell);
+      for (auto &v : values)
+        m_gridMaxRadius = std::max(m_gridMaxRadius, fabsf(v.y));
+
+      g_gridCells[cell] =
+          makeGridCellInstance(device, grid, m_gridIndexArray, values);
+    }
+
+    g_lobeSettings.gridCellsDone += int(finished.size());
+
+    // the shared scale changes when a new cell has the largest lobe
+    float lobeScale = m_gridMaxRadius > 0.f ? 1.f / m_gridMaxRadius : 1.f;
+    bool rescale = lobeScale != m_gridLobeScale;
+    m_gridLobeScale = lobeScale;
+
+    for (size_t cell = 0; cell < g_gridCells.size(); ++cell) {
+      bool isNew =
+          std::find(finished.begin(), finished.end(), cell) != finished.end();
+      if (g_gridCells[cell] && (rescale || isNew))
+        setGridCellTransform(device, g_gridCells[cell], cell, lobeScale);
+    }
+
+    addPlaneAndArrows(device, m_state.world);
+  }
+
   AppState m_state;
 
-  explorer::Material *m_material{nullptr};
+#ifdef EXPLORER_PLUGIN_HOST
+  // declared before all materials, so it outlives them
+  std::unique_ptr<explorer::PluginHost> m_pluginHost;
+#endif
+  std::unique_ptr<explorer::Material> m_material;
+  std::unique_ptr<explorer::Material> m_reference;
+
+  std::future<StartupMaterial> m_startup;
+  std::future<LobeField> m_fullLobe;
+  explorer::IncrementalLobe m_incremental;
+  explorer::QualityController m_quality;
+  std::string m_qualitySubtype;
+  MaterialCopies m_lobeCopies; // declared after the materials, destroyed first
+  MaterialCopies m_referenceCopies;
+  explorer::LobeSensitivityEvaluator m_sensitivity; // keeps its copies
+  bool m_firstFrameStarted{false};
+
+  explorer::LobeGridBuilder m_gridBuilder;
+  anari::Array1D m_gridIndexArray{nullptr};
+  std::array<char, 512> m_exportFileName{"lobe.ply"};
+  std::array<char, 512> m_environmentFileName{"environment.hdr"};
+  std::array<char, 512> m_prefilterPrefix{"prefiltered"};
+  std::future<void> m_prefilter;
+  std::atomic<bool> m_cancelPrefilter{false};
+
+  windows::ParamEditor *m_paramEditor{nullptr};
+  explorer::PluginReloader m_pluginReloader;
+
+  int m_gridIndexSegments{0};
+  float m_gridMaxRadius{0.f};
+  float m_gridLobeScale{0.f};
 };
 
 } // namespace viewer
@@ -801,7 +2056,13 @@ static void printUsage()
 {
   std::cout << "./anariBRDFExplorer [{--help|-h}]\n"
             << "   [{--verbose|-v}] [{--debug|-g}]\n"
+            << "   [--stats] (show the ANARI object accounting panel)\n"
             << "   [{--library|-l} <ANARI library>]\n"
+            << "   [--preset <file>]\n"
+            << "   [--isolate] (evaluate the plugin in a separate process)\n"
+            << "   [--frame-budget <ms>] (evaluate the lobe on the UI thread,\n"
+            << "      spending at most <ms> per frame)\n"
+            << "   [--export <file.ply|file.obj>] (write the lobe and exit)\n"
             << "   [{--trace|-t} <directory>]\n";
 }
 
@@ -818,16 +2079,64 @@ static void parseCommandLine(int argc, char *argv[])
       g_useDefaultLayout = false;
     else if (arg == "-l" || arg == "--library")
       g_libraryName = argv[++i];
-    else if (arg == "--debug" || arg == "-g")
+    else if (arg == "--debug" || arg == "-g") {
       g_enableDebug = true;
+      g_showObjectStats = true;
+    } else if (arg == "--stats")
+      g_showObjectStats = true;
     else if (arg == "--trace")
       g_traceDir = argv[++i];
+    else if (arg == "--preset")
+      g_presetFileName = argv[++i];
+    else if (arg == "--isolate")
+      g_isolatePlugin = true;
+    else if (arg == "--frame-budget") {
+      g_lobeSettings.incremental = true;
+      g_lobeSettings.frameBudgetMs = std::stof(argv[++i]);
+    }
+    else if (arg == "--export")
+      g_exportFileName = argv[++i];
   }
 }
 
+// --export: evaluate and write the lobe without creating a device
+static int exportAndExit()
+{
+  try {
+    explorer::Material::loadPlugin("visionaray_material");
+    if (!explorer::Material::pluginLoaded()) {
+      std::cerr << "Plugin not loaded, nothing much we can do here....\n";
+      return 1;
+    }
+
+    std::unique_ptr<explorer::Material> mat;
+    if (!g_presetFileName.empty()) {
+      auto preset = explorer::loadPreset(g_presetFileName);
+      mat.reset(explorer::Material::createInstance(preset.subtype));
+      if (!mat)
+        throw std::runtime_error("cannot create material " + preset.subtype);
+      explorer::applyPreset(preset, *mat);
+    } else {
+      mat.reset(explorer::Material::createInstance(g_selectedMaterial));
+    }
+    if (!mat)
+      throw std::runtime_error("cannot create material " + g_selectedMaterial);
+
+    evalBRDF(*mat, nullptr);
+    exportLobe(g_exportFileName);
+  } catch (const std::exception &e) {
+    std::cerr << "[ERROR] " << e.what() << '\n';
+    return 1;
+  }
+  return 0;
+}
+
 int main(int argc, char *argv[])
 {
+  g_startTime = std::chrono::steady_clock::now();
   parseCommandLine(argc, argv);
+  if (!g_exportFileName.empty())
+    return exportAndExit();
   viewer::Application app;
   app.run(1920, 1200, "ANARI BRDF Explorer");
   return 0;
@@ -0,0 +1,1033 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+// Headless batch front end for the BRDF plugins (no ANARI device, no GUI)
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+// posix
+#include <sys/wait.h>
+#include <unistd.h>
+// ours
+#include "Directions.h"
+#include "EvalServer.h"
+#include "FactorizedBRDF.h"
+#include "Fit.h"
+#include "Lobe.h"
+#include "material.h"
+#include "MeshExport.h"
+#include "Parallel.h"
+#ifdef EXPLORER_PLUGIN_HOST
+#include "PluginHost.h"
+#endif
+#include "Prefilter.h"
+#include "Preset.h"
+#include "SamplingTable.h"
+#include "Sweep.h"
+
+static std::string g_pluginName = "visionaray_material";
+static bool g_verbose = false;
+static std::string g_executable = "anariBRDFTool"; // for worker processes
+
+static void printUsage()
+{
+  std::cout << "./anariBRDFTool <command> [options]\n"
+            << "\n"
+            << "commands:\n"
+            << "   sweep   evaluate the BRDF over a grid of params/directions\n"
+            << "   bake    tabulate one parameter set (isotropic, theta/theta/phi)\n"
+            << "   albedo  directional albedo over a grid of params/light dirs\n"
+            << "   merge   concatenate the shards of a sweep/bake/albedo job\n"
+            << "   fit     fit plugin params to a tabulated BRDF (bake output)\n"
+            << "   factorize  compress a tabulated BRDF into low-rank factors\n"
+            << "   prefilter  convolve an environment map with the BRDF\n"
+            << "   sampling   build a tabulated sampling distribution\n"
+            << "   lobes   export lobe meshes over a grid of params/light dirs\n"
+            << "   serve   answer eval/albedo/sample requests on a Unix socket\n"
+            << "\n"
+            << "common options:\n"
+            << "   [{--help|-h}] [{--verbose|-v}]\n"
+            << "   [{--plugin|-p} <plugin name>]\n"
+            << "\n"
+            << "sweep/bake/albedo options:\n"
+            << "   {--output|-o} <file> [{--subtype|-s} <subtype>]\n"
+            << "   [--param <name>=<min>:<max>:<count>]...\n"
+            << "   [--set <name>=<value>[,<value>...]]...\n"
+            << "   [--light-theta <min>:<max>:<count>] [--light-phi ...]\n"
+            << "   [--view-theta <min>:<max>:<count>] [--view-phi ...]\n"
+            << "   [{--threads|-j} <N>] [--chunk-rows <N>] [--resume]\n"
+            << "   [--workers <N>] [--shard <i>/<N>]\n"
+            << "   (angles in degrees, theta measured from the normal)\n"
+            << "\n"
+            << "bake options: as sweep, minus --param, plus [--resolution <N>]\n"
+            << "albedo options: as sweep, minus --view-*, plus\n"
+            << "   [--quadrature <theta samples>:<phi samples>]\n"
+            << "\n"
+            << "merge options:\n"
+            << "   {--output|-o} <file> <shard file>...\n"
+            << "\n"
+            << "fit options:\n"
+            << "   [{--subtype|-s} <subtype>] [--preset <initial values>]\n"
+            << "   --fit <name>[=<min>:<max>]... [--set <name>=<value>...]\n"
+            << "   [--metric {l2|cosine|log}] [--iterations <N>]\n"
+            << "   [{--threads|-j} <N>] [{--output|-o} <preset>] <target>...\n"
+            << "   (writes <target>.preset unless --output is given)\n"
+            << "\n"
+            << "factorize options:\n"
+            << "   [--method {svd|nmf}] [--rank <N>] [--iterations <N>]\n"
+            << "   [--light-view] [--resolution <N>]\n"
+            << "   [{--threads|-j} <N>] [{--output|-o} <file>] <table>\n"
+            << "   (writes <table>.lrb unless --output is given; isotropic tables\n"
+            << "   are resampled to half/difference angles unless --light-view)\n"
+            << "\n"
+            << "prefilter options:\n"
+            << "   {--output|-o} <prefix> [{--subtype|-s} <subtype>]\n"
+            << "   [--preset <file>] [--set <name>=<value>...]\n"
+            << "   [--levels <name>=<min>:<max>:<count>] [--width <N>]\n"
+            << "   [--samples <N>] [{--threads|-j} <N>] <environment.hdr>\n"
+            << "   (writes <prefix>_<level>.hdr, halving the width per level)\n"
+            << "\n"
+            << "sampling options:\n"
+            << "   [{--subtype|-s} <subtype>] [--preset <file>] [--set <name>=<value>...]\n"
+            << "   [--cache <dir>] [{--output|-o} <file>]\n"
+            << "   [--resolution <light theta>:<view theta>:<view phi>]\n"
+            << "   [--supersampling <N>] [--samples <N>] [{--threads|-j} <N>]\n"
+            << "   (cache: $EXPLORER_SAMPLING_CACHE or sampling_cache; reports the\n"
+            << "   albedo estimate's error with table vs. cosine sampling)\n"
+            << "\n"
+            << "lobes options:\n"
+            << "   {--output|-o} <prefix> [{--subtype|-s} <subtype>]\n"
+            << "   [--param ...]... [--set ...]... [--light-theta ...] [--light-phi ...]\n"
+            << "   [--segments <N>] [--format {ply|obj}] [{--threads|-j} <N>]\n"
+            << "   (writes <prefix>_<row>.<format>, rows numbered as in sweep)\n"
+            << "\n"
+            << "serve options:\n"
+            << "   --socket <path> [{--threads|-j} <N>]\n"
+            << "   (protocol: see EvalServer.h)\n";
+}
+
+static std::vector<std::string> split(const std::string &str, char delim)
+{
+  std::vector<std::string> result;
+  size_t pos = 0;
+  for (;;) {
+    size_t next = str.find(delim, pos);
+    result.push_back(str.substr(pos, next - pos));
+    if (next == std::string::npos)
+      break;
+    pos = next + 1;
+  }
+  return result;
+}
+
+static void splitAssignment(
+    const std::string &arg, std::string &name, std::string &value)
+{
+  size_t pos = arg.find('=');
+  if (pos == std::string::npos || pos == 0)
+    throw std::runtime_error("expected <name>=<value>, got: " + arg);
+  name = arg.substr(0, pos);
+  value = arg.substr(pos + 1);
+}
+
+static explorer::SweepAxis parseAxis(std::string name, std::string range)
+{
+  auto tokens = split(range, ':');
+  if (tokens.size() != 3)
+    throw std::runtime_error("expected <min>:<max>:<count>, got: " + range);
+
+  explorer::SweepAxis axis;
+  axis.name = name;
+  axis.minValue = std::stof(tokens[0]);
+  axis.maxValue = std::stof(tokens[1]);
+  int count = std::stoi(tokens[2]);
+  if (count < 1)
+    throw std::runtime_error("axis " + name + " needs at least one sample");
+  axis.count = uint32_t(count);
+  return axis;
+}
+
+static explorer::MaterialParam parseParam(
+    std::string_view subtype, const std::string &arg)
+{
+  using namespace anari::math;
+
+  std::string name, value;
+  splitAssignment(arg, name, value);
+
+  for (auto &param : explorer::Material::querySupportedParams(subtype)) {
+    if (param.name != name)
+      continue;
+
+    auto v = split(value, ',');
+    size_t expected = param.type == explorer::DataType::Float ? 1
+        : param.type == explorer::DataType::Float2            ? 2
+        : param.type == explorer::DataType::Float3            ? 3
+                                                              : 4;
+    if (v.size() != expected)
+      throw std::runtime_error("wrong number of values for " + name);
+
+    explorer::MaterialParam result = param;
+    if (param.type == explorer::DataType::Float)
+      result.value = std::stof(v[0]);
+    else if (param.type == explorer::DataType::Float2)
+      result.value = float2(std::stof(v[0]), std::stof(v[1]));
+    else if (param.type == explorer::DataType::Float3)
+      result.value = float3(std::stof(v[0]), std::stof(v[1]), std::stof(v[2]));
+    else
+      result.value = float4(
+          std::stof(v[0]), std::stof(v[1]), std::stof(v[2]), std::stof(v[3]));
+    return result;
+  }
+
+  throw std::runtime_error(
+      "subtype " + std::string(subtype) + " has no parameter " + name);
+}
+
+static void checkSweptParam(std::string_view subtype, const std::string &name)
+{
+  for (auto &param : explorer::Material::querySupportedParams(subtype)) {
+    if (param.name == name) {
+      if (param.type != explorer::DataType::Float)
+        throw std::runtime_error("only Float parameters can be swept: " + name);
+      return;
+    }
+  }
+
+  throw std::runtime_error(
+      "subtype " + std::string(subtype) + " has no parameter " + name);
+}
+
+// Runs numWorkers copies of this executable on disjoint row ranges
+// (shards), then merges their outputs. Workers only share files.
+static void runWorkers(const std::string &command,
+                       unsigned numWorkers,
+                       bool threadsGiven,
+                       const std::vector<std::string> &jobArgs,
+                       const std::string &outputFile)
+{
+  std::vector<std::string> shardFiles;
+  std::vector<pid_t> pids;
+
+  const unsigned threadsPerWorker =
+      std::max(1u, explorer::hardwareThreads() / numWorkers);
+
+  for (unsigned i = 0; i < numWorkers; ++i) {
+    shardFiles.push_back(outputFile + ".shard" + std::to_string(i));
+
+    std::vector<std::string> args = {"anariBRDFTool", command, "-p", g_pluginName};
+    if (g_verbose)
+      args.push_back("-v");
+    args.insert(args.end(), jobArgs.begin(), jobArgs.end());
+    args.push_back("--shard");
+    args.push_back(std::to_string(i) + "/" + std::to_string(numWorkers));
+    args.push_back("-o");
+    args.push_back(shardFiles.back());
+    if (!threadsGiven) {
+      args.push_back("-j");
+      args.push_back(std::to_string(threadsPerWorker));
+    }
+
+    std::vector<char *> argv;
+    for (auto &arg : args)
+      argv.push_back(const_cast<char *>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid < 0)
+      throw std::runtime_error("fork() failed");
+    if (pid == 0) {
+      execvp(g_executable.c_str(), argv.data());
+      _exit(127);
+    }
+    pids.push_back(pid);
+  }
+
+  bool failed = false;
+  for (auto pid : pids) {
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)
+        || WEXITSTATUS(status) != 0)
+      failed = true;
+  }
+
+  // shards stay around on failure, so rerunning with --resume picks up
+  // where each of the workers left off
+  if (failed)
+    throw std::runtime_error("a worker failed, shards were kept for --resume");
+
+  explorer::mergeSweepFiles(shardFiles, outputFile);
+
+  for (auto &f : shardFiles)
+    std::remove(f.c_str());
+}
+
+// Bake axes with n light/view elevations over [0,90] deg and 2n view
+// azimuths over [0,360) deg
+static void setBakeResolution(explorer::SweepSpec &spec, int n)
+{
+  spec.lightTheta = parseAxis("lightTheta", "0:90:" + std::to_string(n));
+  spec.viewTheta = parseAxis("viewTheta", "0:90:" + std::to_string(n));
+  spec.viewPhi = parseAxis("viewPhi",
+      "0:" + std::to_string(360.f - 180.f / n) + ":" + std::to_string(2 * n));
+}
+
+// sweep, bake and albedo only differ in their defaults and output kind
+static int jobCommand(const std::string &command, int argc, char *argv[])
+{
+  explorer::SweepSpec spec;
+  explorer::SweepOptions options;
+  std::vector<std::string> params, fixedParams;
+  std::vector<std::string> jobArgs; // forwarded to worker processes
+  unsigned numWorkers = 0;
+  unsigned shard = 0, numShards = 0;
+  bool threadsGiven = false;
+
+  spec.subtype = "PBM";
+
+  if (command == "bake") {
+    setBakeResolution(spec, 90);
+  } else if (command == "albedo") {
+    spec.kind = explorer::SweepKind::Albedo;
+    spec.lightTheta = parseAxis("lightTheta", "0:89:90");
+    spec.viewTheta = parseAxis("viewTheta", "0:90:64");
+    spec.viewPhi = parseAxis("viewPhi", "0:360:128");
+  }
+
+  for (int i = 0; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc && arg != "--resume")
+      throw std::runtime_error("missing value for " + arg);
+
+    if (arg == "-o" || arg == "--output") {
+      options.outputFile = argv[++i];
+      continue;
+    } else if (arg == "--workers") {
+      numWorkers = unsigned(std::stoi(argv[++i]));
+      continue;
+    } else if (arg == "--shard") {
+      auto tokens = split(argv[++i], '/');
+      if (tokens.size() != 2)
+        throw std::runtime_error("expected --shard <i>/<N>");
+      shard = unsigned(std::stoi(tokens[0]));
+      numShards = unsigned(std::stoi(tokens[1]));
+      if (numShards == 0 || shard >= numShards)
+        throw std::runtime_error("invalid shard " + std::string(argv[i]));
+      continue;
+    }
+
+    jobArgs.push_back(arg);
+    if (arg != "--resume")
+      jobArgs.push_back(argv[i + 1]);
+
+    if (arg == "-s" || arg == "--subtype")
+      spec.subtype = argv[++i];
+    else if (arg == "--param" && command != "bake")
+      params.push_back(argv[++i]);
+    else if (arg == "--set")
+      fixedParams.push_back(argv[++i]);
+    else if (arg == "--light-theta")
+      spec.lightTheta = parseAxis("lightTheta", argv[++i]);
+    else if (arg == "--light-phi")
+      spec.lightPhi = parseAxis("lightPhi", argv[++i]);
+    else if (arg == "--view-theta" && command != "albedo")
+      spec.viewTheta = parseAxis("viewTheta", argv[++i]);
+    else if (arg == "--view-phi" && command != "albedo")
+      spec.viewPhi = parseAxis("viewPhi", argv[++i]);
+    else if (arg == "--resolution" && command == "bake")
+      setBakeResolution(spec, std::stoi(argv[++i]));
+    else if (arg == "--quadrature" && command == "albedo") {
+      auto tokens = split(argv[++i], ':');
+      if (tokens.size() != 2)
+        throw std::runtime_error("expected --quadrature <theta>:<phi>");
+      spec.viewTheta.count = uint32_t(std::max(1, std::stoi(tokens[0])));
+      spec.viewPhi.count = uint32_t(std::max(1, std::stoi(tokens[1])));
+    } else if (arg == "-j" || arg == "--threads") {
+      options.numThreads = unsigned(std::stoi(argv[++i]));
+      threadsGiven = true;
+    } else if (arg == "--chunk-rows")
+      options.rowsPerChunk = std::stoull(argv[++i]);
+    else if (arg == "--resume")
+      options.resume = true;
+    else
+      throw std::runtime_error("unknown " + command + " option " + arg);
+  }
+
+  if (options.outputFile.empty())
+    throw std::runtime_error(command + " needs an output file (--output)");
+
+  for (auto &p : params) {
+    std::string name, range;
+    splitAssignment(p, name, range);
+    checkSweptParam(spec.subtype, name);
+    spec.params.push_back(parseAxis(name, range));
+  }
+
+  for (auto &p : fixedParams)
+    spec.fixedParams.push_back(parseParam(spec.subtype, p));
+
+  // every worker needs at least one row, runSweep() reads an empty range
+  // as "all rows"
+  numWorkers = unsigned(std::min<uint64_t>(numWorkers, spec.rowCount()));
+
+  if (numWorkers > 1) {
+    runWorkers(command, numWorkers, threadsGiven, jobArgs, options.outputFile);
+    return 0;
+  }
+
+  if (numShards > 0)
+    explorer::shardRowRange(spec, shard, numShards, options.firstRow, options.numRows);
+
+  options.verbose = g_verbose;
+
+  if (g_verbose) {
+    std::cerr << "[" << command << "] " << spec.rowCount() << " rows x "
+              << spec.rowSize() << " values";
+    if (numShards > 0) {
+      std::cerr << ", shard " << shard << '/' << numShards << " (rows "
+                << options.firstRow << ".." << options.firstRow + options.numRows
+                << ')';
+    }
+    std::cerr << '\n';
+  }
+
+  explorer::runSweep(spec, options);
+  return 0;
+}
+
+static int fitCommand(int argc, char *argv[])
+{
+  explorer::Preset initial;
+  explorer::FitOptions options;
+  std::vector<explorer::FitParam> params;
+  std::vector<std::string> fitArgs, fixedParams, targets;
+  std::string outputFile;
+
+  initial.subtype = "PBM";
+
+  for (int i = 0; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg.size() > 1 && arg[0] == '-' && i + 1 >= argc)
+      throw std::runtime_error("missing value for " + arg);
+
+    if (arg == "-o" || arg == "--output")
+      outputFile = argv[++i];
+    else if (arg == "-s" || arg == "--subtype")
+      initial.subtype = argv[++i];
+    else if (arg == "--preset")
+      initial = explorer::loadPreset(argv[++i]);
+    else if (arg == "--fit")
+      fitArgs.push_back(argv[++i]);
+    else if (arg == "--set")
+      fixedParams.push_back(argv[++i]);
+    else if (arg == "--metric") {
+      std::string metric = argv[++i];
+      if (metric == "l2")
+        options.metric = explorer::FitMetric::L2;
+      else if (metric == "cosine")
+        options.metric = explorer::FitMetric::Cosine;
+      else if (metric == "log")
+        options.metric = explorer::FitMetric::Log;
+      else
+        throw std::runtime_error("unknown metric " + metric);
+    } else if (arg == "--iterations")
+      options.maxIterations = std::stoi(argv[++i]);
+    else if (arg == "-j" || arg == "--threads")
+      options.numThreads = unsigned(std::stoi(argv[++i]));
+    else if (arg[0] == '-')
+      throw std::runtime_error("unknown fit option " + arg);
+    else
+      targets.push_back(arg);
+  }
+
+  if (targets.empty())
+    throw std::runtime_error("fit needs at least one target file");
+  if (!outputFile.empty() && targets.size() > 1)
+    throw std::runtime_error("--output only works with a single target");
+
+  for (auto &p : fixedParams)
+    initial.params.push_back(parseParam(initial.subtype, p));
+
+  for (auto &f : fitArgs) {
+    explorer::FitParam param;
+    size_t pos = f.find('=');
+    param.name = f.substr(0, pos);
+    if (pos != std::string::npos) {
+      auto axis = parseAxis(param.name, f.substr(pos + 1) + ":1");
+      param.minValue = axis.minValue;
+      param.maxValue = axis.maxValue;
+    }
+
+    bool found = false;
+    for (auto &sp : explorer::Material::querySupportedParams(initial.subtype)) {
+      if (sp.name == param.name) {
+        param.type = sp.type;
+        found = true;
+      }
+    }
+    if (!found) {
+      throw std::runtime_error(
+          "subtype " + initial.subtype + " has no parameter " + param.name);
+    }
+    params.push_back(param);
+  }
+
+  // Few targets: parallelize each fit over its directions. Many targets:
+  // one fit per core, that's the better fit for small tables.
+  const unsigned numThreads = options.numThreads > 0
+      ? options.numThreads
+      : explorer::hardwareThreads();
+  const bool perTarget = targets.size() >= numThreads;
+  if (perTarget)
+    options.numThreads = 1;
+
+  options.verbose = g_verbose && !perTarget;
+
+  explorer::parallelFor(perTarget ? numThreads : 1,
+      targets.size(),
+      [&](unsigned, size_t i) {
+        explorer::MappedSweepFile target(targets[i]);
+        auto result = explorer::fitMaterial(target, initial, params, options);
+
+        std::string presetFile = outputFile.empty() ? targets[i] + ".preset" : outputFile;
+        explorer::savePreset(presetFile, result.preset);
+
+        if (g_verbose) {
+          fprintf(stderr,
+              "[fit] %s: rms %g -> %g after %d iterations\n",
+              targets[i].c_str(),
+              result.initialError,
+              result.finalError,
+              result.iterations);
+        }
+      });
+
+  return 0;
+}
+
+// One lobe mesh per sweep row (params x light dirs); each worker streams
+// its meshes straight from the generator buffers, which are reused
+static int lobesCommand(int argc, char *argv[])
+{
+  using namespace anari::math;
+
+  explorer::SweepSpec spec;
+  std::vector<std::string> params, fixedParams;
+  std::string prefix, format = "ply";
+  int segments = 100;
+  unsigned numThreads = 0;
+
+  spec.subtype = "PBM";
+  spec.lightTheta = parseAxis("lightTheta", "45:45:1");
+
+  for (int i = 0; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc)
+      throw std::runtime_error("missing value for " + arg);
+
+    if (arg == "-o" || arg == "--output")
+      prefix = argv[++i];
+    else if (arg == "-s" || arg == "--subtype")
+      spec.subtype = argv[++i];
+    else if (arg == "--param")
+      params.push_back(argv[++i]);
+    else if (arg == "--set")
+      fixedParams.push_back(argv[++i]);
+    else if (arg == "--light-theta")
+      spec.lightTheta = parseAxis("lightTheta", argv[++i]);
+    else if (arg == "--light-phi")
+      spec.lightPhi = parseAxis("lightPhi", argv[++i]);
+    else if (arg == "--segments")
+      segments = std::max(3, std::stoi(argv[++i]));
+    else if (arg == "--format")
+      format = argv[++i];
+    else if (arg == "-j" || arg == "--threads")
+      numThreads = unsigned(std::stoi(argv[++i]));
+    else
+      throw std::runtime_error("unknown lobes option " + arg);
+  }
+
+  if (prefix.empty())
+    throw std::runtime_error("lobes needs an output prefix (--output)");
+
+  const auto meshFormat = explorer::meshFormatFromFileName("." + format);
+
+  for (auto &p : params) {
+    std::string name, range;
+    splitAssignment(p, name, range);
+    checkSweptParam(spec.subtype, name);
+    spec.params.push_back(parseAxis(name, range));
+  }
+
+  for (auto &p : fixedParams)
+    spec.fixedParams.push_back(parseParam(spec.subtype, p));
+
+  if (numThreads == 0)
+    numThreads = explorer::hardwareThreads();
+
+  const uint64_t rowCount = spec.rowCount();
+  const int digits = int(std::to_string(rowCount - 1).size());
+  const auto grid = explorer::makeSphereGrid(segments);
+  const size_t vertexCount = grid.directions.size();
+
+  struct Worker
+  {
+    std::unique_ptr<explorer::Material> mat;
+    std::vector<float3> values, positions, normals;
+  };
+
+  std::vector<Worker> workers(numThreads);
+  for (auto &w : workers) {
+    w.mat.reset(explorer::Material::createInstance(spec.subtype));
+    if (!w.mat)
+      throw std::runtime_error("cannot create material " + spec.subtype);
+    for (auto &param : spec.fixedParams)
+      w.mat->setParameter(param);
+    w.values.resize(vertexCount);
+    w.positions.resize(vertexCount);
+    w.normals.resize(vertexCount);
+  }
+
+  if (g_verbose) {
+    std::cerr << "[lobes] " << rowCount << " lobes x " << vertexCount
+              << " vertices\n";
+  }
+
+  explorer::parallelFor(numThreads, rowCount, [&](unsigned threadID, size_t row) {
+    auto &w = workers[threadID];
+    float3 lightDir = explorer::setupSweepRow(spec, row, *w.mat);
+
+    explorer::evalLobe(*w.mat, grid, lightDir, w.values.data());
+    explorer::lobeVertices(
+        grid, w.values.data(), 1, w.positions.data(), w.normals.data());
+
+    explorer::MeshView mesh;
+    mesh.positions = w.positions.data();
+    mesh.normals = w.normals.data();
+    mesh.vertexCount = vertexCount;
+    mesh.indices = grid.indices.data();
+    mesh.triangleCount = grid.indices.size();
+
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "_%0*llu.", digits, (unsigned long long)row);
+    explorer::writeMesh(prefix + suffix + format, mesh, meshFormat);
+  });
+
+  return 0;
+}
+
+static int prefilterCommand(int argc, char *argv[])
+{
+  explorer::PrefilterOptions options;
+  std::string subtype = "PBM", presetFile, prefix, mapFile;
+  std::vector<std::string> fixedParams, levels;
+
+  for (int i = 0; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg.size() > 1 && arg[0] == '-' && i + 1 >= argc)
+      throw std::runtime_error("missing value for " + arg);
+
+    if (arg == "-o" || arg == "--output")
+      prefix = argv[++i];
+    else if (arg == "-s" || arg == "--subtype")
+      subtype = argv[++i];
+    else if (arg == "--preset")
+      presetFile = argv[++i];
+    else if (arg == "--set")
+      fixedParams.push_back(argv[++i]);
+    else if (arg == "--levels")
+      levels.push_back(argv[++i]);
+    else if (arg == "--width")
+      options.width = uint32_t(std::max(8, std::stoi(argv[++i])));
+    else if (arg == "--samples")
+      options.samples = uint32_t(std::max(1, std::stoi(argv[++i])));
+    else if (arg == "-j" || arg == "--threads")
+      options.numThreads = unsigned(std::stoi(argv[++i]));
+    else if (arg[0] == '-')
+      throw std::runtime_error("unknown prefilter option " + arg);
+    else if (mapFile.empty())
+      mapFile = arg;
+    else
+      throw std::runtime_error("prefilter takes a single environment map");
+  }
+
+  if (mapFile.empty())
+    throw std::runtime_error("prefilter needs an environment map");
+  if (prefix.empty())
+    throw std::runtime_error("prefilter needs an output prefix (--output)");
+  if (levels.size() > 1)
+    throw std::runtime_error("prefilter varies a single param (--levels)");
+
+  std::unique_ptr<explorer::Material> mat;
+  if (!presetFile.empty()) {
+    auto preset = explorer::loadPreset(presetFile);
+    subtype = preset.subtype;
+    mat.reset(explorer::Material::createInstance(subtype));
+    if (mat)
+      explorer::applyPreset(preset, *mat);
+  } else {
+    mat.reset(explorer::Material::createInstance(subtype));
+    if (mat)
+      mat->setSubtype(subtype);
+  }
+  if (!mat)
+    throw std::runtime_error("cannot create material " + subtype);
+
+  for (auto &p : fixedParams)
+    mat->setParameter(parseParam(subtype, p));
+
+  if (!levels.empty()) {
+    std::string name, range;
+    splitAssignment(levels[0], name, range);
+    checkSweptParam(subtype, name);
+    options.levels = parseAxis(name, range);
+  }
+
+  options.verbose = g_verbose;
+
+  auto map = explorer::loadEnvironmentMap(mapFile);
+  auto result = explorer::prefilterEnvironment(map, *mat, options);
+  explorer::savePrefilteredLevels(prefix, result);
+  return 0;
+}
+
+// Directional albedo (luminance) at lightTheta from numSamples samples,
+// drawn from the table or cosine distributed; returns the mean and the
+// standard error of the estimate
+static std::pair<double, double> estimateAlbedo(const explorer::Material &mat,
+                                                const explorer::SamplingTable *table,
+                                                float lightTheta,
+                                                uint32_t numSamples)
+{
+  using namespace anari::math;
+
+  const float3 up(0.f, 1.f, 0.f);
+  const float3 lightDir = explorer::sphericalDirection(lightTheta, 0.f);
+  const float cosLight = std::max(1e-4f, lightDir.y);
+
+  std::vector<float3> dirs(numSamples), values(numSamples);
+  std::vector<float> pdfs(numSamples);
+  for (uint32_t i = 0; i < numSamples; ++i) {
+    if (table) {
+      uint64_t bits1 = explorer::splitMix64(explorer::splitMix64(i));
+      uint64_t bits2 = explorer::splitMix64(bits1);
+      uint64_t bits3 = explorer::splitMix64(bits2);
+      auto u = [](uint64_t bits) { return float(bits >> 40) * (1.f / float(1ull << 24)); };
+      dirs[i] = table->sample(lightDir, u(bits1), u(bits2), u(bits3), pdfs[i]);
+    } else {
+      float3 t, b;
+      explorer::makeFrame(up, t, b);
+      dirs[i] = explorer::cosineSampleDirection(0, i, up, t, b, pdfs[i]);
+    }
+  }
+
+  mat.evalBatch(up, up, dirs.data(), numSamples, lightDir, float3(1.f), values.data());
+
+  double sum = 0.0, sumSquares = 0.0;
+  for (uint32_t i = 0; i < numSamples; ++i) {
+    float3 v = values[i];
+    double f = 0.2126 * v.x + 0.7152 * v.y + 0.0722 * v.z;
+    double x = pdfs[i] > 0.f && dirs[i].y > 0.f
+        ? f * dirs[i].y / (pdfs[i] * cosLight)
+        : 0.0;
+    if (!std::isfinite(x))
+      x = 0.0;
+    sum += x;
+    sumSquares += x * x;
+  }
+
+  double mean = sum / numSamples;
+  double variance = std::max(0.0, sumSquares / numSamples - mean * mean);
+  return {mean, std::sqrt(variance / numSamples)};
+}
+
+static int samplingCommand(int argc, char *argv[])
+{
+  explorer::SamplingTableOptions options;
+  std::string subtype = "PBM", presetFile, outputFile;
+  std::vector<std::string> fixedParams;
+  uint32_t numSamples = 4096;
+
+  const char *cacheEnv = getenv("EXPLORER_SAMPLING_CACHE");
+  std::string cacheDir = cacheEnv ? cacheEnv : "sampling_cache";
+
+  for (int i = 0; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc)
+      throw std::runtime_error("missing value for " + arg);
+
+    if (arg == "-o" || arg == "--output")
+      outputFile = argv[++i];
+    else if (arg == "-s" || arg == "--subtype")
+      subtype = argv[++i];
+    else if (arg == "--preset")
+      presetFile = argv[++i];
+    else if (arg == "--set")
+      fixedParams.push_back(argv[++i]);
+    else if (arg == "--cache")
+      cacheDir = argv[++i];
+    else if (arg == "--resolution") {
+      auto tokens = split(argv[++i], ':');
+      if (tokens.size() != 3)
+        throw std::runtime_error("expected <light theta>:<view theta>:<view phi>");
+      options.lightTheta = uint32_t(std::max(1, std::stoi(tokens[0])));
+      options.viewTheta = uint32_t(std::max(1, std::stoi(tokens[1])));
+      options.viewPhi = uint32_t(std::max(1, std::stoi(tokens[2])));
+    } else if (arg == "--supersampling")
+      options.supersampling = uint32_t(std::max(1, std::stoi(argv[++i])));
+    else if (arg == "--samples")
+      numSamples = uint32_t(std::max(2, std::stoi(argv[++i])));
+    else if (arg == "-j" || arg == "--threads")
+      options.numThreads = unsigned(std::stoi(argv[++i]));
+    else
+      throw std::runtime_error("unknown sampling option " + arg);
+  }
+
+  std::unique_ptr<explorer::Material> mat;
+  if (!presetFile.empty()) {
+    auto preset = explorer::loadPreset(presetFile);
+    subtype = preset.subtype;
+    mat.reset(explorer::Material::createInstance(subtype));
+    if (mat)
+      explorer::applyPreset(preset, *mat);
+  } else {
+    mat.reset(explorer::Material::createInstance(subtype));
+    if (mat)
+      mat->setSubtype(subtype);
+  }
+  if (!mat)
+    throw std::runtime_error("cannot create material " + subtype);
+
+  for (auto &p : fixedParams)
+    mat->setParameter(parseParam(subtype, p));
+
+  options.verbose = g_verbose;
+
+  auto start = std::chrono::steady_clock::now();
+  bool fromCache = false;
+  auto table =
+      explorer::cachedSamplingTable(cacheDir, subtype, *mat, options, &fromCache);
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  if (!outputFile.empty())
+    explorer::saveSamplingTable(outputFile, table);
+
+  printf("%s: %u x %u x %u cells, %llu bytes, %s in %.1f ms\n",
+      subtype.c_str(),
+      table.numLightTheta,
+      table.numViewTheta,
+      table.numViewPhi,
+      (unsigned long long)table.bytes(),
+      fromCache ? "loaded from cache" : "built",
+      elapsed.count());
+
+  printf("albedo, %u samples:  theta_l   table (stderr)          cosine (stderr)\n",
+      numSamples);
+  for (float degrees : {0.f, 30.f, 60.f, 80.f}) {
+    float theta = explorer::radians(degrees);
+    auto tabulated = estimateAlbedo(*mat, &table, theta, numSamples);
+    auto cosine = estimateAlbedo(*mat, nullptr, theta, numSamples);
+    printf("                      %5.0f   %.5f (%.2e)    %.5f (%.2e)\n",
+        degrees,
+        tabulated.first,
+        tabulated.second,
+        cosine.first,
+        cosine.second);
+  }
+
+  return 0;
+}
+
+static int serveCommand(int argc, char *argv[])
+{
+  explorer::EvalServerOptions options;
+  options.verbose = g_verbose;
+
+  for (int i = 0; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc)
+      throw std::runtime_error("missing value for " + arg);
+
+    if (arg == "--socket")
+      options.socketPath = argv[++i];
+    else if (arg == "-j" || arg == "--threads")
+      options.numThreads = unsigned(std::stoi(argv[++i]));
+    else
+      throw std::runtime_error("unknown serve option " + arg);
+  }
+
+  if (options.socketPath.empty())
+    throw std::runtime_error("serve needs a socket path (--socket)");
+
+  explorer::runEvalServer(options);
+  return 0;
+}
+
+static int mergeCommand(int argc, char *argv[])
+{
+  std::string outputFile;
+  std::vector<std::string> inputFiles;
+
+  for (int i = 0; i < argc; i++) {
+    std::string arg = argv[i];
+    if ((arg == "-o" || arg == "--output") && i + 1 < argc)
+      outputFile = argv[++i];
+    else
+      inputFiles.push_back(arg);
+  }
+
+  if (outputFile.empty())
+    throw std::runtime_error("merge needs an output file (--output)");
+
+  explorer::mergeSweepFiles(inputFiles, outputFile);
+  return 0;
+}
+
+static int factorizeCommand(int argc, char *argv[])
+{
+  explorer::FactorizeOptions options;
+  std::string outputFile, tableFile;
+
+  for (int i = 0; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--light-view") {
+      options.halfDifference = false;
+      continue;
+    }
+
+    if (arg.size() > 1 && arg[0] == '-' && i + 1 >= argc)
+      throw std::runtime_error("missing value for " + arg);
+
+    if (arg == "-o" || arg == "--output")
+      outputFile = argv[++i];
+    else if (arg == "--method") {
+      std::string method = argv[++i];
+      if (method == "svd")
+        options.method = explorer::FactorizeMethod::SVD;
+      else if (method == "nmf")
+        options.method = explorer::FactorizeMethod::NMF;
+      else
+        throw std::runtime_error("unknown method " + method);
+    } else if (arg == "--rank")
+      options.rank = uint32_t(std::max(1, std::stoi(argv[++i])));
+    else if (arg == "--iterations")
+      options.iterations = std::stoi(argv[++i]);
+    else if (arg == "--resolution")
+      options.resolution = uint32_t(std::max(2, std::stoi(argv[++i])));
+    else if (arg == "-j" || arg == "--threads")
+      options.numThreads = unsigned(std::stoi(argv[++i]));
+    else if (arg[0] == '-')
+      throw std::runtime_error("unknown factorize option " + arg);
+    else if (tableFile.empty())
+      tableFile = arg;
+    else
+      throw std::runtime_error("factorize takes a single table");
+  }
+
+  if (tableFile.empty())
+    throw std::runtime_error("factorize needs a table file");
+  if (outputFile.empty())
+    outputFile = tableFile + ".lrb";
+
+  options.verbose = g_verbose;
+
+  explorer::MappedSweepFile table(tableFile);
+  auto result = explorer::factorizeBRDF(table, options);
+  explorer::saveFactorizedBRDF(outputFile, result);
+
+  printf("%s: rank %u, %llu -> %llu bytes (%.1fx), rms error %g, max error %g, "
+         "relative error %g\n",
+      outputFile.c_str(),
+      result.rank,
+      (unsigned long long)result.tableBytes,
+      (unsigned long long)result.factorBytes(),
+      double(result.tableBytes) / double(result.factorBytes()),
+      result.rmsError,
+      result.maxError,
+      result.relativeError);
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2) {
+    printUsage();
+    return 1;
+  }
+
+  std::string command = argv[1];
+
+  // argv[0] without a slash was found on the PATH, so is the worker
+  if (strchr(argv[0], '/')) {
+    if (char *path = realpath(argv[0], nullptr)) {
+      g_executable = path;
+      free(path);
+    }
+  } else {
+    g_executable = argv[0];
+  }
+
+  // strip common options, pass the rest on to the command
+  std::vector<char *> args;
+  for (int i = 2; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-v" || arg == "--verbose")
+      g_verbose = true;
+    else if (arg == "--help" || arg == "-h") {
+      printUsage();
+      return 0;
+    } else if ((arg == "-p" || arg == "--plugin") && i + 1 < argc)
+      g_pluginName = argv[++i];
+    else
+      args.push_back(argv[i]);
+  }
+
+  if (command == "--help" || command == "-h") {
+    printUsage();
+    return 0;
+  }
+
+  try {
+    if (command == "merge")
+      return mergeCommand(int(args.size()), args.data());
+    else if (command == "factorize")
+      return factorizeCommand(int(args.size()), args.data());
+
+    explorer::Material::loadPlugin(g_pluginName);
+
+    if (command == "sweep" || command == "bake" || command == "albedo")
+      return jobCommand(command, int(args.size()), args.data());
+    else if (command == "fit")
+      return fitCommand(int(args.size()), args.data());
+    else if (command == "lobes")
+      return lobesCommand(int(args.size()), args.data());
+    else if (command == "prefilter")
+      return prefilterCommand(int(args.size()), args.data());
+    else if (command == "sampling")
+      return samplingCommand(int(args.size()), args.data());
+    else if (command == "serve")
+      return serveCommand(int(args.size()), args.data());
+#ifdef EXPLORER_PLUGIN_HOST
+    else if (command == "host" && args.size() == 1)
+      return explorer::runPluginHost(args[0]); // started by the explorer
+#endif
+
+    std::cerr << "unknown command: " << command << '\n';
+    printUsage();
+    return 1;
+  } catch (const std::exception &e) {
+    std::cerr << "[ERROR] " << e.what() << '\n';
+    return 1;
+  }
+}
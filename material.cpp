@@ -4,6 +4,20 @@
 namespace explorer {
 
 Plugin Material::g_materialPlugin = nullptr;
+Material::InstanceFactory Material::g_instanceFactory = nullptr;
+
+void Material::evalBatch(anari::math::float3 Ng,
+                         anari::math::float3 Ns,
+                         const anari::math::float3 *viewDirs,
+                         size_t count,
+                         anari::math::float3 lightDir,
+                         anari::math::float3 lightIntensity,
+                         anari::math::float3 *values) const
+{
+  for (size_t i = 0; i < count; ++i) {
+    values[i] = eval(Ng, Ns, viewDirs[i], lightDir, lightIntensity);
+  }
+}
 
 void Material::loadPlugin(std::string name)
 {
@@ -15,8 +29,35 @@ bool Material::pluginLoaded()
   return g_materialPlugin != nullptr;
 }
 
+std::string Material::pluginFileName()
+{
+  if (!g_materialPlugin)
+    return std::string();
+
+  return getLibraryFileName(g_materialPlugin, "createMaterialInstance");
+}
+
+void Material::replacePlugin(Plugin plugin)
+{
+  if (plugin == g_materialPlugin)
+    return;
+
+  freePlugin(g_materialPlugin);
+  g_materialPlugin = plugin;
+}
+
+Plugin Material::exchangePlugin(Plugin plugin)
+{
+  Plugin previous = g_materialPlugin;
+  g_materialPlugin = plugin;
+  return previous;
+}
+
 Material *Material::createInstance(std::string_view subtype)
 {
+  if (g_instanceFactory)
+    return g_instanceFactory(subtype);
+
   if (!g_materialPlugin)
     return nullptr;
 
@@ -28,6 +69,26 @@ Material *Material::createInstance(std::string_view subtype)
   return createMaterialInstance(subtype);
 }
 
+void Material::setInstanceFactory(InstanceFactory factory)
+{
+  g_instanceFactory = factory;
+}
+
+Material *Material::cloneInstance(std::string_view subtype, const Material &mat)
+{
+  Material *result = createInstance(subtype);
+  if (!result)
+    return nullptr;
+
+  for (auto &param : querySupportedParams(subtype)) {
+    auto actualParam = mat.getParameter(param.name);
+    if (actualParam.value.has_value())
+      result->setParameter(actualParam);
+  }
+
+  return result;
+}
+
 std::vector<std::string> Material::querySupportedSubtypes()
 {
   if (!g_materialPlugin)
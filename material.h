@@ -3,7 +3,9 @@
 
 // std
 #include <any>
+#include <cstddef>
 #include <string>
+#include <vector>
 // anari
 #include <anari/anari_cpp/ext/linalg.h>
 // ours
@@ -26,12 +28,25 @@ struct MaterialParam
 class Material
 {
  public:
+  virtual ~Material() = default;
+
   virtual anari::math::float3 eval(anari::math::float3 Ng,
                                    anari::math::float3 Ns,
                                    anari::math::float3 viewDir,
                                    anari::math::float3 lightDir,
                                    anari::math::float3 lightIntensity) const = 0;
 
+  // Evaluates count view directions under the same light; the default
+  // just calls eval() in a loop, plugins can override this to hoist
+  // per-call setup out of the loop
+  virtual void evalBatch(anari::math::float3 Ng,
+                         anari::math::float3 Ns,
+                         const anari::math::float3 *viewDirs,
+                         size_t count,
+                         anari::math::float3 lightDir,
+                         anari::math::float3 lightIntensity,
+                         anari::math::float3 *values) const;
+
   virtual void setSubtype(std::string_view subtype) = 0;
   virtual void setParameter(MaterialParam param) = 0;
   virtual MaterialParam getParameter(std::string_view name) const = 0;
@@ -40,13 +55,36 @@ class Material
 
   static bool pluginLoaded();
 
+  // Path of the loaded plugin library (empty if unknown)
+  static std::string pluginFileName();
+
+  // Makes plugin (already loaded, e.g. a rebuilt version of the current
+  // one) the active plugin and frees the previous one. All instances
+  // created from the previous plugin must have been destroyed before.
+  static void replacePlugin(Plugin plugin);
+
+  // Makes plugin the active plugin and returns the previous one without
+  // freeing it, so instances of both can exist for a while (e.g., to
+  // check a rebuilt plugin before the old instances are destroyed)
+  static Plugin exchangePlugin(Plugin plugin);
+
   static Material *createInstance(std::string_view subtype);
 
+  // Replaces where createInstance() gets its instances from (by default
+  // the plugin's createMaterialInstance()), nullptr restores the default
+  using InstanceFactory = Material *(*)(std::string_view subtype);
+  static void setInstanceFactory(InstanceFactory factory);
+
+  // Creates a new instance of subtype and copies over all parameters
+  // that subtype supports from mat (e.g., to get one copy per thread)
+  static Material *cloneInstance(std::string_view subtype, const Material &mat);
+
   static std::vector<std::string> querySupportedSubtypes();
 
   static std::vector<MaterialParam> querySupportedParams(std::string_view subtype);
  private:
   static Plugin g_materialPlugin;
+  static InstanceFactory g_instanceFactory;
 };
 
 } // namespace explorer
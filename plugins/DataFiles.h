@@ -0,0 +1,42 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace explorer {
+
+// Directory the data file plugins look for their files in: rgl_material
+// (*.bsdf) and factorized_material (*.lrb) both search EXPLORER_BSDF_PATH,
+// or the working directory if that isn't set
+inline std::filesystem::path bsdfDirectory()
+{
+  const char *dir = getenv("EXPLORER_BSDF_PATH");
+  return dir && *dir ? std::filesystem::path(dir)
+                     : std::filesystem::current_path();
+}
+
+// Returns the data for fileName, calling load(fileName) the first time.
+// Files stay loaded while the plugin is, so switching back and forth
+// between materials is just a lookup. There's one cache per data type.
+template <typename T, typename Load>
+std::shared_ptr<T> loadCached(const std::string &fileName, Load load)
+{
+  static std::mutex mutex;
+  static std::map<std::string, std::shared_ptr<T>> files;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &data = files[fileName];
+  if (!data)
+    data = load(fileName);
+  return data;
+}
+
+} // namespace explorer
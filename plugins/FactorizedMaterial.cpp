@@ -0,0 +1,155 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+// std
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+// ours
+#include "DataFiles.h"
+#include "Directions.h"
+#include "FactorizedMaterial.h"
+
+using namespace anari::math;
+
+namespace fs = std::filesystem;
+
+namespace explorer {
+
+constexpr size_t ViewsPerChunk = 256;
+
+// ==================================================================
+// Helpers
+// ==================================================================
+
+static std::shared_ptr<const FactorizedBRDF> loadData(const std::string &fileName)
+{
+  return loadCached<const FactorizedBRDF>(fileName, [](const std::string &fn) {
+    return std::make_shared<const FactorizedBRDF>(loadFactorizedBRDF(fn));
+  });
+}
+
+// ==================================================================
+// Evaluation
+// ==================================================================
+
+FactorizedMaterial::FactorizedMaterial(std::string_view subtype)
+{
+  setSubtype(subtype);
+}
+
+void FactorizedMaterial::evalBatch(float3 Ng,
+                                   float3 Ns,
+                                   const float3 *viewDirs,
+                                   size_t count,
+                                   float3 lightDir,
+                                   float3 lightIntensity,
+                                   float3 *values) const
+{
+  if (!data) {
+    std::fill(values, values + count, float3(0.f, 0.f, 0.f));
+    return;
+  }
+
+  // the tables' frame: theta from Ns, phi measured from t towards b
+  float3 t, b;
+  makeFrame(Ns, t, b);
+  auto toLocal = [&](float3 d) {
+    return normalize(float3(dot(d, t), dot(d, b), dot(d, Ns)));
+  };
+
+  float3 wi = toLocal(lightDir);
+  float3 radiance = lightIntensity * scale;
+
+  float3 wo[ViewsPerChunk];
+  for (size_t first = 0; first < count; first += ViewsPerChunk) {
+    size_t n = std::min(ViewsPerChunk, count - first);
+    for (size_t i = 0; i < n; ++i)
+      wo[i] = toLocal(viewDirs[first + i]);
+
+    evalFactorizedBRDF(*data, wi, wo, n, values + first);
+    for (size_t i = 0; i < n; ++i)
+      values[first + i] *= radiance;
+  }
+}
+
+float3 FactorizedMaterial::eval(float3 Ng,
+                                float3 Ns,
+                                float3 viewDir,
+                                float3 lightDir,
+                                float3 lightIntensity) const
+{
+  float3 value;
+  evalBatch(Ng, Ns, &viewDir, 1, lightDir, lightIntensity, &value);
+  return value;
+}
+
+// ==================================================================
+// Params
+// ==================================================================
+
+void FactorizedMaterial::setSubtype(std::string_view subtype)
+{
+  if (subtype == this->subtype && data)
+    return;
+
+  this->subtype = subtype;
+  data = nullptr;
+
+  fs::path fileName = bsdfDirectory() / (std::string(subtype) + ".lrb");
+  try {
+    data = loadData(fileName.string());
+  } catch (const std::exception &e) {
+    std::cerr << "factorized_material: " << e.what() << '\n';
+  }
+}
+
+void FactorizedMaterial::setParameter(MaterialParam param)
+{
+  if (param.name == "scale")
+    scale = std::any_cast<float>(param.value);
+}
+
+MaterialParam FactorizedMaterial::getParameter(std::string_view name) const
+{
+  if (name == "scale")
+    return {"scale", std::any(scale), DataType::Float};
+
+  return {};
+}
+
+std::vector<std::string> FactorizedMaterial::querySupportedSubtypes()
+{
+  std::vector<std::string> result;
+
+  std::error_code ec;
+  for (auto &entry : fs::directory_iterator(bsdfDirectory(), ec)) {
+    if (entry.path().extension() == ".lrb")
+      result.push_back(entry.path().stem().string());
+  }
+
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+std::vector<MaterialParam> FactorizedMaterial::querySupportedParams(std::string_view subtype)
+{
+  return {{"scale", std::any(1.f), DataType::Float}};
+}
+
+Material *createMaterialInstance(std::string_view subtype)
+{
+  return new FactorizedMaterial(subtype);
+}
+
+std::vector<std::string> querySupportedSubtypes()
+{
+  return FactorizedMaterial::querySupportedSubtypes();
+}
+
+std::vector<MaterialParam> querySupportedParams(std::string_view subtypes)
+{
+  return FactorizedMaterial::querySupportedParams(subtypes);
+}
+
+} // namespace explorer
@@ -0,0 +1,59 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <memory>
+#include <string>
+#include <vector>
+// ours
+#include "FactorizedBRDF.h"
+#include "material.h"
+
+namespace explorer {
+
+// Low-rank factorized BRDF tables (*.lrb, written by anariBRDFTool
+// factorize). Every file in the directory given by the EXPLORER_BSDF_PATH
+// environment variable (default: the working directory) is a subtype,
+// named after the file.
+//
+// Evaluating blends the factors of the surrounding grid points and takes
+// one dot product of length rank per channel, instead of interpolating
+// in the full table.
+struct FactorizedMaterial : public Material
+{
+  std::string subtype;
+  std::shared_ptr<const FactorizedBRDF> data; // nullptr if the file couldn't be loaded
+  float scale{1.f};
+
+  FactorizedMaterial(std::string_view subtype);
+
+  anari::math::float3 eval(anari::math::float3 Ng,
+                           anari::math::float3 Ns,
+                           anari::math::float3 viewDir,
+                           anari::math::float3 lightDir,
+                           anari::math::float3 lightIntensity) const override;
+
+  void evalBatch(anari::math::float3 Ng,
+                 anari::math::float3 Ns,
+                 const anari::math::float3 *viewDirs,
+                 size_t count,
+                 anari::math::float3 lightDir,
+                 anari::math::float3 lightIntensity,
+                 anari::math::float3 *values) const override;
+
+  void setSubtype(std::string_view subtype) override;
+  void setParameter(MaterialParam param) override;
+  MaterialParam getParameter(std::string_view name) const override;
+
+  static std::vector<std::string> querySupportedSubtypes();
+
+  static std::vector<MaterialParam> querySupportedParams(std::string_view subtype);
+};
+
+extern "C" Material *createMaterialInstance(std::string_view subtype);
+extern "C" std::vector<std::string> querySupportedSubtypes();
+extern "C" std::vector<MaterialParam> querySupportedParams(std::string_view subtypes);
+
+} // namespace explorer
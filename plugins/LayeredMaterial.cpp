@@ -0,0 +1,350 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+// std
+#include <algorithm>
+#include <cmath>
+// ours
+#include "LayeredMaterial.h"
+
+using namespace anari::math;
+
+namespace explorer {
+
+constexpr size_t MaxLayers = 8;
+constexpr float Pi = 3.14159265358979f;
+
+// ==================================================================
+// Stack definitions
+// ==================================================================
+
+using LayerType = LayeredMaterial::LayerType;
+
+struct StackLayer
+{
+  LayerType type;
+  const char *prefix;
+  float weight;
+  float roughness;
+};
+
+struct Stack
+{
+  const char *name;
+  std::vector<StackLayer> layers; // top to bottom
+};
+
+static const std::vector<Stack> &stacks()
+{
+  static const std::vector<Stack> result = {
+      {"CoatedMatte",
+          {{LayerType::Dielectric, "coat", 1.f, 0.1f},
+              {LayerType::Matte, "base", 1.f, 0.f}}},
+      {"CoatedPBM",
+          {{LayerType::Dielectric, "coat", 1.f, 0.1f},
+              {LayerType::PBM, "base", 1.f, 0.5f}}},
+      {"Layered",
+          {{LayerType::Dielectric, "coat", 1.f, 0.1f},
+              {LayerType::PBM, "spec", 0.5f, 0.3f},
+              {LayerType::Matte, "base", 1.f, 0.f}}},
+  };
+  return result;
+}
+
+static const Stack *findStack(std::string_view name)
+{
+  for (auto &stack : stacks()) {
+    if (name == stack.name)
+      return &stack;
+  }
+  return nullptr;
+}
+
+// Params of a layer type, as suffixes of the layer's prefix
+static std::vector<std::pair<const char *, DataType>> layerParams(LayerType type)
+{
+  switch (type) {
+  case LayerType::Dielectric:
+    return {{"Weight", DataType::Float},
+        {"Roughness", DataType::Float},
+        {"Ior", DataType::Float}};
+  case LayerType::Matte:
+    return {{"Weight", DataType::Float}, {"Color", DataType::Float3}};
+  case LayerType::PBM:
+    return {{"Weight", DataType::Float},
+        {"Color", DataType::Float3},
+        {"Metallic", DataType::Float},
+        {"Roughness", DataType::Float},
+        {"Ior", DataType::Float}};
+  }
+  return {};
+}
+
+static std::any layerValue(const LayeredMaterial::Layer &layer, std::string_view suffix)
+{
+  if (suffix == "Weight")
+    return layer.weight;
+  else if (suffix == "Color")
+    return layer.color;
+  else if (suffix == "Metallic")
+    return layer.metallic;
+  else if (suffix == "Roughness")
+    return layer.roughness;
+  else if (suffix == "Ior")
+    return layer.ior;
+  return {};
+}
+
+// ==================================================================
+// Kernel
+// ==================================================================
+
+static float schlickWeight(float cosTheta)
+{
+  float m = std::clamp(1.f - cosTheta, 0.f, 1.f);
+  float m2 = m * m;
+  return m2 * m2 * m;
+}
+
+static float ggxD(float alpha2, float NdotH)
+{
+  float d = NdotH * NdotH * (alpha2 - 1.f) + 1.f;
+  return alpha2 / (Pi * d * d);
+}
+
+// Height-correlated Smith visibility term, G / (4 NdotL NdotV); lambdaL
+// is the light side's sqrt term, which is constant for a batch
+static float smithV(float alpha2, float NdotV, float NdotL, float lambdaL)
+{
+  float lambdaV = sqrtf(NdotV * NdotV * (1.f - alpha2) + alpha2);
+  return 0.5f / (NdotL * lambdaV + NdotV * lambdaL);
+}
+
+// Per layer terms that only depend on the light
+struct LightTerms
+{
+  float lambdaL;
+  float transmitL; // Dielectric: 1 - weight*F(NdotL)
+};
+
+void LayeredMaterial::evalBatch(float3 Ng,
+                                float3 Ns,
+                                const float3 *viewDirs,
+                                size_t count,
+                                float3 lightDir,
+                                float3 lightIntensity,
+                                float3 *values) const
+{
+  const size_t numLayers = std::min(layers.size(), MaxLayers);
+
+  float3 L = normalize(lightDir);
+  float NdotL = dot(Ns, L);
+  if (NdotL <= 0.f) {
+    std::fill(values, values + count, float3(0.f, 0.f, 0.f));
+    return;
+  }
+
+  float fwL = schlickWeight(NdotL);
+  LightTerms light[MaxLayers];
+  for (size_t j = 0; j < numLayers; ++j) {
+    const Layer &layer = layers[j];
+    light[j].lambdaL = sqrtf(NdotL * NdotL * (1.f - layer.alpha2) + layer.alpha2);
+    light[j].transmitL = 1.f - layer.weight * (layer.F0.x + (1.f - layer.F0.x) * fwL);
+  }
+
+  float3 radiance = lightIntensity * NdotL;
+
+  for (size_t i = 0; i < count; ++i) {
+    float3 V = normalize(viewDirs[i]);
+    float NdotV = dot(Ns, V);
+    if (NdotV <= 0.f) {
+      values[i] = float3(0.f, 0.f, 0.f);
+      continue;
+    }
+
+    // shared by all layers:
+    float3 H = normalize(V + L);
+    float NdotH = std::max(dot(Ns, H), 0.f);
+    float fwH = schlickWeight(dot(V, H));
+    float fwV = schlickWeight(NdotV);
+
+    float3 result(0.f, 0.f, 0.f);
+    float3 throughput(1.f, 1.f, 1.f);
+    for (size_t j = 0; j < numLayers; ++j) {
+      const Layer &layer = layers[j];
+      if (layer.weight <= 0.f)
+        continue;
+
+      switch (layer.type) {
+      case LayerType::Dielectric: {
+        float DV = ggxD(layer.alpha2, NdotH)
+            * smithV(layer.alpha2, NdotV, NdotL, light[j].lambdaL);
+        float F = layer.F0.x + (1.f - layer.F0.x) * fwH;
+        result += throughput * (layer.weight * DV * F);
+        float transmitV = 1.f - layer.weight * (layer.F0.x + (1.f - layer.F0.x) * fwV);
+        throughput *= transmitV * light[j].transmitL;
+        break;
+      }
+      case LayerType::Matte:
+        result += throughput * (layer.weight * layer.diffuse);
+        throughput *= 1.f - layer.weight;
+        break;
+      case LayerType::PBM: {
+        float DV = ggxD(layer.alpha2, NdotH)
+            * smithV(layer.alpha2, NdotV, NdotL, light[j].lambdaL);
+        float3 F = layer.F0 + (float3(1.f, 1.f, 1.f) - layer.F0) * fwH;
+        float3 f = layer.diffuse * (float3(1.f, 1.f, 1.f) - F) + F * DV;
+        result += throughput * (layer.weight * f);
+        throughput *= 1.f - layer.weight;
+        break;
+      }
+      }
+
+      if (throughput.x <= 0.f && throughput.y <= 0.f && throughput.z <= 0.f)
+        break;
+    }
+
+    values[i] = result * radiance;
+  }
+}
+
+float3 LayeredMaterial::eval(float3 Ng,
+                             float3 Ns,
+                             float3 viewDir,
+                             float3 lightDir,
+                             float3 lightIntensity) const
+{
+  float3 value;
+  evalBatch(Ng, Ns, &viewDir, 1, lightDir, lightIntensity, &value);
+  return value;
+}
+
+// ==================================================================
+// Params
+// ==================================================================
+
+LayeredMaterial::LayeredMaterial(std::string_view subtype)
+{
+  setSubtype(subtype);
+}
+
+void LayeredMaterial::update(Layer &layer)
+{
+  float alpha = layer.roughness * layer.roughness;
+  layer.alpha2 = std::max(alpha * alpha, 1e-6f);
+
+  float r = (layer.ior - 1.f) / (layer.ior + 1.f);
+  float F0 = r * r;
+
+  switch (layer.type) {
+  case LayerType::Dielectric:
+    layer.F0 = float3(F0, F0, F0);
+    layer.diffuse = float3(0.f, 0.f, 0.f);
+    break;
+  case LayerType::Matte:
+    layer.F0 = float3(0.f, 0.f, 0.f);
+    layer.diffuse = layer.color / Pi;
+    break;
+  case LayerType::PBM:
+    layer.F0 = float3(F0, F0, F0) * (1.f - layer.metallic) + layer.color * layer.metallic;
+    layer.diffuse = layer.color * ((1.f - layer.metallic) / Pi);
+    break;
+  }
+}
+
+void LayeredMaterial::setSubtype(std::string_view subtype)
+{
+  const Stack *stack = findStack(subtype);
+  if (!stack)
+    return;
+
+  this->subtype = subtype;
+  layers.clear();
+  for (auto &def : stack->layers) {
+    Layer layer;
+    layer.type = def.type;
+    layer.prefix = def.prefix;
+    layer.weight = def.weight;
+    layer.roughness = def.roughness;
+    update(layer);
+    layers.push_back(layer);
+  }
+}
+
+void LayeredMaterial::setParameter(MaterialParam param)
+{
+  for (auto &layer : layers) {
+    if (param.name.compare(0, layer.prefix.size(), layer.prefix) != 0)
+      continue;
+
+    std::string_view suffix(param.name);
+    suffix.remove_prefix(layer.prefix.size());
+
+    if (suffix == "Weight")
+      layer.weight = std::any_cast<float>(param.value);
+    else if (suffix == "Color")
+      layer.color = std::any_cast<float3>(param.value);
+    else if (suffix == "Metallic")
+      layer.metallic = std::any_cast<float>(param.value);
+    else if (suffix == "Roughness")
+      layer.roughness = std::any_cast<float>(param.value);
+    else if (suffix == "Ior")
+      layer.ior = std::any_cast<float>(param.value);
+    else
+      continue;
+
+    update(layer);
+    return;
+  }
+}
+
+MaterialParam LayeredMaterial::getParameter(std::string_view name) const
+{
+  for (auto &layer : layers) {
+    for (auto &[suffix, type] : layerParams(layer.type)) {
+      if (name == layer.prefix + suffix)
+        return {std::string(name), layerValue(layer, suffix), type};
+    }
+  }
+
+  return {};
+}
+
+std::vector<std::string> LayeredMaterial::querySupportedSubtypes()
+{
+  std::vector<std::string> result;
+  for (auto &stack : stacks())
+    result.push_back(stack.name);
+  return result;
+}
+
+std::vector<MaterialParam> LayeredMaterial::querySupportedParams(std::string_view subtype)
+{
+  std::vector<MaterialParam> result;
+
+  // defaults are those of a fresh instance
+  LayeredMaterial defaults(subtype);
+  for (auto &layer : defaults.layers) {
+    for (auto &[suffix, type] : layerParams(layer.type))
+      result.push_back({layer.prefix + suffix, layerValue(layer, suffix), type});
+  }
+
+  return result;
+}
+
+Material *createMaterialInstance(std::string_view subtype)
+{
+  return new LayeredMaterial(subtype);
+}
+
+std::vector<std::string> querySupportedSubtypes()
+{
+  return LayeredMaterial::querySupportedSubtypes();
+}
+
+std::vector<MaterialParam> querySupportedParams(std::string_view subtypes)
+{
+  return LayeredMaterial::querySupportedParams(subtypes);
+}
+
+} // namespace explorer
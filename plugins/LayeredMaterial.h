@@ -0,0 +1,81 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <string>
+#include <vector>
+// ours
+#include "material.h"
+
+namespace explorer {
+
+// Layer stacks (coated/layered materials), evaluated top to bottom in a
+// single pass per direction: the half vector, the cosines and the Schlick
+// weights are computed once and shared by all layers, and all terms that
+// only depend on the light are hoisted out of evalBatch's loop.
+//
+// Dielectric layers (coats) reflect a white GGX lobe and pass on the
+// energy they don't reflect, 1 - weight*F, at both the light and the view
+// side. Opaque layers (Matte, PBM) pass on 1 - weight.
+struct LayeredMaterial : public Material
+{
+  enum class LayerType
+  {
+    Dielectric, Matte, PBM,
+  };
+
+  struct Layer
+  {
+    LayerType type;
+    std::string prefix; // params are named prefix + "Weight" etc.
+
+    float weight{1.f};
+    anari::math::float3 color{0.8f, 0.8f, 0.8f};
+    float metallic{0.f};
+    float roughness{0.5f};
+    float ior{1.5f};
+
+    // derived from the above in update()
+    float alpha2{0.f};
+    anari::math::float3 F0{0.f, 0.f, 0.f};
+    anari::math::float3 diffuse{0.f, 0.f, 0.f};
+  };
+
+  std::string subtype;
+  std::vector<Layer> layers;
+
+  LayeredMaterial(std::string_view subtype);
+
+  anari::math::float3 eval(anari::math::float3 Ng,
+                           anari::math::float3 Ns,
+                           anari::math::float3 viewDir,
+                           anari::math::float3 lightDir,
+                           anari::math::float3 lightIntensity) const override;
+
+  void evalBatch(anari::math::float3 Ng,
+                 anari::math::float3 Ns,
+                 const anari::math::float3 *viewDirs,
+                 size_t count,
+                 anari::math::float3 lightDir,
+                 anari::math::float3 lightIntensity,
+                 anari::math::float3 *values) const override;
+
+  void setSubtype(std::string_view subtype) override;
+  void setParameter(MaterialParam param) override;
+  MaterialParam getParameter(std::string_view name) const override;
+
+  static std::vector<std::string> querySupportedSubtypes();
+
+  static std::vector<MaterialParam> querySupportedParams(std::string_view subtype);
+
+ private:
+  static void update(Layer &layer);
+};
+
+extern "C" Material *createMaterialInstance(std::string_view subtype);
+extern "C" std::vector<std::string> querySupportedSubtypes();
+extern "C" std::vector<MaterialParam> querySupportedParams(std::string_view subtypes);
+
+} // namespace explorer
@@ -0,0 +1,550 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+// ours
+#include "DataFiles.h"
+#include "Directions.h"
+#include "RGLMaterial.h"
+#include "TensorFile.h"
+
+using namespace anari::math;
+
+namespace fs = std::filesystem;
+
+namespace explorer {
+
+constexpr size_t MaxCachedSlices = 256; // per file
+constexpr float Pi = 3.14159265358979f;
+
+// ==================================================================
+// Helpers
+// ==================================================================
+
+// The tables are parameterized in the unit square, with a square root
+// warp in theta to put more samples near the pole
+static float theta2u(float theta)
+{
+  return sqrtf(theta * (2.f / Pi));
+}
+
+static float phi2u(float phi)
+{
+  return (phi + Pi) * (1.f / (2.f * Pi));
+}
+
+struct GridSize
+{
+  uint32_t x{0}, y{0};
+
+  size_t count() const
+  {
+    return size_t(x) * y;
+  }
+};
+
+// Bilinear interpolation of a grid covering [0,1]^2
+template <typename T>
+static T bilerp(const T *data, GridSize size, float ux, float uy)
+{
+  float x = std::clamp(ux, 0.f, 1.f) * (size.x - 1);
+  float y = std::clamp(uy, 0.f, 1.f) * (size.y - 1);
+  uint32_t px = std::min(uint32_t(x), size.x - 2);
+  uint32_t py = std::min(uint32_t(y), size.y - 2);
+  float wx = x - px, wy = y - py;
+
+  const T *row0 = data + size_t(py) * size.x + px;
+  const T *row1 = row0 + size.x;
+  return (row0[0] * (1.f - wx) + row0[1] * wx) * (1.f - wy)
+      + (row1[0] * (1.f - wx) + row1[1] * wx) * wy;
+}
+
+// Grid interval containing value (clamped); weight is that of index + 1
+struct ParamWeight
+{
+  uint32_t index{0};
+  float weight{0.f};
+};
+
+static ParamWeight findInterval(const float *grid, uint32_t n, float value)
+{
+  if (n < 2)
+    return {};
+
+  uint32_t i = uint32_t(std::upper_bound(grid, grid + n, value) - grid);
+  i = std::clamp(i, 1u, n - 1) - 1;
+  float t = (value - grid[i]) / (grid[i + 1] - grid[i]);
+  return {i, std::clamp(t, 0.f, 1.f)};
+}
+
+// CIE 1931 color matching functions, multi-lobe fit by Wyman et al.,
+// "Simple Analytic Approximations to the CIE XYZ Color Matching
+// Functions" (JCGT 2013)
+static float3 cieXYZ(float lambda)
+{
+  auto g = [lambda](float mu, float sigma1, float sigma2) {
+    float t = (lambda - mu) / (lambda < mu ? sigma1 : sigma2);
+    return expf(-0.5f * t * t);
+  };
+
+  float x = 1.056f * g(599.8f, 37.9f, 31.0f) + 0.362f * g(442.0f, 16.0f, 26.7f)
+      - 0.065f * g(501.1f, 20.4f, 26.2f);
+  float y = 0.821f * g(568.8f, 46.9f, 40.5f) + 0.286f * g(530.9f, 16.3f, 31.1f);
+  float z = 1.217f * g(437.0f, 11.8f, 36.0f) + 0.681f * g(459.0f, 26.0f, 13.8f);
+  return float3(x, y, z);
+}
+
+// Weights to reduce spectral samples to linear sRGB. Each channel is
+// normalized so that a constant spectrum maps to the same gray value.
+static std::vector<float3> spectralToRGBWeights(const float *wavelengths, uint32_t n)
+{
+  std::vector<float3> result(n, float3(0.f, 0.f, 0.f));
+  float3 sum(0.f, 0.f, 0.f);
+  for (uint32_t i = 0; i < n; ++i) {
+    // trapezoidal rule
+    float lo = wavelengths[i > 0 ? i - 1 : i];
+    float hi = wavelengths[i + 1 < n ? i + 1 : i];
+    float width = 0.5f * (hi - lo);
+
+    float3 xyz = cieXYZ(wavelengths[i]) * width;
+    result[i] = float3(3.2406f * xyz.x - 1.5372f * xyz.y - 0.4986f * xyz.z,
+        -0.9689f * xyz.x + 1.8758f * xyz.y + 0.0415f * xyz.z,
+        0.0557f * xyz.x - 0.2040f * xyz.y + 1.0570f * xyz.z);
+    sum += result[i];
+  }
+
+  for (auto &w : result) {
+    w.x = sum.x != 0.f ? w.x / sum.x : 0.f;
+    w.y = sum.y != 0.f ? w.y / sum.y : 0.f;
+    w.z = sum.z != 0.f ? w.z / sum.z : 0.f;
+  }
+  return result;
+}
+
+// ==================================================================
+// File data and slice cache
+// ==================================================================
+
+// Decoded data of one incident angle grid point
+struct RGLSlice
+{
+  // normalized VNDF with its conditional (per row) and marginal CDFs
+  std::vector<float> vndf;
+  std::vector<float> condCdf;
+  std::vector<float> margCdf;
+  std::vector<float3> rgb;
+};
+
+struct RGLData
+{
+  RGLData(const std::string &fileName);
+
+  std::shared_ptr<const RGLSlice> slice(uint32_t phiIndex, uint32_t thetaIndex);
+
+  TensorFile file;
+
+  std::vector<float> phiI; // radians
+  std::vector<float> thetaI;
+  uint32_t numPhi{0}, numTheta{0};
+  bool isotropic{false};
+
+  const float *ndf{nullptr};
+  GridSize ndfSize;
+  const float *sigma{nullptr};
+  GridSize sigmaSize;
+  const float *vndf{nullptr};
+  GridSize vndfSize;
+
+  // spectral (or RGB) samples and their weights for R, G and B
+  const float *channels{nullptr};
+  uint32_t numChannels{0};
+  GridSize channelSize;
+  std::vector<float3> channelWeights;
+
+ private:
+  std::shared_ptr<const RGLSlice> decode(uint32_t phiIndex, uint32_t thetaIndex) const;
+
+  using LRU = std::list<std::pair<uint64_t, std::shared_ptr<const RGLSlice>>>;
+  std::mutex m_mutex;
+  LRU m_lru; // most recently used first
+  std::unordered_map<uint64_t, LRU::iterator> m_cache;
+};
+
+static GridSize gridSize(const std::vector<uint64_t> &shape, const std::string &name)
+{
+  GridSize result{uint32_t(shape[shape.size() - 1]), uint32_t(shape[shape.size() - 2])};
+  if (result.x < 2 || result.y < 2)
+    throw std::runtime_error(name + " must be at least 2x2");
+  return result;
+}
+
+RGLData::RGLData(const std::string &fileName) : file(fileName)
+{
+  const std::vector<uint64_t> *shape = nullptr;
+
+  const float *grid = file.floatField("phi_i", 1, &shape);
+  numPhi = uint32_t((*shape)[0]);
+  phiI.assign(grid, grid + numPhi);
+  grid = file.floatField("theta_i", 1, &shape);
+  numTheta = uint32_t((*shape)[0]);
+  thetaI.assign(grid, grid + numTheta);
+  isotropic = numPhi <= 2;
+
+  if (numPhi == 0 || numTheta == 0)
+    throw std::runtime_error(fileName + ": empty phi_i/theta_i");
+
+  // some converters store the incident angles in degrees
+  if (thetaI.back() > 2.f) {
+    for (auto &phi : phiI)
+      phi = radians(phi);
+    for (auto &theta : thetaI)
+      theta = radians(theta);
+  }
+
+  ndf = file.floatField("ndf", 2, &shape);
+  ndfSize = gridSize(*shape, "ndf");
+  sigma = file.floatField("sigma", 2, &shape);
+  sigmaSize = gridSize(*shape, "sigma");
+  vndf = file.floatField("vndf", 4, &shape);
+  vndfSize = gridSize(*shape, "vndf");
+  if ((*shape)[0] != numPhi || (*shape)[1] != numTheta)
+    throw std::runtime_error(fileName + ": vndf doesn't match phi_i/theta_i");
+
+  if (file.field("rgb")) {
+    channels = file.floatField("rgb", 5, &shape);
+    channelWeights = {float3(1.f, 0.f, 0.f), float3(0.f, 1.f, 0.f), float3(0.f, 0.f, 1.f)};
+  } else {
+    channels = file.floatField("spectra", 5, &shape);
+    const std::vector<uint64_t> *wavelengthShape = nullptr;
+    const float *wavelengths = file.floatField("wavelengths", 1, &wavelengthShape);
+    channelWeights = spectralToRGBWeights(wavelengths, uint32_t((*wavelengthShape)[0]));
+  }
+
+  numChannels = uint32_t((*shape)[2]);
+  channelSize = gridSize(*shape, "spectra");
+  if ((*shape)[0] != numPhi || (*shape)[1] != numTheta || numChannels != channelWeights.size())
+    throw std::runtime_error(fileName + ": spectra don't match phi_i/theta_i/wavelengths");
+}
+
+std::shared_ptr<const RGLSlice> RGLData::slice(uint32_t phiIndex, uint32_t thetaIndex)
+{
+  uint64_t key = (uint64_t(phiIndex) << 32) | thetaIndex;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_cache.find(key);
+    if (it != m_cache.end()) {
+      m_lru.splice(m_lru.begin(), m_lru, it->second);
+      return it->second->second;
+    }
+  }
+
+  // Decode without holding the lock; if another thread decoded the same
+  // slice meanwhile, the first one wins
+  auto result = decode(phiIndex, thetaIndex);
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto it = m_cache.find(key);
+  if (it != m_cache.end())
+    return it->second->second;
+
+  m_lru.emplace_front(key, result);
+  m_cache[key] = m_lru.begin();
+  if (m_lru.size() > MaxCachedSlices) {
+    m_cache.erase(m_lru.back().first);
+    m_lru.pop_back();
+  }
+  return result;
+}
+
+std::shared_ptr<const RGLSlice> RGLData::decode(uint32_t phiIndex, uint32_t thetaIndex) const
+{
+  auto result = std::make_shared<RGLSlice>();
+  size_t sliceIndex = size_t(phiIndex) * numTheta + thetaIndex;
+
+  // CDFs of the bilinearly interpolated VNDF, as in Mitsuba's Marginal2D
+  const GridSize size = vndfSize;
+  const float *data = vndf + sliceIndex * size.count();
+  std::vector<double> condCdf(size.count()), margCdf(size.y);
+
+  for (uint32_t y = 0; y < size.y; ++y) {
+    size_t i = size_t(y) * size.x;
+    double accum = 0.0;
+    condCdf[i] = 0.0;
+    for (uint32_t x = 0; x < size.x - 1; ++x, ++i) {
+      accum += 0.5 * (double(data[i]) + double(data[i + 1]));
+      condCdf[i + 1] = accum;
+    }
+  }
+
+  margCdf[0] = 0.0;
+  double accum = 0.0;
+  for (uint32_t y = 0; y < size.y - 1; ++y) {
+    accum += 0.5 * (condCdf[size_t(y + 1) * size.x - 1] + condCdf[size_t(y + 2) * size.x - 1]);
+    margCdf[y + 1] = accum;
+  }
+
+  double normalization = accum > 0.0 ? 1.0 / accum : 0.0;
+  result->vndf.resize(size.count());
+  result->condCdf.resize(size.count());
+  result->margCdf.resize(size.y);
+  for (size_t i = 0; i < size.count(); ++i) {
+    result->vndf[i] = float(data[i] * normalization);
+    result->condCdf[i] = float(condCdf[i] * normalization);
+  }
+  for (uint32_t y = 0; y < size.y; ++y)
+    result->margCdf[y] = float(margCdf[y] * normalization);
+
+  // reduce to RGB
+  const size_t n = channelSize.count();
+  const float *spectra = channels + sliceIndex * numChannels * n;
+  result->rgb.assign(n, float3(0.f, 0.f, 0.f));
+  for (uint32_t c = 0; c < numChannels; ++c) {
+    const float3 w = channelWeights[c];
+    const float *src = spectra + c * n;
+    for (size_t i = 0; i < n; ++i)
+      result->rgb[i] += w * src[i];
+  }
+
+  return result;
+}
+
+// Files stay mapped with their slice caches while the plugin is loaded
+static std::shared_ptr<RGLData> loadData(const std::string &fileName)
+{
+  return loadCached<RGLData>(fileName, [](const std::string &fn) {
+    return std::make_shared<RGLData>(fn);
+  });
+}
+
+// ==================================================================
+// Evaluation
+// ==================================================================
+
+// Slices around the light direction and their interpolation weights
+struct SliceSet
+{
+  std::shared_ptr<const RGLSlice> slices[4];
+  float weights[4];
+  int count{0};
+
+  float lookup(const std::vector<float> RGLSlice::*array, size_t index) const
+  {
+    float result = 0.f;
+    for (int k = 0; k < count; ++k)
+      result += weights[k] * (*slices[k].*array)[index];
+    return result;
+  }
+};
+
+// Maps u (a point in the VNDF's domain) to the unit square, i.e., inverts
+// the VNDF warp (Mitsuba's Marginal2D::invert), with the data and CDFs
+// interpolated between slices
+static void invertVNDF(const SliceSet &set, GridSize size, float &ux, float &uy)
+{
+  float x = std::clamp(ux, 0.f, 1.f) * (size.x - 1);
+  float y = std::clamp(uy, 0.f, 1.f) * (size.y - 1);
+  uint32_t px = std::min(uint32_t(x), size.x - 2);
+  uint32_t py = std::min(uint32_t(y), size.y - 2);
+  x -= px;
+  y -= py;
+
+  // invert x
+  size_t offset = px + size_t(py) * size.x;
+  float v00 = set.lookup(&RGLSlice::vndf, offset);
+  float v10 = set.lookup(&RGLSlice::vndf, offset + 1);
+  float v01 = set.lookup(&RGLSlice::vndf, offset + size.x);
+  float v11 = set.lookup(&RGLSlice::vndf, offset + size.x + 1);
+  float c0 = (1.f - y) * v00 + y * v01;
+  float c1 = (1.f - y) * v10 + y * v11;
+  x *= c0 + 0.5f * x * (c1 - c0);
+
+  float q0 = set.lookup(&RGLSlice::condCdf, offset);
+  float q1 = set.lookup(&RGLSlice::condCdf, offset + size.x);
+  x += (1.f - y) * q0 + y * q1;
+
+  offset = size_t(py) * size.x;
+  float r0 = set.lookup(&RGLSlice::condCdf, offset + size.x - 1);
+  float r1 = set.lookup(&RGLSlice::condCdf, offset + 2 * size.x - 1);
+  float rowSum = (1.f - y) * r0 + y * r1;
+  if (rowSum > 0.f)
+    x /= rowSum;
+
+  // invert y
+  y *= r0 + 0.5f * y * (r1 - r0);
+  y += set.lookup(&RGLSlice::margCdf, py);
+
+  ux = x;
+  uy = y;
+}
+
+RGLMaterial::RGLMaterial(std::string_view subtype)
+{
+  setSubtype(subtype);
+}
+
+void RGLMaterial::evalBatch(float3 Ng,
+                            float3 Ns,
+                            const float3 *viewDirs,
+                            size_t count,
+                            float3 lightDir,
+                            float3 lightIntensity,
+                            float3 *values) const
+{
+  std::fill(values, values + count, float3(0.f, 0.f, 0.f));
+  if (!data)
+    return;
+
+  // local frame with z up, phi measured from t towards b
+  float3 t, b;
+  makeFrame(Ns, t, b);
+  auto toLocal = [&](float3 d) {
+    return normalize(float3(dot(d, t), dot(d, b), dot(d, Ns)));
+  };
+
+  float3 wi = toLocal(lightDir);
+  if (wi.z <= 0.f)
+    return;
+
+  float thetaI = acosf(std::min(wi.z, 1.f));
+  float phiI = atan2f(wi.y, wi.x);
+
+  float sigma = bilerp(data->sigma, data->sigmaSize, theta2u(thetaI), phi2u(phiI));
+  if (sigma <= 0.f)
+    return;
+
+  // only the slices around the light direction are needed for the batch
+  ParamWeight phiWeight = findInterval(data->phiI.data(), data->numPhi, phiI);
+  ParamWeight thetaWeight = findInterval(data->thetaI.data(), data->numTheta, thetaI);
+
+  SliceSet set;
+  for (uint32_t p = 0; p < 2; ++p) {
+    for (uint32_t q = 0; q < 2; ++q) {
+      float w = (p ? phiWeight.weight : 1.f - phiWeight.weight)
+          * (q ? thetaWeight.weight : 1.f - thetaWeight.weight);
+      if (w <= 0.f)
+        continue;
+      set.slices[set.count] =
+          data->slice(phiWeight.index + p, thetaWeight.index + q);
+      set.weights[set.count++] = w;
+    }
+  }
+
+  // The tabulated values include the cosine at the outgoing (here: view)
+  // direction; by reciprocity swap it for the one at the light
+  float3 radiance = lightIntensity * (scale * wi.z / (4.f * sigma));
+
+  for (size_t i = 0; i < count; ++i) {
+    float3 wo = toLocal(viewDirs[i]);
+    if (wo.z <= 1e-4f)
+      continue;
+
+    float3 wm = normalize(wi + wo);
+    float thetaM = acosf(std::clamp(wm.z, -1.f, 1.f));
+    float phiM = atan2f(wm.y, wm.x);
+    if (data->isotropic)
+      phiM -= phiI;
+
+    float ux = theta2u(thetaM);
+    float uy = phi2u(phiM);
+    uy -= floorf(uy);
+
+    float ndf = bilerp(data->ndf, data->ndfSize, ux, uy);
+
+    invertVNDF(set, data->vndfSize, ux, uy);
+    float3 rgb(0.f, 0.f, 0.f);
+    for (int k = 0; k < set.count; ++k)
+      rgb += bilerp(set.slices[k]->rgb.data(), data->channelSize, ux, uy) * set.weights[k];
+
+    values[i] = rgb * radiance * (ndf / wo.z);
+  }
+}
+
+float3 RGLMaterial::eval(float3 Ng,
+                         float3 Ns,
+                         float3 viewDir,
+                         float3 lightDir,
+                         float3 lightIntensity) const
+{
+  float3 value;
+  evalBatch(Ng, Ns, &viewDir, 1, lightDir, lightIntensity, &value);
+  return value;
+}
+
+// ==================================================================
+// Params
+// ==================================================================
+
+void RGLMaterial::setSubtype(std::string_view subtype)
+{
+  if (subtype == this->subtype && data)
+    return;
+
+  this->subtype = subtype;
+  data = nullptr;
+
+  fs::path fileName = bsdfDirectory() / (std::string(subtype) + ".bsdf");
+  try {
+    data = loadData(fileName.string());
+  } catch (const std::exception &e) {
+    std::cerr << "rgl_material: " << e.what() << '\n';
+  }
+}
+
+void RGLMaterial::setParameter(MaterialParam param)
+{
+  if (param.name == "scale")
+    scale = std::any_cast<float>(param.value);
+}
+
+MaterialParam RGLMaterial::getParameter(std::string_view name) const
+{
+  if (name == "scale")
+    return {"scale", std::any(scale), DataType::Float};
+
+  return {};
+}
+
+std::vector<std::string> RGLMaterial::querySupportedSubtypes()
+{
+  std::vector<std::string> result;
+
+  std::error_code ec;
+  for (auto &entry : fs::directory_iterator(bsdfDirectory(), ec)) {
+    if (entry.path().extension() == ".bsdf")
+      result.push_back(entry.path().stem().string());
+  }
+
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+std::vector<MaterialParam> RGLMaterial::querySupportedParams(std::string_view subtype)
+{
+  return {{"scale", std::any(1.f), DataType::Float}};
+}
+
+Material *createMaterialInstance(std::string_view subtype)
+{
+  return new RGLMaterial(subtype);
+}
+
+std::vector<std::string> querySupportedSubtypes()
+{
+  return RGLMaterial::querySupportedSubtypes();
+}
+
+std::vector<MaterialParam> querySupportedParams(std::string_view subtypes)
+{
+  return RGLMaterial::querySupportedParams(subtypes);
+}
+
+} // namespace explorer
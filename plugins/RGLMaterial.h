@@ -0,0 +1,62 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <memory>
+#include <string>
+#include <vector>
+// ours
+#include "material.h"
+
+namespace explorer {
+
+struct RGLData;
+
+// Measured BSDFs in the RGL tensor format (*.bsdf). Every file in the
+// directory given by the EXPLORER_BSDF_PATH environment variable (default:
+// the working directory) is a subtype, named after the file.
+//
+// Files are memory mapped and shared by all instances. The tabulated
+// (VNDF-warped) data is decoded per incident angle grid point on demand:
+// a slice holds the VNDF's CDFs and the spectral data reduced to RGB, and
+// decoded slices are kept in a per-file LRU cache. A batch only needs
+// the slices around the light direction, so evaluating and switching
+// materials doesn't touch the rest of the file.
+struct RGLMaterial : public Material
+{
+  std::string subtype;
+  std::shared_ptr<RGLData> data; // nullptr if the file couldn't be loaded
+  float scale{1.f};
+
+  RGLMaterial(std::string_view subtype);
+
+  anari::math::float3 eval(anari::math::float3 Ng,
+                           anari::math::float3 Ns,
+                           anari::math::float3 viewDir,
+                           anari::math::float3 lightDir,
+                           anari::math::float3 lightIntensity) const override;
+
+  void evalBatch(anari::math::float3 Ng,
+                 anari::math::float3 Ns,
+                 const anari::math::float3 *viewDirs,
+                 size_t count,
+                 anari::math::float3 lightDir,
+                 anari::math::float3 lightIntensity,
+                 anari::math::float3 *values) const override;
+
+  void setSubtype(std::string_view subtype) override;
+  void setParameter(MaterialParam param) override;
+  MaterialParam getParameter(std::string_view name) const override;
+
+  static std::vector<std::string> querySupportedSubtypes();
+
+  static std::vector<MaterialParam> querySupportedParams(std::string_view subtype);
+};
+
+extern "C" Material *createMaterialInstance(std::string_view subtype);
+extern "C" std::vector<std::string> querySupportedSubtypes();
+extern "C" std::vector<MaterialParam> querySupportedParams(std::string_view subtypes);
+
+} // namespace explorer
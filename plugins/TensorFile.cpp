@@ -0,0 +1,148 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#include "TensorFile.h"
+
+// std
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+// posix
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace explorer {
+
+static size_t dtypeSize(uint8_t dtype)
+{
+  switch (dtype) {
+  case TensorFile::UInt8:
+  case TensorFile::Int8:
+    return 1;
+  case TensorFile::UInt16:
+  case TensorFile::Int16:
+  case TensorFile::Float16:
+    return 2;
+  case TensorFile::UInt32:
+  case TensorFile::Int32:
+  case TensorFile::Float32:
+    return 4;
+  case TensorFile::UInt64:
+  case TensorFile::Int64:
+  case TensorFile::Float64:
+    return 8;
+  }
+  return 0;
+}
+
+TensorFile::TensorFile(const std::string &fileName) : m_fileName(fileName)
+{
+  int fd = open(fileName.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("cannot open " + fileName);
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    throw std::runtime_error("cannot read " + fileName);
+  }
+  m_size = size_t(st.st_size);
+
+  void *mapping = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    throw std::runtime_error("cannot map " + fileName);
+  m_mapping = mapping;
+
+  const auto *bytes = (const uint8_t *)m_mapping;
+  size_t pos = 0;
+  auto read = [&](void *dst, size_t n) {
+    if (pos + n > m_size) {
+      munmap(m_mapping, m_size);
+      throw std::runtime_error(fileName + ": truncated tensor file");
+    }
+    memcpy(dst, bytes + pos, n);
+    pos += n;
+  };
+
+  char header[12];
+  uint8_t version[2];
+  uint32_t numFields = 0;
+  read(header, sizeof(header));
+  read(version, sizeof(version));
+  read(&numFields, sizeof(numFields));
+
+  if (memcmp(header, "tensor_file", 12) != 0 || version[0] != 1) {
+    munmap(m_mapping, m_size);
+    throw std::runtime_error(fileName + ": not a tensor file (version 1)");
+  }
+
+  for (uint32_t i = 0; i < numFields; ++i) {
+    uint16_t nameLength = 0, ndim = 0;
+    uint8_t dtype = 0;
+    uint64_t offset = 0;
+
+    read(&nameLength, sizeof(nameLength));
+    std::string name(nameLength, '\0');
+    read(name.data(), nameLength);
+    read(&ndim, sizeof(ndim));
+    read(&dtype, sizeof(dtype));
+    read(&offset, sizeof(offset));
+
+    Field field;
+    field.dtype = DType(dtype);
+    field.shape.resize(ndim);
+    field.numElements = 1;
+    for (auto &extent : field.shape) {
+      read(&extent, sizeof(extent));
+      // crafted extents must not wrap around and pass the size check below
+      if (extent != 0 && field.numElements > UINT64_MAX / extent) {
+        munmap(m_mapping, m_size);
+        throw std::runtime_error(fileName + ": invalid shape of field " + name);
+      }
+      field.numElements *= extent;
+    }
+
+    size_t elementSize = dtypeSize(dtype);
+    if (elementSize == 0 || offset % elementSize != 0 || offset > m_size
+        || field.numElements > (m_size - offset) / elementSize) {
+      munmap(m_mapping, m_size);
+      throw std::runtime_error(fileName + ": invalid field " + name);
+    }
+
+    field.data = bytes + offset;
+    m_fields[name] = field;
+  }
+}
+
+TensorFile::~TensorFile()
+{
+  munmap(m_mapping, m_size);
+}
+
+const TensorFile::Field *TensorFile::field(const std::string &name) const
+{
+  auto it = m_fields.find(name);
+  return it != m_fields.end() ? &it->second : nullptr;
+}
+
+const float *TensorFile::floatField(const std::string &name, size_t ndim,
+    const std::vector<uint64_t> **shape) const
+{
+  const Field *f = field(name);
+  if (!f)
+    throw std::runtime_error(m_fileName + ": missing field " + name);
+
+  if (f->dtype != Float32 || f->shape.size() != ndim) {
+    throw std::runtime_error(m_fileName + ": field " + name + " must be a "
+        + std::to_string(ndim) + "D float32 tensor");
+  }
+
+  if (shape)
+    *shape = &f->shape;
+  return (const float *)f->data;
+}
+
+} // namespace explorer
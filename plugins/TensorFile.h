@@ -0,0 +1,63 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace explorer {
+
+// Read-only memory mapping of a tensor file (the format of the RGL
+// material database's .bsdf files): a "tensor_file" header followed by
+// named n-dimensional fields that are stored uncompressed. Nothing is
+// read up front except the field table; field data is paged in from the
+// mapping when accessed.
+class TensorFile
+{
+ public:
+  enum DType : uint8_t
+  {
+    UInt8 = 1, Int8, UInt16, Int16, UInt32, Int32, UInt64, Int64,
+    Float16, Float32, Float64,
+  };
+
+  struct Field
+  {
+    DType dtype;
+    std::vector<uint64_t> shape;
+    const void *data;
+    uint64_t numElements;
+  };
+
+  // Throws std::runtime_error if the file can't be mapped or is invalid
+  explicit TensorFile(const std::string &fileName);
+  ~TensorFile();
+
+  TensorFile(const TensorFile &) = delete;
+  TensorFile &operator=(const TensorFile &) = delete;
+
+  // nullptr if there's no such field
+  const Field *field(const std::string &name) const;
+
+  // Field data as float32, shape must have ndim dimensions; throws if
+  // the field is missing or of a different type
+  const float *floatField(const std::string &name, size_t ndim,
+      const std::vector<uint64_t> **shape = nullptr) const;
+
+  const std::string &fileName() const
+  {
+    return m_fileName;
+  }
+
+ private:
+  std::string m_fileName;
+  void *m_mapping{nullptr};
+  size_t m_size{0};
+  std::map<std::string, Field> m_fields;
+};
+
+} // namespace explorer
@@ -42,6 +42,33 @@ anari::math::float3 VisionarayMaterial::eval(anari::math::float3 Ng,
               visionarayLightIntensity));
 }
 
+void VisionarayMaterial::evalBatch(anari::math::float3 Ng,
+                                   anari::math::float3 Ns,
+                                   const anari::math::float3 *viewDirs,
+                                   size_t count,
+                                   anari::math::float3 lightDir,
+                                   anari::math::float3 lightIntensity,
+                                   anari::math::float3 *values) const
+{
+  visionaray::dco::Sampler *samplers{nullptr};
+  visionaray::float4 *attribs{nullptr};
+  int primID{0};
+
+  // only the view dir changes, convert the rest once per batch:
+  visionaray::vec3 visionarayNg = cast(Ng);
+  visionaray::vec3 visionarayNs = cast(Ns);
+  visionaray::vec3 visionarayLightDir = cast(lightDir);
+  visionaray::vec3 visionarayLightIntensity = cast(lightIntensity);
+  for (size_t i = 0; i < count; ++i) {
+    values[i] = cast(evalMaterial(mat,samplers,attribs,primID,
+                     visionarayNg,
+                     visionarayNs,
+                     normalize(cast(viewDirs[i])),
+                     visionarayLightDir,
+                     visionarayLightIntensity));
+  }
+}
+
 void VisionarayMaterial::setSubtype(std::string_view subtype)
 {
   using namespace visionaray;
@@ -20,6 +20,14 @@ struct VisionarayMaterial : public Material
                            anari::math::float3 lightDir,
                            anari::math::float3 lightIntensity) const override;
 
+  void evalBatch(anari::math::float3 Ng,
+                 anari::math::float3 Ns,
+                 const anari::math::float3 *viewDirs,
+                 size_t count,
+                 anari::math::float3 lightDir,
+                 anari::math::float3 lightIntensity,
+                 anari::math::float3 *values) const override;
+
   void setSubtype(std::string_view subtype) override;
   void setParameter(MaterialParam param) override;
   MaterialParam getParameter(std::string_view name) const override;
@@ -0,0 +1,680 @@
+// Copyright 2024 Stefan Zellmann
+// SPDX-License-Identifier: Apache-2.0
+
+// Python module around the plugin interface. Arrays are exchanged through
+// the buffer protocol, so NumPy arrays (or anything else exporting float32
+// buffers) are read and written in place; NumPy is only needed at runtime
+// to hand out result arrays.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+// std
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+// ours
+#include "Directions.h"
+#include "material.h"
+
+using namespace anari::math;
+using explorer::DataType;
+using explorer::Material;
+using explorer::MaterialParam;
+
+namespace {
+
+// ==================================================================
+// Helpers
+// ==================================================================
+
+int numComponents(DataType type)
+{
+  switch (type) {
+  case DataType::Float:
+    return 1;
+  case DataType::Float2:
+    return 2;
+  case DataType::Float3:
+    return 3;
+  case DataType::Float4:
+    return 4;
+  }
+  return 0;
+}
+
+PyObject *paramToPython(const MaterialParam &param)
+{
+  if (!param.value.has_value())
+    Py_RETURN_NONE;
+
+  try {
+    switch (param.type) {
+    case DataType::Float:
+      return PyFloat_FromDouble(std::any_cast<float>(param.value));
+    case DataType::Float2: {
+      auto v = std::any_cast<float2>(param.value);
+      return Py_BuildValue("(dd)", v.x, v.y);
+    }
+    case DataType::Float3: {
+      auto v = std::any_cast<float3>(param.value);
+      return Py_BuildValue("(ddd)", v.x, v.y, v.z);
+    }
+    case DataType::Float4: {
+      auto v = std::any_cast<float4>(param.value);
+      return Py_BuildValue("(dddd)", v.x, v.y, v.z, v.w);
+    }
+    }
+  } catch (const std::bad_any_cast &) {
+  }
+
+  PyErr_Format(PyExc_TypeError, "param %s has an unexpected value type",
+      param.name.c_str());
+  return nullptr;
+}
+
+// float or sequence of n floats
+bool floatsFromPython(PyObject *obj, int n, float *values)
+{
+  if (n == 1 && PyNumber_Check(obj) && !PySequence_Check(obj)) {
+    double d = PyFloat_AsDouble(obj);
+    if (d == -1.0 && PyErr_Occurred())
+      return false;
+    values[0] = float(d);
+    return true;
+  }
+
+  PyObject *seq = PySequence_Fast(obj, "expected a float or a sequence of floats");
+  if (!seq)
+    return false;
+
+  bool ok = PySequence_Fast_GET_SIZE(seq) == n;
+  if (!ok)
+    PyErr_Format(PyExc_ValueError, "expected %d value(s)", n);
+
+  for (int i = 0; ok && i < n; ++i) {
+    double d = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(seq, i));
+    ok = !(d == -1.0 && PyErr_Occurred());
+    values[i] = float(d);
+  }
+
+  Py_DECREF(seq);
+  return ok;
+}
+
+bool float3FromPython(PyObject *obj, float3 &v)
+{
+  return obj == nullptr || floatsFromPython(obj, 3, &v.x);
+}
+
+bool paramFromPython(PyObject *obj, MaterialParam &param)
+{
+  float v[4];
+  if (!floatsFromPython(obj, numComponents(param.type), v))
+    return false;
+
+  switch (param.type) {
+  case DataType::Float:
+    param.value = v[0];
+    break;
+  case DataType::Float2:
+    param.value = float2(v[0], v[1]);
+    break;
+  case DataType::Float3:
+    param.value = float3(v[0], v[1], v[2]);
+    break;
+  case DataType::Float4:
+    param.value = float4(v[0], v[1], v[2], v[3]);
+    break;
+  }
+  return true;
+}
+
+// Buffer of float32 rows with `columns` entries; released on scope exit.
+// Never copies: non-contiguous or non-float32 input is an error, so
+// callers know that what they pass is what gets evaluated.
+struct FloatRows
+{
+  ~FloatRows()
+  {
+    if (view.obj)
+      PyBuffer_Release(&view);
+  }
+
+  bool acquire(PyObject *obj, Py_ssize_t columns, bool writable, const char *what)
+  {
+    int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT;
+    if (writable)
+      flags |= PyBUF_WRITABLE;
+
+    if (PyObject_GetBuffer(obj, &view, flags) != 0) {
+      view.obj = nullptr;
+      return false;
+    }
+
+    const char *format = view.format ? view.format : "B";
+    if (*format == '=' || *format == '<' || *format == '@')
+      ++format;
+
+    bool shapeOk = columns == 1
+        ? view.ndim == 1
+        : view.ndim == 2 && view.shape[1] == columns;
+
+    if (strcmp(format, "f") != 0 || view.itemsize != 4 || !shapeOk) {
+      if (columns == 1) {
+        PyErr_Format(PyExc_TypeError,
+            "%s must be a C-contiguous float32 array of shape (N,)", what);
+      } else {
+        PyErr_Format(PyExc_TypeError,
+            "%s must be a C-contiguous float32 array of shape (N, %zd)",
+            what, columns);
+      }
+      return false;
+    }
+
+    rows = view.shape[0];
+    return true;
+  }
+
+  float *data() const
+  {
+    return (float *)view.buf;
+  }
+
+  Py_buffer view{};
+  Py_ssize_t rows{0};
+};
+
+// New float32 array of shape (rows, columns) (or (rows,) for columns == 1);
+// a NumPy array if NumPy is available, else a memoryview
+PyObject *newFloatArray(Py_ssize_t rows, Py_ssize_t columns)
+{
+  static PyObject *numpyEmpty = nullptr;
+  static bool numpyChecked = false;
+
+  if (!numpyChecked) {
+    numpyChecked = true;
+    if (PyObject *numpy = PyImport_ImportModule("numpy")) {
+      numpyEmpty = PyObject_GetAttrString(numpy, "empty");
+      Py_DECREF(numpy);
+    }
+    PyErr_Clear();
+  }
+
+  PyObject *shape = columns == 1 ? Py_BuildValue("(n)", rows)
+                                 : Py_BuildValue("(nn)", rows, columns);
+  if (!shape)
+    return nullptr;
+
+  PyObject *result = nullptr;
+  if (numpyEmpty) {
+    PyObject *kwargs = Py_BuildValue("{s:s}", "dtype", "float32");
+    PyObject *args = PyTuple_Pack(1, shape);
+    if (kwargs && args)
+      result = PyObject_Call(numpyEmpty, args, kwargs);
+    Py_XDECREF(kwargs);
+    Py_XDECREF(args);
+  } else {
+    PyObject *bytes = PyByteArray_FromStringAndSize(nullptr, rows * columns * 4);
+    PyObject *view = bytes ? PyMemoryView_FromObject(bytes) : nullptr;
+    if (view)
+      result = PyObject_CallMethod(view, "cast", "sO", "f", shape);
+    Py_XDECREF(view);
+    Py_XDECREF(bytes);
+  }
+
+  Py_DECREF(shape);
+  return result;
+}
+
+// ==================================================================
+// Material
+// ==================================================================
+
+// Evaluation runs without the GIL on a private copy of the material, so
+// calls on the same Material from several Python threads run in parallel
+// and setting params meanwhile doesn't race with them. Copies are pooled
+// and reused until the params change.
+struct MaterialState
+{
+  std::string subtype;
+  std::unique_ptr<Material> material;
+  std::vector<MaterialParam> supportedParams;
+
+  std::mutex mutex; // guards everything below and changes to material
+  uint64_t version{0};
+  std::vector<std::unique_ptr<Material>> idle;
+
+  std::unique_ptr<Material> acquire(uint64_t &acquiredVersion)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    acquiredVersion = version;
+    if (!idle.empty()) {
+      auto mat = std::move(idle.back());
+      idle.pop_back();
+      return mat;
+    }
+    std::unique_ptr<Material> mat(Material::cloneInstance(subtype, *material));
+    if (!mat)
+      throw std::runtime_error("cannot create material instance");
+    return mat;
+  }
+
+  void release(std::unique_ptr<Material> mat, uint64_t acquiredVersion)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (acquiredVersion == version)
+      idle.push_back(std::move(mat));
+  }
+};
+
+struct PyMaterial
+{
+  PyObject_HEAD
+  MaterialState *state;
+};
+
+// Runs func(material) without the GIL on a pooled copy; C++ exceptions
+// become RuntimeErrors
+template <typename Func>
+bool runUnlocked(MaterialState &state, Func &&func)
+{
+  std::string error;
+  Py_BEGIN_ALLOW_THREADS
+  try {
+    uint64_t version = 0;
+    auto mat = state.acquire(version);
+    func(*mat);
+    state.release(std::move(mat), version);
+  } catch (const std::exception &e) {
+    error = e.what();
+    if (error.empty())
+      error = "evaluation failed";
+  }
+  Py_END_ALLOW_THREADS
+
+  if (!error.empty()) {
+    PyErr_SetString(PyExc_RuntimeError, error.c_str());
+    return false;
+  }
+  return true;
+}
+
+const MaterialParam *findParam(const MaterialState &state, const char *name)
+{
+  for (auto &param : state.supportedParams) {
+    if (param.name == name)
+      return &param;
+  }
+  PyErr_Format(PyExc_KeyError, "%s has no param %s", state.subtype.c_str(), name);
+  return nullptr;
+}
+
+int Material_init(PyMaterial *self, PyObject *args, PyObject *kwargs)
+{
+  static const char *keywords[] = {"subtype", nullptr};
+  const char *subtype = nullptr;
+  if (!PyArg_ParseTupleAndKeywords(args, kwargs, "s", (char **)keywords, &subtype))
+    return -1;
+
+  // eval() and eval_batch() release the GIL, so another thread may still
+  // be using the current state
+  if (self->state) {
+    PyErr_SetString(PyExc_RuntimeError,
+        "Material is already initialized, create a new one");
+    return -1;
+  }
+
+  if (!Material::pluginLoaded()) {
+    PyErr_SetString(PyExc_RuntimeError, "no plugin loaded, call load_plugin() first");
+    return -1;
+  }
+
+  std::unique_ptr<Material> material(Material::createInstance(subtype));
+  if (!material) {
+    PyErr_Format(PyExc_RuntimeError, "cannot create material instance of %s", subtype);
+    return -1;
+  }
+  material->setSubtype(subtype);
+
+  self->state = new MaterialState;
+  self->state->subtype = subtype;
+  self->state->material = std::move(material);
+  self->state->supportedParams = Material::querySupportedParams(subtype);
+  return 0;
+}
+
+void Material_dealloc(PyMaterial *self)
+{
+  delete self->state;
+  Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+bool checkInitialized(PyMaterial *self)
+{
+  if (!self->state) {
+    PyErr_SetString(PyExc_RuntimeError, "Material is not initialized");
+    return false;
+  }
+  return true;
+}
+
+PyObject *Material_subtype(PyMaterial *self, void *)
+{
+  if (!checkInitialized(self))
+    return nullptr;
+  return PyUnicode_FromString(self->state->subtype.c_str());
+}
+
+PyObject *Material_set_param(PyMaterial *self, PyObject *args)
+{
+  const char *name = nullptr;
+  PyObject *value = nullptr;
+  if (!checkInitialized(self) || !PyArg_ParseTuple(args, "sO", &name, &value))
+    return nullptr;
+
+  auto &state = *self->state;
+  const MaterialParam *supported = findParam(state, name);
+  if (!supported)
+    return nullptr;
+
+  MaterialParam param{supported->name, {}, supported->type};
+  if (!paramFromPython(value, param))
+    return nullptr;
+
+  std::lock_guard<std::mutex> lock(state.mutex);
+  state.material->setParameter(param);
+  state.version++;
+  state.idle.clear();
+  Py_RETURN_NONE;
+}
+
+PyObject *Material_get_param(PyMaterial *self, PyObject *args)
+{
+  const char *name = nullptr;
+  if (!checkInitialized(self) || !PyArg_ParseTuple(args, "s", &name))
+    return nullptr;
+
+  auto &state = *self->state;
+  if (!findParam(state, name))
+    return nullptr;
+
+  std::lock_guard<std::mutex> lock(state.mutex);
+  return paramToPython(state.material->getParameter(name));
+}
+
+PyObject *Material_params(PyMaterial *self, PyObject *)
+{
+  if (!checkInitialized(self))
+    return nullptr;
+
+  auto &state = *self->state;
+  PyObject *result = PyDict_New();
+  for (auto &param : state.supportedParams) {
+    MaterialParam actual;
+    {
+      std::lock_guard<std::mutex> lock(state.mutex);
+      actual = state.material->getParameter(param.name);
+    }
+    if (!actual.value.has_value())
+      actual = param;
+
+    PyObject *value = paramToPython(actual);
+    if (!value || PyDict_SetItemString(result, param.name.c_str(), value) != 0) {
+      Py_XDECREF(value);
+      Py_DECREF(result);
+      return nullptr;
+    }
+    Py_DECREF(value);
+  }
+  return result;
+}
+
+// Returns out (new reference) if given, else a new (rows, columns) array
+PyObject *outputArray(PyObject *out, Py_ssize_t rows, Py_ssize_t columns,
+    FloatRows &buffer, const char *what)
+{
+  PyObject *result = nullptr;
+  if (out && out != Py_None) {
+    Py_INCREF(out);
+    result = out;
+  } else {
+    result = newFloatArray(rows, columns);
+    if (!result)
+      return nullptr;
+  }
+
+  if (!buffer.acquire(result, columns, true, what)) {
+    Py_DECREF(result);
+    return nullptr;
+  }
+
+  if (buffer.rows != rows) {
+    PyErr_Format(PyExc_ValueError, "%s has %zd rows, expected %zd", what,
+        buffer.rows, rows);
+    Py_DECREF(result);
+    return nullptr;
+  }
+
+  return result;
+}
+
+PyObject *Material_eval(PyMaterial *self, PyObject *args, PyObject *kwargs)
+{
+  static const char *keywords[] = {"view_dirs", "light_dir", "out", "normal",
+      "light_intensity", nullptr};
+  PyObject *viewDirsObj = nullptr, *lightDirObj = nullptr, *outObj = nullptr;
+  PyObject *normalObj = nullptr, *intensityObj = nullptr;
+  if (!checkInitialized(self)
+      || !PyArg_ParseTupleAndKeywords(args, kwargs, "OO|$OOO", (char **)keywords,
+          &viewDirsObj, &lightDirObj, &outObj, &normalObj, &intensityObj))
+    return nullptr;
+
+  float3 lightDir, normal(0.f, 1.f, 0.f), intensity(1.f, 1.f, 1.f);
+  if (!float3FromPython(lightDirObj, lightDir) || !float3FromPython(normalObj, normal)
+      || !float3FromPython(intensityObj, intensity))
+    return nullptr;
+
+  FloatRows viewDirs, values;
+  if (!viewDirs.acquire(viewDirsObj, 3, false, "view_dirs"))
+    return nullptr;
+
+  PyObject *result = outputArray(outObj, viewDirs.rows, 3, values, "out");
+  if (!result)
+    return nullptr;
+
+  bool ok = runUnlocked(*self->state, [&](const Material &mat) {
+    mat.evalBatch(normal, normal, (const float3 *)viewDirs.data(), viewDirs.rows,
+        lightDir, intensity, (float3 *)values.data());
+  });
+
+  if (!ok) {
+    Py_DECREF(result);
+    return nullptr;
+  }
+  return result;
+}
+
+PyObject *Material_sample(PyMaterial *self, PyObject *args, PyObject *kwargs)
+{
+  static const char *keywords[] = {"count", "light_dir", "seed", "normal",
+      "light_intensity", nullptr};
+  Py_ssize_t count = 0;
+  unsigned long long seed = 0;
+  PyObject *lightDirObj = nullptr, *normalObj = nullptr, *intensityObj = nullptr;
+  if (!checkInitialized(self)
+      || !PyArg_ParseTupleAndKeywords(args, kwargs, "nO|$KOO", (char **)keywords,
+          &count, &lightDirObj, &seed, &normalObj, &intensityObj))
+    return nullptr;
+
+  if (count < 0) {
+    PyErr_SetString(PyExc_ValueError, "count must not be negative");
+    return nullptr;
+  }
+
+  float3 lightDir, normal(0.f, 1.f, 0.f), intensity(1.f, 1.f, 1.f);
+  if (!float3FromPython(lightDirObj, lightDir) || !float3FromPython(normalObj, normal)
+      || !float3FromPython(intensityObj, intensity))
+    return nullptr;
+
+  FloatRows dirs, values, pdfs;
+  PyObject *dirsObj = outputArray(nullptr, count, 3, dirs, "dirs");
+  PyObject *valuesObj = dirsObj ? outputArray(nullptr, count, 3, values, "values") : nullptr;
+  PyObject *pdfsObj = valuesObj ? outputArray(nullptr, count, 1, pdfs, "pdf") : nullptr;
+  if (!pdfsObj) {
+    Py_XDECREF(dirsObj);
+    Py_XDECREF(valuesObj);
+    return nullptr;
+  }
+
+  // Same cosine sampling as the eval server, so both give identical samples
+  bool ok = runUnlocked(*self->state, [&](const Material &mat) {
+    float3 t, b;
+    explorer::makeFrame(normal, t, b);
+    auto *d = (float3 *)dirs.data();
+    for (Py_ssize_t i = 0; i < count; ++i)
+      d[i] = explorer::cosineSampleDirection(seed, i, normal, t, b, pdfs.data()[i]);
+    mat.evalBatch(normal, normal, d, count, lightDir, intensity, (float3 *)values.data());
+  });
+
+  if (!ok) {
+    Py_DECREF(dirsObj);
+    Py_DECREF(valuesObj);
+    Py_DECREF(pdfsObj);
+    return nullptr;
+  }
+
+  PyObject *result = PyTuple_Pack(3, dirsObj, valuesObj, pdfsObj);
+  Py_DECREF(dirsObj);
+  Py_DECREF(valuesObj);
+  Py_DECREF(pdfsObj);
+  return result;
+}
+
+PyMethodDef Material_methods[] = {
+    {"set_param", (PyCFunction)Material_set_param, METH_VARARGS,
+        "set_param(name, value): value is a float or a tuple of 2-4 floats"},
+    {"get_param", (PyCFunction)Material_get_param, METH_VARARGS,
+        "get_param(name) -> float or tuple"},
+    {"params", (PyCFunction)Material_params, METH_NOARGS,
+        "params() -> dict of all params and their current values"},
+    {"eval", (PyCFunction)(void (*)(void))Material_eval, METH_VARARGS | METH_KEYWORDS,
+        "eval(view_dirs, light_dir, *, out=None, normal=(0, 1, 0),\n"
+        "     light_intensity=(1, 1, 1)) -> array of shape (N, 3)\n\n"
+        "view_dirs is a C-contiguous float32 array of shape (N, 3) and is\n"
+        "read in place, as is out if given. Runs without the GIL."},
+    {"sample", (PyCFunction)(void (*)(void))Material_sample, METH_VARARGS | METH_KEYWORDS,
+        "sample(count, light_dir, *, seed=0, normal=(0, 1, 0),\n"
+        "       light_intensity=(1, 1, 1)) -> (dirs, values, pdf)\n\n"
+        "Cosine distributed view directions, the material's values for them\n"
+        "and their pdf w.r.t. solid angle. Runs without the GIL."},
+    {nullptr, nullptr, 0, nullptr}};
+
+PyGetSetDef Material_getset[] = {
+    {"subtype", (getter)Material_subtype, nullptr, "material subtype", nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr}};
+
+PyTypeObject MaterialType = {PyVarObject_HEAD_INIT(nullptr, 0)};
+
+// ==================================================================
+// Module functions
+// ==================================================================
+
+PyObject *loadPlugin(PyObject *, PyObject *args)
+{
+  const char *name = nullptr;
+  if (!PyArg_ParseTuple(args, "s", &name))
+    return nullptr;
+
+  if (Material::pluginLoaded()) {
+    PyErr_SetString(PyExc_RuntimeError, "a plugin is already loaded");
+    return nullptr;
+  }
+
+  try {
+    Material::loadPlugin(name);
+  } catch (const std::exception &e) {
+    PyErr_SetString(PyExc_RuntimeError, e.what());
+    return nullptr;
+  }
+
+  if (!Material::pluginLoaded()) {
+    PyErr_Format(PyExc_RuntimeError, "cannot load plugin %s", name);
+    return nullptr;
+  }
+  Py_RETURN_NONE;
+}
+
+PyObject *subtypes(PyObject *, PyObject *)
+{
+  auto names = Material::querySupportedSubtypes();
+  PyObject *result = PyList_New(Py_ssize_t(names.size()));
+  for (size_t i = 0; result && i < names.size(); ++i)
+    PyList_SET_ITEM(result, i, PyUnicode_FromString(names[i].c_str()));
+  return result;
+}
+
+PyObject *supportedParams(PyObject *, PyObject *args)
+{
+  const char *subtype = nullptr;
+  if (!PyArg_ParseTuple(args, "s", &subtype))
+    return nullptr;
+
+  PyObject *result = PyDict_New();
+  for (auto &param : Material::querySupportedParams(subtype)) {
+    PyObject *value = paramToPython(param);
+    if (!value || PyDict_SetItemString(result, param.name.c_str(), value) != 0) {
+      Py_XDECREF(value);
+      Py_DECREF(result);
+      return nullptr;
+    }
+    Py_DECREF(value);
+  }
+  return result;
+}
+
+PyMethodDef moduleMethods[] = {
+    {"load_plugin", loadPlugin, METH_VARARGS,
+        "load_plugin(name): loads lib<name>.so/<name>.dll"},
+    {"subtypes", subtypes, METH_NOARGS,
+        "subtypes() -> list of the plugin's material subtypes"},
+    {"params", supportedParams, METH_VARARGS,
+        "params(subtype) -> dict of the subtype's params and their defaults"},
+    {nullptr, nullptr, 0, nullptr}};
+
+PyModuleDef moduleDef = {PyModuleDef_HEAD_INIT, "anari_brdf",
+    "Batch evaluation of BRDF explorer material plugins", -1, moduleMethods};
+
+} // namespace
+
+PyMODINIT_FUNC PyInit_anari_brdf()
+{
+  MaterialType.tp_name = "anari_brdf.Material";
+  MaterialType.tp_doc = "Material(subtype): instance of a plugin material";
+  MaterialType.tp_basicsize = sizeof(PyMaterial);
+  MaterialType.tp_flags = Py_TPFLAGS_DEFAULT;
+  MaterialType.tp_new = PyType_GenericNew;
+  MaterialType.tp_init = (initproc)Material_init;
+  MaterialType.tp_dealloc = (destructor)Material_dealloc;
+  MaterialType.tp_methods = Material_methods;
+  MaterialType.tp_getset = Material_getset;
+
+  if (PyType_Ready(&MaterialType) < 0)
+    return nullptr;
+
+  PyObject *module = PyModule_Create(&moduleDef);
+  if (!module)
+    return nullptr;
+
+  Py_INCREF(&MaterialType);
+  if (PyModule_AddObject(module, "Material", (PyObject *)&MaterialType) < 0) {
+    Py_DECREF(&MaterialType);
+    Py_DECREF(module);
+    return nullptr;
+  }
+
+  return module;
+}